@@ -0,0 +1,146 @@
+#ifndef mAssetLoader
+#define mAssetLoader
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <AssetPack.hpp>
+#include <MPSCQueue.hpp>
+#include <RingBuffer.hpp>
+#include <JobSystem.hpp>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Streams textures in without blocking the render thread. A request returns a
+// handle straight away whose texture is a 1x1 placeholder; a JobSystem job
+// decodes the file and hands the result back through a lock-free queue, and
+// update() copies each slice into a pixel unpack ring buffer, at most one
+// ring segment of bytes per frame. When every slice of an image is resident
+// the handle switches over to the real texture.
+//
+// Files come from the AssetPack. If a baked .ktx2 sits next to the source
+// image (see tools/TextureBaker) and the driver supports its format, it is
+// used straight from the mapping instead and its precomputed,
+// block-compressed mip levels go to glCompressedTexImage2D without
+// decoding. Otherwise the PNG/JPEG is decoded as before.
+//
+// With async off, requests decode and upload on the spot like the old
+// loaders did, which is what the startup timings are compared against.
+class AssetLoader {
+public:
+    typedef int Handle;
+
+    struct Settings {
+        bool async;                // needs JobSystem workers, off without any
+        GLsizeiptr uploadBudget;   // bytes uploaded per frame
+
+        Settings() : async(true), uploadBudget(8 << 20) {}
+    };
+
+    struct Stats {
+        int requested;
+        int decoded;
+        int baked;                 // of the decoded, read from a .ktx2
+        int resident;
+        int failed;
+        int uploadFrames;          // frames that uploaded anything
+        long long bytesUploaded;
+        long long textureBytes;    // GPU memory of the resident textures, mips included
+        double decodeMs;           // summed over all decode jobs
+        double allResidentMs;      // since init(), < 0 until everything is in
+
+        Stats() : requested(0), decoded(0), baked(0), resident(0), failed(0), uploadFrames(0),
+            bytesUploaded(0), textureBytes(0), decodeMs(0.0), allResidentMs(-1.0) {}
+    };
+
+    AssetLoader();
+    ~AssetLoader();
+
+    void init(const Settings& settings = Settings());
+    void shutdown();
+
+    // placeholder is the colour shown until the image is resident
+    Handle requestTexture2D(const std::string& path, bool flipVertically, const glm::vec4& placeholder);
+
+    // Render thread, once per frame
+    void update();
+
+    unsigned int getTexture(Handle handle) const { return textures[handle].id; }
+    bool isResident(Handle handle) const { return textures[handle].resident; }
+    bool allResident() const { return stats.resident + stats.failed == stats.requested; }
+    const Stats& getStats() const { return stats; }
+
+private:
+    struct Request {
+        Handle handle;
+        std::string path;
+        bool flip;
+    };
+
+    struct ImageDeleter {
+        void operator()(unsigned char* pixels) const;
+    };
+
+    // One glTexImage2D / glCompressedTexImage2D call: the whole decoded
+    // image, or one mip level of a baked file
+    struct Slice {
+        int level;
+        int width, height;
+        size_t offset, bytes;      // baked files only, into the mapping
+    };
+
+    struct Decoded {
+        Handle handle;
+        bool ok;
+        int width, height, channels;
+        double decodeMs;
+        std::unique_ptr<unsigned char, ImageDeleter> pixels;   // as returned by stb_image
+        AssetPack::Blob baked;                                 // or a mapped .ktx2
+        unsigned int ktxFormat;
+        int levels;
+        std::vector<Slice> slices;
+    };
+
+    struct Texture {
+        std::string path;
+        unsigned int id;           // placeholder until resident
+        bool resident;
+    };
+
+    struct Upload {
+        std::unique_ptr<Decoded> image;
+        unsigned int texture;      // being filled, swapped in when complete
+        size_t nextSlice;
+    };
+
+    Handle addTexture(const std::string& path, const glm::vec4& placeholder);
+    std::unique_ptr<Decoded> decode(const Request& request) const;
+    bool openBaked(const Request& request, Decoded& image) const;
+    void submit(const Request& request);
+
+    bool uploadSlice(Upload& upload, bool firstThisFrame);
+    void finish(Upload& upload);
+
+    Settings settings;
+    Stats stats;
+    bool supportsBC5, supportsBC7;
+    std::chrono::steady_clock::time_point startTime;
+
+    std::vector<Texture> textures;
+
+    // Decode jobs in flight
+    JobSystem::CounterPtr pending;
+    std::atomic<bool> stopping;
+
+    // Decode jobs -> render thread
+    MPSCQueue<std::unique_ptr<Decoded>> decoded;
+    std::deque<Upload> uploads;
+
+    RingBuffer staging;
+};
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef mAssetPack
+#define mAssetPack
+#pragma once
+
+#include <MappedFile.hpp>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Read-only archive of everything under res/, built after each build by
+// tools/AssetPacker and memory-mapped once at startup. Files are looked up
+// by their path relative to res/ ("shaders/water.frag") through a sorted
+// hash index, and returned as pointers into the mapping, so nothing is
+// copied or read up front.
+//
+// Anything missing from the pack (or everything, when no pack is opened) is
+// served from the loose res/ directory instead, also memory-mapped, so
+// shaders can still be edited without repacking.
+//
+// Layout, little-endian:
+//   header   "OGLPACK1", u32 version, u32 entryCount, u64 stringsOffset
+//   index    entryCount x { u64 nameHash, u32 nameOffset, u32 nameLength,
+//                           u64 dataOffset, u64 size }, sorted by nameHash
+//   strings  names, not terminated
+//   data     file contents, each 16-byte aligned
+class AssetPack {
+public:
+    struct Blob {
+        const unsigned char* data;
+        size_t size;
+        std::shared_ptr<MappedFile> owner;   // keeps a loose file mapped
+
+        Blob() : data(nullptr), size(0) {}
+        bool empty() const { return data == nullptr; }
+        std::string str() const { return std::string((const char*)data, size); }
+    };
+
+    // The one pack the game reads from
+    static AssetPack& instance();
+
+    // packPath may be empty to use loose files only. looseRoot is the res/
+    // directory paths are relative to, e.g. "../res/".
+    bool open(const std::string& packPath, const std::string& looseRoot);
+    void close();
+
+    // name may be relative to res/ or a path starting with looseRoot
+    Blob find(const std::string& name) const;
+    bool isPacked() const { return file.isOpen(); }
+    size_t entryCount() const { return count; }
+    const std::string& getLooseRoot() const { return looseRoot; }
+
+    // Used by the packer: every regular file under root, relative, '/'-separated
+    static std::vector<std::string> listFiles(const std::string& root);
+    static bool write(const std::string& output, const std::string& root, const std::vector<std::string>& names);
+
+    static unsigned long long hashName(const std::string& name);
+
+private:
+    AssetPack() : count(0) {}
+
+    std::string relativeName(const std::string& name) const;
+
+    MappedFile file;
+    size_t count;
+    std::string looseRoot;
+};
+
+#endif
@@ -0,0 +1,207 @@
+#ifndef mAtmosphere
+#define mAtmosphere
+#pragma once
+
+#include <EnvironmentLighting.hpp>
+#include <JobSystem.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+
+// Physically based sky after Bruneton and Hillaire: Rayleigh and Mie
+// scattering and ozone absorption in a spherical shell around the planet,
+// with multiple scattering folded into a small LUT so a single-scattering
+// march gives the whole sky. Distances are in km, apart from the sky
+// directions, which are in world space (y up).
+//
+// Three tables are built once by init(), row by row on the job system:
+//   transmittance       to the top of the atmosphere, by height and zenith
+//                       cosine (Bruneton's parametrisation)
+//   multiple scattering the isotropic light scattered twice or more, by
+//                       height and sun zenith cosine (Hillaire's Psi_ms)
+// and two follow the sun:
+//   sky view            radiance seen from the viewer, by zenith angle
+//                       (packed around the horizon) and azimuth from the sun;
+//                       skybox.frag reads it instead of marching every pixel
+//   environment cube    six small faces looked up from the sky view, with
+//                       GGX-prefiltered mip levels for the water's rough
+//                       reflections and the SH9 irradiance of the whole cube
+//                       for the terrain's ambient (see EnvironmentLighting)
+//
+// update() makes the sun-dependent ones current on the calling thread.
+// start() and poll() refresh them a step at a time as a job, like OceanFFT:
+// the sky view is marched again only once the sun has moved refreshAngle,
+// and each step after that refreshes one cube face, so a moving sun costs
+// one LUT and one face per step instead of a full cube. A refreshed face's
+// mip levels are prefiltered from all six faces as they are at the time,
+// and the irradiance projected again, so both lag the sky by at most a
+// round of faces. The version numbers say which of them the renderer still
+// has to upload. Nothing here touches OpenGL. --bench atmosphere checks the
+// tables against direct integration, --bench irradiance the lighting.
+class Atmosphere {
+public:
+    static const int CUBE_FACES = 6;
+
+    struct Settings {
+        float groundRadius;        // km
+        float topRadius;           // km
+        float viewHeight;          // km above the ground the sky is seen from
+        glm::vec3 rayleighScattering; // per km at the ground
+        float rayleighScaleHeight; // km
+        float mieScattering;       // per km at the ground
+        float mieExtinction;       // per km at the ground, scattering plus absorption
+        float mieScaleHeight;      // km
+        float mieG;                // Henyey-Greenstein asymmetry
+        glm::vec3 ozoneAbsorption; // per km at the layer's peak
+        float ozoneCenter;         // km above the ground
+        float ozoneWidth;          // km; the density falls linearly to zero at the edges
+        glm::vec3 groundAlbedo;
+        float sunIlluminance;      // scales the radiance into the renderer's HDR range
+        float refreshAngle;        // degrees the sun moves before the sky view is marched again
+
+        int transmittanceWidth, transmittanceHeight;   // zenith cosine, height
+        int multiScatteringSize;
+        int skyViewWidth, skyViewHeight;               // azimuth, zenith
+        int skyViewSteps;          // march samples per sky-view texel
+        int cubeSize;              // texels per side of an environment face, a power of two
+
+        Settings() : groundRadius(6360.0f), topRadius(6460.0f), viewHeight(0.2f),
+            rayleighScattering(5.802e-3f, 13.558e-3f, 33.1e-3f), rayleighScaleHeight(8.0f),
+            mieScattering(3.996e-3f), mieExtinction(4.40e-3f), mieScaleHeight(1.2f), mieG(0.8f),
+            ozoneAbsorption(0.650e-3f, 1.881e-3f, 0.085e-3f), ozoneCenter(25.0f), ozoneWidth(30.0f),
+            groundAlbedo(0.3f), sunIlluminance(12.0f), refreshAngle(0.25f),
+            transmittanceWidth(256), transmittanceHeight(64), multiScatteringSize(32),
+            skyViewWidth(192), skyViewHeight(108), skyViewSteps(32), cubeSize(32) {}
+    };
+
+    struct Stats {
+        long long skyViewUpdates;
+        long long faceUpdates;
+        double totalMs;            // CPU time of the steps
+        double maxMs;
+        double precomputeMs;       // transmittance and multiple scattering, at init
+
+        Stats() : skyViewUpdates(0), faceUpdates(0), totalMs(0.0), maxMs(0.0), precomputeMs(0.0) {}
+    };
+
+    Atmosphere();
+    ~Atmosphere();
+
+    // Builds the transmittance and multiple scattering LUTs. False, with a
+    // message, if a size is out of range or the radii are the wrong way round.
+    bool init(const Settings& settings);
+    const Settings& getSettings() const { return settings; }
+
+    // The sky view and all six faces for sunDir (towards the sun), current
+    // on return. Must not overlap with a started step.
+    void update(glm::vec3 sunDir);
+
+    // Starts the next step for sunDir as a job, unless one is still running
+    // or everything is current (with no worker threads it runs right here)
+    void start(glm::vec3 sunDir);
+    // True once a started step has finished and its results are current
+    bool poll();
+    // Waits for a started step, if there is one
+    void finish();
+
+    // Current tables, row by row: the sky view is skyViewWidth x
+    // skyViewHeight, a face cubeSize x cubeSize in GL's face orientation,
+    // halved at each level down to 1 x 1; level m holds the roughness
+    // cubeLevelRoughness(m, getCubeLevels())
+    const std::vector<glm::vec3>& getSkyView() const { return skyView[front]; }
+    int getCubeLevels() const { return cubeLevelCount; }
+    const std::vector<glm::vec3>& getFace(int face, int level = 0) const { return faces[face][level]; }
+    // Irradiance of the environment cube (already convolved with the cosine)
+    const SH9& getIrradiance() const { return irradiance; }
+    const std::vector<glm::vec3>& getTransmittanceLut() const { return transmittanceLut; }
+    const std::vector<glm::vec3>& getMultipleScatteringLut() const { return multiScatteringLut; }
+    // Bumped whenever the table changes
+    long long getSkyViewVersion() const { return skyViewVersion; }
+    long long getFaceVersion(int face) const { return faceVersions[face]; }
+    // Zenith angle of the horizon seen from viewHeight, where the sky view's
+    // two halves meet
+    float getHorizonZenith() const { return horizonZenith; }
+
+    // Sunlight left at the viewer, 0 with the sun below the horizon
+    glm::vec3 sunTransmittance(glm::vec3 sunDir) const;
+
+    // From radius r along zenith cosine mu to the top of the atmosphere,
+    // 0 where the planet is in the way: by LUT, and integrated directly
+    glm::vec3 transmittance(float r, float mu) const;
+    glm::vec3 integrateTransmittance(float r, float mu, int steps) const;
+    // Light scattered twice or more at radius r per unit scattering, by LUT
+    glm::vec3 multipleScattering(float r, float muSun) const;
+
+    // Radiance towards the viewer along viewDir, marched with the given
+    // number of samples: what a sky-view texel holds, for any direction
+    glm::vec3 skyRadiance(glm::vec3 viewDir, glm::vec3 sunDir, int steps) const;
+    // The same from the sky view LUT, bilinearly, as skybox.frag reads it
+    glm::vec3 sampleSkyView(const std::vector<glm::vec3>& lut, glm::vec3 viewDir, glm::vec3 sunDir) const;
+    // Where the sky view keeps a direction: u (azimuth from the sun) and
+    // v (zenith), both 0..1 across the texel centres
+    void skyViewCoordinates(glm::vec3 viewDir, glm::vec3 sunDir, float& u, float& v) const;
+
+    const Stats& getStats() const { return stats; }
+    void resetStats();
+
+private:
+    struct Medium {
+        glm::vec3 rayleigh;        // scattering
+        float mie;                 // scattering
+        glm::vec3 scattering;
+        glm::vec3 extinction;
+    };
+
+    typedef std::vector<std::vector<glm::vec3>> Levels;
+
+    // One step's work and its result
+    struct Step {
+        glm::vec3 sunDir;
+        bool skyView;              // march the sky view again first
+        int face;                  // then look up this face, -1 for none
+        Levels faceLevels;         // prefiltered
+        Levels faceBoxes;          // box-filtered, the prefilter's sources
+        SH9 irradiance;
+        double ms;
+    };
+
+    Medium medium(float r) const;
+    float distanceToTop(float r, float mu) const;
+    bool hitsGround(float r, float mu) const;
+    void transmittanceCoordinates(float r, float mu, float& u, float& v) const;
+    glm::vec3 computeMultipleScattering(float r, float muSun) const;
+    void computeSkyView(glm::vec3 sunDir, std::vector<glm::vec3>& out) const;
+    void computeFace(int face, glm::vec3 sunDir, const std::vector<glm::vec3>& lut, std::vector<glm::vec3>& out) const;
+    void computeBoxes(const std::vector<glm::vec3>& face, Levels& boxes) const;
+    void computeLevels(int face, const Levels* const levels[CUBE_FACES], const Levels* const boxes[CUBE_FACES],
+        Levels& out) const;
+    SH9 computeIrradiance(const Levels* const levels[CUBE_FACES]) const;
+    bool planStep(glm::vec3 sunDir);
+    void runStep();
+    void publish();
+
+    Settings settings;
+    float horizonZenith;
+
+    std::vector<glm::vec3> transmittanceLut, multiScatteringLut;
+    std::vector<glm::vec3> skyView[2];
+    glm::vec3 skyViewSun[2];       // sun the sky view was marched for
+    int front;
+    int cubeLevelCount;
+    int sourceLevels;              // box levels the prefilter reads, from 1
+    Levels faces[CUBE_FACES];      // prefiltered, by level
+    Levels boxes[CUBE_FACES];      // box-filtered, by level; 0 is unused
+    SH9 irradiance;
+    SHProjector projector;
+    long long faceSource[CUBE_FACES]; // sky view version a face was looked up in, -1 before the first
+    int nextFace;
+
+    long long skyViewVersion;
+    long long faceVersions[CUBE_FACES];
+
+    Step step;
+    JobSystem::CounterPtr pending;
+    bool ready;                    // finished on the calling thread, not yet published
+    Stats stats;
+};
+
+#endif
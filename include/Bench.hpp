@@ -0,0 +1,15 @@
+#ifndef mBench
+#define mBench
+#pragma once
+
+#include <string>
+
+// Headless benchmarks, selected on the command line with --bench <name>.
+// They run without creating a window or a GL context.
+
+// Returns the process exit code, or -1 if the benchmark name is unknown.
+int runBenchmark(const std::string& name);
+
+void printBenchmarks();
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef mBenchFixtures
+#define mBenchFixtures
+#pragma once
+
+#include <CommandBuffer.hpp>
+#include <EnvironmentLighting.hpp>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+// Synthetic inputs shared by the --bench modes and OpenGLPrjTests, so the
+// timings and the checks run on the same data. Nothing here touches OpenGL.
+
+// Unit direction elevationDegrees above the horizon (y up)
+glm::vec3 sunDirection(float elevationDegrees, float azimuthDegrees);
+
+// Rec. 709 luma of a linear colour
+float luminance(glm::vec3 c);
+
+// Cube faces from a function of the (normalised) direction
+template <class F>
+void fillCube(std::vector<glm::vec3> faces[6], int size, F radiance)
+{
+    for (int face = 0; face < 6; ++face) {
+        faces[face].resize((size_t)size * size);
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                glm::vec3 dir = glm::normalize(cubeFaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f,
+                    2.0f * (y + 0.5f) / size - 1.0f));
+                faces[face][(size_t)y * size + x] = radiance(dir);
+            }
+        }
+    }
+}
+
+// A frame shaped like renderLoop's, scaled up: per pass, opaque draws over a
+// handful of programs, textures and meshes recorded in scattered order, a
+// sky recorded first that must sort after them, plus a few transparent
+// draws whose order must survive the sort. 4 passes of 416 commands.
+void recordSyntheticFrame(CommandBuffer& commands, unsigned int seed);
+
+// A bottom-up RGBA8 frame like glReadPixels returns, different every frame
+void makeFrame(std::vector<unsigned char>& rgba, int width, int height, int frame);
+
+// Where FrameEncoder writes PNG frame index under directory
+std::string framePath(const std::string& directory, long long index);
+
+#endif
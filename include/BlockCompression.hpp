@@ -0,0 +1,26 @@
+#ifndef mBlockCompression
+#define mBlockCompression
+#pragma once
+
+// CPU encoders for the block-compressed formats the texture baker emits.
+// Both work on 4x4 blocks of 16 bytes each and take tightly packed RGBA8
+// input; width and height need not be multiples of 4 (edge texels repeat).
+//
+// BC7 only uses mode 6 (one subset, RGBA 7.7.7.7 endpoints with a p-bit,
+// 4-bit indices), which covers smooth colour like the sky well and is cheap
+// to search. BC5 stores two independent channels and is used for tangent
+// space normal maps, with z rebuilt in the shader.
+
+const int BLOCK_BYTES = 16;
+
+inline int blockCount(int size) { return (size + 3) / 4; }
+
+void compressBC7(const unsigned char* rgba, int width, int height, unsigned char* out);
+void compressBC5(const unsigned char* rgba, int width, int height, unsigned char* out);
+
+// Decoders for exactly what the encoders produce, used by the baker to
+// report the error of each image
+void decompressBC7Mode6(const unsigned char* blocks, int width, int height, unsigned char* rgba);
+void decompressBC5(const unsigned char* blocks, int width, int height, unsigned char* rgba);
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef mCommandBuffer
+#define mCommandBuffer
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// A frame's draws, recorded up front and then sorted so that commands
+// sharing a program, textures and vertex array end up next to each other.
+// Nothing here talks to GL: GL enums are carried as plain numbers, and
+// GLStateCache is the backend that replays a sorted buffer. That keeps the
+// recording and sorting usable (and checked by --bench commands) without a
+// context.
+//
+// Sort key, most significant first:
+//   pass (8 bits)      passes run in the order they were begun
+//   layer (2 bits)     background, opaque, sky, transparent
+//   program (12 bits)  opaque and background layers only, zero for
+//   textures (16 bits)  transparent commands so they keep their
+//   vao (12 bits)      recording order
+//   sequence (14 bits) recording order inside the pass
+
+enum RenderLayer {
+    LAYER_BACKGROUND,
+    LAYER_OPAQUE,
+    LAYER_SKY,                     // after everything opaque, so early-Z culls what it covers
+    LAYER_TRANSPARENT
+};
+
+// Fixed-function state a command draws with. The backend sets exactly this
+// before every draw, skipping whatever is already set.
+struct RenderState {
+    enum Flags {
+        DEPTH_TEST = 1 << 0,
+        DEPTH_WRITE = 1 << 1,
+        CULL_FACE = 1 << 2,
+        BLEND = 1 << 3
+    };
+
+    unsigned int flags;
+    unsigned int depthFunc;        // GL_LESS etc., 0 = GL_LESS
+    unsigned int blendSrc, blendDst; // 0 = GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA
+
+    explicit RenderState(unsigned int flags = DEPTH_TEST | DEPTH_WRITE | CULL_FACE, unsigned int depthFunc = 0)
+        : flags(flags), depthFunc(depthFunc), blendSrc(0), blendDst(0) {}
+
+    bool operator==(const RenderState& o) const
+    {
+        return flags == o.flags && depthFunc == o.depthFunc && blendSrc == o.blendSrc && blendDst == o.blendDst;
+    }
+    bool operator!=(const RenderState& o) const { return !(*this == o); }
+};
+
+struct TextureBinding {
+    unsigned int unit;
+    unsigned int target;           // GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP
+    unsigned int texture;
+};
+
+struct RenderCommand {
+    static const int MAX_TEXTURES = 8;
+
+    unsigned long long key;
+    unsigned int pass;
+    RenderLayer layer;
+    unsigned int sequence;
+
+    unsigned int program;
+    unsigned int vao;
+    RenderState state;
+    TextureBinding textures[MAX_TEXTURES];
+    int textureCount;
+
+    // Runs with the program bound, for the uniforms of this draw
+    std::function<void()> uniforms;
+    std::function<void()> draw;
+    // draw changes GL state behind the backend's back (and sets none of the
+    // above), so the backend forgets what it knows afterwards
+    bool external;
+
+    void addTexture(unsigned int unit, unsigned int target, unsigned int texture);
+};
+
+class CommandBuffer {
+public:
+    struct Pass {
+        const char* name;
+        bool bindTarget;           // false: leave framebuffer and viewport alone
+        unsigned int framebuffer;
+        int width, height;
+        unsigned int clearMask;    // GL_COLOR_BUFFER_BIT etc.
+        float clearColor[4];       // zero unless set
+
+        Pass(const char* name, unsigned int framebuffer, int width, int height, unsigned int clearMask)
+            : name(name), bindTarget(true), framebuffer(framebuffer), width(width), height(height), clearMask(clearMask)
+        {
+            setClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+        // A pass for external commands only
+        explicit Pass(const char* name)
+            : name(name), bindTarget(false), framebuffer(0), width(0), height(0), clearMask(0)
+        {
+            setClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        Pass& setClearColor(float r, float g, float b, float a)
+        {
+            clearColor[0] = r; clearColor[1] = g; clearColor[2] = b; clearColor[3] = a;
+            return *this;
+        }
+    };
+
+    // What replaying the buffer in its current order changes, counting only
+    // real changes: the calls a redundancy-eliding backend issues
+    struct StateChanges {
+        int passes;
+        int programs;
+        int vaos;
+        int textures;
+        int states;
+        int draws;
+
+        StateChanges() : passes(0), programs(0), vaos(0), textures(0), states(0), draws(0) {}
+        int total() const { return passes + programs + vaos + textures + states; }
+    };
+
+    static const unsigned int MAX_PASSES = 256;
+    static const unsigned int MAX_COMMANDS_PER_PASS = 1 << 14;
+
+    CommandBuffer() : passCommands(0) {}
+
+    void clear();
+
+    // Commands recorded from here on belong to this pass
+    unsigned int beginPass(const Pass& pass);
+    RenderCommand& add(RenderLayer layer, unsigned int program, unsigned int vao, const RenderState& state);
+    RenderCommand& addExternal(std::function<void()> draw);
+
+    void sort();
+
+    const std::vector<Pass>& getPasses() const { return passes; }
+    const std::vector<RenderCommand>& getCommands() const { return commands; }
+    StateChanges countStateChanges() const;
+
+    static unsigned long long makeKey(const RenderCommand& command);
+
+private:
+    std::vector<Pass> passes;
+    std::vector<RenderCommand> commands;
+    unsigned int passCommands;
+};
+
+#endif
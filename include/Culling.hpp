@@ -0,0 +1,76 @@
+#ifndef mCulling
+#define mCulling
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// CPU-side visibility culling. Nothing in here touches OpenGL, so it can be
+// exercised without a context.
+
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB();
+    AABB(const glm::vec3& min, const glm::vec3& max);
+
+    void expand(const glm::vec3& p);
+    void expand(const AABB& other);
+    bool isValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return max - min; }
+};
+
+class Frustum {
+public:
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    // Planes are extracted from a combined projection * view matrix, so the
+    // same code serves the camera, the mirrored reflection camera and the
+    // orthographic light.
+    static Frustum fromMatrix(const glm::mat4& viewProjection);
+
+    Result classify(const AABB& box) const;
+    bool intersects(const AABB& box) const { return classify(box) != OUTSIDE; }
+
+    // left, right, bottom, top, near, far; xyz = normal pointing inside
+    glm::vec4 planes[6];
+};
+
+struct CullStats {
+    int total;         // items in the hierarchy
+    int visible;       // items that passed
+    int nodesTested;   // bounding volumes tested against the frustum
+
+    CullStats() : total(0), visible(0), nodesTested(0) {}
+};
+
+// Bounding-volume hierarchy over a fixed set of boxes (the terrain chunks).
+// Built once; culled every pass.
+class BVH {
+public:
+    void build(const std::vector<AABB>& boxes, int maxLeafSize = 4);
+
+    // Appends the indices of the boxes touching the frustum to visible
+    void cull(const Frustum& frustum, std::vector<unsigned int>& visible, CullStats& stats) const;
+
+    bool empty() const { return nodes.empty(); }
+    const AABB& bounds() const { return nodes[0].bounds; }
+
+private:
+    struct Node {
+        AABB bounds;
+        int left, right;      // child node indices, -1 for leaves
+        int first, count;     // range in items covered by this subtree
+    };
+
+    std::vector<Node> nodes;
+    std::vector<unsigned int> items;
+    std::vector<AABB> itemBounds;
+
+    int buildNode(const std::vector<AABB>& boxes, std::vector<glm::vec3>& centers,
+        int first, int count, int maxLeafSize);
+};
+
+#endif
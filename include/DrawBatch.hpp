@@ -0,0 +1,72 @@
+#ifndef mDrawBatch
+#define mDrawBatch
+#pragma once
+
+#include <glad/glad.h>
+#include <Mesh.hpp>
+#include <RingBuffer.hpp>
+#include <vector>
+
+struct DrawStats {
+    int chunks;      // draw calls a per-chunk loop would have issued
+    int ranges;      // contiguous index ranges after merging neighbouring chunks
+    int drawCalls;   // GL draw calls actually issued
+
+    DrawStats() : chunks(0), ranges(0), drawCalls(0) {}
+};
+
+// Packs the visible chunks of a mesh into a single multi-draw. Chunks that
+// are neighbours in the index buffer are merged into one range first.
+//
+// With a 4.3 context the ranges are streamed into an indirect command ring
+// buffer and submitted with glMultiDrawElementsIndirect; on the 3.3 core
+// context the same ranges go through glMultiDrawElements.
+class DrawBatch {
+public:
+    DrawBatch();
+
+    // Room is reserved for maxCommands in each of passesPerFrame passes
+    void init(unsigned int maxCommands, unsigned int passesPerFrame);
+    void destroy();
+
+    void beginFrame();
+    void endFrame();
+
+    // Sorts visible in place
+    void build(const Mesh& mesh, std::vector<unsigned int>& visible);
+    // Same, nearest chunk to eye first, so the depth test rejects more of
+    // what is drawn later. Only chunks that end up next to each other in
+    // both orders merge, which leaves more ranges.
+    void buildFrontToBack(const Mesh& mesh, std::vector<unsigned int>& visible, const glm::vec3& eye);
+
+    // Draws the last build with the mesh VAO bound
+    void draw(DrawStats& stats);
+
+    bool usesIndirect() const { return indirect; }
+    const RingBuffer& getCommandBuffer() const { return commandBuffer; }
+    RingBuffer& getCommandBuffer() { return commandBuffer; }
+
+private:
+    // Ranges of the chunks in the order given
+    void merge(const Mesh& mesh, const std::vector<unsigned int>& visible);
+
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLuint baseVertex;
+        GLuint baseInstance;
+    };
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<std::pair<float, unsigned int>> byDistance;
+    int builtChunks;
+
+    bool indirect;
+    RingBuffer commandBuffer;
+    unsigned int maxCommands;
+};
+
+#endif
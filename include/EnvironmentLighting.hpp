@@ -0,0 +1,81 @@
+#ifndef mEnvironmentLighting
+#define mEnvironmentLighting
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+// Image-based lighting from a cubemap, on the CPU: the diffuse light as
+// nine spherical harmonics coefficients per channel, which shaders evaluate
+// from a uniform array, and GGX-prefiltered copies of the cube for rough
+// reflections, uploaded as its mip levels. Faces are size * size texels,
+// row by row, in GL's face orientation. Nothing here touches OpenGL.
+
+// Direction through (s, t) of face (GL_TEXTURE_CUBE_MAP_POSITIVE_X + face),
+// s and t in -1..1; not normalised
+inline glm::vec3 cubeFaceDirection(int face, float s, float t)
+{
+    switch (face) {
+    case 0: return glm::vec3(1.0f, -t, -s);
+    case 1: return glm::vec3(-1.0f, -t, s);
+    case 2: return glm::vec3(s, 1.0f, t);
+    case 3: return glm::vec3(s, -1.0f, -t);
+    case 4: return glm::vec3(s, -t, 1.0f);
+    default: return glm::vec3(-s, -t, -1.0f);
+    }
+}
+
+// Real spherical harmonics up to band 2, orthonormal over the sphere
+struct SH9 {
+    glm::vec3 coefficients[9];
+
+    SH9();
+
+    static void basis(glm::vec3 dir, float out[9]);
+    glm::vec3 evaluate(glm::vec3 dir) const;
+
+    // Convolved with the clamped cosine and divided by pi (Ramamoorthi and
+    // Hanrahan): evaluated at a normal, the light a white Lambertian
+    // surface reflects
+    SH9 irradiance() const;
+};
+
+// Projects a cubemap's radiance onto SH9, every texel weighted by the solid
+// angle it covers. Four texels of a row at a time with SSE (a scalar loop
+// does the rest, and everything on builds without SSE2), rows spread over
+// the job system and summed in a fixed order, so the result does not
+// depend on the thread count.
+class SHProjector {
+public:
+    SHProjector();
+
+    SH9 project(const std::vector<glm::vec3>* const faces[6], int size) const;
+
+    // For the benchmark: off runs the scalar path even where SSE is there
+    void setSimd(bool enabled) { simd = enabled && simdAvailable(); }
+    bool getSimd() const { return simd; }
+    static bool simdAvailable();
+
+private:
+    bool simd;
+};
+
+// Mip levels of a cube size texels wide, down to 1 x 1
+int cubeLevels(int size);
+
+// Mip level m of the prefiltered cube holds this roughness, 0 at the full
+// size (the cube itself) to 1 at the smallest
+float cubeLevelRoughness(int level, int levels);
+
+// 2 x 2 box filter: a face of size texels to one of size / 2
+void downsampleFace(const std::vector<glm::vec3>& face, int size, std::vector<glm::vec3>& out);
+
+// One face of a prefiltered level, size texels wide: Karis' split-sum
+// prefilter with the view along the normal, summed over every texel of the
+// source faces (sourceSize wide, usually a box-filtered level a little
+// finer than the output) rather than importance-sampled, so it has no
+// noise. Rows go to the job system.
+void prefilterFace(const std::vector<glm::vec3>* const sources[6], int sourceSize, int face, int size,
+    float roughness, std::vector<glm::vec3>& out);
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef mErosion
+#define mErosion
+#pragma once
+
+#include <vector>
+
+// Particle-based hydraulic erosion. Droplets are spawned at random points on
+// the heightfield, roll downhill carrying sediment and erode or deposit
+// depending on their sediment capacity, while their water evaporates.
+//
+// Droplets are simulated in batches on the JobSystem. Inside a batch every
+// job reads the same height snapshot and writes its changes into a private
+// accumulation buffer, so there are no write conflicts; the buffers are
+// merged into the heightfield when the batch ends.
+class DropletErosion {
+public:
+    struct Settings {
+        int numDroplets;
+        int batchSize;
+        int numThreads;             // accumulation buffers / jobs per batch, 0 = JobSystem thread count
+        int maxLifetime;            // steps before a droplet dies
+        int brushRadius;            // erosion radius in grid cells
+        float inertia;              // 0 = follow the gradient, 1 = never turn
+        float sedimentCapacityFactor;
+        float minSedimentCapacity;
+        float erodeSpeed;
+        float depositSpeed;
+        float evaporateSpeed;
+        float gravity;
+        float initialWater;
+        float initialSpeed;
+        unsigned int seed;
+
+        Settings();
+
+        // numThreads, or the JobSystem's thread count when it is 0. The
+        // eroded heights depend on it through the batch split.
+        int resolvedThreads() const;
+    };
+
+    struct Stats {
+        int droplets;
+        int batches;
+        int threads;
+        double seconds;
+        double dropletsPerSecond;
+    };
+
+    // heights are laid out like Mesh::generateGrid positions: idx = i * n + j
+    DropletErosion(int m, int n, const Settings& settings = Settings());
+
+    Stats erode(std::vector<float>& heights);
+
+    const Settings& getSettings() const { return settings; }
+
+private:
+    int m, n;
+    Settings settings;
+
+    // Precomputed brush: offsets and normalized weights of the cells within
+    // brushRadius of a node.
+    std::vector<int> brushOffsetI;
+    std::vector<int> brushOffsetJ;
+    std::vector<float> brushWeights;
+
+    void simulateDroplets(const std::vector<float>& heights, std::vector<float>& delta,
+        int firstDroplet, int count) const;
+    float sampleHeight(const std::vector<float>& heights, float x, float z,
+        float& gradX, float& gradZ) const;
+};
+
+#endif
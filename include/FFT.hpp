@@ -0,0 +1,46 @@
+#ifndef mFFT
+#define mFFT
+#pragma once
+
+#include <vector>
+
+// Two-dimensional inverse FFT of a square, power-of-two grid, in place on
+// separate real and imaginary arrays (row-major, size * size floats each).
+//
+// The grid is transformed along its columns, transposed, transformed along
+// its columns again and transposed back. Along a column every butterfly
+// combines whole rows, which are contiguous, so the same butterfly is
+// applied to four neighbouring columns at once with SSE (a scalar loop does
+// the rest, and everything on builds without SSE2). Pairs of radix-2 stages
+// are fused into radix-4 stages, halving the passes over the grid; an odd
+// number of stages starts with one radix-2 stage. Column ranges are spread
+// over the job system.
+class FFT2D {
+public:
+    FFT2D();
+
+    // size: a power of two, at least 2
+    bool init(int size);
+    int getSize() const { return size; }
+
+    // out[y][x] = sum over v, u of in[v][u] * e^(2 pi i (u x + v y) / size),
+    // without the 1 / size^2 scale
+    void inverse(float* re, float* im) const;
+
+    // For the benchmark: off runs the scalar path even where SSE is there
+    void setSimd(bool enabled) { simd = enabled && simdAvailable(); }
+    bool getSimd() const { return simd; }
+    static bool simdAvailable();
+
+private:
+    void columns(float* re, float* im, int x0, int x1) const;
+    void transpose(float* data) const;
+
+    int size;
+    int log2Size;
+    std::vector<float> twiddleRe, twiddleIm; // e^(2 pi i k / size), k < size / 2
+    std::vector<int> bitReverse;
+    bool simd;
+};
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef mFrameCapture
+#define mFrameCapture
+#pragma once
+
+#include <glad/glad.h>
+#include <FrameEncoder.hpp>
+#include <vector>
+
+// Records the finished frames to disk (--capture DIR). capture() copies the
+// default framebuffer into one of a ring of pixel-pack buffers right before
+// the swap and fences it, so glReadPixels only queues the copy; collect()
+// maps the buffers whose fences have passed, oldest first, a frame or two
+// later, and hands the pixels to a FrameEncoder thread. Nothing waits on
+// the GPU: a frame finding its slot still in flight is dropped, like one
+// the encoder has no room for, and both are counted. Works the same with
+// --headless, where the context has no window and Mesa renders off screen.
+class FrameCapture {
+public:
+    struct Stats {
+        long long captured;        // frames read back and handed to the encoder
+        long long ringDrops;       // frames whose readback slot was still in flight
+        FrameEncoder::Stats encoder;
+
+        Stats() : captured(0), ringDrops(0) {}
+    };
+
+    FrameCapture();
+
+    // Opens the encoder for frames of width x height (the Y4M stream keeps
+    // that size). False, with a message, if the output cannot be created.
+    bool init(const CaptureSettings& settings, int width, int height);
+    // Waits for the readbacks in flight, writes everything queued, prints
+    // a summary and frees the buffers
+    void destroy();
+
+    // Queues the readback of the default framebuffer's width x height
+    // pixels; call after the frame is drawn, before swapping
+    void capture(int width, int height);
+    // Passes finished readbacks to the encoder; never blocks
+    void collect();
+
+    // True once the frames asked for with --capture-frames are captured
+    bool done() const;
+    bool isActive() const { return active; }
+    // Since init(), not reset
+    Stats getStats() const;
+    const CaptureSettings& getSettings() const { return settings; }
+
+private:
+    static const int READBACK_SLOTS = 3;
+
+    void readSlot(int slot);
+
+    CaptureSettings settings;
+    FrameEncoder encoder;
+    bool active;
+    GLenum readBuffer;             // GL_BACK, or GL_FRONT on a single-buffered context
+
+    unsigned int pbo[READBACK_SLOTS];
+    GLsync fences[READBACK_SLOTS];
+    size_t sizes[READBACK_SLOTS];  // bytes allocated
+    int widths[READBACK_SLOTS], heights[READBACK_SLOTS];
+    long long indices[READBACK_SLOTS];
+    int writeSlot, nextRead;       // next to fill, oldest in flight
+    long long frameIndex;          // frames offered to capture()
+    std::vector<unsigned char> pixels;
+
+    long long captured, ringDrops;
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef mFrameEncoder
+#define mFrameEncoder
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// How captured frames are written: a numbered PNG per frame, or every frame
+// into one uncompressed YUV4MPEG2 (4:2:0) stream that ffmpeg and most
+// players read as it is
+enum CaptureFormat {
+    CAPTURE_PNG,
+    CAPTURE_Y4M,
+    CAPTURE_FORMAT_COUNT
+};
+
+const char* captureFormatName(CaptureFormat format);
+bool parseCaptureFormat(const std::string& name, CaptureFormat& format);
+
+struct CaptureSettings {
+    std::string directory;         // where frames go; empty captures nothing
+    CaptureFormat format;
+    int frames;                    // stop after this many, 0 to run until the window closes
+    int fps;                       // frame rate written into the Y4M header, and of the simulation while capturing
+    int maxQueued;                 // frames waiting for the encoder before new ones are dropped
+
+    CaptureSettings() : format(CAPTURE_PNG), frames(0), fps(60), maxQueued(8) {}
+};
+
+// Writes frames on a thread of its own, so a slow disk or PNG's deflate
+// never holds up the render loop. Frames come in as bottom-up RGBA8 rows,
+// the way glReadPixels returns them, and are flipped while encoding. A frame
+// that arrives with maxQueued already waiting is dropped rather than queued,
+// and counted. PNG files keep the gap in their numbering; the Y4M stream has
+// no numbers, so the next frame written is repeated in place of each one
+// missing and the stream keeps its frame rate. Nothing here touches OpenGL;
+// FrameCapture feeds it from pixel-pack buffers.
+class FrameEncoder {
+public:
+    struct Stats {
+        long long submitted;       // frames offered to submit()
+        long long written;
+        long long dropped;         // queue full, or a Y4M frame of the wrong size
+        long long repeated;        // extra copies of Y4M frames standing in for dropped ones
+        long long failed;          // write errors
+        long long bytes;           // written to disk
+        double encodeMs;           // on the encoder thread
+        double maxEncodeMs;
+
+        Stats() : submitted(0), written(0), dropped(0), repeated(0), failed(0), bytes(0), encodeMs(0.0),
+            maxEncodeMs(0.0) {}
+    };
+
+    FrameEncoder();
+    ~FrameEncoder();
+
+    // Creates the directory if needed (and the Y4M file, whose size is fixed
+    // to width x height from here on) and starts the thread. False, with a
+    // message, if the output cannot be created.
+    bool open(const CaptureSettings& settings, int width, int height);
+    // Writes what is queued, then stops the thread
+    void close();
+    bool isOpen() const { return running; }
+
+    // Queues a frame, numbered index (the file name of a PNG, so dropped
+    // frames show as gaps). rgba is swapped for a spare buffer, which the
+    // caller fills next time round. False if the frame was dropped.
+    bool submit(std::vector<unsigned char>& rgba, int width, int height, long long index);
+
+    Stats getStats() const;
+
+    // 8-bit BT.601 full-range ("JPEG") 4:2:0 planes of a bottom-up RGBA8
+    // image, top row first: width x height luma, then both chroma planes
+    // (width + 1) / 2 x (height + 1) / 2, each chroma sample the mean of
+    // its 2 x 2 block
+    static void rgbaToYuv420(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out);
+
+private:
+    struct Frame {
+        std::vector<unsigned char> rgba;
+        int width, height;
+        long long index;
+    };
+
+    void run();
+    bool writeFrame(const Frame& frame, long long& bytes, long long& repeated);
+
+    CaptureSettings settings;
+    int width, height;
+    std::FILE* stream;             // the Y4M file
+    bool running;
+
+    std::thread thread;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Frame> queue;
+    std::vector<std::vector<unsigned char>> spares;
+    bool stopping;
+    Stats stats;
+
+    // Encoder thread only
+    std::vector<unsigned char> scratch;
+    bool sizeWarned;
+    long long nextIndex;           // of the next Y4M frame, to fill gaps up to
+};
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef mGLRenderTargets
+#define mGLRenderTargets
+#pragma once
+
+#include <glad/glad.h>
+#include <RenderTargetPool.hpp>
+
+// Creates the pool's textures and framebuffers on the current context.
+// A framebuffer has at most one colour attachment; without one it draws
+// depth only.
+class GLRenderTargetBackend : public RenderTargetPool::Backend {
+public:
+    unsigned int createTexture(const RenderTargetDesc& desc, int width, int height) override;
+    void destroyTexture(unsigned int texture) override;
+    unsigned int createFramebuffer(unsigned int colorTexture, unsigned int depthTexture) override;
+    void destroyFramebuffer(unsigned int framebuffer) override;
+    size_t bytesPerTexel(unsigned int format) const override { return formatBytes(format); }
+
+    // What a texel of a sized internal format takes, as drivers usually
+    // store it (24-bit depth padded to 32)
+    static size_t formatBytes(unsigned int format);
+};
+
+#endif
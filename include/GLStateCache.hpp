@@ -0,0 +1,83 @@
+#ifndef mGLStateCache
+#define mGLStateCache
+#pragma once
+
+#include <glad/glad.h>
+#include <CommandBuffer.hpp>
+#include <GpuTimer.hpp>
+#include <vector>
+
+// Replays a CommandBuffer on the current context. A shadow copy of the GL
+// state the commands touch is kept, and a bind or enable that would set
+// what is already set is skipped and counted instead of issued.
+//
+// Code that changes GL state behind the cache's back must call
+// invalidate() afterwards; external commands do so automatically.
+class GLStateCache {
+public:
+    struct Stats {
+        long long issued;          // state calls made
+        long long elided;          // state calls skipped as redundant
+        long long draws;
+
+        Stats() : issued(0), elided(0), draws(0) {}
+    };
+
+    static const int MAX_TEXTURE_UNITS = 16;
+
+    GLStateCache();
+
+    // Forget everything, the next command sets all of its state
+    void invalidate();
+
+    // passTimer, if given, gets a timestamp where each pass starts
+    void submit(const CommandBuffer& buffer, GpuPassTimer* passTimer = nullptr);
+
+    void bindFramebuffer(unsigned int framebuffer);
+    void viewport(int width, int height);
+    void useProgram(unsigned int program);
+    void bindVertexArray(unsigned int vao);
+    void bindTexture(unsigned int unit, unsigned int target, unsigned int texture);
+    void apply(const RenderState& state);
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+private:
+    struct Unit {
+        unsigned int target;
+        unsigned int texture;
+    };
+
+    // Bits of known: which parts of the shadow copy match the context
+    enum Known {
+        KNOWN_FRAMEBUFFER = 1 << 0,
+        KNOWN_VIEWPORT = 1 << 1,
+        KNOWN_PROGRAM = 1 << 2,
+        KNOWN_VAO = 1 << 3,
+        KNOWN_ACTIVE_UNIT = 1 << 4,
+        KNOWN_DEPTH_FUNC = 1 << 5,
+        KNOWN_BLEND_FUNC = 1 << 6
+    };
+
+    bool changed(bool isKnown, bool differs);
+    void setFlag(unsigned int flag, bool enable);
+
+    unsigned int known;
+    unsigned int knownFlags;       // RenderState::Flags
+    bool unitKnown[MAX_TEXTURE_UNITS];
+
+    unsigned int framebuffer;
+    int width, height;
+    unsigned int program;
+    unsigned int vao;
+    unsigned int activeUnit;
+    Unit units[MAX_TEXTURE_UNITS];
+    unsigned int flags;
+    unsigned int depthFunc;
+    unsigned int blendSrc, blendDst;
+
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef mGpuTimer
+#define mGpuTimer
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+
+// GPU time between begin() and end(), measured with GL_TIME_ELAPSED queries
+// in a small ring so a result is only read once the GPU has it: fetch()
+// returns frames a few frames old and never stalls. Timer queries cannot
+// nest, so only one GpuTimer may be between begin() and end() at a time.
+class GpuTimer {
+public:
+    GpuTimer();
+
+    void init();
+    void destroy();
+
+    void begin();
+    void end();
+
+    // The newest finished measurement not fetched yet, in ms; false if none
+    bool fetch(double& ms);
+
+private:
+    static const int SLOTS = 4;
+
+    unsigned int queries[SLOTS];
+    bool pending[SLOTS];
+    int writeSlot;
+};
+
+// GPU time of each pass of a frame, from GL_TIMESTAMP queries issued where
+// a pass starts and where the frame ends (GLStateCache::submit marks the
+// passes). Timestamps are not begin/end queries, so this runs alongside a
+// GpuTimer. Like it, results come back a few frames late without stalling.
+class GpuPassTimer {
+public:
+    struct PassTime {
+        const char* name;          // the CommandBuffer::Pass name
+        double ms;
+    };
+
+    static const int MAX_PASSES = 32;
+
+    GpuPassTimer();
+
+    void init();
+    void destroy();
+
+    void beginFrame();
+    // Ends the previous pass; passes past MAX_PASSES are counted in the last
+    void mark(const char* pass);
+    void endFrame();
+
+    // The passes of the newest finished frame not fetched yet, in order
+    bool fetch(std::vector<PassTime>& passes);
+
+private:
+    static const int SLOTS = 4;
+
+    struct Frame {
+        unsigned int queries[MAX_PASSES + 1];
+        const char* names[MAX_PASSES];
+        int marks;
+        bool pending;
+    };
+
+    Frame frames[SLOTS];
+    int writeSlot;
+};
+
+#endif
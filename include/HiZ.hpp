@@ -0,0 +1,53 @@
+#ifndef mHiZ
+#define mHiZ
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <Occlusion.hpp>
+#include <Programs.hpp>
+
+// GPU depth pyramid. After the opaque scene the depth buffer is reduced into
+// an RG32F mip chain (farthest depth per texel in red, nearest in green),
+// and the farthest depth of one small level is read back asynchronously
+// through pixel-pack buffers. A frame or two later the read-back level is
+// handed to an OcclusionCuller together with the matrix it was rendered
+// with. Screen-space reflections march the nearest depths of the same frame.
+//
+// Level 0 is half the size of the depth target and covers the part of it
+// the frame rendered, so texture coordinates are those of the frame.
+class HiZBuffer {
+public:
+    HiZBuffer();
+
+    void init(const ProgramVariant* program, unsigned int width, unsigned int height, unsigned int maxReadbackWidth = 256);
+    void destroy();
+
+    // Reduces the renderWidth x renderHeight corner of depthTexture that the
+    // frame covers (all of it unless the resolution is scaled) and queues
+    // the readback; restores viewport and depth test
+    void build(unsigned int depthTexture, unsigned int renderWidth, unsigned int renderHeight,
+        const glm::mat4& viewProjection);
+
+    // Passes the newest finished readback to culler; false if none is ready
+    bool fetch(OcclusionCuller& culler);
+
+    unsigned int getTexture() const { return texture; }
+    int getLevels() const { return levels; }
+
+private:
+    static const int READBACK_SLOTS = 3;
+
+    const ProgramVariant* program;
+    unsigned int texture, fbo, vao;
+    unsigned int width, height;
+    int levels;
+
+    int readbackLevel, readbackWidth, readbackHeight;
+    unsigned int pbo[READBACK_SLOTS];
+    GLsync fences[READBACK_SLOTS];
+    glm::mat4 viewProjections[READBACK_SLOTS];
+    int writeSlot;
+};
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef mJobSystem
+#define mJobSystem
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Shared pool of worker threads for CPU work: terrain generation, erosion,
+// texture decoding and compression, cubemap face extraction.
+//
+// Every worker owns a deque. Jobs a worker submits go to the back of its own
+// deque and it pops from the back, so nested work stays hot in its cache;
+// idle workers steal from the front of the others. Jobs submitted from
+// threads outside the pool go to one extra shared deque that everybody
+// steals from.
+//
+// Completion is tracked with counters: run() adds one to a counter and the
+// job takes it away again when it is done. wait() keeps the calling thread
+// busy with other jobs until its counter reaches zero, so waiting inside a
+// job (a nested parallelFor) cannot deadlock the pool. then() queues a
+// continuation that is submitted once a counter reaches zero.
+class JobSystem {
+public:
+    typedef std::function<void()> Job;
+
+    class Counter {
+    public:
+        Counter() : pending(0) {}
+        bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+    private:
+        friend class JobSystem;
+        std::atomic<int> pending;
+        std::mutex mutex;
+        std::vector<std::pair<Job, std::shared_ptr<Counter>>> continuations;
+    };
+    typedef std::shared_ptr<Counter> CounterPtr;
+
+    struct Stats {
+        long long jobs;            // executed
+        long long steals;          // taken from another thread's deque
+        long long sleeps;          // times a worker found nothing and slept
+    };
+
+    // The pool everything shares, started with the default thread count
+    static JobSystem& instance();
+
+    JobSystem();
+    ~JobSystem();
+
+    // numWorkers < 0 uses hardware_concurrency() - 1, leaving the caller's
+    // thread as the last one; 0 runs everything on the waiting thread. The
+    // benchmarks restart the pool at 1..N threads. Neither init nor shutdown
+    // may be called while jobs are in flight.
+    void init(int numWorkers = -1);
+    void shutdown();
+
+    int getWorkerCount() const { return (int)workers.size(); }
+    // Workers plus the thread that waits
+    int getThreadCount() const { return (int)workers.size() + 1; }
+    Stats getStats() const;
+    void resetStats();
+
+    CounterPtr makeCounter() const { return std::make_shared<Counter>(); }
+
+    // counter may be null for fire-and-forget jobs
+    void run(Job job, const CounterPtr& counter = CounterPtr());
+    // Submits job once dependency reaches zero (right away if it already has);
+    // counter counts the continuation from now on
+    void then(const CounterPtr& dependency, Job job, const CounterPtr& counter = CounterPtr());
+    // Runs other jobs until counter reaches zero
+    void wait(const CounterPtr& counter);
+
+    // Calls body(first, last) on ranges of at most grain indices covering
+    // [begin, end) and returns when all are done. With no workers, or a
+    // range that fits one grain, body runs inline.
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body);
+
+private:
+    struct Task {
+        Job job;
+        CounterPtr counter;
+    };
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void submit(Task task);
+    bool popTask(Task& task);
+    void execute(Task& task);
+    void complete(const CounterPtr& counter);
+    void workerMain(int index);
+
+    std::vector<std::thread> workers;
+    // One per worker, then the shared one for outside threads
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+
+    std::atomic<int> queued;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping;
+
+    std::atomic<long long> jobCount, stealCount, sleepCount;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef mKtx2
+#define mKtx2
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Minimal KTX 2.0 container support: 2D textures and cubemaps with a full
+// mip chain, no supercompression, no array layers. Enough for what the
+// texture baker writes and the asset loader reads; GL-free.
+
+// Vulkan format numbers used in the KTX2 header
+enum Ktx2Format {
+    KTX2_FORMAT_RGBA8 = 37,    // VK_FORMAT_R8G8B8A8_UNORM
+    KTX2_FORMAT_BC5 = 141,     // VK_FORMAT_BC5_UNORM_BLOCK
+    KTX2_FORMAT_BC7 = 145      // VK_FORMAT_BC7_UNORM_BLOCK
+};
+
+const char* ktx2FormatName(unsigned int format);
+bool ktx2IsBlockCompressed(unsigned int format);
+// Bytes of one face of a width x height mip level
+size_t ktx2ImageSize(unsigned int format, int width, int height);
+
+struct Ktx2Texture {
+    struct Level {
+        size_t offset;     // from the start of the file
+        size_t size;       // all faces
+    };
+
+    unsigned int format;
+    int width, height;
+    int faces;             // 1 or 6, cubemap faces in GL order
+    std::vector<Level> levels;
+
+    Ktx2Texture() : format(0), width(0), height(0), faces(1) {}
+
+    int levelWidth(int level) const { return width >> level > 0 ? width >> level : 1; }
+    int levelHeight(int level) const { return height >> level > 0 ? height >> level : 1; }
+};
+
+// Parses the header and level index of an in-memory file
+bool readKtx2(const unsigned char* data, size_t size, Ktx2Texture& texture);
+
+// levels[i] holds the faces of mip level i back to back
+bool writeKtx2(const std::string& path, unsigned int format, int width, int height, int faces,
+    const std::vector<std::vector<unsigned char>>& levels);
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef mMPSCQueue
+#define mMPSCQueue
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free multi-producer / single-consumer queue (Vyukov's
+// intrusive node queue). Any thread may push; only one thread may pop.
+// Producers never wait on each other or on the consumer: a push is one
+// atomic exchange plus one store.
+template <typename T>
+class MPSCQueue {
+public:
+    MPSCQueue() : head(new Node()), tail(head.load(std::memory_order_relaxed)) {}
+
+    ~MPSCQueue()
+    {
+        T discard;
+        while (pop(discard)) {}
+        delete tail;
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    void push(T value)
+    {
+        Node* node = new Node();
+        node->value = std::move(value);
+        Node* prev = head.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Consumer thread only. False when empty, or when a producer is between
+    // its exchange and its store; the item shows up on a later pop.
+    bool pop(T& value)
+    {
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next)
+            return false;
+        value = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Node {
+        std::atomic<Node*> next;
+        T value;
+
+        Node() : next(nullptr), value() {}
+    };
+
+    std::atomic<Node*> head;   // last pushed node, shared by producers
+    Node* tail;                // stub node owned by the consumer
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef mMappedFile
+#define mMappedFile
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. Pages are only faulted in when
+// touched, so uploading straight from the mapping avoids a read() copy.
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool isOpen() const { return data != nullptr; }
+    const unsigned char* getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    const unsigned char* data;
+    size_t size;
+#ifdef _WIN32
+    void* file;
+    void* mapping;
+#else
+    int fd;
+#endif
+};
+
+#endif
@@ -4,15 +4,47 @@
 
 #include <vector>
 #include <glm/glm.hpp>
+#include <Erosion.hpp>
+#include <Culling.hpp>
 
 class Mesh {
 public:
+	// Contiguous range of indices covering a square patch of the grid
+	struct Chunk {
+		unsigned int firstIndex;
+		unsigned int indexCount;
+		AABB bounds;
+	};
+
 	std::vector<float> vertices; // interleaved: pos(x,y,z), normal(x,y,z), uv(u,v)
 	std::vector<unsigned int> indices;
+	std::vector<Chunk> chunks;   // only filled by generateGrid
+	AABB bounds;
 	int vertexCount;
 
+	// Coarse, conservative stand-in used by the software occlusion rasterizer
+	std::vector<glm::vec3> occluderVertices;
+	std::vector<unsigned int> occluderIndices;
+
+	// Neighbour-diffusion "hydraulic" erosion followed by thermal erosion
 	static Mesh generateGrid(float width, float depth, int m, int n, int erosionIterations, float hydraulicFactor, float talusAngle);
+	// Particle-based droplet erosion followed by thermal erosion
+	static Mesh generateGrid(float width, float depth, int m, int n, const DropletErosion::Settings& erosion, float talusAngle);
+	// Seeded droplet-eroded terrain, read from the heightfield cache when a
+	// matching one exists and written to it otherwise. Seed 0 is random and
+	// never cached.
+	static Mesh loadGrid(float width, float depth, int m, int n, const DropletErosion::Settings& erosion, float talusAngle, unsigned int seed);
 	static Mesh generateWaterPlane(float width, float depth, unsigned int divisions);
+
+	// Island heightfield before any erosion, laid out as heights[i * n + j]
+	// Seed 0 picks a random noise offset
+	static std::vector<float> generateHeightfield(float width, float depth, int m, int n, unsigned int seed = 0);
+	static std::vector<float> generateErodedHeightfield(float width, float depth, int m, int n, const DropletErosion::Settings& erosion, float talusAngle, unsigned int seed);
+
+private:
+	static void applyDiffusionErosion(std::vector<float>& heights, int m, int n, int iterations, float hydraulicFactor);
+	static void applyThermalErosion(std::vector<float>& heights, int m, int n, float talusAngle);
+	static Mesh buildGrid(const float* heights, float width, float depth, int m, int n);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,101 @@
+#ifndef mOcclusion
+#define mOcclusion
+#pragma once
+
+#include <Culling.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+
+// CPU side of occlusion culling. Boxes are tested against a max-depth
+// pyramid that comes either from the GPU (the previous frame's depth buffer,
+// reduced and read back by HiZBuffer) or from the software rasterizer below.
+// Neither needs a GL context.
+
+enum OcclusionMode { OCCLUSION_OFF, OCCLUSION_SOFTWARE, OCCLUSION_HIZ };
+
+const char* occlusionModeName(OcclusionMode mode);
+
+struct OcclusionStats {
+    int tested;     // boxes that survived frustum culling
+    int occluded;   // of those, rejected by the depth pyramid
+
+    OcclusionStats() : tested(0), occluded(0) {}
+};
+
+// Mip chain of window-space depth where every texel holds the farthest
+// depth of the texels it covers. Row 0 is the bottom of the screen, as
+// returned by glReadPixels.
+class DepthPyramid {
+public:
+    void build(const float* depth, int width, int height);
+    void clear() { levels.clear(); }
+
+    // True if the whole box is behind the depth stored for its screen area.
+    // Boxes crossing the near plane are never occluded.
+    bool isOccluded(const AABB& box, const glm::mat4& viewProjection) const;
+
+    bool empty() const { return levels.empty(); }
+    int levelCount() const { return (int)levels.size(); }
+    int width(int level = 0) const { return levels[level].width; }
+    int height(int level = 0) const { return levels[level].height; }
+    float at(int level, int x, int y) const { return levels[level].depth[y * levels[level].width + x]; }
+
+private:
+    struct Level {
+        int width, height;
+        std::vector<float> depth;
+    };
+    std::vector<Level> levels;
+};
+
+// Minimal depth-only triangle rasterizer for a coarse occluder mesh
+class SoftwareRasterizer {
+public:
+    SoftwareRasterizer(int width, int height);
+
+    void clear();
+    // Triangles crossing the near plane are skipped, which only ever
+    // removes occlusion and so stays conservative
+    void drawTriangles(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices,
+        const glm::mat4& viewProjection);
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    const std::vector<float>& getDepth() const { return depth; }
+
+private:
+    int width, height;
+    std::vector<float> depth;
+    std::vector<glm::vec4> clip;
+};
+
+class OcclusionCuller {
+public:
+    OcclusionCuller(int width = 256, int height = 144);
+
+    void setOccluders(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices);
+
+    // Software path: rasterize the occluders from this viewpoint
+    void renderOccluders(const glm::mat4& viewProjection);
+    // Hi-Z path: depth read back from the GPU, rendered with viewProjection
+    void setDepth(const float* depth, int width, int height, const glm::mat4& viewProjection);
+    void invalidate() { pyramid.clear(); }
+
+    bool ready() const { return !pyramid.empty(); }
+    bool isOccluded(const AABB& box) const;
+
+    // Removes occluded entries from visible (indices into boxes)
+    void cull(const std::vector<AABB>& boxes, std::vector<unsigned int>& visible, OcclusionStats& stats) const;
+
+    const DepthPyramid& getPyramid() const { return pyramid; }
+
+private:
+    SoftwareRasterizer rasterizer;
+    DepthPyramid pyramid;
+    glm::mat4 pyramidViewProjection;
+
+    std::vector<glm::vec3> occluderVertices;
+    std::vector<unsigned int> occluderIndices;
+};
+
+#endif
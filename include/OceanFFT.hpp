@@ -0,0 +1,110 @@
+#ifndef mOceanFFT
+#define mOceanFFT
+#pragma once
+
+#include <FFT.hpp>
+#include <JobSystem.hpp>
+#include <glm/glm.hpp>
+#include <complex>
+#include <vector>
+
+// Tessendorf's FFT ocean: a Phillips spectrum of random wave amplitudes,
+// fixed at init, is advanced to the current time with the deep water
+// dispersion relation and transformed back to a periodic patch of height,
+// horizontal (choppy) displacement and slope. The patch repeats every
+// patchSize world units; water.vert and water.frag sample it as the
+// displacement and normal textures.
+//
+// All five fields are real, so they are transformed in pairs packed as the
+// real and imaginary parts of one grid: three inverse FFTs per update.
+//
+// An update either runs on the calling thread (update()) or as a job
+// (start() and poll()) writing into the back copy of the maps while the
+// renderer uploads the front one. Nothing here touches OpenGL.
+class OceanFFT {
+public:
+    static const int MIN_SIZE = 64;
+    static const int MAX_SIZE = 512;
+
+    struct Settings {
+        int size;                  // grid points per side, a power of two in MIN_SIZE..MAX_SIZE
+        float patchSize;           // world units the patch covers before it repeats
+        float windSpeed;           // m/s; the largest waves are windSpeed^2 / g long
+        glm::vec2 windDirection;
+        float amplitude;           // Phillips constant
+        float choppiness;          // scale of the horizontal displacement, 0 = heights only
+        float period;              // seconds after which the animation repeats exactly
+        unsigned int seed;
+
+        Settings() : size(256), patchSize(40.0f), windSpeed(4.0f), windDirection(1.0f, 0.6f),
+            amplitude(2.0e-6f), choppiness(0.8f), period(200.0f), seed(1) {}
+    };
+
+    struct Stats {
+        long long updates;
+        double totalMs;            // CPU time of the updates, spectrum to maps
+        double maxMs;
+
+        Stats() : updates(0), totalMs(0.0), maxMs(0.0) {}
+    };
+
+    OceanFFT();
+    ~OceanFFT();
+
+    // False, with a message, if the size is out of range
+    bool init(const Settings& settings);
+    const Settings& getSettings() const { return settings; }
+
+    // Computes the maps for time and makes them current. Must not overlap
+    // with a started update.
+    void update(float time);
+
+    // Starts an update for time as a job unless one is still running (with
+    // no worker threads it runs right here)
+    void start(float time);
+    // True once a started update has finished and its maps are current
+    bool poll();
+    // Waits for a started update, if there is one
+    void finish();
+
+    // Current maps, size * size texels, row z, column x: displacement is
+    // (dx, height, dz, 0) and normals (x, y, z, 0), both in world units
+    const std::vector<glm::vec4>& getDisplacement() const { return maps[front].displacement; }
+    const std::vector<glm::vec4>& getNormals() const { return maps[front].normals; }
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+    // Wave vector and height amplitude of grid point (u, v) at time, the
+    // inputs of the transforms; for checking them against a direct sum
+    glm::vec2 waveVector(int u, int v) const;
+    std::complex<float> heightSpectrum(int u, int v, float time) const;
+
+private:
+    struct Maps {
+        std::vector<glm::vec4> displacement;
+        std::vector<glm::vec4> normals;
+        double ms;
+    };
+
+    void compute(float time, Maps& out);
+    void publish();
+
+    Settings settings;
+    FFT2D fft;
+
+    // Per grid point: h0(k), conj(h0(-k)) and the angular frequency
+    std::vector<std::complex<float>> h0, h0MirrorConj;
+    std::vector<float> omega;
+
+    // Three packed grids: height + i dx, dz + i slope x, slope z
+    std::vector<float> gridRe[3], gridIm[3];
+
+    Maps maps[2];
+    int front;
+    JobSystem::CounterPtr pending;
+    bool ready;                    // finished on the calling thread, not yet published
+    Stats stats;
+};
+
+#endif
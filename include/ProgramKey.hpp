@@ -0,0 +1,65 @@
+#ifndef mProgramKey
+#define mProgramKey
+#pragma once
+
+#include <Reflections.hpp>
+#include <ShadowFilter.hpp>
+#include <string>
+
+// Quality presets pick compile-time variants of the shaders rather than
+// branching on uniforms: --quality low|medium|high, cycled with Q.
+enum QualityPreset { QUALITY_LOW, QUALITY_MEDIUM, QUALITY_HIGH, QUALITY_COUNT };
+
+const char* qualityPresetName(QualityPreset preset);
+// By name, false if there is no such preset
+bool parseQualityPreset(const std::string& name, QualityPreset& preset);
+
+struct QualitySettings {
+    int shadowKernel;              // PCF radius in texels: 0 one tap, 1 3x3, 2 5x5
+    int blurTaps;                  // per side of the separable blur, centre included: 3, 5 or 7
+
+    static QualitySettings preset(QualityPreset preset);
+};
+
+// Compile-time switches a program can be built with. Each program has some
+// of them (ProgramSource::features); a key is masked to those before it
+// picks a variant, so programs without a switch do not get a copy per value
+// of it. Medium quality with PCF and no clipping is what the shaders compile
+// to without any defines.
+enum ProgramFeature {
+    FEATURE_CLIP = 1 << 0,          // CLIP_PLANE: discard on one side of clipHeight
+    FEATURE_SHADOW_FILTER = 1 << 1, // SHADOW_FILTER: a ShadowFilter
+    FEATURE_SHADOW_KERNEL = 1 << 2, // SHADOW_KERNEL: QualitySettings::shadowKernel
+    FEATURE_BLUR_TAPS = 1 << 3,     // BLUR_TAPS: QualitySettings::blurTaps
+    FEATURE_REFLECTIONS = 1 << 4,   // SCREEN_SPACE_REFLECTIONS: a ReflectionMode
+};
+
+struct ProgramKey {
+    bool clip;
+    ShadowFilter shadowFilter;
+    int shadowKernel;
+    int blurTaps;
+    ReflectionMode reflections;
+
+    ProgramKey() : clip(false), shadowFilter(SHADOW_PCF), shadowKernel(1), blurTaps(5), reflections(REFLECTION_PLANAR) {}
+    ProgramKey(ShadowFilter filter, const QualitySettings& quality, ReflectionMode reflections = REFLECTION_PLANAR)
+        : clip(false), shadowFilter(filter), shadowKernel(quality.shadowKernel), blurTaps(quality.blurTaps),
+          reflections(reflections) {}
+
+    ProgramKey withClip(bool c) const { ProgramKey k = *this; k.clip = c; return k; }
+    // The switches outside features back at their defaults
+    ProgramKey masked(unsigned int features) const;
+    // Packed, for comparing keys
+    unsigned int bits() const;
+    // #define lines for the switches in features
+    std::string defines(unsigned int features) const;
+    // "CLIP_PLANE SHADOW_FILTER=2 ...", for messages
+    std::string describe(unsigned int features) const;
+};
+
+// source with the defines placed after its #version line (a UTF-8 BOM and
+// comments before it stay where they are) and a #line directive, so
+// compiler messages keep the file's line numbers
+std::string insertDefines(const std::string& source, const std::string& defines);
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef mPrograms
+#define mPrograms
+#pragma once
+
+#include <ProgramKey.hpp>
+#include <glm/glm.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class Shader;
+
+// Every shader program the renderer uses, fixed at compile time. The names
+// and source files in the table are only looked at while compiling; the
+// frame refers to programs by ProgramId and a ProgramKey and sets their
+// uniforms through the typed parameter structs below, with locations looked
+// up once per compiled variant, so nothing per frame hashes or compares a
+// string.
+enum ProgramId {
+    PROGRAM_TERRAIN,
+    PROGRAM_DEPTH,
+    PROGRAM_BLUR,
+    PROGRAM_FINAL,
+    PROGRAM_BRIGHTPASS,
+    PROGRAM_SKYBOX,
+    PROGRAM_WATER,
+    PROGRAM_HIZ,
+    PROGRAM_SHADOW_MOMENTS,
+    PROGRAM_COUNT
+};
+
+struct ProgramSource {
+    const char* name;
+    const char* vertex;
+    const char* fragment;
+    unsigned int features;         // ProgramFeature switches the sources read
+};
+
+// Inline so the headless benchmarks can use the table without GL
+inline const ProgramSource& programSource(ProgramId id)
+{
+    static const ProgramSource sources[PROGRAM_COUNT] = {
+        { "terrain", "shader.vert", "shader.frag", FEATURE_CLIP | FEATURE_SHADOW_FILTER | FEATURE_SHADOW_KERNEL },
+        { "depth", "depth_shader.vert", "depth_shader.frag", 0 },
+        { "blur", "blur.vert", "blur.frag", FEATURE_BLUR_TAPS },
+        { "final", "final.vert", "final.frag", 0 },
+        { "brightpass", "bright_pass.vert", "bright_pass.frag", 0 },
+        { "skybox", "skybox.vert", "skybox.frag", 0 },
+        { "water", "water.vert", "water.frag", FEATURE_SHADOW_FILTER | FEATURE_SHADOW_KERNEL | FEATURE_REFLECTIONS },
+        { "hiz", "hiz.vert", "hiz.frag", 0 },
+        { "shadowmoments", "depth_shader.vert", "shadow_moments.frag", FEATURE_SHADOW_FILTER },
+    };
+    return sources[id];
+}
+
+// ------------------- PARAMETERS ---------------------
+// One struct per program holding the uniforms that change per draw; samplers
+// and constants are set once per variant (ProgramRegistry::setConstants).
+struct TerrainParams {
+    glm::mat4 viewProjection, model;
+    glm::vec3 viewPos, lightDir;
+    glm::mat4 lightSpaceMatrix;
+    float clipHeight;              // CLIP_PLANE variants only
+    int clipAbove;                 // 1 keeps what is above clipHeight, 0 what is below
+    glm::vec3 shIrradiance[9];     // the ambient, Atmosphere::getIrradiance()
+};
+
+// Shadow map and terrain depth pre-pass
+struct DepthParams {
+    glm::mat4 lightSpaceMatrix, model;
+    float minHeight;               // fragments at or below are dropped
+};
+
+// Shadow map of the prefiltered filters (VSM, ESM)
+struct ShadowMomentsParams {
+    glm::mat4 lightSpaceMatrix, model;
+};
+
+// The sky and the sun's disc, on a fullscreen triangle
+struct SkyboxParams {
+    glm::mat4 inverseViewProjection; // of the camera's rotation only
+    glm::vec3 sunDirection;        // towards the sun, the sky view's azimuth 0
+    glm::vec3 sunColor;            // the disc's HDR radiance
+};
+
+struct WaterParams {
+    glm::mat4 projection, view;
+    glm::mat4 reflectionVP;
+    glm::mat4 lightSpaceMatrix;
+    glm::vec3 viewPos;
+    float time;
+    float normalStrength;
+    glm::vec2 renderScale;         // of the reflection texture the frame covers
+    int hizLevels;                 // SCREEN_SPACE_REFLECTIONS: levels of the Hi-Z pyramid
+};
+
+// renderScale: the part of the full-size targets the frame was rendered
+// into, see ResolutionController
+struct BrightPassParams {
+    float threshold;
+    glm::vec2 renderScale;
+};
+
+struct BlurParams {
+    bool horizontal;
+    glm::vec2 renderScale;
+};
+
+struct FinalParams {
+    float exposure;
+    glm::vec2 renderScale;
+};
+
+// One level of the depth pyramid, see HiZBuffer
+struct HiZParams {
+    bool firstLevel;               // reading the depth buffer rather than the pyramid
+    glm::vec2 sourceSize, targetSize;
+};
+
+// One compiled permutation of a program and the uniform locations of its
+// parameter struct (only its own program's are filled in)
+class ProgramVariant {
+public:
+    ProgramId program;
+    ProgramKey key;                // masked to the program's features
+    std::unique_ptr<Shader> shader;
+    unsigned int ID;
+    double compileMs;
+
+    // Each sets the uniforms of its program, which must be current
+    void apply(const TerrainParams& params) const;
+    void apply(const DepthParams& params) const;
+    void apply(const ShadowMomentsParams& params) const;
+    void apply(const SkyboxParams& params) const;
+    void apply(const WaterParams& params) const;
+    void apply(const BrightPassParams& params) const;
+    void apply(const BlurParams& params) const;
+    void apply(const FinalParams& params) const;
+    void apply(const HiZParams& params) const;
+
+private:
+    friend class ProgramRegistry;
+    void locate();
+
+    struct TerrainLocations { int viewProjection, model, viewPos, lightDir, lightSpaceMatrix, clipHeight, clipAbove,
+        shIrradiance; };
+    struct DepthLocations { int lightSpaceMatrix, model, minHeight; };
+    struct ShadowMomentsLocations { int lightSpaceMatrix, model; };
+    struct SkyboxLocations { int inverseViewProjection, sunDirection, sunColor; };
+    struct WaterLocations {
+        int projection, view, reflectionVP, lightSpaceMatrix, viewPos, time, normalStrength, renderScale, hizLevels;
+    };
+    struct HiZLocations { int firstLevel, sourceSize, targetSize; };
+
+    TerrainLocations terrain;
+    DepthLocations depth;
+    ShadowMomentsLocations moments;
+    SkyboxLocations skybox;
+    WaterLocations water;
+    HiZLocations hiz;
+    int brightThreshold;
+    int blurHorizontal;
+    int finalExposure;
+    int brightRenderScale, blurRenderScale, finalRenderScale;
+};
+
+// Owns the compiled variants. load() builds one per program for the start-up
+// key; others are compiled the first time a pass asks for them (a switch of
+// shadow filter or quality preset) and kept.
+class ProgramRegistry {
+public:
+    // Samplers and constants, set by name on every variant once it is compiled
+    typedef std::function<void(ProgramId, Shader&)> ConstantSetter;
+
+    struct Stats {
+        int variants;
+        double compileMs, maxCompileMs;
+
+        Stats() : variants(0), compileMs(0.0), maxCompileMs(0.0) {}
+    };
+
+    ProgramRegistry();
+    ~ProgramRegistry();
+
+    // Compiles every program in the table from shaderPath for key
+    void load(const std::string& shaderPath, const ProgramKey& key);
+    // Runs on the variants compiled so far and all later ones
+    void setConstants(const ConstantSetter& setter);
+
+    // The variant of id for key, compiled on first use; the reference stays
+    // valid as long as the registry
+    const ProgramVariant& variant(ProgramId id, const ProgramKey& key);
+    // The variant load() compiled
+    const ProgramVariant& get(ProgramId id) const { return *loaded[id]; }
+    unsigned int getID(ProgramId id) const { return loaded[id] ? loaded[id]->ID : 0; }
+
+    const Stats& getStats() const { return stats; }
+
+private:
+    ProgramVariant* compile(ProgramId id, const ProgramKey& key);
+
+    std::string shaderPath;
+    std::vector<std::unique_ptr<ProgramVariant>> variants[PROGRAM_COUNT];
+    ProgramVariant* loaded[PROGRAM_COUNT];
+    ConstantSetter constants;
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef mReflections
+#define mReflections
+#pragma once
+
+#include <string>
+
+// Where water.frag gets its reflection from.
+//   PLANAR  the terrain and sun rendered a second time from the mirrored
+//           camera, clipped at the water, into a full-size target
+//   SSR     the opaque scene already rendered this frame: the reflected ray
+//           is marched in screen space through the scene's Hi-Z pyramid
+//           (nearest and farthest depth per texel, see HiZBuffer) and the
+//           colour copied before the water is read where it hits. Rays
+//           that leave the screen, turn towards the camera past the near
+//           plane or run out of steps fall back to the sky cubemap.
+// SSR is a compile-time variant of the water program (ProgramKey); the
+// planar pass is simply not recorded while it is on. --bench ssr checks the
+// Hi-Z march against a texel-by-texel one.
+enum ReflectionMode {
+    REFLECTION_PLANAR,
+    REFLECTION_SSR,
+    REFLECTION_MODE_COUNT
+};
+
+const char* reflectionModeName(ReflectionMode mode);
+// By name, false if there is no such mode
+bool parseReflectionMode(const std::string& name, ReflectionMode& mode);
+
+struct ReflectionSettings {
+    ReflectionMode mode;           // --reflections planar|ssr, toggled with R
+    int maxSteps;                  // SSR: Hi-Z cells visited before a ray gives up
+    float maxDistance;             // SSR: world units a ray is followed
+    float thickness;               // SSR: view depth behind a surface that still counts as a hit
+
+    ReflectionSettings() : mode(REFLECTION_PLANAR), maxSteps(64), maxDistance(60.0f), thickness(0.4f) {}
+};
+
+#endif
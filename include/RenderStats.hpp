@@ -0,0 +1,118 @@
+#ifndef mRenderStats
+#define mRenderStats
+#pragma once
+
+#include <Atmosphere.hpp>
+#include <Culling.hpp>
+#include <DrawBatch.hpp>
+#include <FrameCapture.hpp>
+#include <GLStateCache.hpp>
+#include <GpuTimer.hpp>
+#include <Occlusion.hpp>
+#include <OceanFFT.hpp>
+#include <Programs.hpp>
+#include <Reflections.hpp>
+#include <RenderTargetPool.hpp>
+#include <ResolutionController.hpp>
+#include <RingBuffer.hpp>
+#include <ShadowFilter.hpp>
+#include <Simulation.hpp>
+#include <WaterClipmap.hpp>
+#include <ostream>
+#include <vector>
+
+// Terrain samples the scene pass shaded, from occlusion queries, and the
+// pixels the frame covered
+struct ShadingStats {
+    int frames;
+    long long samples;
+    long long pixels;
+
+    ShadingStats() : frames(0), samples(0), pixels(0) {}
+    void add(long long frameSamples, long long framePixels)
+    {
+        frames++;
+        samples += frameSamples;
+        pixels += framePixels;
+    }
+};
+
+// GPU time per pass name, from GpuPassTimer; passes sharing a name (the
+// bloom blurs) are added up
+struct PassTimeStats {
+    struct Pass {
+        const char* name;
+        double totalMs;
+    };
+
+    int frames;
+    std::vector<Pass> passes;      // in the order first seen
+
+    PassTimeStats() : frames(0) {}
+    void add(const std::vector<GpuPassTimer::PassTime>& frame);
+};
+
+// Per-frame counters accumulated by renderLoop and printed periodically as
+// per-frame averages.
+struct RenderStats {
+    int frames;
+
+    CullStats shadowCull;
+    CullStats reflectionCull;
+    CullStats sceneCull;
+
+    DrawStats shadowDraw;
+    DrawStats reflectionDraw;
+    DrawStats sceneDraw;
+    DrawStats prepassDraw;
+
+    ShadowSettings shadows;
+
+    bool depthPrepass;
+    ShadingStats terrainShading;
+
+    OcclusionMode occlusionMode;
+    OcclusionStats sceneOcclusion;
+    WaterClipmap::Stats water;
+    OceanFFT::Stats ocean;
+    Atmosphere::Stats atmosphere;
+    float sunElevation;            // degrees, at the last frame
+
+    RingBuffer::Stats indirectRing;
+
+    FrameTimeStats frameTime;
+    Simulation::Settings simulationSettings;
+    Simulation::Stats simulation;
+
+    GLStateCache::Stats stateCache;
+
+    FrameTimeStats gpuTime;        // submitted commands, from timer queries
+    PassTimeStats passTimes;
+    ResolutionController::Settings resolutionSettings;
+    ResolutionController::State resolution;
+    ResolutionController::Stats resolutionStats;
+
+    RenderTargetPool::Stats renderTargets;
+
+    QualityPreset quality;
+    ProgramRegistry::Stats programs;   // since start-up, not reset
+
+    ReflectionMode reflections;
+    // GPU time the water's reflection costs per mode, since start-up, not
+    // reset: planar is the reflection pass plus the water pass, SSR the
+    // scene copy, the Hi-Z build (shared with occlusion culling when that
+    // uses it) and the water pass
+    FrameTimeStats reflectionCost[REFLECTION_MODE_COUNT];
+
+    bool capturing;
+    FrameCapture::Stats capture;       // since start-up, not reset
+
+    RenderStats() { reset(); }
+
+    void reset();
+    // One measured frame into passTimes and reflectionCost
+    void addPassTimes(const std::vector<GpuPassTimer::PassTime>& frame);
+    void print(std::ostream& out) const;
+};
+
+#endif
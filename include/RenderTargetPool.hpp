@@ -0,0 +1,135 @@
+#ifndef mRenderTargetPool
+#define mRenderTargetPool
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// What a render target is: its size, either fixed or a fraction of the
+// pool's reference size (the window), and how it is stored and sampled.
+// GL enums are carried as plain numbers, as in CommandBuffer.
+struct RenderTargetDesc {
+    int width, height;             // texels, 0 x 0 to follow the reference size
+    float scale;                   // of the reference size, per axis
+    unsigned int format;           // sized internal format: GL_RGBA16F, GL_DEPTH_COMPONENT24, ...
+    int samples;                   // 1 for a texture shaders sample
+    unsigned int filter;           // GL_LINEAR, GL_NEAREST
+    unsigned int wrap;             // GL_CLAMP_TO_EDGE; GL_CLAMP_TO_BORDER has a white border
+    unsigned int compare;          // 0, or the depth comparison of a sampler2DShadow (GL_LEQUAL)
+
+    static RenderTargetDesc fixed(int width, int height, unsigned int format, unsigned int filter, unsigned int wrap);
+    static RenderTargetDesc relative(float scale, unsigned int format, unsigned int filter, unsigned int wrap);
+
+    bool isRelative() const { return width == 0 && height == 0; }
+    // Same storage and sampling; the size is compared separately
+    bool compatible(const RenderTargetDesc& o) const
+    {
+        return format == o.format && samples == o.samples && filter == o.filter && wrap == o.wrap
+            && compare == o.compare;
+    }
+};
+
+// A texture handed out by the pool, valid until it is released
+struct RenderTarget {
+    unsigned int texture;
+    int width, height;
+};
+
+// Hands out render targets by descriptor. A target released in the middle
+// of a frame goes to the next pass that asks for a compatible one, so
+// passes whose targets are not alive at the same time share memory. The
+// frame is recorded in pass order and replayed in the same order (see
+// CommandBuffer), so a target may be released as soon as the last pass
+// reading it has been recorded.
+//
+// Relative targets follow the reference size given to beginFrame(). When
+// it changes, idle targets of the old size are freed and the first pass to
+// ask allocates at the new size; nothing is reallocated up front. Targets
+// nobody asked for in a few frames are freed too.
+//
+// Framebuffers are cached per set of attachments and go with them.
+//
+// The GL work is done by a Backend (GLRenderTargetBackend); the pool
+// itself does not touch OpenGL, so --bench rendertargets runs it headless.
+class RenderTargetPool {
+public:
+    class Backend {
+    public:
+        virtual ~Backend() {}
+        virtual unsigned int createTexture(const RenderTargetDesc& desc, int width, int height) = 0;
+        virtual void destroyTexture(unsigned int texture) = 0;
+        // colorTexture or depthTexture may be 0
+        virtual unsigned int createFramebuffer(unsigned int colorTexture, unsigned int depthTexture) = 0;
+        virtual void destroyFramebuffer(unsigned int framebuffer) = 0;
+        virtual size_t bytesPerTexel(unsigned int format) const = 0;
+    };
+
+    struct Settings {
+        int maxIdleFrames;         // frames a free target is kept without being asked for
+
+        Settings() : maxIdleFrames(3) {}
+    };
+
+    struct Stats {
+        int targets;               // allocated now
+        int framebuffers;
+        size_t bytes;              // estimated from format, size and samples
+        size_t peakBytes;
+        long long allocations;
+        long long reuses;          // acquires served by a target allocated earlier
+        long long frees;
+
+        Stats() : targets(0), framebuffers(0), bytes(0), peakBytes(0), allocations(0), reuses(0), frees(0) {}
+    };
+
+    RenderTargetPool();
+    ~RenderTargetPool();
+
+    void init(Backend* backend, const Settings& settings = Settings());
+    // Frees everything; the backend must still be usable
+    void destroy();
+
+    // Reference size of relative targets for this frame, at least 1 x 1
+    void beginFrame(int referenceWidth, int referenceHeight);
+    // Takes back what is still held and frees idle targets
+    void endFrame();
+
+    RenderTarget acquire(const RenderTargetDesc& desc);
+    void release(const RenderTarget& target);
+    // A framebuffer drawing into the given targets; either may be 0
+    unsigned int framebuffer(unsigned int colorTexture, unsigned int depthTexture);
+
+    // Size desc resolves to this frame
+    void resolveSize(const RenderTargetDesc& desc, int& width, int& height) const;
+    size_t targetBytes(const RenderTargetDesc& desc, int width, int height) const;
+
+    const Stats& getStats() const { return stats; }
+    // Keeps the current and peak memory, zeroes the counters
+    void resetStats();
+
+private:
+    struct Entry {
+        RenderTargetDesc desc;
+        RenderTarget target;
+        size_t bytes;
+        bool inUse;
+        long long lastUsedFrame;
+    };
+
+    struct CachedFramebuffer {
+        unsigned int framebuffer;
+        unsigned int color, depth;
+    };
+
+    void free(size_t index);
+
+    Backend* backend;
+    Settings settings;
+    std::vector<Entry> entries;
+    std::vector<CachedFramebuffer> framebuffers;
+    int referenceWidth, referenceHeight;
+    long long frame;
+    Stats stats;
+};
+
+#endif
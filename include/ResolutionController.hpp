@@ -0,0 +1,74 @@
+#ifndef mResolutionController
+#define mResolutionController
+#pragma once
+
+// Picks the internal render resolution from measured GPU frame times. The
+// scene, reflection and bloom targets stay allocated at full size; a frame
+// renders into the lower left scale x scale of them and the final composite
+// upscales that to the window, so changing the scale never reallocates.
+//
+// A PID controller on the relative error (target - ms) / target: the
+// proportional and derivative terms react to load changes, the integral
+// holds the scale the load settles at. The frame time is smoothed first,
+// the integral only moves while the scale is not pinned at a limit in the
+// direction it would push (no windup), and the scale only follows the
+// controller once it has moved a whole step, so noise does not resize the
+// frame every frame. Measurements arrive a few frames late (GPU timer
+// queries), which the gains allow for; --bench resolution runs it against
+// a model of that.
+//
+// Nothing here touches OpenGL.
+class ResolutionController {
+public:
+    struct Settings {
+        double targetMs;           // GPU time budget; 0 keeps maxScale
+        float minScale, maxScale;  // per axis, of the full-size targets
+        float kp, ki, kd;
+        float step;                // the scale moves in multiples of this
+        float smoothing;           // weight of a new measurement in the average
+
+        Settings() : targetMs(14.0), minScale(0.5f), maxScale(1.0f), kp(0.15f), ki(0.04f), kd(0.1f),
+            step(0.025f), smoothing(0.3f) {}
+    };
+
+    struct State {
+        float scale;               // applied
+        float requested;           // controller output before stepping and limits
+        double filteredMs;
+        double error, integral, derivative;
+    };
+
+    struct Stats {
+        int frames;
+        double scaleSum;
+        float minScale, maxScale;  // seen
+        int changes;
+
+        Stats() : frames(0), scaleSum(0.0), minScale(1.0f), maxScale(0.0f), changes(0) {}
+    };
+
+    ResolutionController();
+
+    void init(const Settings& settings);
+    const Settings& getSettings() const { return settings; }
+    bool isEnabled() const { return settings.targetMs > 0.0; }
+
+    // One GPU frame time in; the scale to render the next frame at out
+    float update(double gpuMs);
+
+    float getScale() const { return state.scale; }
+    const State& getState() const { return state; }
+
+    // Counted per frame rendered, not per measurement
+    void countFrame();
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+private:
+    Settings settings;
+    State state;
+    bool measured;
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef mRingBuffer
+#define mRingBuffer
+#pragma once
+
+#include <glad/glad.h>
+#include <vector>
+
+// Streaming buffer for per-frame dynamic data (indirect commands, uniform
+// blocks, debug geometry...). The storage is split into one segment per
+// frame in flight and every frame sub-allocates aligned ranges from its own
+// segment, so the CPU never writes memory the GPU may still be reading.
+//
+// With GL 4.4 / ARB_buffer_storage the buffer is mapped once with
+// GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT and a fence per segment tells
+// when it can be reused; waiting on such a fence is counted as a stall.
+// Without it allocations are staged in client memory, uploaded with
+// glBufferSubData, and the buffer is orphaned each time the ring wraps.
+class RingBuffer {
+public:
+    struct Allocation {
+        void* data;          // write here, then call flush()
+        GLintptr offset;     // offset in the GL buffer
+        GLsizeiptr size;
+    };
+
+    struct Stats {
+        int frames;
+        int stalls;            // frames that had to wait for a fence
+        double stallMs;        // total time spent waiting
+        int overflows;         // allocations that did not fit their segment
+        long long bytes;       // bytes allocated
+
+        Stats() : frames(0), stalls(0), stallMs(0.0), overflows(0), bytes(0) {}
+    };
+
+    RingBuffer();
+
+    void init(GLenum target, GLsizeiptr segmentSize, int framesInFlight = 3);
+    void destroy();
+
+    void beginFrame();
+    void endFrame();
+
+    // data is nullptr when the segment is full
+    Allocation allocate(GLsizeiptr size, GLsizeiptr alignment = 16);
+    // Makes the written range visible to GL (a no-op when persistently mapped)
+    void flush(const Allocation& allocation);
+
+    void bind() const { glBindBuffer(target, buffer); }
+    unsigned int getBuffer() const { return buffer; }
+    bool isPersistent() const { return persistent; }
+    GLsizeiptr getSegmentSize() const { return segmentSize; }
+    // Bytes still free in this frame's segment (before alignment)
+    GLsizeiptr remaining() const { return segmentSize - head; }
+
+    const Stats& getStats() const { return stats; }
+    void resetStats() { stats = Stats(); }
+
+private:
+    GLenum target;
+    unsigned int buffer;
+    bool persistent;
+
+    unsigned char* mapped;                 // persistent mapping
+    std::vector<unsigned char> staging;    // fallback client copy
+
+    GLsizeiptr segmentSize;
+    int framesInFlight;
+    int segment;
+    GLsizeiptr head;
+    std::vector<GLsync> fences;
+
+    Stats stats;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef mSampleCounter
+#define mSampleCounter
+#pragma once
+
+#include <glad/glad.h>
+
+// Samples that pass the depth test between begin() and end(), counted with
+// GL_SAMPLES_PASSED queries in a ring like GpuTimer's: fetch() returns
+// counts a few frames old and never stalls. With early depth testing that
+// is close to the fragments shaded.
+class SampleCounter {
+public:
+    SampleCounter();
+
+    void init();
+    void destroy();
+
+    void begin();
+    void end();
+
+    // The newest finished count not fetched yet; false if none
+    bool fetch(long long& samples);
+
+private:
+    static const int SLOTS = 4;
+
+    unsigned int queries[SLOTS];
+    bool pending[SLOTS];
+    int writeSlot;
+};
+
+#endif
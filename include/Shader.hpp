@@ -24,6 +24,11 @@ public:
   // ------------------------------------------------------------------------
   Shader(const std::string vertexPath, const std::string fragmentPath);
 
+  // a permutation: defines (#define lines) go after #version in both stages
+  // ------------------------------------------------------------------------
+  Shader(const std::string vertexPath, const std::string fragmentPath,
+         const std::string &defines);
+
   // activate the shader
   // ------------------------------------------------------------------------
   void use();
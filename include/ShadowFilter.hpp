@@ -0,0 +1,43 @@
+#ifndef mShadowFilter
+#define mShadowFilter
+#pragma once
+
+#include <string>
+
+// How shader.frag and water.frag filter the shadow map. The numbers are
+// the shadowFilter uniform.
+//   PCF           3x3 nearest depth fetches compared in the shader
+//   HARDWARE_PCF  sampler2DShadow with linear filtering: four fetches, each
+//                 a bilinear blend of four comparisons, 16 texels in all
+//   VSM           depth and depth^2 in an RG32F map blurred before use,
+//                 one fetch and Chebyshev's bound
+//   ESM           exp(c (depth - 1)) in an R32F map blurred before use,
+//                 one fetch
+// The two prefiltered modes render a smaller colour map (momentMapSize)
+// and blur it with the bloom blur; --bench shadows compares all four.
+enum ShadowFilter {
+    SHADOW_PCF,
+    SHADOW_HARDWARE_PCF,
+    SHADOW_VSM,
+    SHADOW_ESM,
+    SHADOW_FILTER_COUNT
+};
+
+const char* shadowFilterName(ShadowFilter filter);
+// By name, false if there is no such filter
+bool parseShadowFilter(const std::string& name, ShadowFilter& filter);
+
+struct ShadowSettings {
+    ShadowFilter filter;           // --shadow-filter NAME, cycled with F
+    int mapSize;                   // depth map of the PCF modes
+    int momentMapSize;             // moment map of VSM and ESM
+    float vsmBleedReduction;       // VSM: visibility below this is cut to zero
+    float esmExponent;             // ESM: c; higher is sharper but overflows sooner
+
+    ShadowSettings() : filter(SHADOW_HARDWARE_PCF), mapSize(4096), momentMapSize(2048), vsmBleedReduction(0.3f),
+        esmExponent(80.0f) {}
+
+    bool prefiltered() const { return filter == SHADOW_VSM || filter == SHADOW_ESM; }
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef mSimdLanes
+#define mSimdLanes
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMD_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include <cmath>
+
+// Inner loops are written once against these and instantiated for a single
+// float and, where available, four floats in an SSE register. Callers keep
+// a scalar loop for whatever is left over after the last full register.
+struct ScalarLanes {
+    typedef float V;
+    static const int WIDTH = 1;
+    static V load(const float* p) { return *p; }
+    static void store(float* p, V v) { *p = v; }
+    static V set(float v) { return v; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return a / b; }
+    static V sqrt(V a) { return std::sqrt(a); }
+};
+
+#ifdef SIMD_SSE
+struct SseLanes {
+    typedef __m128 V;
+    static const int WIDTH = 4;
+    static V load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, V v) { _mm_storeu_ps(p, v); }
+    static V set(float v) { return _mm_set1_ps(v); }
+    static V add(V a, V b) { return _mm_add_ps(a, b); }
+    static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+    static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+    static V div(V a, V b) { return _mm_div_ps(a, b); }
+    static V sqrt(V a) { return _mm_sqrt_ps(a); }
+};
+#endif
+
+#endif
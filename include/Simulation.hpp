@@ -0,0 +1,136 @@
+#ifndef mSimulation
+#define mSimulation
+#pragma once
+
+#include <Camera.hpp>
+#include <glm/glm.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// Input gathered on the main thread between two frames. Keys are the
+// current state, mouse and scroll offsets accumulate until a tick uses them.
+struct InputState {
+    bool forward, backward, left, right;
+    float mouseX, mouseY;
+    float scroll;
+
+    InputState() : forward(false), backward(false), left(false), right(false),
+        mouseX(0.0f), mouseY(0.0f), scroll(0.0f) {}
+};
+
+// Everything the render thread needs from the simulation for one frame,
+// interpolated between the last two ticks. Built by value and never shared.
+struct RenderPacket {
+    glm::vec3 cameraPosition;
+    float cameraYaw, cameraPitch, cameraZoom;
+    float time;                // simulation seconds: water waves, day cycle
+    glm::vec3 lightDir;
+    long long tick;            // newest tick that went into the packet
+    float alpha;               // 0 = previous tick, 1 = newest
+
+    // A camera placed as the packet says, for the code that wants one
+    Camera makeCamera() const;
+};
+
+// Frame-to-frame times, for judging how even the pacing is
+struct FrameTimeStats {
+    int frames;
+    double sumMs, sumSqMs, maxMs;
+
+    FrameTimeStats() : frames(0), sumMs(0.0), sumSqMs(0.0), maxMs(0.0) {}
+
+    void add(double ms);
+    double meanMs() const;
+    double stddevMs() const;
+};
+
+// Fixed-timestep update stage: camera movement, light animation and
+// simulation time advance in ticks of 1 / tickRate seconds, independent of
+// the frame rate. With threaded on (the default) ticks run on their own
+// thread, so a slow tick only delays the simulation and never the frame;
+// frames interpolate between the last two ticks, rendering one tick behind.
+// With threaded off the ticks run inside packet() on the render thread, the
+// usual accumulator loop, which is what the frame-time numbers are compared
+// against.
+//
+// loadMs burns that much CPU time in every tick, and four times as much in
+// every 16th, to stand in for heavier simulation work.
+//
+// With frameStep set the clock is the frame count instead: every packet()
+// moves the simulation on by exactly frameStep seconds, however long the
+// frame took, and runs the ticks that makes due on the render thread
+// without ever skipping any. Frame capture uses it so the frames land at
+// the rate written into the video.
+class Simulation {
+public:
+    struct Settings {
+        double tickRate;
+        bool threaded;
+        double loadMs;
+        float dayLength;           // seconds for the sun to go once round the sky
+        double frameStep;          // > 0: seconds per packet() instead of the clock, threaded ignored
+
+        Settings() : tickRate(60.0), threaded(true), loadMs(0.0), dayLength(300.0f), frameStep(0.0) {}
+    };
+
+    struct Stats {
+        long long ticks;
+        long long lateTicks;       // started more than a tick behind schedule
+        long long droppedTicks;    // skipped to catch up
+        double maxTickMs;
+
+        Stats() : ticks(0), lateTicks(0), droppedTicks(0), maxTickMs(0.0) {}
+    };
+
+    Simulation();
+    ~Simulation();
+
+    void start(const Camera& camera, const Settings& settings = Settings());
+    void stop();
+
+    // Main thread, once per frame
+    void submitInput(const InputState& input);
+    RenderPacket packet();
+
+    const Settings& getSettings() const { return settings; }
+    Stats getStats();
+    void resetStats();
+
+private:
+    struct State {
+        glm::vec3 position;
+        float yaw, pitch, zoom;
+        float time;
+        glm::vec3 lightDir;
+        long long tick;
+        double stamp;              // seconds after start() the tick was due
+    };
+
+    double now() const;
+    bool ticksOnRenderThread() const { return !settings.threaded || settings.frameStep > 0.0; }
+    void runDueTicks(double t);
+    void step(double dt, double stamp);
+    void threadMain();
+
+    Settings settings;
+    std::chrono::steady_clock::time_point startTime;
+    long long packets;             // frameStep's clock
+
+    // Owned by whichever thread runs the ticks
+    Camera camera;
+    State current;
+    double nextDue;
+
+    // Shared between the ticks and packet()
+    std::mutex mutex;
+    State previous, latest;
+    InputState input;
+    Stats stats;
+
+    std::thread thread;
+    std::atomic<bool> running;
+};
+
+#endif
@@ -1,20 +1,35 @@
 #pragma once
-#include <string>
-#include <iostream>
-#include <glad/glad.h> // or GLEW
+#include <cstring>
 
+// Layout of a 4x3 cubemap cross. The sky is drawn by the atmosphere now, so
+// all that is left is the GL-free face extraction the texture baker shares.
 class SkyBox {
-    int width, height, channels;
-    std::string imagePath;
-    unsigned int textureID; // OpenGL texture handle
-
 public:
-    
-    // Constructor: takes path to the cross image
-    SkyBox(const std::string& path);
-
-    unsigned char* extractFace(unsigned char* src, int faceSize, int xOffset, int yOffset, int width, int channels);
-    unsigned int loadCubemapFromCross(const std::string& path);
+    // Top-left texel of face i (GL_TEXTURE_CUBE_MAP_POSITIVE_X + i) in a 4x3 cross
+    static void faceOrigin(int face, int faceSize, int& x, int& y)
+    {
+        // Map your layout: row 0 = top, row1 = middle, row2 = bottom
+        // columns 0..3
+        static const int offsets[6][2] = {
+            {2, 1}, // POSITIVE_X
+            {0, 1}, // NEGATIVE_X
+            {1, 0}, // POSITIVE_Y (top)
+            {1, 2}, // NEGATIVE_Y (bottom)
+            {1, 1}, // POSITIVE_Z (front)
+            {3, 1}  // NEGATIVE_Z (back)
+        };
+        x = offsets[face][0] * faceSize;
+        y = offsets[face][1] * faceSize;
+    }
 
-    unsigned int getTextureID() const { return textureID; }
+    // Copies one face into dst (faceSize * faceSize * channels bytes), a row at a time
+    static void extractFace(const unsigned char* src, int faceSize, int xOffset, int yOffset,
+        int imgWidth, int channels, unsigned char* dst)
+    {
+        size_t rowBytes = (size_t)faceSize * channels;
+        for (int y = 0; y < faceSize; ++y) {
+            const unsigned char* srcRow = src + ((size_t)(y + yOffset) * imgWidth + xOffset) * channels;
+            memcpy(dst + y * rowBytes, srcRow, rowBytes);
+        }
+    }
 };
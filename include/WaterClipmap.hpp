@@ -0,0 +1,93 @@
+#ifndef mWaterClipmap
+#define mWaterClipmap
+#pragma once
+
+#include <Culling.hpp>
+#include <glm/glm.hpp>
+#include <vector>
+
+// One instance of the water tile mesh; laid out as the vec4 instance
+// attribute water.vert reads
+struct WaterTile {
+    float x, z;                    // corner with the smallest coordinates
+    float size;
+    float level;                   // 0 = finest
+};
+
+// Level-of-detail selection for the water surface. Every tile is the same
+// gridResolution x gridResolution grid, scaled by powers of two and drawn
+// instanced; a quadtree over the water square is refined around the camera,
+// so the tiles form concentric rings that double in size (and in spacing
+// between vertices) with every level. The number of tiles grows with the
+// logarithm of the water size, not its area.
+//
+// Seams between levels are closed by morphing rather than by stitching
+// strips: within the outer quarter of its range a tile slides its odd
+// vertices onto their even neighbours, so at the edge of the range it has
+// become exactly the next coarser grid (the same scheme as CDLOD). Ranges
+// are chosen so that a coarser tile next to a finer one has not started
+// to morph yet along their shared edge. morphFactor() and morphGrid() are the
+// CPU side of the same maths in water.vert.
+//
+// Nothing here touches OpenGL.
+class WaterClipmap {
+public:
+    static const int MAX_LEVELS = 16;
+
+    struct Settings {
+        int gridResolution;        // quads per tile side, a power of two
+        float leafSize;            // world size of the finest tiles
+        float size;                // side of the water square, centred on the origin
+        // LOD range of a level, in its tile sizes. Seams stay closed only if
+        // it is at least 2 * sqrt(2) / (2 * morphStart - 1)
+        float rangeFactor;
+        float morphStart;          // fraction of the range where morphing begins
+        float height;              // water level
+        float waveAmplitude;       // for the tile bounds
+
+        Settings() : gridResolution(16), leafSize(4.0f), size(20000.0f), rangeFactor(6.0f),
+            morphStart(0.75f), height(0.0f), waveAmplitude(0.1f) {}
+    };
+
+    struct Stats {
+        int nodesTested;           // quadtree nodes tested against range and frustum
+        int tiles;                 // drawn
+        int occluded;              // selected but rejected by occlusion culling
+        long long vertices;        // vertex shader invocations of the drawn tiles
+
+        Stats() : nodesTested(0), tiles(0), occluded(0), vertices(0) {}
+    };
+
+    WaterClipmap();
+
+    void init(const Settings& settings);
+    const Settings& getSettings() const { return settings; }
+
+    int getLevels() const { return levels; }
+    float getTileSize(int level) const;
+    // Distance out to which a level is used, and where its morphing starts
+    float getRange(int level) const { return ranges[level]; }
+    float getMorphStartDistance(int level) const { return ranges[level] * settings.morphStart; }
+    int getTileVertexCount() const { return (settings.gridResolution + 1) * (settings.gridResolution + 1); }
+
+    // The shared tile mesh: vec2 grid positions in [0, 1] and a triangle list
+    void buildTileMesh(std::vector<float>& vertices, std::vector<unsigned int>& indices) const;
+
+    // Replaces tiles with the ones to draw for this camera and frustum
+    void select(const glm::vec3& camera, const Frustum& frustum, std::vector<WaterTile>& tiles, Stats& stats) const;
+
+    AABB tileBounds(const WaterTile& tile) const;
+
+    float morphFactor(const WaterTile& tile, const glm::vec2& grid, const glm::vec3& camera) const;
+    glm::vec2 morphGrid(const glm::vec2& grid, float morph) const;
+
+private:
+    void selectNode(float x, float z, int level, const glm::vec3& camera, const Frustum& frustum,
+        std::vector<WaterTile>& tiles, Stats& stats) const;
+
+    Settings settings;
+    int levels;
+    float ranges[MAX_LEVELS];
+};
+
+#endif
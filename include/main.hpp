@@ -7,7 +7,29 @@
 #include <GLFW/glfw3.h>
 #include <Camera.hpp>
 #include <Shader.hpp>
+#include <Programs.hpp>
 #include <Mesh.hpp>
+#include <Culling.hpp>
+#include <RenderStats.hpp>
+#include <DrawBatch.hpp>
+#include <Occlusion.hpp>
+#include <HiZ.hpp>
+#include <AssetLoader.hpp>
+#include <AssetPack.hpp>
+#include <Simulation.hpp>
+#include <WaterClipmap.hpp>
+#include <OceanFFT.hpp>
+#include <CommandBuffer.hpp>
+#include <GLStateCache.hpp>
+#include <GpuTimer.hpp>
+#include <SampleCounter.hpp>
+#include <ResolutionController.hpp>
+#include <RenderTargetPool.hpp>
+#include <GLRenderTargets.hpp>
+#include <ShadowFilter.hpp>
+#include <Reflections.hpp>
+#include <Atmosphere.hpp>
+#include <FrameCapture.hpp>
 #include <stb_perlin.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -16,31 +38,86 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <memory>
+#include <chrono>
+#include <limits>
+#include <cerrno>
+#include <cstdlib>
+#include <type_traits>
 
 const unsigned int SCR_WIDTH = 1920;
 const unsigned int SCR_HEIGHT = 1080;
 
+// Window framebuffer, which the final composite fills. The render targets
+// follow it (see RenderTargetPool); the frame covers a scaled part of them.
+int windowWidth = SCR_WIDTH;
+int windowHeight = SCR_HEIGHT;
+// --res-target MS (0 = fixed), --res-min S, --res-max S
+ResolutionController::Settings resolutionSettings;
+
+// Starting camera for the simulation; rebuilt from the render packet every frame
 Camera camera(glm::vec3(0.0f, 5.0f, 10.0f));
 
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
+// Input since the last frame, handed to the simulation by renderLoop
+InputState frameInput;
+// --sim-inline ticks on the render thread, --sim-load MS adds CPU cost per tick
+Simulation::Settings simulationSettings;
+
+OcclusionMode occlusionMode = OCCLUSION_HIZ; // cycled with O
+bool depthPrepass = true; // terrain depth before shading; --no-prepass, toggled with P
+ShadowSettings shadowSettings; // --shadow-filter pcf|hardware|vsm|esm, cycled with F
+QualityPreset qualityPreset = QUALITY_MEDIUM; // --quality low|medium|high, cycled with Q
+ReflectionSettings reflectionSettings; // --reflections planar|ssr, toggled with R
+CaptureSettings captureSettings; // --capture DIR, --capture-format png|y4m, --capture-frames N, --capture-fps N, --capture-queue N
+bool headless = false; // --headless: GLFW's null platform with an OSMesa or surfaceless EGL context (GLFW 3.4+)
+
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 unsigned int quadVAO = 0;
 unsigned int quadVBO;
 
-const float DAY_LENGTH = 300.0f; // seconds per full day (adjust)
+// Startup timing: from entering main() to the first presented frame
+std::chrono::steady_clock::time_point startupTime;
+bool asyncAssets = true; // --sync-assets loads textures before the first frame
+bool looseAssets = false; // --loose-assets ignores assets.pack and reads res/ directly
+unsigned int terrainSeed = 0; // --seed N: reproducible terrain, cached in res/heightfields
+OceanFFT::Settings oceanSettings; // --ocean-size N: FFT grid of the waves, 64..512
+
+const float DAY_LENGTH = 300.0f; // seconds per full day, --day-length S
+const float WATER_LEVEL = -0.01f; // before the waves, which are clamped to 0.005..0.05
+const float STATS_INTERVAL = 5.0f; // seconds between render stats reports
+const float TERRAIN_MIN_HEIGHT = 0.01f; // shader.frag discards terrain up to here (seaLevel + 0.01)
+const float NEAR_PLANE = 0.1f; // of the scene and reflection cameras
+const float FAR_PLANE = 5000.0f;
+
+struct WaterGeometry {
+    unsigned int VAO, VBO, EBO;
+    unsigned int instanceVBO;
+    GLsizei indexCount;
+};
+
+// The ocean maps, size x size RGBA16F with mipmaps, repeating
+struct OceanTextures {
+    unsigned int displacement;
+    unsigned int normals;
+};
 
-std::unordered_map<std::string, Shader> shaders;
+struct SceneTextures {
+    AssetLoader::Handle waterNormals;
+};
 
-struct BloomBuffers {
-    unsigned int hdrFBO;
-    unsigned int colorBuffers[2];
-    unsigned int pingpongFBO[2];
-    unsigned int pingpongColorbuffers[2];
+// The atmosphere's sky-view LUT, which the sky is drawn from, and the small
+// cubemap the water reflects, RGB16F; with the versions last uploaded
+struct SkyTextures {
+    unsigned int skyView;
+    unsigned int environment;
+    long long skyViewVersion;
+    long long faceVersions[Atmosphere::CUBE_FACES];
 };
 
 struct Vertex {
@@ -54,34 +131,45 @@ struct Vertex {
 
 // Function declarations
 // Main
-int main();
+int main(int argc, char** argv);
 
 // GLFW / OpenGL init
 GLFWwindow* initGLFW();
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 
-// Mesh & Shadow setup
+// Mesh setup
 void setupMesh(const Mesh& terrain, unsigned int& VAO, unsigned int& VBO, unsigned int& EBO);
-void setupShadowMap(unsigned int& depthMapFBO, unsigned int& depthMap, const unsigned int SHADOW_WIDTH, const unsigned int SHADOW_HEIGHT);
-unsigned int setupSun();
+unsigned int createSkyVAO();
 
 // Render helpers
-void setupBloomBuffers(BloomBuffers& bloom, unsigned int width, unsigned int height);
-void renderSun(Shader* sunShader, unsigned int sunVAO, glm::vec3 lightDir, glm::mat4 projection, glm::mat4 view);
+void recordSky(CommandBuffer& commands, const ProgramRegistry& programs, unsigned int skyVAO,
+    unsigned int skyViewTexture, glm::vec3 sunDir, glm::vec3 sunColor, const glm::mat4& view,
+    const glm::mat4& projection, const RenderState& state);
 
 // Render loop
 void renderLoop(GLFWwindow* window,
-    std::unordered_map<std::string, std::unique_ptr<Shader>>& shaders,
+    ProgramRegistry& programs,
     const Mesh& terrain, unsigned int terrainVAO,
-	const Mesh& waterMesh, unsigned int waterVAO,
-    unsigned int depthMapFBO, unsigned int depthMap);
+    const WaterClipmap& waterLod, const WaterGeometry& water,
+    glm::vec3 islandCenter,
+    AssetLoader& assets, const SceneTextures& textures);
+
+// Terrain chunks
+void cullTerrain(const BVH& bvh, const glm::mat4& viewProjection,
+    std::vector<unsigned int>& visible, CullStats& stats);
 
+// Fullscreen quad: positions and texture coordinates, drawn as a 4-vertex strip
+unsigned int getQuadVAO();
 void renderQuad();
 
-unsigned int loadWaterNormalMap(const char* path);
-unsigned int createWaterPlaneVAO(std::vector<float>& outVertices, std::vector<unsigned int>& outIndices, unsigned int& VAO, unsigned int& VBO, unsigned int& EBO);
+void createWaterTilesVAO(const WaterClipmap& lod, WaterGeometry& water);
+void createOceanTextures(int size, OceanTextures& textures);
+void uploadOceanMaps(const OceanFFT& ocean, const OceanTextures& textures);
+void createSkyTextures(const Atmosphere& atmosphere, SkyTextures& textures);
+void uploadSky(const Atmosphere& atmosphere, SkyTextures& textures);
 // Input
 void processInput(GLFWwindow* window);
 #endif
\ No newline at end of file
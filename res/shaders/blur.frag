@@ -5,28 +5,47 @@ in vec2 TexCoords;
 
 uniform sampler2D image;
 uniform bool horizontal;
+uniform vec2 renderScale; // part of the image the frame covers
 
+// Taps stay inside the rendered part; beyond it is an older frame
+vec3 tap(vec2 uv, vec2 texel)
+{
+    return texture(image, clamp(uv, texel * 0.5, renderScale - texel * 0.5)).rgb;
+}
+
+// Taps each side of the centre, centre included, as the quality preset
+// picks (ProgramKey); binomial weights, the outermost of the wider rows cut
+#ifndef BLUR_TAPS
+#define BLUR_TAPS 5
+#endif
+#if BLUR_TAPS == 3
+const float weights[3] = float[](0.375, 0.25, 0.0625);
+#elif BLUR_TAPS == 7
+const float weights[7] = float[](0.1964826, 0.1746512, 0.1222558, 0.0666850, 0.0277854, 0.0085494, 0.0018320);
+#else
 const float weights[5] = float[](0.227027, 0.1945946, 0.1216216, 0.054054, 0.016216);
+#endif
 
 void main()
 {
     vec2 tex_offset = 1.0 / textureSize(image, 0); // size of 1 texel
-    vec3 result = texture(image, TexCoords).rgb * weights[0];
+    vec2 uv = TexCoords * renderScale;
+    vec3 result = tap(uv, tex_offset) * weights[0];
 
     if(horizontal)
     {
-        for(int i = 1; i < 5; ++i)
+        for(int i = 1; i < BLUR_TAPS; ++i)
         {
-            result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weights[i];
-            result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weights[i];
+            result += tap(uv + vec2(tex_offset.x * i, 0.0), tex_offset) * weights[i];
+            result += tap(uv - vec2(tex_offset.x * i, 0.0), tex_offset) * weights[i];
         }
     }
     else
     {
-        for(int i = 1; i < 5; ++i)
+        for(int i = 1; i < BLUR_TAPS; ++i)
         {
-            result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weights[i];
-            result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weights[i];
+            result += tap(uv + vec2(0.0, tex_offset.y * i), tex_offset) * weights[i];
+            result += tap(uv - vec2(0.0, tex_offset.y * i), tex_offset) * weights[i];
         }
     }
 
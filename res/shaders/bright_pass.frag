@@ -5,10 +5,11 @@ in vec2 TexCoords;
 
 uniform sampler2D scene;
 uniform float threshold; // brightness cutoff
+uniform vec2 renderScale; // part of the scene texture the frame covers
 
 void main()
 {
-    vec3 color = texture(scene, TexCoords).rgb;
+    vec3 color = texture(scene, TexCoords * renderScale).rgb;
     float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
     if (brightness > threshold)
         FragColor = vec4(color, 1.0);
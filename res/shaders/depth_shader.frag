@@ -1,6 +1,12 @@
 #version 330 core
+in float WorldHeight;
+
+// The pre-pass drops what shader.frag discards; the shadow pass keeps all
+uniform float minHeight;
+
 void main()
 {
-    // Fragment shader is empty because we only need depth
-    // The depth is automatically written to the depth buffer
+    // Only depth is written
+    if (WorldHeight <= minHeight)
+        discard;
 }
@@ -1,8 +1,17 @@
 #version 330 core
 layout(location=0) in vec3 aPos;
 uniform mat4 model;
+// The light's for shadows, the camera's for the terrain depth pre-pass
 uniform mat4 lightSpaceMatrix;
 
+out float WorldHeight;
+
+// Same expression as shader.vert, so the pre-pass depth matches the
+// shading pass exactly and GL_EQUAL passes
+invariant gl_Position;
+
 void main(){
-    gl_Position = lightSpaceMatrix * model * vec4(aPos,1.0);
+    vec4 worldPos = model * vec4(aPos, 1.0);
+    WorldHeight = worldPos.y;
+    gl_Position = lightSpaceMatrix * worldPos;
 }
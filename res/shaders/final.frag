@@ -5,11 +5,50 @@ in vec2 TexCoords;
 uniform sampler2D scene;
 uniform sampler2D bloomBlur;
 uniform float exposure;
+// Part of scene and bloomBlur the frame was rendered into; below 1 the
+// scene is upscaled here
+uniform vec2 renderScale;
+
+// Catmull-Rom through nine bilinear fetches (the two middle weights of
+// each axis folded into one fetch), clamped to the rendered part. Sharper
+// than bilinear when upscaling; the ringing can go negative, so clamped.
+vec3 sampleCatmullRom(sampler2D tex, vec2 uv)
+{
+    vec2 texSize = vec2(textureSize(tex, 0));
+    vec2 lo = 0.5 / texSize, hi = renderScale - 0.5 / texSize;
+
+    vec2 samplePos = uv * texSize;
+    vec2 center = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - center;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+    vec2 w12 = w1 + w2;
+
+    vec2 p0 = clamp((center - 1.0) / texSize, lo, hi);
+    vec2 p12 = clamp((center + w2 / w12) / texSize, lo, hi);
+    vec2 p3 = clamp((center + 2.0) / texSize, lo, hi);
+
+    vec3 result =
+        (texture(tex, vec2(p0.x, p0.y)).rgb * w0.x + texture(tex, vec2(p12.x, p0.y)).rgb * w12.x
+            + texture(tex, vec2(p3.x, p0.y)).rgb * w3.x) * w0.y
+        + (texture(tex, vec2(p0.x, p12.y)).rgb * w0.x + texture(tex, vec2(p12.x, p12.y)).rgb * w12.x
+            + texture(tex, vec2(p3.x, p12.y)).rgb * w3.x) * w12.y
+        + (texture(tex, vec2(p0.x, p3.y)).rgb * w0.x + texture(tex, vec2(p12.x, p3.y)).rgb * w12.x
+            + texture(tex, vec2(p3.x, p3.y)).rgb * w3.x) * w3.y;
+    return max(result, vec3(0.0));
+}
 
 void main()
 {
-    vec3 hdrColor = texture(scene, TexCoords).rgb;
-    vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
+    vec2 uv = TexCoords * renderScale;
+    vec3 hdrColor = renderScale.x < 1.0 || renderScale.y < 1.0
+        ? sampleCatmullRom(scene, uv)
+        : texture(scene, uv).rgb;
+    // Blurred anyway: bilinear is enough
+    vec3 bloomColor = texture(bloomBlur, uv).rgb;
     hdrColor += bloomColor; // add bloom
 
     // Reinhard tone mapping  keeps bright stuff visible
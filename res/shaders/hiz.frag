@@ -0,0 +1,40 @@
+#version 330 core
+out vec2 Depth;
+
+// Depth texture for the first level, the pyramid after that. The caller
+// points the base level at the level being reduced.
+uniform sampler2D source;
+uniform bool firstLevel;
+// Texels of the source that hold data (the depth buffer may only be
+// partly rendered, see ResolutionController) and of the level being written
+uniform vec2 sourceSize;
+uniform vec2 targetSize;
+
+// Farthest and nearest depth of the source texels this texel covers: the
+// first for occlusion culling, the second for the screen-space reflection
+// march in water.frag. Every texel covers
+// at most three source texels a side: two, plus one shared with the
+// neighbour where the sizes do not divide evenly.
+void main()
+{
+    ivec2 dst = ivec2(gl_FragCoord.xy);
+    vec2 ratio = sourceSize / targetSize;
+    ivec2 last = ivec2(sourceSize) - 1;
+    ivec2 first = min(ivec2(floor(vec2(dst) * ratio)), last);
+    ivec2 end = min(ivec2(ceil(vec2(dst + 1) * ratio)) - 1, last);
+
+    vec2 depth = vec2(0.0, 1.0);
+    for (int y = 0; y < 3; ++y) {
+        for (int x = 0; x < 3; ++x) {
+            ivec2 src = first + ivec2(x, y);
+            if (src.x <= end.x && src.y <= end.y) {
+                vec2 texel = texelFetch(source, src, 0).rg;
+                if (firstLevel)
+                    texel.y = texel.x;
+                depth = vec2(max(depth.x, texel.x), min(depth.y, texel.y));
+            }
+        }
+    }
+
+    Depth = depth;
+}
@@ -2,20 +2,84 @@
 
 in vec3 FragPos;
 in vec3 Normal;
+#ifdef CLIP_PLANE
 in float clipDist;   // <-- comes from vertex shader
+#endif
+
+// Compile-time switches, see ProgramKey; these are the defaults
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER 0
+#endif
+#ifndef SHADOW_KERNEL
+#define SHADOW_KERNEL 1
+#endif
 
 out vec4 FragColor;
 
 uniform vec3 viewPos;
 uniform vec3 lightDir;
-uniform sampler2D shadowMap;
+uniform sampler2D shadowMap;              // depth, or moments for VSM / ESM
+uniform sampler2DShadow shadowCompareMap;  // depth, hardware compared
 uniform mat4 lightSpaceMatrix;
 
-uniform int clipAbove;
+uniform float vsmBleedReduction;
+uniform float esmExponent;
 
 uniform float seaLevel;
 
-// Shadow calculation unchanged
+// The sky's irradiance as SH9, already convolved with the cosine lobe, see
+// EnvironmentLighting
+uniform vec3 shIrradiance[9];
+
+vec3 skyIrradiance(vec3 n)
+{
+    vec3 e = shIrradiance[0] * 0.282095
+        + shIrradiance[1] * (0.488603 * n.y)
+        + shIrradiance[2] * (0.488603 * n.z)
+        + shIrradiance[3] * (0.488603 * n.x)
+        + shIrradiance[4] * (1.092548 * n.x * n.y)
+        + shIrradiance[5] * (1.092548 * n.y * n.z)
+        + shIrradiance[6] * (0.315392 * (3.0 * n.z * n.z - 1.0))
+        + shIrradiance[7] * (1.092548 * n.x * n.z)
+        + shIrradiance[8] * (0.546274 * (n.x * n.x - n.y * n.y));
+    return max(e, vec3(0.0));
+}
+
+// 0 PCF: (2 SHADOW_KERNEL + 1)^2 nearest fetches; 1 hardware: bilinear
+// compares of shadowCompareMap two texels apart, (SHADOW_KERNEL + 1)^2 of
+// them; 2 VSM and 3 ESM: one fetch of a blurred moment map. Only the
+// active mode's map is bound. Returns 0 lit .. 1 shadowed.
+float filterShadow(vec2 uv, float z)
+{
+#if SHADOW_FILTER == 1
+    vec2 texel = 1.0 / textureSize(shadowCompareMap, 0);
+    float lit = 0.0;
+    for (int x = -SHADOW_KERNEL; x <= SHADOW_KERNEL; x += 2)
+        for (int y = -SHADOW_KERNEL; y <= SHADOW_KERNEL; y += 2)
+            lit += texture(shadowCompareMap, vec3(uv + vec2(x, y) * texel, z));
+    return 1.0 - lit / float((SHADOW_KERNEL + 1) * (SHADOW_KERNEL + 1));
+#elif SHADOW_FILTER == 2
+    vec2 moments = texture(shadowMap, uv).rg;
+    if (z <= moments.x)
+        return 0.0;
+    // Chebyshev's upper bound on the lit fraction, with the tail cut off
+    // to hide light bleeding between overlapping occluders
+    float variance = max(moments.y - moments.x * moments.x, 0.00002);
+    float d = z - moments.x;
+    float lit = variance / (variance + d * d);
+    return 1.0 - clamp((lit - vsmBleedReduction) / (1.0 - vsmBleedReduction), 0.0, 1.0);
+#elif SHADOW_FILTER == 3
+    return 1.0 - clamp(texture(shadowMap, uv).r * exp(-esmExponent * (z - 1.0)), 0.0, 1.0);
+#else
+    float shadow = 0.0;
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    for (int x = -SHADOW_KERNEL; x <= SHADOW_KERNEL; ++x)
+        for (int y = -SHADOW_KERNEL; y <= SHADOW_KERNEL; ++y)
+            shadow += z > texture(shadowMap, uv + vec2(x, y) * texelSize).r ? 1.0 : 0.0;
+    return shadow / float((2 * SHADOW_KERNEL + 1) * (2 * SHADOW_KERNEL + 1));
+#endif
+}
+
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 norm)
 {
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
@@ -24,25 +88,17 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 norm)
     if (projCoords.z > 1.0)
         return 0.0;
 
-    float shadow = 0.0;
     float bias = max(0.002 * (1.0 - dot(norm, -lightDir)), 0.01);
-    float texelSize = 1.0 / textureSize(shadowMap, 0).x;
-
-    for (int x = -1; x <= 1; ++x)
-        for (int y = -1; y <= 1; ++y)
-        {
-            float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r;
-            shadow += projCoords.z - bias > pcfDepth ? 1.0 : 0.0;
-        }
-
-    return shadow / 9.0;
+    return filterShadow(projCoords.xy, projCoords.z - bias);
 }
 
 void main()
 {
     // ---------- CLIPPING ----------
-    if (clipAbove != -1 && clipDist < 0.0)
+#ifdef CLIP_PLANE
+    if (clipDist < 0.0)
         discard;
+#endif
 
 
     // ---------- HEIGHT FADE ----------
@@ -70,7 +126,7 @@ void main()
     vec3 norm = normalize(Normal);
     vec3 lightDirection = normalize(-lightDir);
 
-    vec3 ambient = 0.1 * baseColor;
+    vec3 ambient = skyIrradiance(norm) * baseColor;
     float diff = max(dot(norm, lightDirection), 0.0);
     vec3 diffuse = diff * baseColor;
 
@@ -7,21 +7,28 @@ out vec3 FragPos;
 out vec3 Normal;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 viewProjection;
 
+// Only the reflection's variant clips; see ProgramKey
+#ifdef CLIP_PLANE
 uniform float clipHeight;
 uniform int clipAbove;
 out float clipDist;
+#endif
+
+// Matches depth_shader.vert, see there
+invariant gl_Position;
 
 void main()
 {
     vec4 worldPos = model * vec4(aPos, 1.0);
     Normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * worldPos;
+    gl_Position = viewProjection * worldPos;
     FragPos = vec3(model * vec4(aPos,1.0));
 
+#ifdef CLIP_PLANE
     clipDist = clipAbove == 1
         ? worldPos.y - clipHeight
         : clipHeight - worldPos.y;
+#endif
 }
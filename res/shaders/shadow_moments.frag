@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+// What the prefiltered shadow modes store instead of depth; see
+// ShadowFilter.hpp. SHADOW_FILTER is 2 (VSM) or 3 (ESM), see ProgramKey.
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER 2
+#endif
+uniform float esmExponent;
+
+void main()
+{
+    // The light's projection is orthographic, so depth is linear already
+    float depth = gl_FragCoord.z;
+#if SHADOW_FILTER == 2
+    FragColor = vec4(depth, depth * depth, 0.0, 1.0);
+#else
+    // Scaled by exp(-c) so the far plane, and the white border, is 1
+    FragColor = vec4(exp(esmExponent * (depth - 1.0)), 0.0, 0.0, 1.0);
+#endif
+}
@@ -1,14 +1,52 @@
 #version 330 core
 out vec4 FragColor;
 
-in vec3 TexCoords;
-uniform samplerCube skybox;
-uniform float exposure = 0.5; // tweak for brightness
+in vec3 ViewRay;
+// Linear radiance by azimuth from the sun (u) and zenith angle packed
+// around the horizon (v), from the CPU; see Atmosphere::skyViewCoordinates
+uniform sampler2D skyView;
+uniform float horizonZenith;
+uniform vec3 sunDirection;
+uniform vec3 sunColor;          // HDR radiance at the disc's centre, through the air
+uniform float sunAngularRadius; // radians; larger than the real sun's so bloom has something to spread
+
+const vec3 LIMB_DARKENING = vec3(0.397, 0.503, 0.652);
+
+const float PI = 3.14159265358979;
+
+// The sun's disc, darker towards the limb: intensity mu^k with mu the
+// cosine between the sun's surface normal and the view, k per channel
+// (a common power-law fit), so the edge is also redder
+vec3 sunDisc(vec3 dir)
+{
+    float angle = acos(clamp(dot(dir, sunDirection), -1.0, 1.0));
+    // A pixel's worth of smoothing at the edge
+    float coverage = 1.0 - smoothstep(sunAngularRadius - fwidth(angle), sunAngularRadius, angle);
+    if (coverage <= 0.0)
+        return vec3(0.0);
+    float r = min(angle / sunAngularRadius, 1.0);
+    float mu = sqrt(max(1.0 - r * r, 1e-4));
+    return sunColor * pow(vec3(mu), LIMB_DARKENING) * coverage;
+}
 
 void main()
 {
-    vec3 color = texture(skybox, TexCoords).rgb;
-    color = pow(color, vec3(2.2)); // gamma correction
-    color *= exposure;             // scale brightness
-    FragColor = vec4(color, 1.0);
+    vec3 dir = normalize(ViewRay);
+    float zenith = acos(clamp(dir.y, -1.0, 1.0));
+    float v = zenith < horizonZenith
+        ? 0.5 * (1.0 - sqrt(max(1.0 - zenith / horizonZenith, 0.0)))
+        : 0.5 + 0.5 * sqrt(max((zenith - horizonZenith) / (PI - horizonZenith), 0.0));
+
+    // The sky is symmetric about the sun's vertical plane
+    float u = 0.0;
+    if (length(dir.xz) > 1e-6 && length(sunDirection.xz) > 1e-6)
+        u = acos(clamp(dot(normalize(dir.xz), normalize(sunDirection.xz)), -1.0, 1.0)) / PI;
+
+    // u and v run from the first texel centre to the last
+    vec2 size = vec2(textureSize(skyView, 0));
+    vec2 uv = (vec2(u, v) * (size - 1.0) + 0.5) / size;
+    // Below the horizon the planet hides the sun; fwidth needs every pixel
+    // to evaluate the disc
+    vec3 sun = sunDisc(dir) * step(cos(horizonZenith), dir.y);
+    FragColor = vec4(texture(skyView, uv).rgb + sun, 1.0);
 }
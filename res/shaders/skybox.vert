@@ -1,14 +1,17 @@
 #version 330 core
-layout(location = 0) in vec3 aPos;
 
-out vec3 TexCoords;
+// One triangle over the whole screen, corners from gl_VertexID: no vertex
+// buffer. It sits on the far plane and is drawn after the opaque geometry,
+// so early depth testing drops every pixel something already covers.
+out vec3 ViewRay;
 
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat4 inverseViewProjection;  // of the camera's rotation only
 
 void main()
 {
-    TexCoords = aPos;
-    vec4 pos = projection * view * vec4(aPos, 1.0);
-    gl_Position = pos.xyww; // w = depth, keep cube at infinity
+    vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2) * 2.0 - 1.0;
+    gl_Position = vec4(pos, 1.0, 1.0);
+    // w is the same over the far plane, so the direction interpolates linearly
+    vec4 world = inverseViewProjection * vec4(pos, 1.0, 1.0);
+    ViewRay = world.xyz / world.w;
 }
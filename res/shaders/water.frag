@@ -3,6 +3,7 @@ out vec4 FragColor;
 
 in vec3 FragPos;
 in vec2 TexCoords;
+in vec2 OceanUV;
 in vec4 ReflectedClipPos;
 in mat3 TBN;
 
@@ -10,15 +11,154 @@ uniform vec3 viewPos;
 uniform vec3 islandPos;
 uniform float time;
 
-uniform sampler2D reflectionTex;
-uniform sampler2D shadowMap;
-uniform samplerCube skyCubemap;
+uniform sampler2D reflectionTex;          // planar: the mirrored scene
+uniform sampler2D shadowMap;              // depth, or moments for VSM / ESM
+uniform sampler2DShadow shadowCompareMap;  // depth, hardware compared
+uniform samplerCube skyCubemap;  // mip m prefiltered for roughness m / skyMaxLod
+uniform float skyMaxLod;
+uniform float waterRoughness;
 uniform sampler2D normalMap;
+uniform sampler2D oceanNormalMap;  // world space, from the FFT slopes
 
 uniform mat4 lightSpaceMatrix;
 uniform float normalStrength;
+uniform vec2 renderScale;  // part of reflectionTex (sceneColorTex) the frame covers
+
+// Compile-time switches, see ProgramKey; these are the defaults
+#ifndef SHADOW_FILTER
+#define SHADOW_FILTER 0
+#endif
+#ifndef SHADOW_KERNEL
+#define SHADOW_KERNEL 1
+#endif
+
+uniform float vsmBleedReduction;
+uniform float esmExponent;
+
+#ifdef SCREEN_SPACE_REFLECTIONS
+uniform sampler2D sceneColorTex;  // the opaque scene, copied before the water
+uniform sampler2D hizTex;         // its (farthest, nearest) depth pyramid, see HiZBuffer
+uniform int hizLevels;
+uniform mat4 view;
+uniform mat4 projection;
+uniform float nearPlane;
+uniform float farPlane;
+uniform int ssrMaxSteps;
+uniform float ssrMaxDistance;
+uniform float ssrThickness;
+
+float linearDepth(float depth)
+{
+    float z = depth * 2.0 - 1.0;
+    return 2.0 * nearPlane * farPlane / (farPlane + nearPlane - z * (farPlane - nearPlane));
+}
+
+// Frame texture coordinates and window depth
+vec3 toScreen(vec3 worldPos)
+{
+    vec4 clip = projection * view * vec4(worldPos, 1.0);
+    return clip.xyz / clip.w * 0.5 + 0.5;
+}
+
+// Marches the ray through the nearest-depth pyramid. In screen space
+// (texture coordinates and window depth) a ray is a straight line, so each
+// step finds where it leaves the cell it is in: if the ray is still in
+// front of the nearest depth there when it does, nothing in the cell can
+// be hit and it moves on a level coarser; otherwise it drops a level, and
+// at level 0 it hits unless it is more than ssrThickness behind the
+// surface. --bench ssr runs the same march on the CPU. Returns how much
+// to trust the hit, 0 for a miss.
+float traceScreenSpace(vec3 origin, vec3 dir, out vec2 hitUV)
+{
+    // Stop short of the near plane when the ray comes back at the camera
+    vec3 viewOrigin = (view * vec4(origin, 1.0)).xyz;
+    vec3 viewDir = mat3(view) * dir;
+    float len = ssrMaxDistance;
+    if (viewDir.z > 0.0)
+        len = min(len, 0.99 * (-nearPlane - viewOrigin.z) / viewDir.z);
+
+    vec3 o = toScreen(origin);
+    vec3 d = toScreen(origin + dir * len) - o;
+    // Where the ray leaves the screen, and per axis the side of a cell it
+    // leaves through
+    vec2 exitSide = step(0.0, d.xy);
+    vec2 invD = 1.0 / max(abs(d.xy), vec2(1e-7)) * sign(d.xy + vec2(1e-12));
+    vec2 tScreen = (exitSide - o.xy) * invD;
+    float tMax = min(1.0, min(tScreen.x, tScreen.y));
+
+    // Off the texel the ray starts in
+    float t = 0.5 / float(textureSize(hizTex, 0).x) * abs(invD.x);
+    t = min(t, 0.5 / float(textureSize(hizTex, 0).y) * abs(invD.y));
+    int level = 0;
+    for (int i = 0; i < ssrMaxSteps && t < tMax; ++i) {
+        vec2 size = vec2(textureSize(hizTex, level));
+        vec3 p = o + d * t;
+        // On a cell edge the cell is the one the ray is heading into
+        vec2 cell = clamp(floor(p.xy * size + sign(d.xy) * 0.001), vec2(0.0), size - 1.0);
+        vec2 tCell = ((cell + exitSide) / size - o.xy) * invD;
+        float tOut = min(min(tCell.x, tCell.y), tMax);
+        float nearest = texelFetch(hizTex, ivec2(cell), level).g;
+        // Farthest the ray gets inside the cell
+        float rayDepth = o.z + d.z * (d.z > 0.0 ? tOut : t);
+        if (rayDepth < nearest) {
+            t = tOut + 1e-5;
+            level = min(level + 1, hizLevels - 1);
+        }
+        else {
+            // Nothing in the cell is nearer, so the ray can skip to that depth
+            if (d.z > 0.0)
+                t = max(t, (nearest - o.z) / d.z);
+            if (level > 0) {
+                level--;
+                continue;
+            }
+            vec3 hit = o + d * t;
+            if (linearDepth(hit.z) - linearDepth(nearest) < ssrThickness) {
+                hitUV = hit.xy;
+                // Fade out towards the screen edges and the end of the ray
+                vec2 edge = smoothstep(0.0, 0.08, hitUV) * smoothstep(0.0, 0.08, 1.0 - hitUV);
+                return edge.x * edge.y * (1.0 - smoothstep(0.7, 1.0, t));
+            }
+            t = tOut + 1e-5;
+        }
+    }
+    hitUV = vec2(0.0);
+    return 0.0;
+}
+#endif
 
 
+// The shadow filters of shader.frag; 0 lit .. 1 shadowed
+float filterShadow(vec2 uv, float z)
+{
+#if SHADOW_FILTER == 1
+    vec2 texel = 1.0 / textureSize(shadowCompareMap, 0);
+    float lit = 0.0;
+    for (int x = -SHADOW_KERNEL; x <= SHADOW_KERNEL; x += 2)
+        for (int y = -SHADOW_KERNEL; y <= SHADOW_KERNEL; y += 2)
+            lit += texture(shadowCompareMap, vec3(uv + vec2(x, y) * texel, z));
+    return 1.0 - lit / float((SHADOW_KERNEL + 1) * (SHADOW_KERNEL + 1));
+#elif SHADOW_FILTER == 2
+    vec2 moments = texture(shadowMap, uv).rg;
+    if (z <= moments.x)
+        return 0.0;
+    // Chebyshev's upper bound on the lit fraction, with the tail cut off
+    // to hide light bleeding between overlapping occluders
+    float variance = max(moments.y - moments.x * moments.x, 0.00002);
+    float d = z - moments.x;
+    float lit = variance / (variance + d * d);
+    return 1.0 - clamp((lit - vsmBleedReduction) / (1.0 - vsmBleedReduction), 0.0, 1.0);
+#elif SHADOW_FILTER == 3
+    return 1.0 - clamp(texture(shadowMap, uv).r * exp(-esmExponent * (z - 1.0)), 0.0, 1.0);
+#else
+    float shadow = 0.0;
+    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
+    for (int x = -SHADOW_KERNEL; x <= SHADOW_KERNEL; ++x)
+        for (int y = -SHADOW_KERNEL; y <= SHADOW_KERNEL; ++y)
+            shadow += z > texture(shadowMap, uv + vec2(x, y) * texelSize).r ? 1.0 : 0.0;
+    return shadow / float((2 * SHADOW_KERNEL + 1) * (2 * SHADOW_KERNEL + 1));
+#endif
+}
 
 float ShadowCalculation(vec4 fragPosLightSpace)
 {
@@ -30,16 +170,7 @@ float ShadowCalculation(vec4 fragPosLightSpace)
         return 0.0;
 
     float bias = 0.005;
-    float shadow = 0.0;
-    vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-
-    for (int x = -1; x <= 1; ++x)
-        for (int y = -1; y <= 1; ++y)
-            shadow += projCoords.z - bias >
-                      texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r
-                      ? 1.0 : 0.0;
-
-    return shadow / 9.0;
+    return filterShadow(projCoords.xy, projCoords.z - bias);
 }
 
 void main()
@@ -57,12 +188,18 @@ void main()
     vec2 distortion =
         vec2(sin(time + dist), cos(time + dist)) * 0.01 * islandInfluence;
 
-    vec3 normalTex =
-        texture(normalMap, uv + distortion).xyz * 2.0 - 1.0;
+    // Only x and y are read so baked two-channel (BC5) maps work too
+    vec3 normalTex;
+    normalTex.xy = texture(normalMap, uv + distortion).xy * 2.0 - 1.0;
+    normalTex.z = sqrt(max(1.0 - dot(normalTex.xy, normalTex.xy), 0.0));
 
     normalTex.xy *= normalStrength;
 
-    vec3 waterNormal = normalize(TBN * normalTex);
+    // Detail on top of the FFT waves, blended as whiteout (y is up)
+    vec3 detailNormal = TBN * normalTex;
+    vec3 oceanNormal = normalize(texture(oceanNormalMap, OceanUV).xyz);
+    vec3 waterNormal = normalize(vec3(oceanNormal.x + detailNormal.x, oceanNormal.y * detailNormal.y,
+                                      oceanNormal.z + detailNormal.z));
 
     // ===== FRESNEL =====
     float ndotv = max(dot(waterNormal, viewDir), 0.0);
@@ -78,24 +215,32 @@ void main()
     // ===== REFLECTION =====
     float distToCam = distance(FragPos, viewPos);
 
+    vec3 skyReflection = textureLod(
+        skyCubemap,
+        reflect(-viewDir, waterNormal),
+        waterRoughness * skyMaxLod
+    ).rgb;
+
+#ifdef SCREEN_SPACE_REFLECTIONS
+    // The scene where the reflected ray hits it, the sky where it does not
+    vec2 hitUV;
+    float hit = traceScreenSpace(FragPos, reflect(-viewDir, waterNormal), hitUV);
+    vec3 sceneReflection = texture(sceneColorTex, hitUV * renderScale).rgb;
+    vec3 reflection = mix(skyReflection, sceneReflection, hit);
+#else
     // planar reflections only near camera
     float planarFade = clamp(1.0 - distToCam / 150.0, 0.0, 1.0);
 
     vec2 ndc = ReflectedClipPos.xy / ReflectedClipPos.w;
     vec2 reflUV = ndc * 0.5 + 0.5 + waterNormal.xz * 0.05;
 
-    reflUV = clamp(reflUV, 0.001, 0.999);
+    reflUV = clamp(reflUV, 0.001, 0.999) * renderScale;
 
     vec3 planarReflection = texture(reflectionTex, reflUV).rgb;
-    vec3 skyReflection = texture(
-        skyCubemap,
-        reflect(-viewDir, waterNormal)
-    ).rgb;
-
-
 
     // fade planar → sky
     vec3 reflection = mix(skyReflection, planarReflection, planarFade);
+#endif
 
 
     // ===== SHADOW =====
@@ -1,54 +1,63 @@
 #version 330 core
-layout(location = 0) in vec3 aPos;
-layout(location = 1) in vec3 aNormal;
-layout(location = 2) in vec2 aTexCoords;
-layout(location = 3) in vec3 aTangent;
-layout(location = 4) in vec3 aBitangent;
+layout(location = 0) in vec2 aGrid;    // 0..1 across the tile
+layout(location = 5) in vec4 aTile;    // corner x, corner z, size, LOD level
 
 out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
+out vec2 OceanUV;
 out vec4 ReflectedClipPos;
 out mat3 TBN;
 
-uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 uniform mat4 reflectionVP;
+uniform vec3 viewPos;
 
-uniform float time;
 uniform float minHeight;
 uniform float maxHeight;
+uniform float waterLevel;
+
+// Displacement (dx, height, dz) of the FFT patch, patchSize units across
+uniform sampler2D displacementMap;
+uniform float patchSize;
+
+// See WaterClipmap: quads per tile side, and per level the distances where
+// morphing towards the next coarser grid starts and ends
+uniform float gridResolution;
+uniform vec2 morphRanges[16];
 
 void main()
 {
-    // --- WORLD POSITION FIRST ---
-    vec4 worldPos = model * vec4(aPos, 1.0);
-    vec3 worldXZ = worldPos.xyz;
+    // --- LOD MORPH ---
+    // Odd grid vertices slide onto their even neighbours as the tile nears
+    // the end of its range, so its edge matches the coarser ring outside it
+    vec2 worldXZ = aTile.xy + aGrid * aTile.z;
+    vec2 range = morphRanges[int(aTile.w)];
+    float dist = distance(viewPos, vec3(worldXZ.x, waterLevel, worldXZ.y));
+    float morph = clamp((dist - range.x) / (range.y - range.x), 0.0, 1.0);
+    vec2 odd = fract(aGrid * gridResolution * 0.5) * 2.0;
+    vec2 grid = aGrid - odd / gridResolution * morph;
+    worldXZ = aTile.xy + grid * aTile.z;
 
-    // --- SAME WAVES, BUT WORLD-SPACE ---
-    float wave1 = sin(worldXZ.x * 0.5 + worldXZ.z * 0.4 + time * 0.8) * 0.03;
-    float wave2 = cos(worldXZ.x * 0.45 - worldXZ.z * 0.55 + time * 0.9) * 0.025;
-    float wave3 = sin((worldXZ.x + worldXZ.z) * 0.48 + time * 1.0) * 0.02;
-    float wave4 = cos((worldXZ.x - worldXZ.z) * 0.35 + time * 1.2) * 0.015;
-    float wave5 = sin((worldXZ.x * 0.6 + worldXZ.z * 0.5) + time * 0.7) * 0.01;
+    // --- FFT WAVES ---
+    // One repeating patch (OceanFFT), read at the mip level whose texels
+    // are as far apart as this tile's vertices
+    OceanUV = worldXZ / patchSize;
+    float texelsPerVertex = aTile.z / gridResolution * float(textureSize(displacementMap, 0).x) / patchSize;
+    vec3 displacement = textureLod(displacementMap, OceanUV, max(log2(texelsPerVertex), 0.0)).xyz;
 
-    float totalWave = wave1 + wave2 + wave3 + wave4 + wave5;
-
-    worldPos.y += totalWave;
+    vec4 worldPos = vec4(worldXZ.x + displacement.x, waterLevel + displacement.y, worldXZ.y + displacement.z, 1.0);
     worldPos.y = clamp(worldPos.y, minHeight, maxHeight);
 
     FragPos = worldPos.xyz;
 
     // --- NORMALS ---
-    Normal = normalize(mat3(transpose(inverse(model))) * aNormal);
-
-    vec3 T = normalize(mat3(model) * aTangent);
-    vec3 B = normalize(mat3(model) * aBitangent);
-    vec3 N = normalize(mat3(model) * aNormal);
-    TBN = mat3(T, B, N);
+    // Flat here: water.frag takes the normal from the FFT and detail maps
+    Normal = vec3(0.0, 1.0, 0.0);
+    TBN = mat3(vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, 1.0), Normal);
 
-    TexCoords = aTexCoords;
+    TexCoords = worldXZ * 0.05;
 
     ReflectedClipPos = reflectionVP * worldPos;
     gl_Position = projection * view * worldPos;
@@ -0,0 +1,345 @@
+#include <AssetLoader.hpp>
+#include <JobSystem.hpp>
+#include <Ktx2.hpp>
+
+#include <stb_image.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+static GLenum formatForChannels(int channels)
+{
+    switch (channels) {
+    case 1: return GL_RED;
+    case 2: return GL_RG;
+    case 3: return GL_RGB;
+    default: return GL_RGBA;
+    }
+}
+
+void AssetLoader::ImageDeleter::operator()(unsigned char* pixels) const
+{
+    stbi_image_free(pixels);
+}
+
+static double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+AssetLoader::AssetLoader() : supportsBC5(false), supportsBC7(false), stopping(false)
+{
+}
+
+AssetLoader::~AssetLoader()
+{
+    shutdown();
+}
+
+void AssetLoader::init(const Settings& settings)
+{
+    this->settings = settings;
+    stats = Stats();
+    startTime = std::chrono::steady_clock::now();
+    stopping = false;
+    pending = JobSystem::instance().makeCounter();
+    // Without workers nothing would run the decode jobs between frames
+    if (JobSystem::instance().getWorkerCount() == 0)
+        this->settings.async = false;
+
+    // Read here on the GL thread, the jobs only look at the flags.
+    // RGTC (BC5) is core since 3.0, so any context we create has it.
+    supportsBC5 = true;
+    supportsBC7 = GLAD_GL_VERSION_4_2 || GLAD_GL_ARB_texture_compression_bptc;
+
+    if (this->settings.async)
+        staging.init(GL_PIXEL_UNPACK_BUFFER, settings.uploadBudget);
+}
+
+void AssetLoader::shutdown()
+{
+    // Queued decodes see the flag and return without decoding
+    stopping = true;
+    JobSystem::instance().wait(pending);
+
+    for (Upload& upload : uploads)
+        if (upload.texture)
+            glDeleteTextures(1, &upload.texture);
+    uploads.clear();
+    std::unique_ptr<Decoded> discard;
+    while (decoded.pop(discard)) {}
+
+    for (Texture& texture : textures)
+        if (texture.id)
+            glDeleteTextures(1, &texture.id);
+    textures.clear();
+
+    staging.destroy();
+}
+
+// ------------------- REQUESTS ---------------------
+AssetLoader::Handle AssetLoader::addTexture(const std::string& path, const glm::vec4& placeholder)
+{
+    unsigned char texel[4] = {
+        (unsigned char)(glm::clamp(placeholder.x, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(placeholder.y, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(placeholder.z, 0.0f, 1.0f) * 255.0f + 0.5f),
+        (unsigned char)(glm::clamp(placeholder.w, 0.0f, 1.0f) * 255.0f + 0.5f)
+    };
+
+    Texture texture;
+    texture.path = path;
+    texture.resident = false;
+    glGenTextures(1, &texture.id);
+
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    textures.push_back(texture);
+    stats.requested++;
+    return (Handle)textures.size() - 1;
+}
+
+AssetLoader::Handle AssetLoader::requestTexture2D(const std::string& path, bool flipVertically,
+    const glm::vec4& placeholder)
+{
+    Request request;
+    request.handle = addTexture(path, placeholder);
+    request.path = path;
+    request.flip = flipVertically;
+
+    if (settings.async) {
+        submit(request);
+    }
+    else {
+        decoded.push(decode(request));
+        update();
+    }
+    return request.handle;
+}
+
+// ------------------- DECODE JOBS ---------------------
+void AssetLoader::submit(const Request& request)
+{
+    JobSystem::instance().run([this, request]() {
+        if (!stopping)
+            decoded.push(decode(request));
+    }, pending);
+}
+
+bool AssetLoader::openBaked(const Request& request, Decoded& image) const
+{
+    std::string path = request.path.substr(0, request.path.find_last_of('.')) + ".ktx2";
+    AssetPack::Blob file = AssetPack::instance().find(path);
+    if (file.empty())
+        return false;
+
+    Ktx2Texture ktx;
+    if (!readKtx2(file.data, file.size, ktx))
+        return false;
+    if (ktx.faces != 1
+        || (ktx.format == KTX2_FORMAT_BC5 && !supportsBC5)
+        || (ktx.format == KTX2_FORMAT_BC7 && !supportsBC7))
+        return false;
+
+    image.baked = file;
+    image.ktxFormat = ktx.format;
+    image.levels = (int)ktx.levels.size();
+    image.width = ktx.width;
+    image.height = ktx.height;
+    image.channels = 4;
+
+    // Largest level first so the texture is complete as soon as possible
+    for (int level = 0; level < image.levels; ++level) {
+        Slice slice = { level, ktx.levelWidth(level), ktx.levelHeight(level),
+            ktx.levels[level].offset, ktx.levels[level].size };
+        image.slices.push_back(slice);
+    }
+    image.ok = true;
+    return true;
+}
+
+std::unique_ptr<AssetLoader::Decoded> AssetLoader::decode(const Request& request) const
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<Decoded> image(new Decoded());
+    image->handle = request.handle;
+    image->ok = false;
+    image->width = image->height = image->channels = 0;
+    image->ktxFormat = 0;
+    image->levels = 1;
+
+    if (openBaked(request, *image)) {
+        image->decodeMs = millisecondsSince(start);
+        return image;
+    }
+
+    // stbi_set_flip_vertically_on_load is global state, so flips are done here
+    int w, h, c;
+    AssetPack::Blob file = AssetPack::instance().find(request.path);
+    if (!file.empty())
+        image->pixels.reset(stbi_load_from_memory(file.data, (int)file.size, &w, &h, &c, 0));
+    if (image->pixels) {
+        image->width = w;
+        image->height = h;
+        image->channels = c;
+
+        if (request.flip) {
+            size_t rowBytes = (size_t)w * c;
+            std::vector<unsigned char> row(rowBytes);
+            unsigned char* pixels = image->pixels.get();
+            for (int y = 0; y < h / 2; ++y) {
+                unsigned char* top = pixels + y * rowBytes;
+                unsigned char* bottom = pixels + (h - 1 - y) * rowBytes;
+                memcpy(row.data(), top, rowBytes);
+                memcpy(top, bottom, rowBytes);
+                memcpy(bottom, row.data(), rowBytes);
+            }
+        }
+        Slice whole = { 0, w, h, 0, 0 };
+        image->slices.push_back(whole);
+        image->ok = true;
+    }
+
+    image->decodeMs = millisecondsSince(start);
+    return image;
+}
+
+// ------------------- UPLOADS ---------------------
+void AssetLoader::update()
+{
+    std::unique_ptr<Decoded> image;
+    while (decoded.pop(image)) {
+        stats.decodeMs += image->decodeMs;
+        if (!image->ok) {
+            std::cout << "Failed to load texture: " << textures[image->handle].path << "\n";
+            stats.failed++;
+            continue;
+        }
+        stats.decoded++;
+        if (!image->baked.empty())
+            stats.baked++;
+
+        Upload upload;
+        upload.image = std::move(image);
+        upload.nextSlice = 0;
+        glGenTextures(1, &upload.texture);
+        uploads.push_back(std::move(upload));
+    }
+
+    if (uploads.empty())
+        return;
+
+    if (settings.async)
+        staging.beginFrame();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    bool first = true;
+    while (!uploads.empty()) {
+        Upload& upload = uploads.front();
+        if (!uploadSlice(upload, first))
+            break;
+        first = false;
+        if (upload.nextSlice == upload.image->slices.size()) {
+            finish(upload);
+            uploads.pop_front();
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (settings.async)
+        staging.endFrame();
+    if (!first)
+        stats.uploadFrames++;
+
+    if (allResident() && stats.allResidentMs < 0.0) {
+        stats.allResidentMs = millisecondsSince(startTime);
+        std::cout << "Assets: " << stats.resident << " textures resident after " << stats.allResidentMs
+            << " ms (" << stats.baked << " baked, " << stats.bytesUploaded / (1024 * 1024) << " MB over "
+            << stats.uploadFrames << " frames, " << stats.decodeMs << " ms decoding, "
+            << stats.textureBytes / (1024 * 1024) << " MB of textures)\n";
+    }
+}
+
+bool AssetLoader::uploadSlice(Upload& upload, bool firstThisFrame)
+{
+    const Decoded& image = *upload.image;
+    const Slice& slice = image.slices[upload.nextSlice];
+
+    // Both baked levels and decoded images are contiguous
+    bool baked = !image.baked.empty();
+    GLsizeiptr bytes = baked ? (GLsizeiptr)slice.bytes
+        : (GLsizeiptr)((size_t)slice.width * slice.height * image.channels);
+    const unsigned char* origin = baked ? image.baked.data + slice.offset : image.pixels.get();
+
+    const void* source = origin;
+    bool staged = false;
+    if (settings.async) {
+        if (bytes + 4 <= staging.remaining()) {
+            RingBuffer::Allocation allocation = staging.allocate(bytes, 4);
+            memcpy(allocation.data, origin, bytes);
+            staging.flush(allocation);
+            staging.bind();
+            source = (const void*)allocation.offset;
+            staged = true;
+        }
+        else if (!firstThisFrame || bytes <= staging.getSegmentSize() - 4) {
+            // Over budget: the rest waits for the next frame
+            return false;
+        }
+        // else a single slice larger than the whole budget goes straight from client memory
+    }
+
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    if (image.ktxFormat == KTX2_FORMAT_BC7 || image.ktxFormat == KTX2_FORMAT_BC5) {
+        GLenum internalFormat = image.ktxFormat == KTX2_FORMAT_BC7
+            ? GL_COMPRESSED_RGBA_BPTC_UNORM : GL_COMPRESSED_RG_RGTC2;
+        glCompressedTexImage2D(GL_TEXTURE_2D, slice.level, internalFormat, slice.width, slice.height, 0,
+            (GLsizei)bytes, source);
+    }
+    else if (image.ktxFormat == KTX2_FORMAT_RGBA8) {
+        glTexImage2D(GL_TEXTURE_2D, slice.level, GL_RGBA8, slice.width, slice.height, 0, GL_RGBA,
+            GL_UNSIGNED_BYTE, source);
+    }
+    else {
+        GLenum format = formatForChannels(image.channels);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, slice.width, slice.height, 0, format, GL_UNSIGNED_BYTE, source);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (staged)
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    stats.bytesUploaded += bytes;
+    // Mips generated on the GPU add another third
+    stats.textureBytes += baked ? bytes : bytes * 4 / 3;
+    upload.nextSlice++;
+    return true;
+}
+
+void AssetLoader::finish(Upload& upload)
+{
+    Texture& texture = textures[upload.image->handle];
+
+    glBindTexture(GL_TEXTURE_2D, upload.texture);
+    // Baked files carry their own mip chain
+    if (!upload.image->baked.empty())
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, upload.image->levels - 1);
+    else
+        glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDeleteTextures(1, &texture.id);
+    texture.id = upload.texture;
+    texture.resident = true;
+    upload.texture = 0;
+    stats.resident++;
+}
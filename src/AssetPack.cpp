@@ -0,0 +1,267 @@
+#include <AssetPack.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+static const char PACK_MAGIC[8] = { 'O', 'G', 'L', 'P', 'A', 'C', 'K', '1' };
+static const uint32_t PACK_VERSION = 1;
+static const size_t PACK_HEADER_SIZE = 24;
+static const size_t PACK_ENTRY_SIZE = 32;
+static const size_t PACK_ALIGNMENT = 16;
+
+struct PackEntry {
+    uint64_t nameHash;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    uint64_t dataOffset;
+    uint64_t size;
+};
+
+static PackEntry readEntry(const unsigned char* p)
+{
+    PackEntry e;
+    memcpy(&e.nameHash, p, 8);
+    memcpy(&e.nameOffset, p + 8, 4);
+    memcpy(&e.nameLength, p + 12, 4);
+    memcpy(&e.dataOffset, p + 16, 8);
+    memcpy(&e.size, p + 24, 8);
+    return e;
+}
+
+AssetPack& AssetPack::instance()
+{
+    static AssetPack pack;
+    return pack;
+}
+
+// FNV-1a, 64 bit
+unsigned long long AssetPack::hashName(const std::string& name)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for (unsigned char c : name) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool AssetPack::open(const std::string& packPath, const std::string& looseRoot)
+{
+    close();
+    this->looseRoot = looseRoot;
+    if (packPath.empty())
+        return false;
+
+    if (!file.open(packPath)) {
+        std::cout << "Asset pack " << packPath << " not found, reading loose files from " << looseRoot << "\n";
+        return false;
+    }
+
+    const unsigned char* data = file.getData();
+    uint32_t version = 0, entries = 0;
+    uint64_t stringsOffset = 0;
+    if (file.getSize() >= PACK_HEADER_SIZE) {
+        memcpy(&version, data + 8, 4);
+        memcpy(&entries, data + 12, 4);
+        memcpy(&stringsOffset, data + 16, 8);
+    }
+    if (file.getSize() < PACK_HEADER_SIZE || memcmp(data, PACK_MAGIC, sizeof(PACK_MAGIC)) != 0
+        || version != PACK_VERSION || PACK_HEADER_SIZE + (uint64_t)entries * PACK_ENTRY_SIZE > file.getSize()
+        || stringsOffset > file.getSize()) {
+        std::cout << "Asset pack " << packPath << " is invalid, reading loose files\n";
+        file.close();
+        return false;
+    }
+
+    count = entries;
+    std::cout << "Asset pack: " << count << " files, " << file.getSize() / 1024 << " KB mapped\n";
+    return true;
+}
+
+void AssetPack::close()
+{
+    file.close();
+    count = 0;
+}
+
+std::string AssetPack::relativeName(const std::string& name) const
+{
+    if (!looseRoot.empty() && name.compare(0, looseRoot.size(), looseRoot) == 0)
+        return name.substr(looseRoot.size());
+    return name;
+}
+
+AssetPack::Blob AssetPack::find(const std::string& path) const
+{
+    std::string name = relativeName(path);
+    Blob blob;
+
+    if (file.isOpen()) {
+        const unsigned char* data = file.getData();
+        const unsigned char* index = data + PACK_HEADER_SIZE;
+        uint64_t stringsOffset;
+        memcpy(&stringsOffset, data + 16, 8);
+        uint64_t hash = hashName(name);
+
+        // Lower bound on the hash, then compare names across any collisions
+        size_t lo = 0, hi = count;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (readEntry(index + mid * PACK_ENTRY_SIZE).nameHash < hash)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        for (size_t i = lo; i < count; ++i) {
+            PackEntry e = readEntry(index + i * PACK_ENTRY_SIZE);
+            if (e.nameHash != hash)
+                break;
+            if (e.nameLength == name.size() && stringsOffset + e.nameOffset + e.nameLength <= file.getSize()
+                && memcmp(data + stringsOffset + e.nameOffset, name.data(), name.size()) == 0
+                && e.dataOffset + e.size <= file.getSize()) {
+                blob.data = data + e.dataOffset;
+                blob.size = (size_t)e.size;
+                return blob;
+            }
+        }
+    }
+
+    std::shared_ptr<MappedFile> loose = std::make_shared<MappedFile>();
+    if (loose->open(looseRoot + name)) {
+        blob.data = loose->getData();
+        blob.size = loose->getSize();
+        blob.owner = loose;
+    }
+    return blob;
+}
+
+// ------------------- PACKING ---------------------
+static void listDirectory(const std::string& root, const std::string& prefix, std::vector<std::string>& names)
+{
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((root + prefix + "*").c_str(), &entry);
+    if (find == INVALID_HANDLE_VALUE)
+        return;
+    do {
+        std::string name = entry.cFileName;
+        if (name[0] == '.')
+            continue;
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            listDirectory(root, prefix + name + "/", names);
+        else
+            names.push_back(prefix + name);
+    } while (FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* dir = opendir((root + prefix).c_str());
+    if (!dir)
+        return;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name[0] == '.')
+            continue;
+        struct stat st;
+        if (stat((root + prefix + name).c_str(), &st) != 0)
+            continue;
+        if (S_ISDIR(st.st_mode))
+            listDirectory(root, prefix + name + "/", names);
+        else if (S_ISREG(st.st_mode))
+            names.push_back(prefix + name);
+    }
+    closedir(dir);
+#endif
+}
+
+std::vector<std::string> AssetPack::listFiles(const std::string& root)
+{
+    std::vector<std::string> names;
+    std::string base = root;
+    if (!base.empty() && base.back() != '/' && base.back() != '\\')
+        base += '/';
+    listDirectory(base, "", names);
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+bool AssetPack::write(const std::string& output, const std::string& root, const std::vector<std::string>& names)
+{
+    std::string base = root;
+    if (!base.empty() && base.back() != '/' && base.back() != '\\')
+        base += '/';
+
+    std::vector<PackEntry> entries;
+    std::string strings;
+    std::vector<std::vector<char>> contents;
+    for (const std::string& name : names) {
+        std::ifstream in(base + name, std::ios::binary);
+        if (!in) {
+            std::cout << "AssetPacker: cannot read " << base + name << "\n";
+            return false;
+        }
+        contents.push_back(std::vector<char>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()));
+
+        PackEntry e;
+        e.nameHash = hashName(name);
+        e.nameOffset = (uint32_t)strings.size();
+        e.nameLength = (uint32_t)name.size();
+        e.dataOffset = 0;
+        e.size = contents.back().size();
+        entries.push_back(e);
+        strings += name;
+    }
+
+    std::vector<size_t> order(entries.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return entries[a].nameHash < entries[b].nameHash; });
+
+    uint64_t stringsOffset = PACK_HEADER_SIZE + entries.size() * PACK_ENTRY_SIZE;
+    uint64_t offset = stringsOffset + strings.size();
+    for (size_t i : order) {
+        offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+        entries[i].dataOffset = offset;
+        offset += entries[i].size;
+    }
+
+    std::vector<char> pack((size_t)offset, 0);
+    memcpy(&pack[0], PACK_MAGIC, sizeof(PACK_MAGIC));
+    uint32_t entryCount = (uint32_t)entries.size();
+    memcpy(&pack[8], &PACK_VERSION, 4);
+    memcpy(&pack[12], &entryCount, 4);
+    memcpy(&pack[16], &stringsOffset, 8);
+
+    size_t at = PACK_HEADER_SIZE;
+    for (size_t i : order) {
+        const PackEntry& e = entries[i];
+        memcpy(&pack[at], &e.nameHash, 8);
+        memcpy(&pack[at + 8], &e.nameOffset, 4);
+        memcpy(&pack[at + 12], &e.nameLength, 4);
+        memcpy(&pack[at + 16], &e.dataOffset, 8);
+        memcpy(&pack[at + 24], &e.size, 8);
+        at += PACK_ENTRY_SIZE;
+        if (!contents[i].empty())
+            memcpy(&pack[(size_t)e.dataOffset], contents[i].data(), contents[i].size());
+    }
+    if (!strings.empty())
+        memcpy(&pack[(size_t)stringsOffset], strings.data(), strings.size());
+
+    std::ofstream out(output, std::ios::binary);
+    if (!out) {
+        std::cout << "AssetPacker: cannot write " << output << "\n";
+        return false;
+    }
+    out.write(pack.data(), pack.size());
+    return (bool)out;
+}
@@ -0,0 +1,533 @@
+#include <Atmosphere.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+static const float PI = 3.14159265358979323846f;
+static const int MAX_LUT_SIZE = 1024;
+
+// Directions the multiple scattering LUT integrates over, per axis of a
+// stratified sphere, and samples along each of them
+static const int MULTI_SCATTERING_DIRECTIONS = 8;
+static const int MULTI_SCATTERING_STEPS = 20;
+static const int TRANSMITTANCE_STEPS = 40;
+// Widest box-filtered level the prefilter sums over: every output texel
+// reads all six faces of it
+static const int PREFILTER_SOURCE_SIZE = 8;
+
+// Bilinear, with u and v running 0..1 from the first texel centre to the last
+static glm::vec3 sampleLut(const std::vector<glm::vec3>& lut, int width, int height, float u, float v)
+{
+    float x = std::min(std::max(u, 0.0f), 1.0f) * (width - 1);
+    float y = std::min(std::max(v, 0.0f), 1.0f) * (height - 1);
+    int x0 = std::min((int)x, width - 2), y0 = std::min((int)y, height - 2);
+    float fx = x - x0, fy = y - y0;
+    const glm::vec3* row0 = &lut[(size_t)y0 * width + x0];
+    const glm::vec3* row1 = row0 + width;
+    glm::vec3 top = row0[0] * (1.0f - fx) + row0[1] * fx;
+    glm::vec3 bottom = row1[0] * (1.0f - fx) + row1[1] * fx;
+    return top * (1.0f - fy) + bottom * fy;
+}
+
+static bool validSize(int size)
+{
+    return size >= 2 && size <= MAX_LUT_SIZE;
+}
+
+Atmosphere::Atmosphere() : horizonZenith(0.5f * PI), front(0), cubeLevelCount(1), sourceLevels(0), nextFace(0),
+    skyViewVersion(0), ready(false)
+{
+    for (int face = 0; face < CUBE_FACES; ++face) {
+        faceSource[face] = -1;
+        faceVersions[face] = 0;
+    }
+}
+
+Atmosphere::~Atmosphere()
+{
+    finish();
+}
+
+bool Atmosphere::init(const Settings& s)
+{
+    finish();
+    pending.reset();
+    if (s.groundRadius <= 0.0f || s.topRadius <= s.groundRadius || s.viewHeight < 0.0f
+        || s.viewHeight >= s.topRadius - s.groundRadius) {
+        std::cout << "Atmosphere: radii " << s.groundRadius << " and " << s.topRadius << " km with the viewer "
+            << s.viewHeight << " km up do not make a shell around the viewer\n";
+        return false;
+    }
+    if (!validSize(s.transmittanceWidth) || !validSize(s.transmittanceHeight) || !validSize(s.multiScatteringSize)
+        || !validSize(s.skyViewWidth) || !validSize(s.skyViewHeight) || !validSize(s.cubeSize) || s.skyViewSteps < 1) {
+        std::cout << "Atmosphere: LUT sizes must be from 2 to " << MAX_LUT_SIZE << "\n";
+        return false;
+    }
+    if ((s.cubeSize & (s.cubeSize - 1)) != 0) {
+        std::cout << "Atmosphere: the cube size " << s.cubeSize << " is not a power of two\n";
+        return false;
+    }
+    settings = s;
+    float r = s.groundRadius + s.viewHeight;
+    horizonZenith = PI - std::asin(std::min(s.groundRadius / r, 1.0f));
+
+    auto startTime = std::chrono::steady_clock::now();
+    JobSystem& jobs = JobSystem::instance();
+
+    // Transmittance first: every multiple scattering sample reads it
+    const int tw = s.transmittanceWidth, th = s.transmittanceHeight;
+    const float h = std::sqrt(s.topRadius * s.topRadius - s.groundRadius * s.groundRadius);
+    transmittanceLut.resize((size_t)tw * th);
+    jobs.parallelFor(0, th, 4, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            float rho = h * y / (th - 1);
+            float radius = std::sqrt(rho * rho + s.groundRadius * s.groundRadius);
+            float dMin = s.topRadius - radius, dMax = rho + h;
+            for (int x = 0; x < tw; ++x) {
+                float d = dMin + (dMax - dMin) * x / (tw - 1);
+                float mu = d <= 0.0f ? 1.0f : (h * h - rho * rho - d * d) / (2.0f * radius * d);
+                mu = std::min(std::max(mu, -1.0f), 1.0f);
+                transmittanceLut[(size_t)y * tw + x] = integrateTransmittance(radius, mu, TRANSMITTANCE_STEPS);
+            }
+        }
+    });
+
+    const int n = s.multiScatteringSize;
+    multiScatteringLut.resize((size_t)n * n);
+    jobs.parallelFor(0, n, 2, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            // Just above the ground, so the lowest row still marches upwards
+            float radius = s.groundRadius + std::max((s.topRadius - s.groundRadius) * y / (n - 1), 0.01f);
+            radius = std::min(radius, s.topRadius - 0.01f);
+            for (int x = 0; x < n; ++x)
+                multiScatteringLut[(size_t)y * n + x] = computeMultipleScattering(radius, -1.0f + 2.0f * x / (n - 1));
+        }
+    });
+
+    for (std::vector<glm::vec3>& lut : skyView)
+        lut.assign((size_t)s.skyViewWidth * s.skyViewHeight, glm::vec3(0.0f));
+    skyViewSun[0] = skyViewSun[1] = glm::vec3(0.0f, 1.0f, 0.0f);
+    front = 0;
+    cubeLevelCount = cubeLevels(s.cubeSize);
+    sourceLevels = 0;
+    while ((s.cubeSize >> sourceLevels) > PREFILTER_SOURCE_SIZE)
+        sourceLevels++;
+    for (int face = 0; face < CUBE_FACES; ++face) {
+        faces[face].resize(cubeLevelCount);
+        for (int level = 0; level < cubeLevelCount; ++level) {
+            int size = std::max(s.cubeSize >> level, 1);
+            faces[face][level].assign((size_t)size * size, glm::vec3(0.0f));
+        }
+        computeBoxes(faces[face][0], boxes[face]);
+        faceSource[face] = -1;
+    }
+    irradiance = SH9();
+    nextFace = 0;
+    ready = false;
+
+    stats = Stats();
+    stats.precomputeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    return true;
+}
+
+// ------------------- MEDIUM ---------------------
+Atmosphere::Medium Atmosphere::medium(float r) const
+{
+    float height = std::max(r - settings.groundRadius, 0.0f);
+    float rayleighDensity = std::exp(-height / settings.rayleighScaleHeight);
+    float mieDensity = std::exp(-height / settings.mieScaleHeight);
+    float ozoneDensity = std::max(0.0f, 1.0f - std::abs(height - settings.ozoneCenter) / (0.5f * settings.ozoneWidth));
+
+    Medium m;
+    m.rayleigh = settings.rayleighScattering * rayleighDensity;
+    m.mie = settings.mieScattering * mieDensity;
+    m.scattering = m.rayleigh + glm::vec3(m.mie);
+    m.extinction = m.rayleigh + glm::vec3(settings.mieExtinction * mieDensity) + settings.ozoneAbsorption * ozoneDensity;
+    return m;
+}
+
+float Atmosphere::distanceToTop(float r, float mu) const
+{
+    float discriminant = r * r * (mu * mu - 1.0f) + settings.topRadius * settings.topRadius;
+    return std::max(-r * mu + std::sqrt(std::max(discriminant, 0.0f)), 0.0f);
+}
+
+bool Atmosphere::hitsGround(float r, float mu) const
+{
+    return mu < 0.0f && r * r * (mu * mu - 1.0f) + settings.groundRadius * settings.groundRadius >= 0.0f;
+}
+
+// ------------------- TRANSMITTANCE ---------------------
+// Bruneton's mapping: v is the distance to the horizon, u where the
+// distance to the top lies between straight up and the horizon
+void Atmosphere::transmittanceCoordinates(float r, float mu, float& u, float& v) const
+{
+    float h = std::sqrt(settings.topRadius * settings.topRadius - settings.groundRadius * settings.groundRadius);
+    float rho = std::sqrt(std::max(r * r - settings.groundRadius * settings.groundRadius, 0.0f));
+    float d = distanceToTop(r, mu);
+    float dMin = settings.topRadius - r, dMax = rho + h;
+    u = dMax > dMin ? (d - dMin) / (dMax - dMin) : 0.0f;
+    v = rho / h;
+}
+
+glm::vec3 Atmosphere::integrateTransmittance(float r, float mu, int steps) const
+{
+    float dt = distanceToTop(r, mu) / steps;
+    glm::vec3 depth(0.0f);
+    for (int i = 0; i < steps; ++i) {
+        float t = (i + 0.5f) * dt;
+        depth += medium(std::sqrt(r * r + t * t + 2.0f * r * mu * t)).extinction * dt;
+    }
+    return glm::exp(-depth);
+}
+
+glm::vec3 Atmosphere::transmittance(float r, float mu) const
+{
+    if (hitsGround(r, mu))
+        return glm::vec3(0.0f);
+    float u, v;
+    transmittanceCoordinates(r, mu, u, v);
+    return sampleLut(transmittanceLut, settings.transmittanceWidth, settings.transmittanceHeight, u, v);
+}
+
+glm::vec3 Atmosphere::sunTransmittance(glm::vec3 sunDir) const
+{
+    return transmittance(settings.groundRadius + settings.viewHeight, glm::normalize(sunDir).y);
+}
+
+// ------------------- MULTIPLE SCATTERING ---------------------
+// Hillaire's approximation: light scattered twice or more is isotropic and
+// the same around every point, so a sphere of rays from a point gives the
+// second order (lum) and the fraction of it scattered again (transfer); all
+// the higher orders sum to lum / (1 - transfer).
+glm::vec3 Atmosphere::computeMultipleScattering(float r, float muSun) const
+{
+    const glm::vec3 origin(0.0f, r, 0.0f);
+    const glm::vec3 sunDir(std::sqrt(std::max(1.0f - muSun * muSun, 0.0f)), muSun, 0.0f);
+    const float isotropicPhase = 1.0f / (4.0f * PI);
+
+    glm::vec3 lum(0.0f), transfer(0.0f);
+    for (int a = 0; a < MULTI_SCATTERING_DIRECTIONS; ++a) {
+        for (int b = 0; b < MULTI_SCATTERING_DIRECTIONS; ++b) {
+            float cosTheta = 1.0f - 2.0f * (a + 0.5f) / MULTI_SCATTERING_DIRECTIONS;
+            float sinTheta = std::sqrt(std::max(1.0f - cosTheta * cosTheta, 0.0f));
+            float phi = 2.0f * PI * (b + 0.5f) / MULTI_SCATTERING_DIRECTIONS;
+            glm::vec3 dir(sinTheta * std::cos(phi), cosTheta, sinTheta * std::sin(phi));
+
+            bool ground = hitsGround(r, cosTheta);
+            float length = ground
+                ? -r * cosTheta - std::sqrt(std::max(r * r * (cosTheta * cosTheta - 1.0f)
+                    + settings.groundRadius * settings.groundRadius, 0.0f))
+                : distanceToTop(r, cosTheta);
+            float dt = length / MULTI_SCATTERING_STEPS;
+
+            glm::vec3 throughput(1.0f);
+            for (int i = 0; i < MULTI_SCATTERING_STEPS; ++i) {
+                glm::vec3 p = origin + dir * ((i + 0.5f) * dt);
+                float radius = glm::length(p);
+                Medium m = medium(radius);
+                glm::vec3 stepTransmittance = glm::exp(-m.extinction * dt);
+                // Integrated analytically over the step
+                glm::vec3 fraction = (glm::vec3(1.0f) - stepTransmittance) / m.extinction;
+                glm::vec3 sun = transmittance(radius, glm::dot(p, sunDir) / radius);
+                lum += throughput * sun * m.scattering * isotropicPhase * fraction;
+                transfer += throughput * m.scattering * fraction;
+                throughput *= stepTransmittance;
+            }
+            if (ground) {
+                glm::vec3 p = origin + dir * length;
+                float muGround = glm::dot(glm::normalize(p), sunDir);
+                lum += throughput * transmittance(settings.groundRadius, muGround) * std::max(muGround, 0.0f)
+                    * settings.groundAlbedo / PI;
+            }
+        }
+    }
+    // Each direction covers 4 pi / N^2 of the sphere; the phase function of
+    // the transfer is isotropic too
+    const float weight = 1.0f / (MULTI_SCATTERING_DIRECTIONS * MULTI_SCATTERING_DIRECTIONS);
+    lum *= weight;
+    transfer *= weight;
+    return lum / (glm::vec3(1.0f) - transfer);
+}
+
+glm::vec3 Atmosphere::multipleScattering(float r, float muSun) const
+{
+    const int n = settings.multiScatteringSize;
+    return sampleLut(multiScatteringLut, n, n, muSun * 0.5f + 0.5f,
+        (r - settings.groundRadius) / (settings.topRadius - settings.groundRadius));
+}
+
+// ------------------- SKY VIEW ---------------------
+glm::vec3 Atmosphere::skyRadiance(glm::vec3 viewDir, glm::vec3 sunDir, int steps) const
+{
+    const float r = settings.groundRadius + settings.viewHeight;
+    const glm::vec3 origin(0.0f, r, 0.0f);
+    float mu = viewDir.y;
+    float length = hitsGround(r, mu)
+        ? -r * mu - std::sqrt(std::max(r * r * (mu * mu - 1.0f) + settings.groundRadius * settings.groundRadius, 0.0f))
+        : distanceToTop(r, mu);
+
+    float cosTheta = glm::dot(viewDir, sunDir);
+    float rayleighPhase = 3.0f / (16.0f * PI) * (1.0f + cosTheta * cosTheta);
+    float g = settings.mieG;
+    float mieDenominator = 1.0f + g * g - 2.0f * g * cosTheta;
+    float miePhase = (1.0f - g * g) / (4.0f * PI * mieDenominator * std::sqrt(mieDenominator));
+
+    // Samples crowd towards the viewer, where the air is densest along
+    // rays near the horizon
+    glm::vec3 lum(0.0f), throughput(1.0f);
+    float t0 = 0.0f;
+    for (int i = 0; i < steps; ++i) {
+        float f = (i + 1.0f) / steps;
+        float t1 = length * f * f;
+        float dt = t1 - t0;
+        glm::vec3 p = origin + viewDir * (0.5f * (t0 + t1));
+        t0 = t1;
+
+        float radius = glm::length(p);
+        float muSun = glm::dot(p, sunDir) / radius;
+        Medium m = medium(radius);
+        glm::vec3 stepTransmittance = glm::exp(-m.extinction * dt);
+        glm::vec3 scattered = transmittance(radius, muSun) * (m.rayleigh * rayleighPhase + glm::vec3(m.mie * miePhase))
+            + multipleScattering(radius, muSun) * m.scattering;
+        lum += throughput * scattered * (glm::vec3(1.0f) - stepTransmittance) / m.extinction;
+        throughput *= stepTransmittance;
+    }
+    return lum * settings.sunIlluminance;
+}
+
+// Zenith angles are packed towards the horizon on both sides of it, where
+// the sky changes fastest: v = 0 straight up, 0.5 the horizon, 1 straight down
+void Atmosphere::skyViewCoordinates(glm::vec3 viewDir, glm::vec3 sunDir, float& u, float& v) const
+{
+    float zenith = std::acos(std::min(std::max(viewDir.y, -1.0f), 1.0f));
+    if (zenith < horizonZenith)
+        v = 0.5f * (1.0f - std::sqrt(std::max(1.0f - zenith / horizonZenith, 0.0f)));
+    else
+        v = 0.5f + 0.5f * std::sqrt(std::max((zenith - horizonZenith) / (PI - horizonZenith), 0.0f));
+
+    // The sky is symmetric about the sun's vertical plane, so 0..pi covers it
+    float viewLength = std::sqrt(viewDir.x * viewDir.x + viewDir.z * viewDir.z);
+    float sunLength = std::sqrt(sunDir.x * sunDir.x + sunDir.z * sunDir.z);
+    if (viewLength < 1e-6f || sunLength < 1e-6f) {
+        u = 0.0f;
+        return;
+    }
+    float cosAzimuth = (viewDir.x * sunDir.x + viewDir.z * sunDir.z) / (viewLength * sunLength);
+    u = std::acos(std::min(std::max(cosAzimuth, -1.0f), 1.0f)) / PI;
+}
+
+glm::vec3 Atmosphere::sampleSkyView(const std::vector<glm::vec3>& lut, glm::vec3 viewDir, glm::vec3 sunDir) const
+{
+    float u, v;
+    skyViewCoordinates(viewDir, sunDir, u, v);
+    return sampleLut(lut, settings.skyViewWidth, settings.skyViewHeight, u, v);
+}
+
+// Only the sun's elevation matters: every texel is marched with the sun at
+// azimuth 0
+void Atmosphere::computeSkyView(glm::vec3 sunDir, std::vector<glm::vec3>& out) const
+{
+    const int w = settings.skyViewWidth, h = settings.skyViewHeight;
+    float sunY = glm::normalize(sunDir).y;
+    const glm::vec3 sun(std::sqrt(std::max(1.0f - sunY * sunY, 0.0f)), sunY, 0.0f);
+    out.resize((size_t)w * h);
+    JobSystem::instance().parallelFor(0, h, 4, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            float v = (float)y / (h - 1);
+            float zenith = v < 0.5f
+                ? horizonZenith * (1.0f - (1.0f - 2.0f * v) * (1.0f - 2.0f * v))
+                : horizonZenith + (PI - horizonZenith) * (2.0f * v - 1.0f) * (2.0f * v - 1.0f);
+            for (int x = 0; x < w; ++x) {
+                float azimuth = PI * x / (w - 1);
+                glm::vec3 dir(std::sin(zenith) * std::cos(azimuth), std::cos(zenith), std::sin(zenith) * std::sin(azimuth));
+                out[(size_t)y * w + x] = skyRadiance(dir, sun, settings.skyViewSteps);
+            }
+        }
+    });
+}
+
+// ------------------- ENVIRONMENT CUBE ---------------------
+void Atmosphere::computeFace(int face, glm::vec3 sunDir, const std::vector<glm::vec3>& lut,
+    std::vector<glm::vec3>& out) const
+{
+    const int n = settings.cubeSize;
+    out.resize((size_t)n * n);
+    JobSystem::instance().parallelFor(0, n, 8, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            for (int x = 0; x < n; ++x) {
+                glm::vec3 dir = glm::normalize(cubeFaceDirection(face, 2.0f * (x + 0.5f) / n - 1.0f,
+                    2.0f * (y + 0.5f) / n - 1.0f));
+                out[(size_t)y * n + x] = sampleSkyView(lut, dir, sunDir);
+            }
+        }
+    });
+}
+
+void Atmosphere::computeBoxes(const std::vector<glm::vec3>& face, Levels& out) const
+{
+    out.resize(sourceLevels + 1);
+    for (int level = 1; level <= sourceLevels; ++level)
+        downsampleFace(level == 1 ? face : out[level - 1], settings.cubeSize >> (level - 1), out[level]);
+}
+
+// Levels 1.. of one face; level 0, the face itself, is left alone
+void Atmosphere::computeLevels(int face, const Levels* const levels[CUBE_FACES], const Levels* const boxes[CUBE_FACES],
+    Levels& out) const
+{
+    out.resize(cubeLevelCount);
+    for (int level = 1; level < cubeLevelCount; ++level) {
+        // A level finer than the output, up to PREFILTER_SOURCE_SIZE wide
+        int source = std::min(level - 1, sourceLevels);
+        const std::vector<glm::vec3>* sources[CUBE_FACES];
+        for (int f = 0; f < CUBE_FACES; ++f)
+            sources[f] = source == 0 ? &(*levels[f])[0] : &(*boxes[f])[source];
+        prefilterFace(sources, settings.cubeSize >> source, face, std::max(settings.cubeSize >> level, 1),
+            cubeLevelRoughness(level, cubeLevelCount), out[level]);
+    }
+}
+
+SH9 Atmosphere::computeIrradiance(const Levels* const levels[CUBE_FACES]) const
+{
+    const std::vector<glm::vec3>* bases[CUBE_FACES];
+    for (int f = 0; f < CUBE_FACES; ++f)
+        bases[f] = &(*levels[f])[0];
+    return projector.project(bases, settings.cubeSize).irradiance();
+}
+
+// ------------------- UPDATES ---------------------
+void Atmosphere::update(glm::vec3 sunDir)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    sunDir = glm::normalize(sunDir);
+    computeSkyView(sunDir, skyView[1 - front]);
+    front = 1 - front;
+    skyViewSun[front] = sunDir;
+    skyViewVersion++;
+    const Levels* levels[CUBE_FACES];
+    const Levels* boxLevels[CUBE_FACES];
+    for (int face = 0; face < CUBE_FACES; ++face) {
+        computeFace(face, sunDir, skyView[front], faces[face][0]);
+        computeBoxes(faces[face][0], boxes[face]);
+        levels[face] = &faces[face];
+        boxLevels[face] = &boxes[face];
+    }
+    // Every face's levels read all six, so only once they are all current
+    for (int face = 0; face < CUBE_FACES; ++face) {
+        computeLevels(face, levels, boxLevels, faces[face]);
+        faceSource[face] = skyViewVersion;
+        faceVersions[face]++;
+    }
+    irradiance = computeIrradiance(levels);
+    nextFace = 0;
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    stats.skyViewUpdates++;
+    stats.faceUpdates += CUBE_FACES;
+    stats.totalMs += ms;
+    stats.maxMs = std::max(stats.maxMs, ms);
+}
+
+// False if there is nothing to do
+bool Atmosphere::planStep(glm::vec3 sunDir)
+{
+    sunDir = glm::normalize(sunDir);
+    step.skyView = skyViewVersion == 0
+        || glm::dot(sunDir, skyViewSun[front]) < std::cos(settings.refreshAngle * PI / 180.0f);
+    // Faces looked up in an older sky view, from the one after the last refreshed
+    step.face = -1;
+    for (int i = 0; i < CUBE_FACES; ++i) {
+        int face = (nextFace + i) % CUBE_FACES;
+        if (step.skyView || faceSource[face] != skyViewVersion) {
+            step.face = face;
+            break;
+        }
+    }
+    // A face is looked up with the sun its sky view was marched for
+    step.sunDir = step.skyView ? sunDir : skyViewSun[front];
+    return step.skyView || step.face >= 0;
+}
+
+void Atmosphere::runStep()
+{
+    auto startTime = std::chrono::steady_clock::now();
+    if (step.skyView)
+        computeSkyView(step.sunDir, skyView[1 - front]);
+    if (step.face >= 0) {
+        step.faceLevels.resize(1);
+        computeFace(step.face, step.sunDir, skyView[step.skyView ? 1 - front : front], step.faceLevels[0]);
+        computeBoxes(step.faceLevels[0], step.faceBoxes);
+        // The other faces as they are; the renderer only reads them between steps
+        const Levels* levels[CUBE_FACES];
+        const Levels* boxLevels[CUBE_FACES];
+        for (int face = 0; face < CUBE_FACES; ++face) {
+            levels[face] = face == step.face ? &step.faceLevels : &faces[face];
+            boxLevels[face] = face == step.face ? &step.faceBoxes : &boxes[face];
+        }
+        computeLevels(step.face, levels, boxLevels, step.faceLevels);
+        step.irradiance = computeIrradiance(levels);
+    }
+    step.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void Atmosphere::publish()
+{
+    if (step.skyView) {
+        front = 1 - front;
+        skyViewSun[front] = step.sunDir;
+        skyViewVersion++;
+        stats.skyViewUpdates++;
+    }
+    if (step.face >= 0) {
+        faces[step.face].swap(step.faceLevels);
+        boxes[step.face].swap(step.faceBoxes);
+        irradiance = step.irradiance;
+        faceSource[step.face] = skyViewVersion;
+        faceVersions[step.face]++;
+        nextFace = (step.face + 1) % CUBE_FACES;
+        stats.faceUpdates++;
+    }
+    stats.totalMs += step.ms;
+    stats.maxMs = std::max(stats.maxMs, step.ms);
+}
+
+void Atmosphere::start(glm::vec3 sunDir)
+{
+    if (pending || ready || !planStep(sunDir))
+        return;
+    JobSystem& jobs = JobSystem::instance();
+    if (jobs.getWorkerCount() == 0) {
+        // Nobody would pick the job up until something waits
+        runStep();
+        ready = true;
+        return;
+    }
+    pending = jobs.makeCounter();
+    jobs.run([this]() { runStep(); }, pending);
+}
+
+bool Atmosphere::poll()
+{
+    if (pending && pending->done())
+        pending.reset();
+    else if (!ready)
+        return false;
+    ready = false;
+    publish();
+    return true;
+}
+
+void Atmosphere::finish()
+{
+    if (pending)
+        JobSystem::instance().wait(pending);
+}
+
+void Atmosphere::resetStats()
+{
+    Stats kept;
+    kept.precomputeMs = stats.precomputeMs;
+    stats = kept;
+}
@@ -0,0 +1,1888 @@
+#include <Bench.hpp>
+#include <BenchFixtures.hpp>
+#include <Atmosphere.hpp>
+#include <CommandBuffer.hpp>
+#include <Culling.hpp>
+#include <EnvironmentLighting.hpp>
+#include <Erosion.hpp>
+#include <FFT.hpp>
+#include <FrameEncoder.hpp>
+#include <GLRenderTargets.hpp>
+#include <JobSystem.hpp>
+#include <Mesh.hpp>
+#include <OceanFFT.hpp>
+#include <Programs.hpp>
+#include <Reflections.hpp>
+#include <RenderTargetPool.hpp>
+#include <ResolutionController.hpp>
+#include <ShadowFilter.hpp>
+#include <Simulation.hpp>
+#include <Skybox.hpp>
+#include <WaterClipmap.hpp>
+
+#include <stb_image.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// 1, 2, 4, ... up to and including the hardware thread count
+static std::vector<int> benchThreadCounts()
+{
+    int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+    std::vector<int> threadCounts;
+    for (int threads = 1; threads < maxThreads; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+    return threadCounts;
+}
+
+// ------------------- EROSION ---------------------
+static int benchErosion()
+{
+    const int m = 1000, n = 1000;
+    std::vector<float> source = Mesh::generateHeightfield(10.0f, 10.0f, m, n);
+
+    std::cout << "Droplet erosion, " << m << "x" << n << " grid\n";
+    std::cout << "threads  droplets  batches  ms        droplets/s\n";
+
+    double baseline = 0.0;
+    for (int threads : benchThreadCounts()) {
+        JobSystem::instance().init(threads - 1);
+        DropletErosion::Settings settings;
+        settings.numThreads = threads;
+
+        std::vector<float> heights = source;
+        DropletErosion erosion(m, n, settings);
+        DropletErosion::Stats stats = erosion.erode(heights);
+        if (threads == 1)
+            baseline = stats.dropletsPerSecond;
+
+        std::cout << threads << "\t " << stats.droplets << "\t   " << stats.batches
+            << "\t    " << stats.seconds * 1000.0 << "\t" << (long long)stats.dropletsPerSecond
+            << " (x" << (baseline > 0.0 ? stats.dropletsPerSecond / baseline : 0.0) << ")\n";
+    }
+    JobSystem::instance().init();
+    return 0;
+}
+
+// ------------------- JOB SYSTEM ---------------------
+static int benchJobs()
+{
+    const int m = 512, n = 512;
+    DropletErosion::Settings erosion;
+    erosion.numDroplets = 50000;
+    erosion.numThreads = 8;     // fixed so every pool size produces the same terrain
+
+    std::cout << "Job system: Mesh::generateGrid " << m << "x" << n << ", "
+        << erosion.numDroplets << " droplets\n";
+    std::cout << "threads  ms        speedup  jobs     steals\n";
+
+    double baseline = 0.0;
+    for (int threads : benchThreadCounts()) {
+        JobSystem& jobs = JobSystem::instance();
+        jobs.init(threads - 1);
+
+        jobs.resetStats();
+        auto start = std::chrono::high_resolution_clock::now();
+        Mesh mesh = Mesh::generateGrid(10.0f, 10.0f, m, n, erosion, 0.1f);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        JobSystem::Stats stats = jobs.getStats();
+        if (threads == 1)
+            baseline = ms;
+
+        std::cout << threads << "\t " << ms << "\t" << (ms > 0.0 ? baseline / ms : 0.0) << "\t "
+            << stats.jobs << "\t  " << stats.steals << "  (" << mesh.chunks.size() << " chunks)\n";
+    }
+    JobSystem::instance().init();
+    return 0;
+}
+
+// ------------------- SKYBOX FACES ---------------------
+// Keeps the timed copies from being optimized away
+static volatile unsigned int benchSink;
+
+// The original per-face extraction: a fresh buffer per face, filled one channel at a time
+static unsigned char* legacyExtractFace(const unsigned char* src, int faceSize, int xOffset, int yOffset,
+    int imgWidth, int channels)
+{
+    unsigned char* face = new unsigned char[faceSize * faceSize * channels];
+    for (int y = 0; y < faceSize; ++y) {
+        for (int x = 0; x < faceSize; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                int srcIndex = ((y + yOffset) * imgWidth + (x + xOffset)) * channels + c;
+                int dstIndex = (y * faceSize + x) * channels + c;
+                face[dstIndex] = src[srcIndex];
+            }
+        }
+    }
+    return face;
+}
+
+static int benchSkybox()
+{
+    const char* path = "../res/textures/Daylight Box UV.png";
+    int w, h, c;
+    unsigned char* data = stbi_load(path, &w, &h, &c, 0);
+    std::vector<unsigned char> synthetic;
+    if (!data) {
+        // No resources next to the binary: a synthetic cross of the same shape
+        w = 4096; h = 3072; c = 3;
+        synthetic.resize((size_t)w * h * c);
+        for (size_t i = 0; i < synthetic.size(); ++i)
+            synthetic[i] = (unsigned char)(i * 2654435761u >> 24);
+    }
+    const unsigned char* pixels = data ? data : synthetic.data();
+    const int faceSize = h / 3;
+    const size_t faceBytes = (size_t)faceSize * faceSize * c;
+    const int repeats = 10;
+
+    std::cout << "Skybox face extraction, " << w << "x" << h << "x" << c
+        << (data ? " (" : " (synthetic, ") << faceSize << " px faces, " << repeats << " runs)\n";
+
+    // Every path must produce the same faces
+    bool match = true;
+    std::vector<unsigned char> scratch(faceBytes);
+    for (int i = 0; i < 6; ++i) {
+        int x, y;
+        SkyBox::faceOrigin(i, faceSize, x, y);
+        unsigned char* legacy = legacyExtractFace(pixels, faceSize, x, y, w, c);
+        SkyBox::extractFace(pixels, faceSize, x, y, w, c, scratch.data());
+        match = match && memcmp(legacy, scratch.data(), faceBytes) == 0;
+        delete[] legacy;
+    }
+
+    auto timeRuns = [&](bool legacy) {
+        unsigned int checksum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < repeats; ++r) {
+            for (int i = 0; i < 6; ++i) {
+                int x, y;
+                SkyBox::faceOrigin(i, faceSize, x, y);
+                if (legacy) {
+                    unsigned char* face = legacyExtractFace(pixels, faceSize, x, y, w, c);
+                    checksum += face[faceBytes / 2];
+                    delete[] face;
+                }
+                else {
+                    SkyBox::extractFace(pixels, faceSize, x, y, w, c, scratch.data());
+                    checksum += scratch[faceBytes / 2];
+                }
+            }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        benchSink = checksum;
+        return std::chrono::duration<double, std::milli>(end - start).count() / repeats;
+    };
+
+    double legacyMs = timeRuns(true);
+    double rowCopyMs = timeRuns(false);
+    double mb = 6.0 * faceBytes / (1024.0 * 1024.0);
+
+    std::cout << "path              ms/cubemap  MB/s      copies\n";
+    std::cout << "per-channel loop  " << legacyMs << "\t" << mb / (legacyMs / 1000.0) << "\t6 allocations + " << mb << " MB\n";
+    std::cout << "row memcpy        " << rowCopyMs << "\t" << mb / (rowCopyMs / 1000.0) << "\t1 scratch face, " << mb << " MB"
+        << " (x" << legacyMs / rowCopyMs << ")\n";
+    std::cout << "faces " << (match ? "match" : "DIFFER") << "\n";
+
+    if (data)
+        stbi_image_free(data);
+    return match ? 0 : 1;
+}
+
+// ------------------- SIMULATION ---------------------
+// A stand-in render loop: every frame takes a packet, spends a few
+// milliseconds "rendering" and waits for the next 60 Hz vsync. The same
+// synthetic simulation load runs once on the render thread and once on the
+// update thread, and the frame-to-frame times are compared.
+static FrameTimeStats emulateFrames(const Simulation::Settings& settings, double seconds, Simulation::Stats& simStats)
+{
+    typedef std::chrono::steady_clock Clock;
+    const auto vsync = std::chrono::microseconds(16667);
+    const auto renderCost = std::chrono::milliseconds(3);
+
+    Simulation simulation;
+    Camera camera(glm::vec3(0.0f, 5.0f, 10.0f));
+    simulation.start(camera, settings);
+
+    InputState input;
+    input.forward = true;           // keep the camera moving
+    FrameTimeStats frames;
+    volatile float sink = 0.0f;
+
+    auto start = Clock::now();
+    auto nextVsync = start + vsync;
+    auto last = start;
+    while (Clock::now() - start < std::chrono::duration<double>(seconds)) {
+        simulation.submitInput(input);
+        RenderPacket packet = simulation.packet();
+        sink = sink + packet.cameraPosition.z;
+
+        auto renderEnd = Clock::now() + renderCost;
+        while (Clock::now() < renderEnd) {}
+
+        // A late frame waits for the next vsync after it
+        while (nextVsync <= Clock::now())
+            nextVsync += vsync;
+        std::this_thread::sleep_until(nextVsync);
+
+        auto now = Clock::now();
+        frames.add(std::chrono::duration<double, std::milli>(now - last).count());
+        last = now;
+    }
+
+    simulation.stop();
+    simStats = simulation.getStats();
+    return frames;
+}
+
+static int benchSimulation()
+{
+    const double seconds = 3.0;
+    std::cout << "Fixed-timestep simulation, emulated 60 Hz frames with 3 ms of rendering, "
+        << seconds << " s per run\n";
+    std::cout << "mode      load ms  frames  mean ms  stddev ms  max ms  ticks  late  dropped\n";
+
+    double worstInline = 0.0, worstThreaded = 0.0;
+    for (double load : { 0.0, 4.0, 8.0 }) {
+        for (int threaded = 0; threaded < 2; ++threaded) {
+            Simulation::Settings settings;
+            settings.threaded = threaded != 0;
+            settings.loadMs = load;
+
+            Simulation::Stats simStats;
+            FrameTimeStats frames = emulateFrames(settings, seconds, simStats);
+            (threaded ? worstThreaded : worstInline) = std::max(threaded ? worstThreaded : worstInline, frames.stddevMs());
+
+            std::cout << (threaded ? "threaded" : "inline  ") << "  " << load << "\t   " << frames.frames
+                << "\t   " << frames.meanMs() << "\t" << frames.stddevMs() << "\t   " << frames.maxMs
+                << "\t" << simStats.ticks << "\t" << simStats.lateTicks << "\t" << simStats.droppedTicks << "\n";
+        }
+    }
+    std::cout << "worst frame-time stddev: inline " << worstInline << " ms, threaded " << worstThreaded << " ms\n";
+    return 0;
+}
+
+// ------------------- COMMAND SORTING ---------------------
+static int benchCommands()
+{
+    const int FRAMES = 200;
+    std::cout << "Command buffer: synthetic frames of " << 4 * 416 << " draws in 4 passes, " << FRAMES << " frames\n";
+
+    CommandBuffer commands;
+    CommandBuffer::StateChanges before, after;
+    double recordMs = 0.0, sortMs = 0.0;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        auto start = std::chrono::steady_clock::now();
+        recordSyntheticFrame(commands, 1234u + frame);
+        auto recorded = std::chrono::steady_clock::now();
+        CommandBuffer::StateChanges unsorted = commands.countStateChanges();
+        auto counted = std::chrono::steady_clock::now();
+        commands.sort();
+        auto sortedTime = std::chrono::steady_clock::now();
+
+        recordMs += std::chrono::duration<double, std::milli>(recorded - start).count();
+        sortMs += std::chrono::duration<double, std::milli>(sortedTime - counted).count();
+        CommandBuffer::StateChanges changes = commands.countStateChanges();
+        if (frame == 0) {
+            before = unsorted;
+            after = changes;
+        }
+    }
+
+    std::cout << "order      programs  vaos  textures  states  total\n";
+    std::cout << "recorded   " << before.programs << "\t   " << before.vaos << "\t " << before.textures
+        << "\t   " << before.states << "\t   " << before.total() << "\n";
+    std::cout << "sorted     " << after.programs << "\t   " << after.vaos << "\t " << after.textures
+        << "\t   " << after.states << "\t   " << after.total() << "\n";
+    std::cout << "record " << recordMs / FRAMES << " ms, sort " << sortMs / FRAMES << " ms per frame\n";
+    return 0;
+}
+
+// ------------------- UNIFORM SUBMISSION ---------------------
+// Stand-in for a linked program in the driver: uniform storage and the
+// name-to-location table glGetUniformLocation searches
+struct BenchProgram {
+    std::unordered_map<std::string, int> locations;
+    std::vector<float> storage;
+
+    void upload(int location, const float* data, int count)
+    {
+        if (location >= 0)
+            memcpy(&storage[location], data, count * sizeof(float));
+    }
+};
+
+struct BenchUniform {
+    const char* name;
+    int floats;
+};
+
+// The uniforms renderLoop sets per draw, program by program
+static std::vector<BenchUniform> benchUniforms(ProgramId id)
+{
+    switch (id) {
+    case PROGRAM_TERRAIN:
+        return { { "viewProjection", 16 }, { "model", 16 }, { "viewPos", 3 }, { "lightDir", 3 },
+            { "lightSpaceMatrix", 16 }, { "clipHeight", 1 }, { "clipAbove", 1 }, { "shIrradiance", 27 } };
+    case PROGRAM_DEPTH: return { { "lightSpaceMatrix", 16 }, { "model", 16 }, { "minHeight", 1 } };
+    case PROGRAM_SKYBOX: return { { "inverseViewProjection", 16 }, { "sunDirection", 3 }, { "sunColor", 3 } };
+    case PROGRAM_WATER:
+        return { { "projection", 16 }, { "view", 16 }, { "reflectionVP", 16 },
+            { "lightSpaceMatrix", 16 }, { "viewPos", 3 }, { "time", 1 }, { "normalStrength", 1 }, { "renderScale", 2 },
+            { "hizLevels", 1 } };
+    case PROGRAM_BRIGHTPASS: return { { "threshold", 1 }, { "renderScale", 2 } };
+    case PROGRAM_BLUR: return { { "horizontal", 1 }, { "renderScale", 2 } };
+    case PROGRAM_SHADOW_MOMENTS: return { { "lightSpaceMatrix", 16 }, { "model", 16 } };
+    case PROGRAM_FINAL: return { { "exposure", 1 }, { "renderScale", 2 } };
+    default: return {};
+    }
+}
+
+// Per-frame CPU cost of finding programs and setting their uniforms: by
+// name through string maps, as the loop used to (a std::string built per
+// call, hashed for the program and again for the location), against
+// ProgramId indexing with locations resolved at load time. Only the lookup
+// and copy are timed, no GL is involved.
+static int benchSubmit()
+{
+    const ProgramId FRAME[] = { PROGRAM_DEPTH, PROGRAM_TERRAIN, PROGRAM_SKYBOX, PROGRAM_DEPTH, PROGRAM_TERRAIN,
+        PROGRAM_SKYBOX, PROGRAM_WATER, PROGRAM_BRIGHTPASS, PROGRAM_BLUR, PROGRAM_BLUR, PROGRAM_BLUR, PROGRAM_BLUR,
+        PROGRAM_BLUR, PROGRAM_FINAL };
+    const int FRAMES = 20000;
+
+    std::unordered_map<std::string, std::unique_ptr<BenchProgram>> byName;
+    BenchProgram* byId[PROGRAM_COUNT];
+    std::vector<int> cachedLocations[PROGRAM_COUNT];
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        ProgramId id = (ProgramId)i;
+        std::unique_ptr<BenchProgram> program(new BenchProgram());
+        int size = 0;
+        for (const BenchUniform& u : benchUniforms(id)) {
+            program->locations[u.name] = size;
+            cachedLocations[i].push_back(size);
+            size += u.floats;
+        }
+        program->storage.resize(std::max(size, 1));
+        byId[i] = program.get();
+        byName[programSource(id).name] = std::move(program);
+    }
+
+    std::vector<BenchUniform> uniforms[PROGRAM_COUNT];
+    for (int i = 0; i < PROGRAM_COUNT; ++i)
+        uniforms[i] = benchUniforms((ProgramId)i);
+    // As many as the largest uniform, shIrradiance
+    float values[27];
+    for (int i = 0; i < 27; ++i)
+        values[i] = (float)i;
+
+    int uniformsPerFrame = 0;
+    for (ProgramId id : FRAME)
+        uniformsPerFrame += (int)uniforms[id].size();
+    std::cout << "Uniform submission: " << sizeof(FRAME) / sizeof(FRAME[0]) << " draws, " << uniformsPerFrame
+        << " uniforms per frame, " << FRAMES << " frames\n";
+
+    auto checksum = [&]() {
+        double sum = 0.0;
+        for (int i = 0; i < PROGRAM_COUNT; ++i)
+            for (float v : byId[i]->storage)
+                sum += v;
+        return sum;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        values[0] = (float)frame;
+        for (ProgramId id : FRAME) {
+            BenchProgram& program = *byName[std::string(programSource(id).name)];
+            for (const BenchUniform& u : uniforms[id]) {
+                auto location = program.locations.find(std::string(u.name));
+                program.upload(location != program.locations.end() ? location->second : -1, values, u.floats);
+            }
+        }
+    }
+    double namedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    double namedSum = checksum();
+
+    for (int i = 0; i < PROGRAM_COUNT; ++i)
+        std::fill(byId[i]->storage.begin(), byId[i]->storage.end(), 0.0f);
+
+    start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        values[0] = (float)frame;
+        for (ProgramId id : FRAME) {
+            BenchProgram& program = *byId[id];
+            const std::vector<int>& locations = cachedLocations[id];
+            for (size_t u = 0; u < locations.size(); ++u)
+                program.upload(locations[u], values, uniforms[id][u].floats);
+        }
+    }
+    double cachedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    bool ok = checksum() == namedSum;
+
+    std::cout << "by name:         " << namedMs * 1000.0 / FRAMES << " us/frame\n";
+    std::cout << "by ProgramId:    " << cachedMs * 1000.0 / FRAMES << " us/frame ("
+        << (cachedMs > 0.0 ? namedMs / cachedMs : 0.0) << "x)\n";
+    std::cout << (ok ? "uniform values match" : "CHECKS FAILED: uniform values differ") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ------------------- WATER LOD ---------------------
+static int benchWater()
+{
+    std::cout << "Water LOD tiles: 16x16 quads per tile, camera 5 units up looking across the water\n";
+    std::cout << "size     levels  tiles  vertices   plane vertices  select ms\n";
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 5000.0f);
+    for (float size : { 2500.0f, 5000.0f, 10000.0f, 20000.0f, 40000.0f }) {
+        WaterClipmap::Settings settings;
+        settings.size = size;
+        WaterClipmap clipmap;
+        clipmap.init(settings);
+
+        glm::vec3 camera(0.0f, 5.0f, 10.0f);
+        glm::mat4 view = glm::lookAt(camera, glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        Frustum frustum = Frustum::fromMatrix(projection * view);
+
+        std::vector<WaterTile> tiles;
+        WaterClipmap::Stats stats;
+        const int RUNS = 200;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < RUNS; ++i)
+            clipmap.select(camera, frustum, tiles, stats);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / RUNS;
+
+        // The single plane it replaces: 10000 units wide, size / 10 quads a side
+        double planeSide = size / 10.0 + 1.0;
+        std::cout << size << "\t " << clipmap.getLevels() << "\t " << tiles.size() << "\t"
+            << (long long)tiles.size() * clipmap.getTileVertexCount() << "\t    " << (long long)(planeSide * planeSide)
+            << "\t     " << ms << "\n";
+    }
+    return 0;
+}
+
+// ------------------- OCEAN FFT ---------------------
+static int benchOcean()
+{
+    std::cout << "Ocean update: spectrum, 3 inverse FFTs, maps; " << JobSystem::instance().getThreadCount() << " threads\n";
+    std::cout << "size  fft ms  scalar fft ms  update ms  max height\n";
+    for (int n = OceanFFT::MIN_SIZE; n <= OceanFFT::MAX_SIZE; n *= 2) {
+        OceanFFT::Settings settings;
+        settings.size = n;
+        OceanFFT ocean;
+        ocean.init(settings);
+
+        std::vector<float> re((size_t)n * n, 1.0f), im((size_t)n * n, 0.0f);
+        FFT2D fft;
+        fft.init(n);
+        double fftMs[2];
+        const int RUNS = std::max(4, (1 << 20) / (n * n));
+        for (int simd = 0; simd < 2; ++simd) {
+            fft.setSimd(simd == 0);
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < RUNS; ++i)
+                fft.inverse(re.data(), im.data());
+            fftMs[simd] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / RUNS;
+        }
+
+        for (int i = 0; i < RUNS; ++i)
+            ocean.update(10.0f + i / 60.0f);
+        float maxHeight = 0.0f;
+        for (const glm::vec4& d : ocean.getDisplacement())
+            maxHeight = std::max(maxHeight, std::abs(d.y));
+
+        std::cout << n << "\t" << fftMs[0] << "\t" << fftMs[1] << "\t" << ocean.getStats().totalMs / ocean.getStats().updates
+            << "\t" << maxHeight << "\n";
+    }
+    return 0;
+}
+
+// ------------------- DYNAMIC RESOLUTION ---------------------
+// A GPU whose frame costs fixedMs plus pixelMs at full resolution, scaled by
+// the pixel count, with some noise. Timer results come back two frames
+// late, as they do from the query ring.
+struct ResolutionScenario {
+    enum Expect {
+        FULL_SCALE,                // fits the budget: never leaves full scale
+        ON_TARGET,                 // settles on the budget from frame `from` on
+        RECOVERS                   // back at full scale soon after frame `from`
+    };
+
+    const char* name;
+    double fixedMs;
+    double (*pixelMs)(int frame);
+    int frames;
+    int from;
+    Expect expect;
+};
+
+static double lightLoad(int) { return 6.0; }
+static double heavyLoad(int) { return 24.0; }
+static double stepLoad(int frame) { return frame >= 300 && frame < 600 ? 30.0 : 12.0; }
+static double overload(int frame) { return frame < 450 ? 60.0 : 6.0; }
+
+struct ResolutionRun {
+    FrameTimeStats settled;        // from the first frame within 10% of target on
+    int settleFrame;               // after `from`, -1 if never
+    int fullScaleFrame;            // first frame after `from` at full scale, -1 if never
+    int overBudget;                // settled frames more than 10% over
+    double scaleSum;
+    int changes;
+};
+
+static ResolutionRun runResolution(const ResolutionController::Settings& settings, const ResolutionScenario& scenario)
+{
+    const size_t LATENCY = 2;
+    ResolutionController controller;
+    controller.init(settings);
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(1.0, 0.04);
+    std::vector<double> inFlight;
+
+    ResolutionRun run = ResolutionRun();
+    run.settleFrame = run.fullScaleFrame = -1;
+    for (int frame = 0; frame < scenario.frames; ++frame) {
+        double scale = controller.getScale();
+        double ms = (scenario.fixedMs + scenario.pixelMs(frame) * scale * scale) * noise(rng);
+        inFlight.push_back(ms);
+        if (inFlight.size() > LATENCY) {
+            controller.update(inFlight.front());
+            inFlight.erase(inFlight.begin());
+        }
+
+        if (frame < scenario.from)
+            continue;
+        if (run.fullScaleFrame < 0 && scale == settings.maxScale)
+            run.fullScaleFrame = frame - scenario.from;
+        if (run.settleFrame < 0 && std::abs(ms - settings.targetMs) < 0.1 * settings.targetMs)
+            run.settleFrame = frame - scenario.from;
+        if (run.settleFrame >= 0) {
+            run.settled.add(ms);
+            run.overBudget += ms > 1.1 * settings.targetMs;
+            run.scaleSum += scale;
+        }
+    }
+    run.changes = controller.getStats().changes;
+    return run;
+}
+
+static int benchResolution()
+{
+    ResolutionController::Settings settings;
+    std::cout << "Dynamic resolution: " << settings.targetMs << " ms target, scale " << settings.minScale << ".."
+        << settings.maxScale << ", timings 2 frames late, 4% noise\n";
+    std::cout << "scenario   settle  mean ms  stddev  over 10%  mean scale  changes  full res ms\n";
+
+    const ResolutionScenario scenarios[] = {
+        { "light", 3.0, lightLoad, 600, 0, ResolutionScenario::FULL_SCALE },
+        { "heavy", 4.0, heavyLoad, 600, 0, ResolutionScenario::ON_TARGET },
+        { "step up", 4.0, stepLoad, 600, 300, ResolutionScenario::ON_TARGET },
+        { "step down", 4.0, stepLoad, 900, 600, ResolutionScenario::ON_TARGET },
+        { "overload", 4.0, overload, 900, 450, ResolutionScenario::RECOVERS },
+    };
+    bool ok = true;
+    for (const ResolutionScenario& scenario : scenarios) {
+        ResolutionRun run = runResolution(settings, scenario);
+
+        bool pass = false;
+        if (scenario.expect == ResolutionScenario::FULL_SCALE)
+            pass = run.fullScaleFrame == 0 && run.changes == 0;
+        else if (scenario.expect == ResolutionScenario::ON_TARGET)
+            pass = run.settleFrame >= 0 && run.settleFrame < 120
+                && std::abs(run.settled.meanMs() - settings.targetMs) < 0.05 * settings.targetMs
+                && run.overBudget < run.settled.frames / 20;
+        else
+            // Pinned at the minimum until then; a wound up integral would
+            // hold the scale down long after
+            pass = run.fullScaleFrame >= 0 && run.fullScaleFrame < 60;
+        ok = ok && pass;
+
+        double frames = std::max(run.settled.frames, 1);
+        std::cout << scenario.name << "\t   " << run.settleFrame << "\t" << run.settled.meanMs() << "\t "
+            << run.settled.stddevMs() << "\t " << 100.0 * run.overBudget / frames << "%\t   "
+            << run.scaleSum / frames << "\t" << run.changes << "\t " << scenario.fixedMs + scenario.pixelMs(scenario.from)
+            << "\t" << (pass ? "ok" : "FAIL");
+        if (scenario.expect == ResolutionScenario::RECOVERS)
+            std::cout << " (full scale " << run.fullScaleFrame << " frames after the load drops)";
+        std::cout << "\n";
+    }
+    std::cout << (ok ? "all checks passed" : "CHECKS FAILED") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ------------------- RENDER TARGETS ---------------------
+// Hands out ids and keeps count of what is alive instead of calling GL;
+// texel sizes are the GL backend's
+static const int BENCH_SHADOW_SIZE = 4096;
+static const int FIXED_WIDTH = 1920, FIXED_HEIGHT = 1080;
+
+struct BenchTargetBackend : RenderTargetPool::Backend {
+    unsigned int nextId;
+    int textures, framebuffers;
+
+    BenchTargetBackend() : nextId(1), textures(0), framebuffers(0) {}
+
+    unsigned int createTexture(const RenderTargetDesc&, int, int) override { textures++; return nextId++; }
+    void destroyTexture(unsigned int) override { textures--; }
+    unsigned int createFramebuffer(unsigned int, unsigned int) override { framebuffers++; return nextId++; }
+    void destroyFramebuffer(unsigned int) override { framebuffers--; }
+    size_t bytesPerTexel(unsigned int format) const override { return GLRenderTargetBackend::formatBytes(format); }
+};
+
+struct TargetFrame {
+    unsigned int reflectionColor, reflectionDepth;
+    unsigned int sceneColor, sceneDepth;
+    unsigned int pingpong[2];
+    bool distinct;                 // no texture held twice at once
+};
+
+// The acquires and releases of renderLoop, in its order
+static TargetFrame recordTargetFrame(RenderTargetPool& pool, int windowWidth, int windowHeight, float scale)
+{
+    const RenderTargetDesc shadowDesc = RenderTargetDesc::fixed(BENCH_SHADOW_SIZE, BENCH_SHADOW_SIZE,
+        GL_DEPTH_COMPONENT24, GL_NEAREST, GL_CLAMP_TO_BORDER);
+    const RenderTargetDesc colorDesc = RenderTargetDesc::relative(scale, GL_RGBA16F, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    const RenderTargetDesc depthDesc = RenderTargetDesc::relative(scale, GL_DEPTH_COMPONENT24, GL_NEAREST,
+        GL_CLAMP_TO_EDGE);
+
+    TargetFrame frame;
+    pool.beginFrame(windowWidth, windowHeight);
+    RenderTarget shadow = pool.acquire(shadowDesc);
+    pool.framebuffer(0, shadow.texture);
+    RenderTarget reflectionColor = pool.acquire(colorDesc);
+    RenderTarget reflectionDepth = pool.acquire(depthDesc);
+    pool.framebuffer(reflectionColor.texture, reflectionDepth.texture);
+    pool.release(reflectionDepth);
+    RenderTarget sceneColor = pool.acquire(colorDesc);
+    RenderTarget sceneDepth = pool.acquire(depthDesc);
+    pool.framebuffer(sceneColor.texture, sceneDepth.texture);
+    pool.release(reflectionColor);
+    pool.release(shadow);
+    pool.release(sceneDepth);
+    RenderTarget pingpong[2] = { pool.acquire(colorDesc), pool.acquire(colorDesc) };
+    pool.framebuffer(pingpong[0].texture, 0);
+    pool.framebuffer(pingpong[1].texture, 0);
+    pool.endFrame();
+
+    frame.reflectionColor = reflectionColor.texture;
+    frame.reflectionDepth = reflectionDepth.texture;
+    frame.sceneColor = sceneColor.texture;
+    frame.sceneDepth = sceneDepth.texture;
+    frame.pingpong[0] = pingpong[0].texture;
+    frame.pingpong[1] = pingpong[1].texture;
+    frame.distinct = shadow.texture != reflectionColor.texture && reflectionColor.texture != sceneColor.texture
+        && sceneColor.texture != pingpong[0].texture && sceneColor.texture != pingpong[1].texture
+        && pingpong[0].texture != pingpong[1].texture;
+    return frame;
+}
+
+// What renderLoop allocated before the pool, for any window: two HDR
+// colour buffers (one never written) and a depth texture, two ping-pong
+// buffers, the reflection's colour texture and depth renderbuffer, all at
+// 1920 x 1080, and an unsized (in practice 32-bit) 4096^2 shadow map
+static size_t fixedTargetBytes()
+{
+    size_t pixels = (size_t)FIXED_WIDTH * FIXED_HEIGHT;
+    size_t color = GLRenderTargetBackend::formatBytes(GL_RGBA16F);
+    size_t depth = GLRenderTargetBackend::formatBytes(GL_DEPTH_COMPONENT24);
+    return pixels * (5 * color + 2 * depth) + (size_t)BENCH_SHADOW_SIZE * BENCH_SHADOW_SIZE * 4;
+}
+
+// Render target memory of the frame at a few window sizes, through resizes
+// and a lower resolution cap (--res-max), against the fixed allocation it replaces. Checks
+// that the reflection's targets are reused later in the frame, that a
+// steady window allocates nothing after the first frame, and that resizing
+// leaves only targets of the new size.
+static int benchRenderTargets()
+{
+    const double MB = 1024.0 * 1024.0;
+    struct Step {
+        int width, height;
+        float scale;
+        int frames;
+    };
+    const Step steps[] = {
+        { 1920, 1080, 1.0f, 10 },
+        { 1280, 720, 1.0f, 10 },
+        { 2560, 1440, 1.0f, 10 },
+        { 1600, 900, 1.0f, 1 },    // dragging the window edge
+        { 1610, 905, 1.0f, 1 },
+        { 1620, 910, 1.0f, 10 },
+        { 1920, 1080, 0.75f, 10 },
+    };
+
+    BenchTargetBackend backend;
+    RenderTargetPool pool;
+    pool.init(&backend);
+    size_t fixedBytes = fixedTargetBytes();
+    std::cout << "Render targets: fixed allocation " << fixedBytes / MB << " MB (8 targets at 1920x1080 whatever "
+        "the window)\n";
+    std::cout << "window      scale  targets  pool MB  vs fixed  allocated  reused/frame\n";
+
+    bool ok = true;
+    for (const Step& step : steps) {
+        RenderTargetPool::Stats before = pool.getStats();
+        TargetFrame frame = TargetFrame();
+        bool steady = true;
+        for (int i = 0; i < step.frames; ++i) {
+            long long allocations = pool.getStats().allocations;
+            frame = recordTargetFrame(pool, step.width, step.height, step.scale);
+            if (i > 0 && pool.getStats().allocations != allocations)
+                steady = false;
+        }
+        const RenderTargetPool::Stats& s = pool.getStats();
+
+        int width = std::max(1, (int)(step.width * step.scale + 0.5f));
+        int height = std::max(1, (int)(step.height * step.scale + 0.5f));
+        RenderTargetDesc color = RenderTargetDesc::fixed(width, height, GL_RGBA16F, GL_LINEAR, GL_CLAMP_TO_EDGE);
+        RenderTargetDesc depth = RenderTargetDesc::fixed(width, height, GL_DEPTH_COMPONENT24, GL_NEAREST, GL_CLAMP_TO_EDGE);
+        size_t expected = 3 * pool.targetBytes(color, width, height) + pool.targetBytes(depth, width, height)
+            + (size_t)BENCH_SHADOW_SIZE * BENCH_SHADOW_SIZE * GLRenderTargetBackend::formatBytes(GL_DEPTH_COMPONENT24);
+
+        bool pass = frame.distinct && steady && s.targets == 5 && s.bytes == expected
+            && frame.sceneDepth == frame.reflectionDepth && frame.pingpong[0] == frame.reflectionColor
+            && backend.textures == s.targets && backend.framebuffers == s.framebuffers;
+        ok = ok && pass;
+        std::cout << step.width << "x" << step.height << "\t" << step.scale << "\t" << s.targets << "\t "
+            << s.bytes / MB << "\t " << 100.0 * s.bytes / fixedBytes << "%\t  " << s.allocations - before.allocations
+            << "\t     " << (double)(s.reuses - before.reuses) / step.frames << "\t" << (pass ? "ok" : "FAIL") << "\n";
+    }
+
+    pool.destroy();
+    bool released = backend.textures == 0 && backend.framebuffers == 0;
+    ok = ok && released;
+    std::cout << "peak " << pool.getStats().peakBytes / MB << " MB; " << (released ? "all freed on destroy"
+        : "CHECKS FAILED: targets left after destroy") << "\n";
+    std::cout << (ok ? "all checks passed" : "CHECKS FAILED") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ------------------- SHADOW FILTERING ---------------------
+// The light looks straight down on gently rolling ground with discs
+// floating above it: canopies, a small disc over a large one, a rock just
+// above the ground and a few twigs about a texel wide. Coordinates are the
+// shadow map's: u, v across it, depth 0 at the light's near plane and 1 at
+// its far plane.
+struct ShadowDisc {
+    float u, v, radius, depth;
+};
+
+static const ShadowDisc SHADOW_DISCS[] = {
+    { 0.15f, 0.50f, 0.020f, 0.25f },   // canopy
+    { 0.30f, 0.50f, 0.030f, 0.20f },   // canopy with a branch below it
+    { 0.31f, 0.49f, 0.012f, 0.45f },
+    { 0.45f, 0.51f, 0.010f, 0.475f },  // rock
+    { 0.60f, 0.48f, 0.015f, 0.30f },
+    { 0.62f, 0.52f, 0.015f, 0.40f },   // overlapping canopies
+    { 0.75f, 0.50f, 0.0004f, 0.30f },  // twigs
+    { 0.76f, 0.51f, 0.0003f, 0.35f },
+    { 0.77f, 0.49f, 0.0005f, 0.30f },
+    { 0.85f, 0.50f, 0.025f, 0.10f },
+};
+
+// terrain's bias in shader.frag
+static const float SHADOW_BIAS = 0.01f;
+
+static float shadowGroundDepth(float u, float v)
+{
+    return 0.5f + 0.004f * std::sin(40.0f * u) * std::cos(30.0f * v);
+}
+
+// Nearest occluder at (u, v), 1 if there is none
+static float shadowOccluderDepth(float u, float v)
+{
+    float depth = 1.0f;
+    for (const ShadowDisc& disc : SHADOW_DISCS) {
+        float du = u - disc.u, dv = v - disc.v;
+        if (du * du + dv * dv <= disc.radius * disc.radius)
+            depth = std::min(depth, disc.depth);
+    }
+    return depth;
+}
+
+// A square map sampled as the GL does: texel centres at (i + 0.5) / size,
+// white (1) outside, as GL_CLAMP_TO_BORDER
+struct ShadowImage {
+    int size, channels;
+    std::vector<float> texels;
+
+    float texel(int x, int y, int c) const
+    {
+        if (x < 0 || y < 0 || x >= size || y >= size)
+            return 1.0f;
+        return texels[((size_t)y * size + x) * channels + c];
+    }
+
+    float nearest(float u, float v, int c) const
+    {
+        return texel((int)std::floor(u * size), (int)std::floor(v * size), c);
+    }
+
+    float bilinear(float u, float v, int c) const
+    {
+        float x = u * size - 0.5f, y = v * size - 0.5f;
+        int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+        float fx = x - x0, fy = y - y0;
+        return (texel(x0, y0, c) * (1.0f - fx) + texel(x0 + 1, y0, c) * fx) * (1.0f - fy)
+            + (texel(x0, y0 + 1, c) * (1.0f - fx) + texel(x0 + 1, y0 + 1, c) * fx) * fy;
+    }
+};
+
+// What the light rasterizes: the nearest surface at every texel centre
+static ShadowImage renderShadowDepth(int size)
+{
+    ShadowImage image = { size, 1, std::vector<float>((size_t)size * size) };
+    for (int y = 0; y < size; ++y)
+        for (int x = 0; x < size; ++x)
+            image.texels[(size_t)y * size + x] = shadowGroundDepth((x + 0.5f) / size, (y + 0.5f) / size);
+    for (const ShadowDisc& disc : SHADOW_DISCS) {
+        int x0 = std::max(0, (int)((disc.u - disc.radius) * size)), x1 = std::min(size - 1, (int)((disc.u + disc.radius) * size));
+        int y0 = std::max(0, (int)((disc.v - disc.radius) * size)), y1 = std::min(size - 1, (int)((disc.v + disc.radius) * size));
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x) {
+                float du = (x + 0.5f) / size - disc.u, dv = (y + 0.5f) / size - disc.v;
+                float& depth = image.texels[(size_t)y * size + x];
+                if (du * du + dv * dv <= disc.radius * disc.radius)
+                    depth = std::min(depth, disc.depth);
+            }
+    }
+    return image;
+}
+
+// shadow_moments.frag on the depth map, then blur.frag across and down
+static ShadowImage renderShadowMoments(const ShadowImage& depth, ShadowFilter filter, float esmExponent)
+{
+    int channels = filter == SHADOW_VSM ? 2 : 1;
+    ShadowImage moments = { depth.size, channels, std::vector<float>(depth.texels.size() * channels) };
+    for (size_t i = 0; i < depth.texels.size(); ++i) {
+        float d = depth.texels[i];
+        if (filter == SHADOW_VSM) {
+            moments.texels[i * 2] = d;
+            moments.texels[i * 2 + 1] = d * d;
+        }
+        else {
+            moments.texels[i] = std::exp(esmExponent * (d - 1.0f));
+        }
+    }
+
+    const float weights[5] = { 0.227027f, 0.1945946f, 0.1216216f, 0.054054f, 0.016216f };
+    int size = moments.size;
+    ShadowImage blurred = moments;
+    for (int pass = 0; pass < 2; ++pass) {
+        const ShadowImage& src = pass == 0 ? moments : blurred;
+        ShadowImage& dst = pass == 0 ? blurred : moments;
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+                for (int c = 0; c < channels; ++c) {
+                    // blur.frag clamps its taps to the image
+                    float sum = src.texel(x, y, c) * weights[0];
+                    for (int i = 1; i < 5; ++i) {
+                        if (pass == 0) {
+                            sum += src.texel(std::min(x + i, size - 1), y, c) * weights[i];
+                            sum += src.texel(std::max(x - i, 0), y, c) * weights[i];
+                        }
+                        else {
+                            sum += src.texel(x, std::min(y + i, size - 1), c) * weights[i];
+                            sum += src.texel(x, std::max(y - i, 0), c) * weights[i];
+                        }
+                    }
+                    dst.texels[((size_t)y * size + x) * channels + c] = sum;
+                }
+    }
+    return moments;
+}
+
+// filterShadow() of shader.frag, as the lit fraction, for a receiver at
+// depth z (bias applied)
+static float shadowVisibility(ShadowFilter filter, const ShadowImage& map, const ShadowSettings& settings,
+    float u, float v, float z)
+{
+    float texel = 1.0f / map.size;
+    if (filter == SHADOW_PCF) {
+        float lit = 0.0f;
+        for (int x = -1; x <= 1; ++x)
+            for (int y = -1; y <= 1; ++y)
+                lit += z > map.nearest(u + x * texel, v + y * texel, 0) ? 0.0f : 1.0f;
+        return lit / 9.0f;
+    }
+    if (filter == SHADOW_HARDWARE_PCF) {
+        // GL_LEQUAL compares each of the four texels, then filters
+        float lit = 0.0f;
+        for (int i = 0; i < 4; ++i) {
+            float x = (u + (i & 1 ? texel : -texel)) * map.size - 0.5f;
+            float y = (v + (i & 2 ? texel : -texel)) * map.size - 0.5f;
+            int x0 = (int)std::floor(x), y0 = (int)std::floor(y);
+            float fx = x - x0, fy = y - y0;
+            auto cmp = [&](int tx, int ty) { return z <= map.texel(tx, ty, 0) ? 1.0f : 0.0f; };
+            lit += (cmp(x0, y0) * (1.0f - fx) + cmp(x0 + 1, y0) * fx) * (1.0f - fy)
+                + (cmp(x0, y0 + 1) * (1.0f - fx) + cmp(x0 + 1, y0 + 1) * fx) * fy;
+        }
+        return lit * 0.25f;
+    }
+    if (filter == SHADOW_VSM) {
+        float mean = map.bilinear(u, v, 0), square = map.bilinear(u, v, 1);
+        if (z <= mean)
+            return 1.0f;
+        float variance = std::max(square - mean * mean, 0.00002f);
+        float d = z - mean;
+        float lit = variance / (variance + d * d);
+        float r = settings.vsmBleedReduction;
+        return std::min(std::max((lit - r) / (1.0f - r), 0.0f), 1.0f);
+    }
+    return std::min(std::max(map.bilinear(u, v, 0) * std::exp(-settings.esmExponent * (z - 1.0f)), 0.0f), 1.0f);
+}
+
+struct ShadowRun {
+    const char* name;
+    ShadowFilter filter;
+    double sumSquared, maxError;
+    long long lookups, bleeding, falseShadow;
+    double lookupNs;
+    int fetches;                   // texture instructions per lookup
+    long long prefilterReads;      // texels the blur reads per frame
+    size_t bytes;                  // shadow targets alive in the shadow passes
+
+    double rmse() const { return std::sqrt(sumSquared / std::max(lookups, 1LL)); }
+};
+
+// Cost and quality of the shadow filters over a fixed camera path: each
+// frame looks at a patch of ground along a line across the scene, at a
+// sub-texel offset that changes from frame to frame. Against the visibility
+// the 3x3 PCF kernel approximates, a box over its nine texels supersampled
+// from the analytic scene. Light bleeding counts receivers fully in shadow
+// that come out more than 20% lit, false shadow receivers fully lit that
+// come out more than 20% shadowed (acne, or a wider filter). Maps are the
+// sizes ShadowSettings gives; memory is what renderLoop holds during the
+// shadow passes.
+static int benchShadows()
+{
+    const int FRAMES = 24, GRID = 48, SUPERSAMPLE = 8;
+    const float WINDOW = 0.1f;
+    const double MB = 1024.0 * 1024.0;
+    ShadowSettings settings;
+
+    auto start = std::chrono::steady_clock::now();
+    ShadowImage depthMap = renderShadowDepth(settings.mapSize);
+    ShadowImage momentsDepth = renderShadowDepth(settings.momentMapSize);
+    ShadowImage vsmMap = renderShadowMoments(momentsDepth, SHADOW_VSM, settings.esmExponent);
+    ShadowImage esmMap = renderShadowMoments(momentsDepth, SHADOW_ESM, settings.esmExponent);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    // Receivers and their reference visibility
+    struct Receiver {
+        float u, v, z, visible;
+    };
+    std::vector<Receiver> receivers;
+    float texel = 1.0f / settings.mapSize;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        float centerU = 0.1f + 0.8f * frame / (FRAMES - 1);
+        float jitter = 0.37f * frame * texel;
+        for (int j = 0; j < GRID; ++j)
+            for (int i = 0; i < GRID; ++i) {
+                Receiver r;
+                r.u = centerU - 0.5f * WINDOW + WINDOW * (i + 0.5f) / GRID + jitter;
+                r.v = 0.5f - 0.5f * WINDOW + WINDOW * (j + 0.5f) / GRID + jitter;
+                r.z = shadowGroundDepth(r.u, r.v);
+                int lit = 0, samples = 3 * SUPERSAMPLE;
+                float cornerU = (std::floor(r.u * settings.mapSize) - 1.0f) * texel;
+                float cornerV = (std::floor(r.v * settings.mapSize) - 1.0f) * texel;
+                for (int sy = 0; sy < samples; ++sy)
+                    for (int sx = 0; sx < samples; ++sx)
+                        lit += shadowOccluderDepth(cornerU + (sx + 0.5f) * texel / SUPERSAMPLE,
+                            cornerV + (sy + 0.5f) * texel / SUPERSAMPLE) >= r.z;
+                r.visible = (float)lit / (samples * samples);
+                receivers.push_back(r);
+            }
+    }
+
+    size_t depthBytes = GLRenderTargetBackend::formatBytes(GL_DEPTH_COMPONENT24);
+    size_t mapTexels = (size_t)settings.mapSize * settings.mapSize;
+    size_t momentTexels = (size_t)settings.momentMapSize * settings.momentMapSize;
+    long long blurReads = 2LL * 9 * (long long)momentTexels;
+    ShadowSettings noReduction = settings;
+    noReduction.vsmBleedReduction = 0.0f;
+
+    ShadowRun runs[] = {
+        { "pcf", SHADOW_PCF, 0, 0, 0, 0, 0, 0, 9, 0, mapTexels * depthBytes },
+        { "hardware", SHADOW_HARDWARE_PCF, 0, 0, 0, 0, 0, 0, 4, 0, mapTexels * depthBytes },
+        { "vsm", SHADOW_VSM, 0, 0, 0, 0, 0, 0, 1, blurReads,
+            momentTexels * (2 * GLRenderTargetBackend::formatBytes(GL_RG32F) + depthBytes) },
+        { "vsm nocut", SHADOW_VSM, 0, 0, 0, 0, 0, 0, 1, blurReads,
+            momentTexels * (2 * GLRenderTargetBackend::formatBytes(GL_RG32F) + depthBytes) },
+        { "esm", SHADOW_ESM, 0, 0, 0, 0, 0, 0, 1, blurReads,
+            momentTexels * (2 * GLRenderTargetBackend::formatBytes(GL_R32F) + depthBytes) },
+    };
+
+    std::cout << "Shadow filtering: " << FRAMES << " frames of " << GRID * GRID << " receivers, depth map "
+        << settings.mapSize << "^2, moment maps " << settings.momentMapSize << "^2 (built in " << buildMs
+        << " ms on the CPU)\n";
+    std::cout << "filter\t\trmse\tmax err\tbleeding  false shadow  fetches  prefilter reads  MB\tcpu ns/lookup\n";
+    float sink = 0.0f;
+    for (ShadowRun& run : runs) {
+        const ShadowImage& map = run.filter == SHADOW_VSM ? vsmMap : run.filter == SHADOW_ESM ? esmMap : depthMap;
+        const ShadowSettings& s = &run == &runs[3] ? noReduction : settings;
+        std::vector<float> visible(receivers.size());
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < receivers.size(); ++i)
+            visible[i] = shadowVisibility(run.filter, map, s, receivers[i].u, receivers[i].v,
+                receivers[i].z - SHADOW_BIAS);
+        run.lookupNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+            / receivers.size();
+
+        for (size_t i = 0; i < receivers.size(); ++i) {
+            double error = std::abs(visible[i] - receivers[i].visible);
+            run.sumSquared += error * error;
+            run.maxError = std::max(run.maxError, error);
+            run.bleeding += receivers[i].visible == 0.0f && visible[i] > 0.2f;
+            run.falseShadow += receivers[i].visible == 1.0f && visible[i] < 0.8f;
+            sink += visible[i];
+        }
+        run.lookups = (long long)receivers.size();
+
+        std::cout << run.name << (std::strlen(run.name) < 8 ? "\t\t" : "\t") << run.rmse() << "\t" << run.maxError
+            << "\t" << 100.0 * run.bleeding / run.lookups << "%\t  " << 100.0 * run.falseShadow / run.lookups
+            << "%\t\t" << run.fetches << "\t " << run.prefilterReads / 1e6 << "M\t\t  " << run.bytes / MB << "\t"
+            << run.lookupNs << "\n";
+    }
+    benchSink = (unsigned int)sink;
+
+    const ShadowRun& pcf = runs[0];
+    const ShadowRun& hardware = runs[1];
+    const ShadowRun& vsm = runs[2];
+    const ShadowRun& vsmUncut = runs[3];
+    const ShadowRun& esm = runs[4];
+    bool ok = true;
+    auto check = [&ok](bool pass, const char* what) {
+        if (!pass)
+            std::cout << "CHECK FAILED: " << what << "\n";
+        ok = ok && pass;
+    };
+    check(pcf.rmse() < 0.05, "pcf follows the reference");
+    check(hardware.rmse() < 0.05 && hardware.fetches < pcf.fetches, "hardware pcf follows it in fewer fetches");
+    check(vsm.rmse() < 0.15 && esm.rmse() < 0.15, "prefiltered filters stay near the reference");
+    check(vsm.bleeding < vsmUncut.bleeding, "the vsm bleed cut reduces light bleeding");
+    for (const ShadowRun& run : runs)
+        check(run.falseShadow * 100 < run.lookups, "no shadow acne on the ground");
+    std::cout << (ok ? "all checks passed" : "CHECKS FAILED") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ------------------- SHADER PERMUTATIONS ---------------------
+// The variants renderLoop asks the registry for in one frame, keys masked
+// as ProgramRegistry::variant() masks them
+static std::vector<std::pair<ProgramId, unsigned int>> frameVariants(ShadowFilter filter, QualityPreset preset,
+    ReflectionMode reflections)
+{
+    ProgramKey key(filter, QualitySettings::preset(preset), reflections);
+    std::vector<std::pair<ProgramId, ProgramKey>> asked = {
+        { PROGRAM_DEPTH, ProgramKey() }, { PROGRAM_BLUR, key }, { PROGRAM_TERRAIN, key }, { PROGRAM_WATER, key },
+        { PROGRAM_SKYBOX, ProgramKey() }, { PROGRAM_BRIGHTPASS, ProgramKey() },
+        { PROGRAM_FINAL, ProgramKey() }, { PROGRAM_HIZ, ProgramKey() } };
+    if (reflections == REFLECTION_PLANAR)
+        asked.push_back({ PROGRAM_TERRAIN, key.withClip(true) });
+    if (filter == SHADOW_VSM || filter == SHADOW_ESM)
+        asked.push_back({ PROGRAM_SHADOW_MOMENTS, key });
+
+    std::vector<std::pair<ProgramId, unsigned int>> out;
+    for (const auto& a : asked)
+        out.push_back({ a.first, a.second.masked(programSource(a.first).features).bits() });
+    return out;
+}
+
+// Line the compiler reports for line `line` of the original source, given
+// the #line directives in the injected one
+static int reportedLine(const std::string& injected, const std::string& text)
+{
+    std::istringstream in(injected);
+    std::string l;
+    int line = 1;
+    while (std::getline(in, l)) {
+        if (l.find(text) != std::string::npos)
+            return line;
+        line = l.compare(0, 6, "#line ") == 0 ? std::stoi(l.substr(6)) : line + 1;
+    }
+    return -1;
+}
+
+// Define injection on sources shaped like the repo's (with a BOM, with
+// CRLF, without #version), then the variants each shadow filter and
+// quality preset needs: how many a frame asks for, how many a session can
+// compile at most, and what specializing saves per fragment. Compile times
+// need a context; renderLoop reports them with the render stats.
+static int benchPermutations()
+{
+    bool ok = true;
+    auto check = [&ok](bool pass, const char* what) {
+        if (!pass)
+            std::cout << "CHECK FAILED: " << what << "\n";
+        ok = ok && pass;
+    };
+
+    const std::string defines = "#define CLIP_PLANE\n#define SHADOW_FILTER 1\n";
+    const std::string sources[] = {
+        "#version 330 core\nuniform float a;\nvoid main() {}\n",
+        "\xEF\xBB\xBF#version 330 core\nout vec4 FragColor;\n\nvoid main() {}\n",
+        "// comment\r\n#version 330 core\r\nin vec3 FragPos;\r\nvoid main() {}\r\n",
+        "void main() {}\n",
+    };
+    for (const std::string& source : sources) {
+        std::string injected = insertDefines(source, defines);
+        size_t version = injected.find("#version");
+        check(version == source.find("#version"), "#version stays where it was");
+        check(injected.find("#define SHADOW_FILTER 1") != std::string::npos
+            && (version == std::string::npos || injected.find("#define") > version), "defines follow #version");
+        check(reportedLine(injected, "void main") == reportedLine(source, "void main"),
+            "compiler line numbers match the file");
+    }
+    check(insertDefines(sources[0], "") == sources[0], "no defines, no change");
+
+    // Keys the switches of a program do not read must not make variants
+    ProgramKey a(SHADOW_VSM, QualitySettings::preset(QUALITY_HIGH)), b;
+    check(a.masked(programSource(PROGRAM_SKYBOX).features).bits() == b.bits()
+        && a.defines(programSource(PROGRAM_SKYBOX).features).empty(), "programs without switches have one variant");
+    check(a.masked(programSource(PROGRAM_BLUR).features).bits()
+        != b.masked(programSource(PROGRAM_BLUR).features).bits(), "blur has a variant per tap count");
+    check(a.withClip(true).defines(programSource(PROGRAM_TERRAIN).features)
+        != a.defines(programSource(PROGRAM_TERRAIN).features), "the clipped terrain differs");
+    ProgramKey ssr(SHADOW_VSM, QualitySettings::preset(QUALITY_HIGH), REFLECTION_SSR);
+    check(ssr.defines(programSource(PROGRAM_WATER).features).find("SCREEN_SPACE_REFLECTIONS") != std::string::npos
+        && ssr.masked(programSource(PROGRAM_TERRAIN).features).bits() == a.masked(programSource(PROGRAM_TERRAIN).features).bits(),
+        "only the water has a screen-space reflection variant");
+
+    std::cout << "Shader permutations: " << PROGRAM_COUNT << " programs\n";
+    std::cout << "quality\tfilter\t\treflections  per frame  new  shadow fetches  blur taps\n";
+    ShadowSettings defaults;
+    auto startup = frameVariants(defaults.filter, QUALITY_MEDIUM, ReflectionSettings().mode);
+    std::vector<std::pair<ProgramId, unsigned int>> all;
+    for (int p = 0; p < QUALITY_COUNT; ++p) {
+        for (int f = 0; f < SHADOW_FILTER_COUNT * REFLECTION_MODE_COUNT; ++f) {
+            QualityPreset preset = (QualityPreset)p;
+            ShadowFilter filter = (ShadowFilter)(f / REFLECTION_MODE_COUNT);
+            ReflectionMode reflections = (ReflectionMode)(f % REFLECTION_MODE_COUNT);
+            auto frame = frameVariants(filter, preset, reflections);
+            std::sort(frame.begin(), frame.end());
+            frame.erase(std::unique(frame.begin(), frame.end()), frame.end());
+            int added = 0;
+            for (const auto& v : frame) {
+                if (std::find(startup.begin(), startup.end(), v) == startup.end())
+                    added++;
+                if (std::find(all.begin(), all.end(), v) == all.end())
+                    all.push_back(v);
+            }
+
+            QualitySettings q = QualitySettings::preset(preset);
+            int k = q.shadowKernel;
+            int fetches = filter == SHADOW_PCF ? (2 * k + 1) * (2 * k + 1)
+                : filter == SHADOW_HARDWARE_PCF ? (k + 1) * (k + 1) : 1;
+            std::cout << qualityPresetName(preset) << "\t" << shadowFilterName(filter)
+                << (std::strlen(shadowFilterName(filter)) < 8 ? "\t\t" : "\t") << reflectionModeName(reflections)
+                << "\t     " << frame.size() << "\t\t"
+                << added << "\t" << fetches << "\t\t" << 2 * q.blurTaps - 1 << "\n";
+        }
+    }
+
+    // terrain: 2 clip x 4 filters x 3 kernels, water 4 x 3 x 2 reflection
+    // modes, blur 3, moments 2 filters (VSM, ESM) and one of everything else
+    int bound = 24 + 24 + 3 + 2 + (PROGRAM_COUNT - 4);
+    std::cout << all.size() << " variants over all presets, filters and reflection modes (at most " << bound << "), "
+        << startup.size() << " in the first frame at the defaults\n";
+    check((int)all.size() <= bound, "variant count stays bounded");
+    std::cout << (ok ? "all checks passed" : "CHECKS FAILED") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ------------------- SCREEN-SPACE REFLECTIONS ---------------------
+// Water at y = 0 seen from just above it, with boxes standing on it at
+// increasing distance and nothing else but sky. The depth image stands in
+// for the Hi-Z pyramid's level 0.
+struct SsrBox {
+    glm::vec3 min, max;
+};
+
+static const SsrBox SSR_BOXES[] = {
+    { { -6.0f, 0.0f, -18.0f }, { -3.0f, 4.0f, -15.0f } },
+    { { 2.0f, 0.0f, -26.0f }, { 5.0f, 9.0f, -22.0f } },
+    { { -14.0f, 0.0f, -40.0f }, { -8.0f, 6.0f, -34.0f } },
+    { { 7.0f, 0.0f, -55.0f }, { 16.0f, 14.0f, -48.0f } },
+    { { -2.0f, 0.0f, -75.0f }, { 3.0f, 20.0f, -70.0f } },
+    { { -30.0f, 0.0f, -90.0f }, { -18.0f, 11.0f, -80.0f } },
+    { { 0.6f, 0.0f, -9.0f }, { 0.9f, 2.5f, -8.7f } },      // a post, a texel or two wide
+};
+
+static const float SSR_NEAR = 0.1f, SSR_FAR = 5000.0f;
+
+// Nearest box along the ray, or a negative distance
+static float ssrHitBoxes(const glm::vec3& origin, const glm::vec3& dir)
+{
+    float nearest = -1.0f;
+    for (const SsrBox& box : SSR_BOXES) {
+        float t0 = 0.0f, t1 = std::numeric_limits<float>::max();
+        for (int axis = 0; axis < 3; ++axis) {
+            float inv = 1.0f / dir[axis];
+            float a = (box.min[axis] - origin[axis]) * inv, b = (box.max[axis] - origin[axis]) * inv;
+            t0 = std::max(t0, std::min(a, b));
+            t1 = std::min(t1, std::max(a, b));
+        }
+        if (t0 <= t1 && t0 > 1e-4f && (nearest < 0.0f || t0 < nearest))
+            nearest = t0;
+    }
+    return nearest;
+}
+
+// The nearest-depth pyramid as hiz.frag builds it: every texel the
+// nearest of the source texels it covers, sizes halving down to 1 x 1
+struct SsrPyramid {
+    std::vector<int> widths, heights;
+    std::vector<std::vector<float>> nearest;
+
+    float at(int level, int x, int y) const { return nearest[level][y * widths[level] + x]; }
+
+    void build(const std::vector<float>& depth, int width, int height)
+    {
+        widths.assign(1, width);
+        heights.assign(1, height);
+        nearest.assign(1, depth);
+        while (widths.back() > 1 || heights.back() > 1) {
+            int sw = widths.back(), sh = heights.back();
+            int w = std::max(sw / 2, 1), h = std::max(sh / 2, 1);
+            std::vector<float> level((size_t)w * h);
+            for (int y = 0; y < h; ++y) {
+                for (int x = 0; x < w; ++x) {
+                    int x0 = std::min(x * sw / w, sw - 1), x1 = std::min(((x + 1) * sw + w - 1) / w - 1, sw - 1);
+                    int y0 = std::min(y * sh / h, sh - 1), y1 = std::min(((y + 1) * sh + h - 1) / h - 1, sh - 1);
+                    float d = 1.0f;
+                    for (int sy = y0; sy <= y1; ++sy)
+                        for (int sx = x0; sx <= x1; ++sx)
+                            d = std::min(d, nearest.back()[sy * sw + sx]);
+                    level[y * w + x] = d;
+                }
+            }
+            widths.push_back(w);
+            heights.push_back(h);
+            nearest.push_back(level);
+        }
+    }
+};
+
+struct SsrTrace {
+    bool hit;
+    glm::vec2 uv;
+    int fetches;
+};
+
+static float ssrLinearDepth(float depth)
+{
+    float z = depth * 2.0f - 1.0f;
+    return 2.0f * SSR_NEAR * SSR_FAR / (SSR_FAR + SSR_NEAR - z * (SSR_FAR - SSR_NEAR));
+}
+
+static glm::vec3 ssrToScreen(const glm::mat4& viewProjection, const glm::vec3& p)
+{
+    glm::vec4 clip = viewProjection * glm::vec4(p, 1.0f);
+    return glm::vec3(clip) / clip.w * 0.5f + 0.5f;
+}
+
+// traceScreenSpace() of water.frag; maxLevel 0 marches texel by texel
+static SsrTrace ssrTrace(const SsrPyramid& pyramid, const glm::mat4& view, const glm::mat4& projection,
+    const glm::vec3& origin, const glm::vec3& dir, const ReflectionSettings& settings, int maxSteps, int maxLevel)
+{
+    SsrTrace trace = { false, glm::vec2(0.0f), 0 };
+    glm::vec3 viewOrigin = glm::vec3(view * glm::vec4(origin, 1.0f));
+    glm::vec3 viewDir = glm::mat3(view) * dir;
+    float len = settings.maxDistance;
+    if (viewDir.z > 0.0f)
+        len = std::min(len, 0.99f * (-SSR_NEAR - viewOrigin.z) / viewDir.z);
+
+    glm::mat4 viewProjection = projection * view;
+    glm::vec3 o = ssrToScreen(viewProjection, origin);
+    glm::vec3 d = ssrToScreen(viewProjection, origin + dir * len) - o;
+    glm::vec2 exitSide(d.x >= 0.0f ? 1.0f : 0.0f, d.y >= 0.0f ? 1.0f : 0.0f);
+    glm::vec2 invD;
+    for (int axis = 0; axis < 2; ++axis)
+        invD[axis] = (d[axis] + 1e-12f < 0.0f ? -1.0f : 1.0f) / std::max(std::abs(d[axis]), 1e-7f);
+    glm::vec2 tScreen = (exitSide - glm::vec2(o)) * invD;
+    float tMax = std::min(1.0f, std::min(tScreen.x, tScreen.y));
+
+    float t = std::min(0.5f / pyramid.widths[0] * std::abs(invD.x), 0.5f / pyramid.heights[0] * std::abs(invD.y));
+    int level = 0;
+    int top = std::min(maxLevel, (int)pyramid.widths.size() - 1);
+    for (int i = 0; i < maxSteps && t < tMax; ++i) {
+        glm::vec2 size((float)pyramid.widths[level], (float)pyramid.heights[level]);
+        glm::vec3 p = o + d * t;
+        glm::vec2 heading(d.x > 0.0f ? 0.001f : d.x < 0.0f ? -0.001f : 0.0f, d.y > 0.0f ? 0.001f : d.y < 0.0f ? -0.001f : 0.0f);
+        glm::vec2 cell = glm::clamp(glm::floor(glm::vec2(p) * size + heading), glm::vec2(0.0f), size - 1.0f);
+        glm::vec2 tCell = ((cell + exitSide) / size - glm::vec2(o)) * invD;
+        float tOut = std::min(std::min(tCell.x, tCell.y), tMax);
+        float nearest = pyramid.at(level, (int)cell.x, (int)cell.y);
+        trace.fetches++;
+        float rayDepth = o.z + d.z * (d.z > 0.0f ? tOut : t);
+        if (rayDepth < nearest) {
+            t = tOut + 1e-5f;
+            level = std::min(level + 1, top);
+            continue;
+        }
+        if (d.z > 0.0f)
+            t = std::max(t, (nearest - o.z) / d.z);
+        if (level > 0) {
+            level--;
+            continue;
+        }
+        glm::vec3 hit = o + d * t;
+        if (ssrLinearDepth(hit.z) - ssrLinearDepth(nearest) < settings.thickness) {
+            trace.hit = true;
+            trace.uv = glm::vec2(hit);
+            return trace;
+        }
+        t = tOut + 1e-5f;
+    }
+    return trace;
+}
+
+// Every water pixel of the view traced three ways: with the Hi-Z march at
+// the settings' step limit, with the same march held at level 0 and no step
+// limit (the reference it must agree with), and against the boxes
+// themselves, which also finds what is off screen or hidden and so out of
+// reach of any screen-space method. Fetches per ray are what the GPU pays.
+static int benchSsr()
+{
+    const int width = 480, height = 270;
+    ReflectionSettings settings;
+    glm::vec3 eye(0.0f, 2.0f, 0.0f);
+    glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(0.0f, -0.12f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)width / height, SSR_NEAR, SSR_FAR);
+    glm::mat4 inverseVP = glm::inverse(projection * view);
+
+    // The opaque scene's depth and, per pixel, where its view ray meets the water
+    std::vector<float> depth((size_t)width * height, 1.0f);
+    std::vector<glm::vec3> waterPoints;
+    std::vector<glm::vec3> viewDirs;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            glm::vec4 farPoint = inverseVP * glm::vec4((x + 0.5f) / width * 2.0f - 1.0f,
+                (y + 0.5f) / height * 2.0f - 1.0f, 1.0f, 1.0f);
+            glm::vec3 dir = glm::normalize(glm::vec3(farPoint) / farPoint.w - eye);
+            float box = ssrHitBoxes(eye, dir);
+            float water = dir.y < 0.0f ? -eye.y / dir.y : -1.0f;
+            if (box > 0.0f && (water < 0.0f || box < water))
+                depth[y * width + x] = ssrToScreen(projection * view, eye + dir * box).z;
+            else if (water > 0.0f) {
+                waterPoints.push_back(eye + dir * water);
+                viewDirs.push_back(dir);
+            }
+        }
+    }
+    SsrPyramid pyramid;
+    pyramid.build(depth, width, height);
+
+    int rays = 0, hizHits = 0, linearHits = 0, agree = 0, boxHits = 0, found = 0, spurious = 0, outOfSteps = 0;
+    long long hizFetches = 0, linearFetches = 0;
+    int maxHizFetches = 0;
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> ripple(-0.04f, 0.04f);
+    for (size_t i = 0; i < waterPoints.size(); i += 3) {
+        glm::vec3 normal = glm::normalize(glm::vec3(ripple(rng), 1.0f, ripple(rng)));
+        glm::vec3 dir = glm::reflect(viewDirs[i], normal);
+        SsrTrace hiz = ssrTrace(pyramid, view, projection, waterPoints[i], dir, settings, settings.maxSteps, 64);
+        SsrTrace linear = ssrTrace(pyramid, view, projection, waterPoints[i], dir, settings, 1 << 20, 0);
+        float box = ssrHitBoxes(waterPoints[i], dir);
+        bool boxHit = box > 0.0f && box < settings.maxDistance;
+
+        rays++;
+        hizHits += hiz.hit;
+        linearHits += linear.hit;
+        if (hiz.hit == linear.hit && (!hiz.hit || glm::length((hiz.uv - linear.uv) * glm::vec2(width, height)) < 2.0f))
+            agree++;
+        else if (!hiz.hit && hiz.fetches >= settings.maxSteps)
+            outOfSteps++;
+        boxHits += boxHit;
+        found += boxHit && hiz.hit;
+        spurious += !boxHit && hiz.hit;
+        hizFetches += hiz.fetches;
+        linearFetches += linear.fetches;
+        maxHizFetches = std::max(maxHizFetches, hiz.fetches);
+    }
+
+    double agreement = 100.0 * agree / std::max(rays, 1);
+    double hizMean = (double)hizFetches / std::max(rays, 1), linearMean = (double)linearFetches / std::max(rays, 1);
+    std::cout << "SSR: " << width << "x" << height << " depth, " << pyramid.widths.size() << " levels, "
+        << rays << " water rays, up to " << settings.maxSteps << " steps\n";
+    std::cout << "  Hi-Z march:     " << 100.0 * hizHits / rays << "% hit, " << hizMean << " fetches/ray mean, "
+        << maxHizFetches << " max, " << outOfSteps << " ran out of steps\n";
+    std::cout << "  texel march:    " << 100.0 * linearHits / rays << "% hit, " << linearMean << " fetches/ray mean\n";
+    std::cout << "  agreement:      " << agreement << "% of rays\n";
+    std::cout << "  scene geometry: " << 100.0 * boxHits / rays << "% of rays hit a box, " << 100.0 * found
+        / std::max(boxHits, 1) << "% of those found on screen; the rest fall back to the sky\n";
+    std::cout << "  false hits:     " << 100.0 * spurious / rays << "% of rays hit on screen but miss the boxes\n";
+
+    bool ok = true;
+    auto check = [&ok](bool pass, const char* what) {
+        if (!pass)
+            std::cout << "CHECK FAILED: " << what << "\n";
+        ok = ok && pass;
+    };
+    check(hizHits > rays / 10, "the boxes show in the water");
+    check(agreement >= 98.0, "the Hi-Z march finds what the texel march finds");
+    check(hizMean * 4.0 < linearMean, "the pyramid saves most fetches");
+    check(spurious * 50 <= rays, "screen-space hits are real");
+    std::cout << (ok ? "all checks passed" : "CHECKS FAILED") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ------------------- ATMOSPHERE ---------------------
+static int cubeFaceOf(glm::vec3 d, float& s, float& t)
+{
+    glm::vec3 a(std::abs(d.x), std::abs(d.y), std::abs(d.z));
+    if (a.x >= a.y && a.x >= a.z) {
+        s = (d.x > 0.0f ? -d.z : d.z) / a.x;
+        t = -d.y / a.x;
+        return d.x > 0.0f ? 0 : 1;
+    }
+    if (a.y >= a.z) {
+        s = d.x / a.y;
+        t = (d.y > 0.0f ? d.z : -d.z) / a.y;
+        return d.y > 0.0f ? 2 : 3;
+    }
+    s = (d.z > 0.0f ? d.x : -d.x) / a.z;
+    t = -d.y / a.z;
+    return d.z > 0.0f ? 4 : 5;
+}
+
+// Steps until nothing is left to do, waiting for each
+static int benchSettleAtmosphere(Atmosphere& atmosphere, glm::vec3 sunDir)
+{
+    int steps = 0;
+    for (;;) {
+        atmosphere.start(sunDir);
+        atmosphere.finish();
+        if (!atmosphere.poll())
+            return steps;
+        ++steps;
+    }
+}
+
+static int benchAtmosphere()
+{
+    bool ok = true;
+    auto check = [&ok](bool pass, const char* what) {
+        if (!pass)
+            std::cout << "CHECK FAILED: " << what << "\n";
+        ok = ok && pass;
+    };
+
+    Atmosphere::Settings settings;
+    Atmosphere atmosphere;
+    atmosphere.init(settings);
+    std::cout << "Atmosphere: transmittance " << settings.transmittanceWidth << "x" << settings.transmittanceHeight
+        << " and multiple scattering " << settings.multiScatteringSize << "x" << settings.multiScatteringSize
+        << " LUTs in " << atmosphere.getStats().precomputeMs << " ms on " << JobSystem::instance().getThreadCount()
+        << " threads\n";
+
+    // The LUT against integrating every lookup, rays that reach the top
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    double maxTransmittanceError = 0.0;
+    for (int i = 0; i < 2000; ++i) {
+        float r = settings.groundRadius + (settings.topRadius - settings.groundRadius) * unit(rng) * unit(rng);
+        float muHorizon = -std::sqrt(std::max(1.0f - settings.groundRadius * settings.groundRadius / (r * r), 0.0f));
+        float mu = muHorizon + 0.002f + (1.0f - muHorizon - 0.002f) * unit(rng);
+        glm::vec3 lut = atmosphere.transmittance(r, mu), direct = atmosphere.integrateTransmittance(r, mu, 400);
+        for (int c = 0; c < 3; ++c)
+            maxTransmittanceError = std::max(maxTransmittanceError, (double)std::abs(lut[c] - direct[c]));
+    }
+    // Straight up the curvature hardly matters: each layer's optical depth
+    // is its density at the ground times its scale height (the ozone tent
+    // half its width)
+    glm::vec3 zenith = atmosphere.transmittance(settings.groundRadius, 1.0f);
+    glm::vec3 analytic = glm::exp(-(settings.rayleighScattering * settings.rayleighScaleHeight
+        + glm::vec3(settings.mieExtinction * settings.mieScaleHeight) + settings.ozoneAbsorption * (0.5f * settings.ozoneWidth)));
+    double zenithError = 0.0;
+    for (int c = 0; c < 3; ++c)
+        zenithError = std::max(zenithError, (double)std::abs(zenith[c] - analytic[c]) / analytic[c]);
+    std::cout << "  transmittance:  LUT within " << maxTransmittanceError << " of direct integration, zenith ("
+        << zenith.x << ", " << zenith.y << ", " << zenith.z << ") within " << 100.0 * zenithError
+        << "% of the layers' optical depths\n";
+    check(maxTransmittanceError < 0.01, "the transmittance LUT matches direct integration");
+    check(zenithError < 0.01, "zenith transmittance matches the scale heights");
+
+    // The sky view against marching every direction, at a few sun heights
+    std::cout << "  sky view " << settings.skyViewWidth << "x" << settings.skyViewHeight << ", " << settings.skyViewSteps
+        << " samples a texel, against a " << 256 << "-sample march:\n";
+    std::cout << "  sun\tmarch ms\tmean error\t95th pct\tzenith\t\t\thorizon at the sun\n";
+    glm::vec3 noonZenith(0.0f), sunsetHorizon(0.0f), noonHorizon(0.0f);
+    for (float elevation : { 60.0f, 30.0f, 10.0f, 2.0f }) {
+        glm::vec3 sun = sunDirection(elevation, 40.0f);
+        auto start = std::chrono::steady_clock::now();
+        atmosphere.update(sun);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> errors;
+        for (int i = 0; i < 1500; ++i) {
+            // Above the horizon, away from the sun's Mie peak
+            glm::vec3 dir = sunDirection(glm::degrees(std::asin(unit(rng))), 360.0f * unit(rng));
+            if (glm::dot(dir, sun) > std::cos(glm::radians(5.0f)))
+                continue;
+            float reference = luminance(atmosphere.skyRadiance(dir, sun, 256));
+            float lut = luminance(atmosphere.sampleSkyView(atmosphere.getSkyView(), dir, sun));
+            errors.push_back(std::abs(lut - reference) / std::max(reference, 1e-6f));
+        }
+        std::sort(errors.begin(), errors.end());
+        double mean = 0.0;
+        for (double e : errors)
+            mean += e;
+        mean /= std::max<size_t>(errors.size(), 1);
+        double p95 = errors.empty() ? 0.0 : errors[errors.size() * 95 / 100];
+
+        glm::vec3 up = atmosphere.sampleSkyView(atmosphere.getSkyView(), glm::vec3(0.0f, 1.0f, 0.0f), sun);
+        glm::vec3 horizon = atmosphere.sampleSkyView(atmosphere.getSkyView(), sunDirection(1.0f, 40.0f), sun);
+        if (elevation == 60.0f) {
+            noonZenith = up;
+            noonHorizon = horizon;
+        }
+        if (elevation == 2.0f)
+            sunsetHorizon = horizon;
+        std::cout << "  " << elevation << "\t" << ms << "\t\t" << 100.0 * mean << "%\t\t" << 100.0 * p95 << "%\t\t("
+            << up.x << ", " << up.y << ", " << up.z << ")\t(" << horizon.x << ", " << horizon.y << ", " << horizon.z << ")\n";
+        check(mean < 0.03 && p95 < 0.08, "the sky view matches marching each direction");
+    }
+    check(noonZenith.z > noonZenith.y && noonZenith.y > noonZenith.x, "the noon sky is blue");
+    check(sunsetHorizon.x / sunsetHorizon.z > 2.0f * noonHorizon.x / noonHorizon.z, "the sky reddens towards a low sun");
+    glm::vec3 lowSun = atmosphere.sunTransmittance(sunDirection(3.0f, 0.0f));
+    glm::vec3 highSun = atmosphere.sunTransmittance(sunDirection(60.0f, 0.0f));
+    check(lowSun.z / lowSun.x < 0.5f * highSun.z / highSun.x, "a low sun is redder");
+    check(luminance(atmosphere.sunTransmittance(sunDirection(-2.0f, 0.0f))) == 0.0f, "no sunlight once it has set");
+
+    // What a skybox marching every pixel would pay against reading the LUT
+    {
+        glm::vec3 sun = sunDirection(30.0f, 40.0f);
+        const int DIRECTIONS = 20000;
+        std::vector<glm::vec3> dirs;
+        for (int i = 0; i < DIRECTIONS; ++i)
+            dirs.push_back(sunDirection(glm::degrees(std::asin(2.0f * unit(rng) - 1.0f)), 360.0f * unit(rng)));
+        glm::vec3 sink(0.0f);
+        auto start = std::chrono::steady_clock::now();
+        for (const glm::vec3& dir : dirs)
+            sink += atmosphere.skyRadiance(dir, sun, settings.skyViewSteps);
+        double marchNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / DIRECTIONS;
+        start = std::chrono::steady_clock::now();
+        for (const glm::vec3& dir : dirs)
+            sink += atmosphere.sampleSkyView(atmosphere.getSkyView(), dir, sun);
+        double lutNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / DIRECTIONS;
+        std::cout << "  per direction:  " << marchNs << " ns marched, " << lutNs << " ns from the sky view ("
+            << marchNs / std::max(lutNs, 1e-3) << "x)\n";
+        benchSink = (unsigned int)luminance(sink);
+        check(marchNs > 10.0 * lutNs, "the LUT is much cheaper than marching");
+    }
+
+    // The cube faces point where GL's lookup expects them
+    int wrongFaces = 0;
+    for (int face = 0; face < Atmosphere::CUBE_FACES; ++face) {
+        for (int i = 0; i < 16; ++i) {
+            float s = -0.95f + 1.9f * unit(rng), t = -0.95f + 1.9f * unit(rng), s2, t2;
+            int found = cubeFaceOf(cubeFaceDirection(face, s, t), s2, t2);
+            wrongFaces += found != face || std::abs(s - s2) > 1e-5f || std::abs(t - t2) > 1e-5f;
+        }
+    }
+    check(wrongFaces == 0, "cube face directions match GL's face selection");
+
+    // Incremental refresh: a sun moving faster than refreshAngle marches
+    // the sky view every step and refreshes one face with it; once it
+    // stops, the rest follow one a step and the cube ends up as a full
+    // update would leave it
+    int marches = 0;
+    for (int i = 0; i < 12; ++i) {
+        long long version = atmosphere.getSkyViewVersion();
+        atmosphere.start(sunDirection(20.0f + i, 40.0f));
+        atmosphere.finish();
+        atmosphere.poll();
+        marches += atmosphere.getSkyViewVersion() != version;
+    }
+    glm::vec3 finalSun = sunDirection(40.0f, 40.0f);
+    int settle = benchSettleAtmosphere(atmosphere, finalSun);
+    Atmosphere full;
+    full.init(settings);
+    full.update(finalSun);
+    double faceError = 0.0;
+    for (int face = 0; face < Atmosphere::CUBE_FACES; ++face) {
+        for (size_t i = 0; i < full.getFace(face).size(); ++i) {
+            glm::vec3 d = atmosphere.getFace(face)[i] - full.getFace(face)[i];
+            faceError = std::max(faceError, (double)std::max(std::abs(d.x), std::max(std::abs(d.y), std::abs(d.z))));
+        }
+    }
+    std::cout << "  incremental:    " << marches << " of 12 moving steps marched the sky view, " << settle
+        << " steps to settle once the sun stopped, faces within " << faceError << " of a full update\n";
+    check(marches == 12 && settle == Atmosphere::CUBE_FACES, "a moving sun marches every step, the cube settles in six");
+    check(faceError < 1e-5, "the settled cube matches a full update");
+
+    // A day at 60 frames a second, at the default day length: most frames
+    // only look up a face, or do nothing
+    {
+        const float DAY = 300.0f;
+        const int FRAMES = 1200;
+        atmosphere.resetStats();
+        auto start = std::chrono::steady_clock::now();
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            float phase = 2.0f * 3.14159265f * frame / 60.0f / DAY;
+            atmosphere.start(sunDirection(31.5f + 28.5f * std::sin(phase), 90.0f + glm::degrees(phase)));
+            atmosphere.finish();
+            atmosphere.poll();
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        const Atmosphere::Stats& stats = atmosphere.getStats();
+        double fullMs = 0.0;
+        for (int i = 0; i < 3; ++i) {
+            auto fullStart = std::chrono::steady_clock::now();
+            full.update(sunDirection(30.0f + i, 40.0f));
+            fullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fullStart).count() / 3;
+        }
+        std::cout << "  day cycle:      " << FRAMES << " frames, " << stats.skyViewUpdates << " sky view marches, "
+            << stats.faceUpdates << " faces, " << ms / FRAMES << " ms a frame mean, " << stats.maxMs
+            << " ms max; a full update every frame would be " << fullMs << " ms\n";
+        check(stats.skyViewUpdates * 5 < FRAMES, "a slow sun marches the sky view on few frames");
+        check(ms / FRAMES < 0.5 * fullMs, "incremental updates cost less than full ones");
+    }
+
+    std::cout << (ok ? "all checks passed" : "CHECKS FAILED") << "\n";
+    return ok ? 0 : 1;
+}
+
+// ------------------- IMAGE-BASED LIGHTING ---------------------
+// Cost of the SH9 projection: the sky cube the atmosphere builds, then a
+// large cube with the scalar and SSE paths across thread counts, and the
+// prefilter's levels. OpenGLPrjTests checks the results.
+static int benchIrradiance()
+{
+    SHProjector projector;
+    Atmosphere::Settings settings;
+    Atmosphere atmosphere;
+    atmosphere.init(settings);
+
+    std::cout << "  sky irradiance, " << settings.cubeSize << "^2 faces:\n";
+    std::cout << "  sun\tup\t\t\tSH ms\n";
+    for (float elevation : { 60.0f, 20.0f, 3.0f }) {
+        atmosphere.update(sunDirection(elevation, 40.0f));
+        const std::vector<glm::vec3>* ptrs[6];
+        for (int face = 0; face < 6; ++face)
+            ptrs[face] = &atmosphere.getFace(face);
+        auto start = std::chrono::steady_clock::now();
+        SH9 irradiance = projector.project(ptrs, settings.cubeSize).irradiance();
+        double shMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        glm::vec3 up = irradiance.evaluate(glm::vec3(0.0f, 1.0f, 0.0f));
+        std::cout << "  " << elevation << "\t(" << up.x << ", " << up.y << ", " << up.z << ")\t" << shMs << "\n";
+    }
+
+    // Projection cost at a large face: scalar and SSE, then across threads
+    {
+        const int SIZE = 256;
+        std::vector<glm::vec3> faces[6];
+        glm::vec3 sun = sunDirection(20.0f, 40.0f);
+        fillCube(faces, SIZE, [&](glm::vec3 d) {
+            return glm::vec3(0.2f, 0.4f, 0.9f) * (0.5f + 0.5f * d.y) + glm::vec3(3.0f) * std::pow(std::max(glm::dot(d, sun), 0.0f), 8.0f);
+        });
+        const std::vector<glm::vec3>* ptrs[6] = { &faces[0], &faces[1], &faces[2], &faces[3], &faces[4], &faces[5] };
+        auto time = [&]() {
+            const int RUNS = 5;
+            SH9 result;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < RUNS; ++i)
+                result = projector.project(ptrs, SIZE);
+            benchSink += (unsigned int)result.coefficients[0].x;
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / RUNS;
+        };
+
+        std::cout << "  projection of a " << SIZE << "^2 cube (" << 6 * SIZE * SIZE << " texels):\n";
+        std::cout << "  threads\tscalar ms\tSSE ms\n";
+        for (int threads : benchThreadCounts()) {
+            JobSystem::instance().init(threads - 1);
+            projector.setSimd(false);
+            double scalarMs = time();
+            projector.setSimd(true);
+            double simdMs = time();
+            std::cout << "  " << threads << "\t\t" << scalarMs << "\t\t";
+            if (SHProjector::simdAvailable())
+                std::cout << simdMs << " (" << scalarMs / std::max(simdMs, 1e-6) << "x)\n";
+            else
+                std::cout << "n/a\n";
+        }
+    }
+
+    // Prefiltering one face of each level straight from the full-size cube
+    {
+        atmosphere.update(sunDirection(10.0f, 40.0f));
+        const int levels = atmosphere.getCubeLevels();
+        const std::vector<glm::vec3>* full[6];
+        for (int face = 0; face < 6; ++face)
+            full[face] = &atmosphere.getFace(face);
+        std::cout << "  prefiltering a face from the " << settings.cubeSize << "^2 cube:\n  level\tsize\troughness\tms\n";
+        for (int level = 1; level < levels; ++level) {
+            int size = std::max(settings.cubeSize >> level, 1);
+            std::vector<glm::vec3> out;
+            auto start = std::chrono::steady_clock::now();
+            prefilterFace(full, settings.cubeSize, 0, size, cubeLevelRoughness(level, levels), out);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            std::cout << "  " << level << "\t" << size << "\t" << cubeLevelRoughness(level, levels) << "\t\t" << ms << "\n";
+        }
+    }
+    return 0;
+}
+
+// ------------------- FRAME CAPTURE ---------------------
+// 1080p frames fed to the encoder as fast as they can be made, through a
+// short queue and a long one: how long a frame takes to encode, and what a
+// busy encoder drops. Writes under bench_capture/ in the working directory
+// and deletes the files again.
+static int benchCapture()
+{
+    const std::string DIRECTORY = "bench_capture";
+    std::cout << "  1080p\tqueue\tsubmitted\twritten\tdropped\tms/frame encoding\tMB\n";
+    for (int format = 0; format < CAPTURE_FORMAT_COUNT; ++format) {
+        for (int maxQueued : { 2, 64 }) {
+            const int W = 1920, H = 1080, FRAMES = 24;
+            CaptureSettings settings;
+            settings.directory = DIRECTORY;
+            settings.format = (CaptureFormat)format;
+            settings.maxQueued = maxQueued;
+            FrameEncoder encoder;
+            if (!encoder.open(settings, W, H))
+                return 1;
+            std::vector<unsigned char> rgba;
+            for (int i = 0; i < FRAMES; ++i) {
+                makeFrame(rgba, W, H, i);
+                encoder.submit(rgba, W, H, i);
+            }
+            encoder.close();
+            FrameEncoder::Stats stats = encoder.getStats();
+            std::cout << "  " << captureFormatName((CaptureFormat)format) << "\t" << maxQueued << "\t"
+                << stats.submitted << "\t\t" << stats.written << "\t" << stats.dropped << "\t"
+                << (stats.written ? stats.encodeMs / stats.written : 0.0) << "\t\t\t" << stats.bytes / (1024.0 * 1024.0)
+                << "\n";
+            if (format == CAPTURE_Y4M)
+                std::remove((DIRECTORY + "/capture.y4m").c_str());
+            for (int i = 0; i < FRAMES; ++i)
+                std::remove(framePath(DIRECTORY, i).c_str());
+        }
+    }
+    return 0;
+}
+
+// ------------------- CULLING ---------------------
+// A terrain's worth of chunk boxes culled through the BVH and one by one,
+// from the camera, the reflection camera below the water and the light.
+// OpenGLPrjTests checks that both keep the same boxes.
+static int benchCulling()
+{
+    const int GRID = 64;
+    const float CHUNK = 16.0f;
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> height(0.0f, 12.0f);
+    std::vector<AABB> boxes;
+    for (int z = 0; z < GRID; ++z) {
+        for (int x = 0; x < GRID; ++x) {
+            glm::vec3 min((x - GRID / 2) * CHUNK, -1.0f, (z - GRID / 2) * CHUNK);
+            boxes.push_back(AABB(min, min + glm::vec3(CHUNK, 1.0f + height(rng), CHUNK)));
+        }
+    }
+    BVH bvh;
+    auto start = std::chrono::steady_clock::now();
+    bvh.build(boxes);
+    double buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << boxes.size() << " chunks, BVH built in " << buildMs << " ms\n";
+
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 5000.0f);
+    const glm::vec3 eye(0.0f, 5.0f, 10.0f), target(60.0f, 0.0f, -80.0f);
+    const glm::vec3 reflEye(eye.x, -eye.y, eye.z);
+    const glm::vec3 reflTarget = reflEye + glm::vec3(target.x - eye.x, eye.y - target.y, target.z - eye.z);
+    struct View {
+        const char* name;
+        glm::mat4 viewProjection;
+    };
+    const View views[] = {
+        { "camera", projection * glm::lookAt(eye, target, glm::vec3(0.0f, 1.0f, 0.0f)) },
+        { "reflection", projection * glm::lookAt(reflEye, reflTarget, glm::vec3(0.0f, 1.0f, 0.0f)) },
+        { "light", glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 1.0f, 30.0f)
+            * glm::lookAt(glm::vec3(-10.0f, 12.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)) },
+    };
+
+    std::cout << "  view\t\tvisible\tBVH volumes\tBVH us\tone by one us\n";
+    const int RUNS = 200;
+    std::vector<unsigned int> visible;
+    for (const View& view : views) {
+        Frustum frustum = Frustum::fromMatrix(view.viewProjection);
+        CullStats stats;
+        start = std::chrono::steady_clock::now();
+        for (int run = 0; run < RUNS; ++run) {
+            visible.clear();
+            stats = CullStats();
+            bvh.cull(frustum, visible, stats);
+        }
+        double bvhUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / RUNS;
+
+        size_t kept = 0;
+        start = std::chrono::steady_clock::now();
+        for (int run = 0; run < RUNS; ++run) {
+            kept = 0;
+            for (const AABB& box : boxes)
+                kept += frustum.intersects(box);
+        }
+        double bruteUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / RUNS;
+        benchSink += (unsigned int)kept;
+        std::cout << "  " << view.name << "\t" << (std::strlen(view.name) < 8 ? "\t" : "") << stats.visible << "\t"
+            << stats.nodesTested << "\t\t" << bvhUs << "\t" << bruteUs << "\n";
+    }
+    return 0;
+}
+
+struct Benchmark {
+    const char* name;
+    int (*run)();
+};
+
+static const Benchmark BENCHMARKS[] = {
+    { "erosion", benchErosion },
+    { "skybox", benchSkybox },
+    { "jobs", benchJobs },
+    { "sim", benchSimulation },
+    { "commands", benchCommands },
+    { "submit", benchSubmit },
+    { "water", benchWater },
+    { "ocean", benchOcean },
+    { "resolution", benchResolution },
+    { "rendertargets", benchRenderTargets },
+    { "shadows", benchShadows },
+    { "permutations", benchPermutations },
+    { "ssr", benchSsr },
+    { "atmosphere", benchAtmosphere },
+    { "irradiance", benchIrradiance },
+    { "capture", benchCapture },
+    { "culling", benchCulling },
+};
+
+int runBenchmark(const std::string& name)
+{
+    for (const Benchmark& b : BENCHMARKS) {
+        if (name == b.name || name == "all") {
+            int result = b.run();
+            if (name != "all")
+                return result;
+        }
+    }
+    return name == "all" ? 0 : -1;
+}
+
+void printBenchmarks()
+{
+    std::cout << "Available benchmarks:";
+    for (const Benchmark& b : BENCHMARKS)
+        std::cout << " " << b.name;
+    std::cout << " all\n";
+}
@@ -0,0 +1,62 @@
+#include <BenchFixtures.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+glm::vec3 sunDirection(float elevationDegrees, float azimuthDegrees)
+{
+    float elevation = glm::radians(elevationDegrees), azimuth = glm::radians(azimuthDegrees);
+    return glm::vec3(std::cos(elevation) * std::cos(azimuth), std::sin(elevation), std::cos(elevation) * std::sin(azimuth));
+}
+
+float luminance(glm::vec3 c)
+{
+    return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+void recordSyntheticFrame(CommandBuffer& commands, unsigned int seed)
+{
+    const int PASSES = 4, OPAQUE = 400, TRANSPARENT = 16;
+    unsigned int state = seed;
+    auto next = [&state]() { state = state * 1664525u + 1013904223u; return state >> 8; };
+
+    commands.clear();
+    for (int p = 0; p < PASSES; ++p) {
+        commands.beginPass(CommandBuffer::Pass("pass", p + 1, 1920, 1080, 0));
+        commands.add(LAYER_SKY, 7, 13, RenderState(RenderState::DEPTH_TEST)).addTexture(0, 0x0DE1, 11);
+        for (int i = 0; i < OPAQUE + TRANSPARENT; ++i) {
+            bool transparent = i % ((OPAQUE + TRANSPARENT) / TRANSPARENT) == 0;
+            RenderLayer layer = transparent ? LAYER_TRANSPARENT : (next() % 16 == 0 ? LAYER_BACKGROUND : LAYER_OPAQUE);
+            RenderState renderState(transparent ? RenderState::DEPTH_TEST | RenderState::BLEND
+                : RenderState::DEPTH_TEST | RenderState::DEPTH_WRITE | RenderState::CULL_FACE);
+            RenderCommand& command = commands.add(layer, 1 + next() % 6, 1 + next() % 12, renderState);
+            command.addTexture(0, 0x0DE1, 1 + next() % 10);
+            if (next() % 3 == 0)
+                command.addTexture(1, 0x0DE1, 20 + next() % 2);
+        }
+        if (p == 2)
+            commands.addExternal(std::function<void()>());
+    }
+}
+
+void makeFrame(std::vector<unsigned char>& rgba, int width, int height, int frame)
+{
+    rgba.resize((size_t)width * height * 4);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            unsigned char* p = &rgba[((size_t)y * width + x) * 4];
+            p[0] = (unsigned char)(x * 255 / std::max(width - 1, 1));
+            p[1] = (unsigned char)(y * 255 / std::max(height - 1, 1));
+            p[2] = (unsigned char)(frame * 37);
+            p[3] = 255;
+        }
+    }
+}
+
+std::string framePath(const std::string& directory, long long index)
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame_%06lld.png", index);
+    return directory + name;
+}
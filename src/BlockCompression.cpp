@@ -0,0 +1,354 @@
+#include <BlockCompression.hpp>
+#include <JobSystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+static const int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Splits the rows of blocks over the job system
+template <typename Fn>
+static void forEachBlockRow(int rows, Fn fn)
+{
+    JobSystem::instance().parallelFor(0, rows, 4, [&](int first, int last) {
+        for (int row = first; row < last; ++row)
+            fn(row);
+    });
+}
+
+static void loadBlock(const unsigned char* rgba, int width, int height, int bx, int by, int block[16][4])
+{
+    for (int y = 0; y < 4; ++y) {
+        int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            int sx = std::min(bx * 4 + x, width - 1);
+            const unsigned char* texel = rgba + ((size_t)sy * width + sx) * 4;
+            for (int c = 0; c < 4; ++c)
+                block[y * 4 + x][c] = texel[c];
+        }
+    }
+}
+
+static void storeBlock(unsigned char* rgba, int width, int height, int bx, int by, const int block[16][4])
+{
+    for (int y = 0; y < 4 && by * 4 + y < height; ++y)
+        for (int x = 0; x < 4 && bx * 4 + x < width; ++x)
+            for (int c = 0; c < 4; ++c)
+                rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4 + c] = (unsigned char)block[y * 4 + x][c];
+}
+
+struct BitWriter {
+    unsigned char* out;
+    int pos;
+
+    void write(unsigned int value, int bits)
+    {
+        for (int i = 0; i < bits; ++i, ++pos)
+            if ((value >> i) & 1u)
+                out[pos >> 3] |= (unsigned char)(1u << (pos & 7));
+    }
+};
+
+struct BitReader {
+    const unsigned char* in;
+    int pos;
+
+    unsigned int read(int bits)
+    {
+        unsigned int value = 0;
+        for (int i = 0; i < bits; ++i, ++pos)
+            value |= (unsigned int)((in[pos >> 3] >> (pos & 7)) & 1) << i;
+        return value;
+    }
+};
+
+// ------------------- BC7 MODE 6 ---------------------
+struct Mode6Fit {
+    int endpoints[2][4];   // 7-bit
+    int pbits[2];
+    int indices[16];
+    long long error;
+};
+
+static int interpolate4(int e0, int e1, int index)
+{
+    int w = BC7_WEIGHTS4[index];
+    return ((64 - w) * e0 + w * e1 + 32) >> 6;
+}
+
+// Quantizes float endpoints for every p-bit combination and keeps the best
+static void fitMode6(const int block[16][4], const float e[2][4], Mode6Fit& best)
+{
+    best.error = -1;
+    for (int p0 = 0; p0 < 2; ++p0) {
+        for (int p1 = 0; p1 < 2; ++p1) {
+            Mode6Fit fit;
+            fit.pbits[0] = p0;
+            fit.pbits[1] = p1;
+            int full[2][4];
+            for (int c = 0; c < 4; ++c) {
+                for (int k = 0; k < 2; ++k) {
+                    int p = k == 0 ? p0 : p1;
+                    int q = (int)std::floor((e[k][c] - p) * 0.5f + 0.5f);
+                    q = std::max(0, std::min(127, q));
+                    fit.endpoints[k][c] = q;
+                    full[k][c] = (q << 1) | p;
+                }
+            }
+
+            int palette[16][4];
+            for (int i = 0; i < 16; ++i)
+                for (int c = 0; c < 4; ++c)
+                    palette[i][c] = interpolate4(full[0][c], full[1][c], i);
+
+            fit.error = 0;
+            for (int t = 0; t < 16; ++t) {
+                int bestIndex = 0;
+                int bestError = 1 << 30;
+                for (int i = 0; i < 16; ++i) {
+                    int err = 0;
+                    for (int c = 0; c < 4; ++c) {
+                        int d = palette[i][c] - block[t][c];
+                        err += d * d;
+                    }
+                    if (err < bestError) {
+                        bestError = err;
+                        bestIndex = i;
+                    }
+                }
+                fit.indices[t] = bestIndex;
+                fit.error += bestError;
+            }
+
+            if (best.error < 0 || fit.error < best.error)
+                best = fit;
+        }
+    }
+}
+
+static void encodeBC7Block(const int block[16][4], unsigned char* out)
+{
+    // Principal axis of the block colours
+    float mean[4] = { 0, 0, 0, 0 };
+    for (int t = 0; t < 16; ++t)
+        for (int c = 0; c < 4; ++c)
+            mean[c] += block[t][c] / 16.0f;
+
+    float cov[4][4] = {};
+    for (int t = 0; t < 16; ++t)
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                cov[i][j] += (block[t][i] - mean[i]) * (block[t][j] - mean[j]);
+
+    float axis[4] = { 1, 1, 1, 1 };
+    for (int iter = 0; iter < 8; ++iter) {
+        float next[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j)
+                next[i] += cov[i][j] * axis[j];
+        float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (len < 1e-6f)
+            break;
+        for (int i = 0; i < 4; ++i)
+            axis[i] = next[i] / len;
+    }
+
+    float tMin = 1e30f, tMax = -1e30f;
+    for (int t = 0; t < 16; ++t) {
+        float d = 0.0f;
+        for (int c = 0; c < 4; ++c)
+            d += (block[t][c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, d);
+        tMax = std::max(tMax, d);
+    }
+
+    float e[2][4];
+    for (int c = 0; c < 4; ++c) {
+        e[0][c] = std::max(0.0f, std::min(255.0f, mean[c] + axis[c] * tMin));
+        e[1][c] = std::max(0.0f, std::min(255.0f, mean[c] + axis[c] * tMax));
+    }
+
+    Mode6Fit best;
+    fitMode6(block, e, best);
+
+    // One least-squares refinement of the endpoints for the chosen indices
+    float a = 0, b = 0, d = 0, x[4] = {}, y[4] = {};
+    for (int t = 0; t < 16; ++t) {
+        float w = BC7_WEIGHTS4[best.indices[t]] / 64.0f;
+        a += (1 - w) * (1 - w);
+        b += (1 - w) * w;
+        d += w * w;
+        for (int c = 0; c < 4; ++c) {
+            x[c] += (1 - w) * block[t][c];
+            y[c] += w * block[t][c];
+        }
+    }
+    float det = a * d - b * b;
+    if (std::fabs(det) > 1e-6f) {
+        for (int c = 0; c < 4; ++c) {
+            e[0][c] = std::max(0.0f, std::min(255.0f, (d * x[c] - b * y[c]) / det));
+            e[1][c] = std::max(0.0f, std::min(255.0f, (a * y[c] - b * x[c]) / det));
+        }
+        Mode6Fit refined;
+        fitMode6(block, e, refined);
+        if (refined.error < best.error)
+            best = refined;
+    }
+
+    // The anchor index is stored without its top bit, so it must be < 8
+    if (best.indices[0] & 8) {
+        for (int c = 0; c < 4; ++c)
+            std::swap(best.endpoints[0][c], best.endpoints[1][c]);
+        std::swap(best.pbits[0], best.pbits[1]);
+        for (int t = 0; t < 16; ++t)
+            best.indices[t] = 15 - best.indices[t];
+    }
+
+    memset(out, 0, BLOCK_BYTES);
+    BitWriter bits = { out, 0 };
+    bits.write(1u << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        bits.write(best.endpoints[0][c], 7);
+        bits.write(best.endpoints[1][c], 7);
+    }
+    bits.write(best.pbits[0], 1);
+    bits.write(best.pbits[1], 1);
+    bits.write(best.indices[0], 3);
+    for (int t = 1; t < 16; ++t)
+        bits.write(best.indices[t], 4);
+}
+
+void compressBC7(const unsigned char* rgba, int width, int height, unsigned char* out)
+{
+    int blocksX = blockCount(width);
+    forEachBlockRow(blockCount(height), [=](int by) {
+        int block[16][4];
+        for (int bx = 0; bx < blocksX; ++bx) {
+            loadBlock(rgba, width, height, bx, by, block);
+            encodeBC7Block(block, out + ((size_t)by * blocksX + bx) * BLOCK_BYTES);
+        }
+    });
+}
+
+void decompressBC7Mode6(const unsigned char* blocks, int width, int height, unsigned char* rgba)
+{
+    int blocksX = blockCount(width);
+    for (int by = 0; by < blockCount(height); ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            BitReader bits = { blocks + ((size_t)by * blocksX + bx) * BLOCK_BYTES, 0 };
+            int block[16][4] = {};
+            if (bits.read(7) == (1u << 6)) {
+                int e[2][4];
+                for (int c = 0; c < 4; ++c) {
+                    e[0][c] = (int)bits.read(7) << 1;
+                    e[1][c] = (int)bits.read(7) << 1;
+                }
+                int p0 = (int)bits.read(1), p1 = (int)bits.read(1);
+                for (int c = 0; c < 4; ++c) {
+                    e[0][c] |= p0;
+                    e[1][c] |= p1;
+                }
+                for (int t = 0; t < 16; ++t) {
+                    int index = (int)bits.read(t == 0 ? 3 : 4);
+                    for (int c = 0; c < 4; ++c)
+                        block[t][c] = interpolate4(e[0][c], e[1][c], index);
+                }
+            }
+            storeBlock(rgba, width, height, bx, by, block);
+        }
+    }
+}
+
+// ------------------- BC5 ---------------------
+static void bc4Palette(int r0, int r1, int palette[8])
+{
+    palette[0] = r0;
+    palette[1] = r1;
+    if (r0 > r1) {
+        for (int i = 2; i < 8; ++i)
+            palette[i] = ((8 - i) * r0 + (i - 1) * r1) / 7;
+    }
+    else {
+        for (int i = 2; i < 6; ++i)
+            palette[i] = ((6 - i) * r0 + (i - 1) * r1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+static void encodeBC4Block(const int block[16][4], int channel, unsigned char* out)
+{
+    int lo = 255, hi = 0;
+    for (int t = 0; t < 16; ++t) {
+        lo = std::min(lo, block[t][channel]);
+        hi = std::max(hi, block[t][channel]);
+    }
+
+    // hi > lo selects the 8-value ramp; a flat block just repeats index 0
+    int palette[8];
+    bc4Palette(hi, lo, palette);
+
+    unsigned long long indices = 0;
+    for (int t = 0; t < 16; ++t) {
+        int bestIndex = 0;
+        int bestError = 1 << 30;
+        for (int i = 0; i < 8; ++i) {
+            int err = std::abs(palette[i] - block[t][channel]);
+            if (err < bestError) {
+                bestError = err;
+                bestIndex = i;
+            }
+        }
+        indices |= (unsigned long long)bestIndex << (3 * t);
+    }
+
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = (unsigned char)(indices >> (8 * i));
+}
+
+static void decodeBC4Block(const unsigned char* in, int channel, int block[16][4])
+{
+    int palette[8];
+    bc4Palette(in[0], in[1], palette);
+    unsigned long long indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= (unsigned long long)in[2 + i] << (8 * i);
+    for (int t = 0; t < 16; ++t)
+        block[t][channel] = palette[(indices >> (3 * t)) & 7];
+}
+
+void compressBC5(const unsigned char* rgba, int width, int height, unsigned char* out)
+{
+    int blocksX = blockCount(width);
+    forEachBlockRow(blockCount(height), [=](int by) {
+        int block[16][4];
+        for (int bx = 0; bx < blocksX; ++bx) {
+            loadBlock(rgba, width, height, bx, by, block);
+            unsigned char* dst = out + ((size_t)by * blocksX + bx) * BLOCK_BYTES;
+            encodeBC4Block(block, 0, dst);
+            encodeBC4Block(block, 1, dst + 8);
+        }
+    });
+}
+
+void decompressBC5(const unsigned char* blocks, int width, int height, unsigned char* rgba)
+{
+    int blocksX = blockCount(width);
+    for (int by = 0; by < blockCount(height); ++by) {
+        for (int bx = 0; bx < blocksX; ++bx) {
+            const unsigned char* src = blocks + ((size_t)by * blocksX + bx) * BLOCK_BYTES;
+            int block[16][4];
+            for (int t = 0; t < 16; ++t) {
+                block[t][2] = 0;
+                block[t][3] = 255;
+            }
+            decodeBC4Block(src, 0, block);
+            decodeBC4Block(src + 8, 1, block);
+            storeBlock(rgba, width, height, bx, by, block);
+        }
+    }
+}
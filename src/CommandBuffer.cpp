@@ -0,0 +1,139 @@
+#include <CommandBuffer.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+void RenderCommand::addTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+    if (textureCount == MAX_TEXTURES) {
+        std::cout << "RenderCommand: more than " << MAX_TEXTURES << " textures, ignoring unit " << unit << "\n";
+        return;
+    }
+    TextureBinding binding = { unit, target, texture };
+    textures[textureCount++] = binding;
+}
+
+void CommandBuffer::clear()
+{
+    passes.clear();
+    commands.clear();
+    passCommands = 0;
+}
+
+unsigned int CommandBuffer::beginPass(const Pass& pass)
+{
+    if (passes.size() == MAX_PASSES)
+        std::cout << "CommandBuffer: more than " << MAX_PASSES << " passes, sorting will mix them\n";
+    passes.push_back(pass);
+    passCommands = 0;
+    return (unsigned int)passes.size() - 1;
+}
+
+RenderCommand& CommandBuffer::add(RenderLayer layer, unsigned int program, unsigned int vao, const RenderState& state)
+{
+    if (passes.empty())
+        beginPass(Pass("default"));
+
+    commands.push_back(RenderCommand());
+    RenderCommand& command = commands.back();
+    command.key = 0;
+    command.pass = (unsigned int)passes.size() - 1;
+    command.layer = layer;
+    command.sequence = passCommands++;
+    command.program = program;
+    command.vao = vao;
+    command.state = state;
+    command.textureCount = 0;
+    command.external = false;
+    return command;
+}
+
+RenderCommand& CommandBuffer::addExternal(std::function<void()> draw)
+{
+    RenderCommand& command = add(LAYER_TRANSPARENT, 0, 0, RenderState());
+    command.draw = std::move(draw);
+    command.external = true;
+    return command;
+}
+
+// ------------------- SORTING ---------------------
+static unsigned int hashTextures(const RenderCommand& command)
+{
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < command.textureCount; ++i) {
+        const TextureBinding& t = command.textures[i];
+        unsigned int values[3] = { t.unit, t.target, t.texture };
+        for (unsigned int v : values) {
+            hash ^= v;
+            hash *= 16777619u;
+        }
+    }
+    return (hash ^ (hash >> 16)) & 0xFFFFu;
+}
+
+unsigned long long CommandBuffer::makeKey(const RenderCommand& command)
+{
+    unsigned long long key = (unsigned long long)(command.pass & 0xFFu) << 56;
+    key |= (unsigned long long)(command.layer & 0x3u) << 54;
+    if (command.layer != LAYER_TRANSPARENT) {
+        key |= (unsigned long long)(command.program & 0xFFFu) << 42;
+        key |= (unsigned long long)hashTextures(command) << 26;
+        key |= (unsigned long long)(command.vao & 0xFFFu) << 14;
+    }
+    key |= command.sequence & (MAX_COMMANDS_PER_PASS - 1);
+    return key;
+}
+
+void CommandBuffer::sort()
+{
+    for (RenderCommand& command : commands)
+        command.key = makeKey(command);
+    // Keys are unique within a pass through the sequence, stable keeps
+    // the rest deterministic past the limits
+    std::stable_sort(commands.begin(), commands.end(),
+        [](const RenderCommand& a, const RenderCommand& b) { return a.key < b.key; });
+}
+
+CommandBuffer::StateChanges CommandBuffer::countStateChanges() const
+{
+    StateChanges changes;
+    bool first = true;
+    unsigned int pass = 0, program = 0, vao = 0;
+    RenderState state;
+    std::vector<TextureBinding> bound;
+
+    for (const RenderCommand& command : commands) {
+        if (first || command.pass != pass) {
+            changes.passes++;
+            pass = command.pass;
+        }
+        if (command.external) {
+            // Anything may have changed, as in the backend
+            first = true;
+            bound.clear();
+            changes.draws++;
+            continue;
+        }
+        if (first || command.program != program)
+            changes.programs++;
+        if (first || command.vao != vao)
+            changes.vaos++;
+        if (first || command.state != state)
+            changes.states++;
+        for (int i = 0; i < command.textureCount; ++i) {
+            const TextureBinding& t = command.textures[i];
+            if (bound.size() <= t.unit)
+                bound.resize(t.unit + 1, TextureBinding{ 0, 0, 0 });
+            if (bound[t.unit].target != t.target || bound[t.unit].texture != t.texture) {
+                changes.textures++;
+                bound[t.unit] = t;
+            }
+        }
+        program = command.program;
+        vao = command.vao;
+        state = command.state;
+        first = false;
+        changes.draws++;
+    }
+    return changes;
+}
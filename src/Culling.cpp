@@ -0,0 +1,173 @@
+#include <Culling.hpp>
+
+#include <algorithm>
+#include <cfloat>
+
+// ------------------- AABB ---------------------
+AABB::AABB()
+    : min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX)
+{
+}
+
+AABB::AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max)
+{
+}
+
+void AABB::expand(const glm::vec3& p)
+{
+    min = glm::min(min, p);
+    max = glm::max(max, p);
+}
+
+void AABB::expand(const AABB& other)
+{
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
+
+// ------------------- FRUSTUM ---------------------
+Frustum Frustum::fromMatrix(const glm::mat4& m)
+{
+    // Gribb/Hartmann: rows of the (column-major) clip matrix
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    Frustum f;
+    f.planes[0] = row3 + row0;
+    f.planes[1] = row3 - row0;
+    f.planes[2] = row3 + row1;
+    f.planes[3] = row3 - row1;
+    f.planes[4] = row3 + row2;
+    f.planes[5] = row3 - row2;
+
+    for (int i = 0; i < 6; ++i) {
+        float len = glm::length(glm::vec3(f.planes[i].x, f.planes[i].y, f.planes[i].z));
+        if (len > 0.0f)
+            f.planes[i] = f.planes[i] / len;
+    }
+    return f;
+}
+
+Frustum::Result Frustum::classify(const AABB& box) const
+{
+    Result result = INSIDE;
+    for (int i = 0; i < 6; ++i) {
+        const glm::vec4& p = planes[i];
+
+        // Corner furthest along the plane normal, and the one opposite to it
+        glm::vec3 positive(p.x >= 0.0f ? box.max.x : box.min.x,
+                           p.y >= 0.0f ? box.max.y : box.min.y,
+                           p.z >= 0.0f ? box.max.z : box.min.z);
+        glm::vec3 negative(p.x >= 0.0f ? box.min.x : box.max.x,
+                           p.y >= 0.0f ? box.min.y : box.max.y,
+                           p.z >= 0.0f ? box.min.z : box.max.z);
+
+        if (p.x * positive.x + p.y * positive.y + p.z * positive.z + p.w < 0.0f)
+            return OUTSIDE;
+        if (p.x * negative.x + p.y * negative.y + p.z * negative.z + p.w < 0.0f)
+            result = INTERSECTS;
+    }
+    return result;
+}
+
+// ------------------- BVH ---------------------
+void BVH::build(const std::vector<AABB>& boxes, int maxLeafSize)
+{
+    nodes.clear();
+    items.resize(boxes.size());
+    itemBounds = boxes;
+    if (boxes.empty())
+        return;
+
+    std::vector<glm::vec3> centers(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        items[i] = (unsigned int)i;
+        centers[i] = boxes[i].center();
+    }
+
+    nodes.reserve(boxes.size() * 2);
+    buildNode(boxes, centers, 0, (int)boxes.size(), std::max(maxLeafSize, 1));
+}
+
+int BVH::buildNode(const std::vector<AABB>& boxes, std::vector<glm::vec3>& centers,
+    int first, int count, int maxLeafSize)
+{
+    int index = (int)nodes.size();
+    nodes.push_back(Node());
+
+    AABB bounds, centerBounds;
+    for (int i = first; i < first + count; ++i) {
+        bounds.expand(boxes[items[i]]);
+        centerBounds.expand(centers[items[i]]);
+    }
+
+    nodes[index].bounds = bounds;
+    nodes[index].first = first;
+    nodes[index].count = count;
+    nodes[index].left = -1;
+    nodes[index].right = -1;
+
+    if (count <= maxLeafSize)
+        return index;
+
+    // Median split along the widest axis of the chunk centers
+    glm::vec3 size = centerBounds.extent();
+    int axis = 0;
+    if (size.y > size[axis]) axis = 1;
+    if (size.z > size[axis]) axis = 2;
+
+    int mid = first + count / 2;
+    std::nth_element(items.begin() + first, items.begin() + mid, items.begin() + first + count,
+        [&](unsigned int a, unsigned int b) { return centers[a][axis] < centers[b][axis]; });
+
+    int left = buildNode(boxes, centers, first, mid - first, maxLeafSize);
+    int right = buildNode(boxes, centers, mid, first + count - mid, maxLeafSize);
+    nodes[index].left = left;
+    nodes[index].right = right;
+    return index;
+}
+
+void BVH::cull(const Frustum& frustum, std::vector<unsigned int>& visible, CullStats& stats) const
+{
+    stats.total += (int)items.size();
+    if (nodes.empty())
+        return;
+
+    int stack[64];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes[stack[--top]];
+        stats.nodesTested++;
+
+        Frustum::Result result = frustum.classify(node.bounds);
+        if (result == Frustum::OUTSIDE)
+            continue;
+
+        // Everything below a fully contained node is visible without more tests
+        if (result == Frustum::INSIDE) {
+            for (int i = node.first; i < node.first + node.count; ++i)
+                visible.push_back(items[i]);
+            stats.visible += node.count;
+            continue;
+        }
+
+        // Leaves hold a handful of boxes, test them individually
+        if (node.left < 0) {
+            for (int i = node.first; i < node.first + node.count; ++i) {
+                stats.nodesTested++;
+                if (frustum.intersects(itemBounds[items[i]])) {
+                    visible.push_back(items[i]);
+                    stats.visible++;
+                }
+            }
+            continue;
+        }
+
+        stack[top++] = node.left;
+        stack[top++] = node.right;
+    }
+}
@@ -0,0 +1,129 @@
+#include <DrawBatch.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+DrawBatch::DrawBatch()
+    : builtChunks(0), indirect(false), maxCommands(0)
+{
+}
+
+void DrawBatch::init(unsigned int maxCommands, unsigned int passesPerFrame)
+{
+    this->maxCommands = maxCommands;
+
+    indirect = GLAD_GL_VERSION_4_3 != 0;
+    if (indirect)
+        commandBuffer.init(GL_DRAW_INDIRECT_BUFFER,
+            maxCommands * passesPerFrame * sizeof(DrawElementsIndirectCommand));
+
+    std::cout << "Terrain batching: "
+        << (indirect ? "glMultiDrawElementsIndirect" : "glMultiDrawElements");
+    if (indirect)
+        std::cout << (commandBuffer.isPersistent() ? ", persistent-mapped" : ", orphaned") << " command ring";
+    std::cout << "\n";
+}
+
+void DrawBatch::destroy()
+{
+    if (indirect)
+        commandBuffer.destroy();
+}
+
+void DrawBatch::beginFrame()
+{
+    if (indirect)
+        commandBuffer.beginFrame();
+}
+
+void DrawBatch::endFrame()
+{
+    if (indirect)
+        commandBuffer.endFrame();
+}
+
+void DrawBatch::build(const Mesh& mesh, std::vector<unsigned int>& visible)
+{
+    std::sort(visible.begin(), visible.end());
+    merge(mesh, visible);
+}
+
+void DrawBatch::buildFrontToBack(const Mesh& mesh, std::vector<unsigned int>& visible, const glm::vec3& eye)
+{
+    // Squared distance from eye to the nearest point of the chunk's bounds
+    byDistance.clear();
+    for (unsigned int c : visible) {
+        const AABB& bounds = mesh.chunks[c].bounds;
+        glm::vec3 d = glm::max(glm::max(bounds.min - eye, eye - bounds.max), glm::vec3(0.0f));
+        byDistance.push_back(std::make_pair(glm::dot(d, d), c));
+    }
+    std::sort(byDistance.begin(), byDistance.end());
+    for (size_t i = 0; i < byDistance.size(); ++i)
+        visible[i] = byDistance[i].second;
+    merge(mesh, visible);
+}
+
+void DrawBatch::merge(const Mesh& mesh, const std::vector<unsigned int>& visible)
+{
+    commands.clear();
+    counts.clear();
+    offsets.clear();
+    builtChunks = (int)visible.size();
+
+    for (unsigned int c : visible) {
+        const Mesh::Chunk& chunk = mesh.chunks[c];
+        if (!commands.empty()) {
+            DrawElementsIndirectCommand& last = commands.back();
+            if (last.firstIndex + last.count == chunk.firstIndex) {
+                last.count += chunk.indexCount;
+                continue;
+            }
+        }
+        DrawElementsIndirectCommand cmd = { chunk.indexCount, 1, chunk.firstIndex, 0, 0 };
+        commands.push_back(cmd);
+    }
+
+    if (commands.size() > maxCommands)
+        commands.resize(maxCommands);
+
+    if (!indirect) {
+        for (const DrawElementsIndirectCommand& cmd : commands) {
+            counts.push_back((GLsizei)cmd.count);
+            offsets.push_back((const void*)(cmd.firstIndex * sizeof(unsigned int)));
+        }
+    }
+}
+
+void DrawBatch::draw(DrawStats& stats)
+{
+    stats.chunks += builtChunks;
+    stats.ranges += (int)commands.size();
+    if (commands.empty())
+        return;
+
+    RingBuffer::Allocation allocation = { nullptr, 0, 0 };
+    if (indirect)
+        allocation = commandBuffer.allocate(commands.size() * sizeof(DrawElementsIndirectCommand), 4);
+
+    if (allocation.data) {
+        memcpy(allocation.data, commands.data(), allocation.size);
+        commandBuffer.flush(allocation);
+        commandBuffer.bind();
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)allocation.offset,
+            (GLsizei)commands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else if (indirect) {
+        // Ring segment exhausted: plain draws for the rest of the frame
+        for (const DrawElementsIndirectCommand& cmd : commands)
+            glDrawElements(GL_TRIANGLES, cmd.count, GL_UNSIGNED_INT,
+                (const void*)(cmd.firstIndex * sizeof(unsigned int)));
+        stats.drawCalls += (int)commands.size() - 1;
+    }
+    else {
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), GL_UNSIGNED_INT,
+            offsets.data(), (GLsizei)counts.size());
+    }
+    stats.drawCalls++;
+}
@@ -0,0 +1,285 @@
+#include <EnvironmentLighting.hpp>
+#include <JobSystem.hpp>
+#include <SimdLanes.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+static const float PI = 3.14159265358979323846f;
+static const int CUBE_FACES = 6;
+
+// Per-row sums of the projection: 9 coefficients for each of r, g and b,
+// then the solid angle itself
+static const int SH_SUMS = 28;
+static const int SH_WEIGHT = 27;
+// Face rows per job
+static const int SH_ROW_GRAIN = 16;
+
+// ------------------- SH9 ---------------------
+SH9::SH9()
+{
+    for (glm::vec3& c : coefficients)
+        c = glm::vec3(0.0f);
+}
+
+void SH9::basis(glm::vec3 d, float out[9])
+{
+    out[0] = 0.282095f;
+    out[1] = 0.488603f * d.y;
+    out[2] = 0.488603f * d.z;
+    out[3] = 0.488603f * d.x;
+    out[4] = 1.092548f * d.x * d.y;
+    out[5] = 1.092548f * d.y * d.z;
+    out[6] = 0.315392f * (3.0f * d.z * d.z - 1.0f);
+    out[7] = 1.092548f * d.x * d.z;
+    out[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+glm::vec3 SH9::evaluate(glm::vec3 dir) const
+{
+    float b[9];
+    basis(dir, b);
+    glm::vec3 sum(0.0f);
+    for (int i = 0; i < 9; ++i)
+        sum += coefficients[i] * b[i];
+    return sum;
+}
+
+SH9 SH9::irradiance() const
+{
+    // The cosine lobe's bands, pi, 2 pi / 3 and pi / 4, over pi
+    static const float BAND[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+        0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    SH9 out;
+    for (int i = 0; i < 9; ++i)
+        out.coefficients[i] = coefficients[i] * BAND[i];
+    return out;
+}
+
+// ------------------- PROJECTION ---------------------
+// Texel (x, y) of a face looks along e0 + es * s + et * t; the texel's
+// solid angle is area / |dir|^3
+struct FaceFrame {
+    glm::vec3 e0, es, et;
+    float area;
+};
+
+static FaceFrame faceFrame(int face, int size)
+{
+    FaceFrame f;
+    f.e0 = cubeFaceDirection(face, 0.0f, 0.0f);
+    f.es = cubeFaceDirection(face, 1.0f, 0.0f) - f.e0;
+    f.et = cubeFaceDirection(face, 0.0f, 1.0f) - f.e0;
+    f.area = (2.0f / size) * (2.0f / size);
+    return f;
+}
+
+// Texels [x, x1) of a row, channels split into r, g and b and s running
+// along it, added to sums WIDTH at a time; returns where it stopped
+template <typename L>
+static int projectRow(const FaceFrame& f, float t, const float* s, const float* r, const float* g, const float* b,
+    int x, int x1, float* sums)
+{
+    typedef typename L::V V;
+    if (x + L::WIDTH > x1)
+        return x;
+
+    V acc[SH_SUMS];
+    for (V& a : acc)
+        a = L::set(0.0f);
+    const V one = L::set(1.0f), three = L::set(3.0f), area = L::set(f.area);
+    const V bx = L::set(f.e0.x + f.et.x * t), by = L::set(f.e0.y + f.et.y * t), bz = L::set(f.e0.z + f.et.z * t);
+    const V sx = L::set(f.es.x), sy = L::set(f.es.y), sz = L::set(f.es.z);
+    const V c0 = L::set(0.282095f), c1 = L::set(0.488603f), c2 = L::set(1.092548f);
+    const V c3 = L::set(0.315392f), c4 = L::set(0.546274f);
+
+    for (; x + L::WIDTH <= x1; x += L::WIDTH) {
+        V sv = L::load(s + x);
+        V dx = L::add(bx, L::mul(sx, sv)), dy = L::add(by, L::mul(sy, sv)), dz = L::add(bz, L::mul(sz, sv));
+        V len2 = L::add(L::add(L::mul(dx, dx), L::mul(dy, dy)), L::mul(dz, dz));
+        V len = L::sqrt(len2);
+        V w = L::div(area, L::mul(len2, len));
+        V inv = L::div(one, len);
+        dx = L::mul(dx, inv);
+        dy = L::mul(dy, inv);
+        dz = L::mul(dz, inv);
+
+        V wb[9];
+        wb[0] = L::mul(w, c0);
+        V w1 = L::mul(w, c1), w2 = L::mul(w, c2);
+        wb[1] = L::mul(w1, dy);
+        wb[2] = L::mul(w1, dz);
+        wb[3] = L::mul(w1, dx);
+        wb[4] = L::mul(w2, L::mul(dx, dy));
+        wb[5] = L::mul(w2, L::mul(dy, dz));
+        wb[6] = L::mul(L::mul(w, c3), L::sub(L::mul(three, L::mul(dz, dz)), one));
+        wb[7] = L::mul(w2, L::mul(dx, dz));
+        wb[8] = L::mul(L::mul(w, c4), L::sub(L::mul(dx, dx), L::mul(dy, dy)));
+
+        V cr = L::load(r + x), cg = L::load(g + x), cb = L::load(b + x);
+        for (int i = 0; i < 9; ++i) {
+            acc[i] = L::add(acc[i], L::mul(wb[i], cr));
+            acc[9 + i] = L::add(acc[9 + i], L::mul(wb[i], cg));
+            acc[18 + i] = L::add(acc[18 + i], L::mul(wb[i], cb));
+        }
+        acc[SH_WEIGHT] = L::add(acc[SH_WEIGHT], w);
+    }
+
+    // Lanes added in order, so the sum only depends on the lane width
+    float lanes[L::WIDTH];
+    for (int i = 0; i < SH_SUMS; ++i) {
+        L::store(lanes, acc[i]);
+        for (int lane = 0; lane < L::WIDTH; ++lane)
+            sums[i] += lanes[lane];
+    }
+    return x;
+}
+
+SHProjector::SHProjector() : simd(simdAvailable())
+{
+}
+
+bool SHProjector::simdAvailable()
+{
+#ifdef SIMD_SSE
+    return true;
+#else
+    return false;
+#endif
+}
+
+SH9 SHProjector::project(const std::vector<glm::vec3>* const faces[6], int size) const
+{
+    SH9 out;
+    if (size < 1)
+        return out;
+    const int rows = CUBE_FACES * size;
+    std::vector<float> rowSums((size_t)rows * SH_SUMS, 0.0f);
+    std::vector<float> s(size);
+    for (int x = 0; x < size; ++x)
+        s[x] = 2.0f * (x + 0.5f) / size - 1.0f;
+    const bool useSimd = simd;
+
+    JobSystem::instance().parallelFor(0, rows, SH_ROW_GRAIN, [&](int first, int last) {
+        std::vector<float> channels((size_t)3 * size);
+        float* r = &channels[0];
+        float* g = r + size;
+        float* b = g + size;
+        for (int row = first; row < last; ++row) {
+            const int face = row / size, y = row % size;
+            const FaceFrame f = faceFrame(face, size);
+            const glm::vec3* texels = &(*faces[face])[(size_t)y * size];
+            for (int x = 0; x < size; ++x) {
+                r[x] = texels[x].r;
+                g[x] = texels[x].g;
+                b[x] = texels[x].b;
+            }
+            const float t = 2.0f * (y + 0.5f) / size - 1.0f;
+            float* sums = &rowSums[(size_t)row * SH_SUMS];
+            int x = 0;
+#ifdef SIMD_SSE
+            if (useSimd)
+                x = projectRow<SseLanes>(f, t, &s[0], r, g, b, x, size, sums);
+#else
+            (void)useSimd;
+#endif
+            projectRow<ScalarLanes>(f, t, &s[0], r, g, b, x, size, sums);
+        }
+    });
+
+    // Rows in order, whoever summed them
+    double total[SH_SUMS] = {};
+    for (int row = 0; row < rows; ++row) {
+        for (int i = 0; i < SH_SUMS; ++i)
+            total[i] += rowSums[(size_t)row * SH_SUMS + i];
+    }
+    // The texels' solid angles are a touch off 4 pi in sum; scale them to it
+    double scale = total[SH_WEIGHT] > 0.0 ? 4.0 * PI / total[SH_WEIGHT] : 0.0;
+    for (int i = 0; i < 9; ++i) {
+        out.coefficients[i] = glm::vec3((float)(total[i] * scale), (float)(total[9 + i] * scale),
+            (float)(total[18 + i] * scale));
+    }
+    return out;
+}
+
+// ------------------- PREFILTERED MIPS ---------------------
+int cubeLevels(int size)
+{
+    int levels = 1;
+    while (size > 1) {
+        size /= 2;
+        levels++;
+    }
+    return levels;
+}
+
+float cubeLevelRoughness(int level, int levels)
+{
+    return levels > 1 ? (float)level / (levels - 1) : 0.0f;
+}
+
+void downsampleFace(const std::vector<glm::vec3>& face, int size, std::vector<glm::vec3>& out)
+{
+    const int half = std::max(size / 2, 1);
+    out.resize((size_t)half * half);
+    for (int y = 0; y < half; ++y) {
+        const glm::vec3* row0 = &face[(size_t)std::min(2 * y, size - 1) * size];
+        const glm::vec3* row1 = &face[(size_t)std::min(2 * y + 1, size - 1) * size];
+        for (int x = 0; x < half; ++x) {
+            int x0 = std::min(2 * x, size - 1), x1 = std::min(2 * x + 1, size - 1);
+            out[(size_t)y * half + x] = 0.25f * (row0[x0] + row0[x1] + row1[x0] + row1[x1]);
+        }
+    }
+}
+
+void prefilterFace(const std::vector<glm::vec3>* const sources[6], int sourceSize, int face, int size,
+    float roughness, std::vector<glm::vec3>& out)
+{
+    out.resize((size_t)size * size);
+
+    // Every source texel's direction and solid angle, once
+    const int sourceTexels = sourceSize * sourceSize;
+    std::vector<glm::vec4> directions((size_t)CUBE_FACES * sourceTexels);
+    for (int f = 0; f < CUBE_FACES; ++f) {
+        for (int y = 0; y < sourceSize; ++y) {
+            for (int x = 0; x < sourceSize; ++x) {
+                glm::vec3 dir = cubeFaceDirection(f, 2.0f * (x + 0.5f) / sourceSize - 1.0f,
+                    2.0f * (y + 0.5f) / sourceSize - 1.0f);
+                float len = glm::length(dir);
+                float solidAngle = (2.0f / sourceSize) * (2.0f / sourceSize) / (len * len * len);
+                directions[(size_t)f * sourceTexels + y * sourceSize + x] = glm::vec4(dir / len, solidAngle);
+            }
+        }
+    }
+
+    // GGX with alpha = roughness^2, kept off zero so the lobe stays finite
+    const float alpha = std::max(roughness * roughness, 1e-3f);
+    const float alpha2 = alpha * alpha;
+    JobSystem::instance().parallelFor(0, size, 4, [&](int y0, int y1) {
+        for (int y = y0; y < y1; ++y) {
+            for (int x = 0; x < size; ++x) {
+                glm::vec3 n = glm::normalize(cubeFaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f,
+                    2.0f * (y + 0.5f) / size - 1.0f));
+                glm::vec3 sum(0.0f);
+                float weight = 0.0f;
+                for (int f = 0; f < CUBE_FACES; ++f) {
+                    const glm::vec4* dirs = &directions[(size_t)f * sourceTexels];
+                    const glm::vec3* texels = &(*sources[f])[0];
+                    for (int i = 0; i < sourceTexels; ++i) {
+                        glm::vec3 l(dirs[i]);
+                        float nl = glm::dot(n, l);
+                        if (nl <= 0.0f)
+                            continue;
+                        // With the view along n, n.h = sqrt((1 + n.l) / 2)
+                        float nh2 = 0.5f * (1.0f + nl);
+                        float denom = nh2 * (alpha2 - 1.0f) + 1.0f;
+                        float w = alpha2 / (PI * denom * denom) * nl * dirs[i].w;
+                        sum += texels[i] * w;
+                        weight += w;
+                    }
+                }
+                out[(size_t)y * size + x] = weight > 0.0f ? sum / weight : glm::vec3(0.0f);
+            }
+        }
+    });
+}
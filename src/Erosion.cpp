@@ -0,0 +1,217 @@
+#include <Erosion.hpp>
+#include <JobSystem.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+DropletErosion::Settings::Settings()
+    : numDroplets(200000), batchSize(16384), numThreads(0),
+      maxLifetime(40), brushRadius(3),
+      inertia(0.05f), sedimentCapacityFactor(4.0f), minSedimentCapacity(0.0005f),
+      erodeSpeed(0.3f), depositSpeed(0.3f), evaporateSpeed(0.02f),
+      gravity(4.0f), initialWater(1.0f), initialSpeed(1.0f), seed(1337u)
+{
+}
+
+int DropletErosion::Settings::resolvedThreads() const
+{
+    return numThreads > 0 ? numThreads : JobSystem::instance().getThreadCount();
+}
+
+// Small stateless hash so every droplet gets its own random stream no matter
+// which thread or batch simulates it.
+static unsigned int hashDroplet(unsigned int x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static float toUnitFloat(unsigned int x)
+{
+    return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+DropletErosion::DropletErosion(int m, int n, const Settings& settings)
+    : m(m), n(n), settings(settings)
+{
+    int r = std::max(settings.brushRadius, 1);
+    float weightSum = 0.0f;
+    for (int di = -r; di <= r; ++di) {
+        for (int dj = -r; dj <= r; ++dj) {
+            float dist = std::sqrt((float)(di * di + dj * dj));
+            if (dist > r)
+                continue;
+            float w = 1.0f - dist / r;
+            brushOffsetI.push_back(di);
+            brushOffsetJ.push_back(dj);
+            brushWeights.push_back(w);
+            weightSum += w;
+        }
+    }
+    for (size_t k = 0; k < brushWeights.size(); ++k)
+        brushWeights[k] /= weightSum;
+}
+
+// Bilinear height and gradient at a fractional grid position (x along i, z along j)
+float DropletErosion::sampleHeight(const std::vector<float>& heights, float x, float z,
+    float& gradX, float& gradZ) const
+{
+    int i = (int)x;
+    int j = (int)z;
+    float u = x - i;
+    float v = z - j;
+
+    int idx = i * n + j;
+    float h00 = heights[idx];
+    float h01 = heights[idx + 1];
+    float h10 = heights[idx + n];
+    float h11 = heights[idx + n + 1];
+
+    gradX = (h10 - h00) * (1.0f - v) + (h11 - h01) * v;
+    gradZ = (h01 - h00) * (1.0f - u) + (h11 - h10) * u;
+
+    return h00 * (1.0f - u) * (1.0f - v) + h10 * u * (1.0f - v)
+        + h01 * (1.0f - u) * v + h11 * u * v;
+}
+
+void DropletErosion::simulateDroplets(const std::vector<float>& heights, std::vector<float>& delta,
+    int firstDroplet, int count) const
+{
+    const Settings& s = settings;
+    const float maxX = (float)(m - 1);
+    const float maxZ = (float)(n - 1);
+
+    for (int d = 0; d < count; ++d) {
+        unsigned int h = hashDroplet(s.seed * 0x9e3779b9u + (unsigned int)(firstDroplet + d));
+        float x = toUnitFloat(h) * (maxX - 1.0f);
+        float z = toUnitFloat(hashDroplet(h)) * (maxZ - 1.0f);
+
+        float dirX = 0.0f, dirZ = 0.0f;
+        float speed = s.initialSpeed;
+        float water = s.initialWater;
+        float sediment = 0.0f;
+
+        for (int life = 0; life < s.maxLifetime; ++life) {
+            int nodeI = (int)x;
+            int nodeJ = (int)z;
+            float u = x - nodeI;
+            float v = z - nodeJ;
+
+            float gradX, gradZ;
+            float height = sampleHeight(heights, x, z, gradX, gradZ);
+
+            dirX = dirX * s.inertia - gradX * (1.0f - s.inertia);
+            dirZ = dirZ * s.inertia - gradZ * (1.0f - s.inertia);
+            float len = std::sqrt(dirX * dirX + dirZ * dirZ);
+            if (len < 1e-6f)
+                break;
+            dirX /= len;
+            dirZ /= len;
+
+            x += dirX;
+            z += dirZ;
+            if (x < 0.0f || z < 0.0f || x >= maxX - 1.0f || z >= maxZ - 1.0f)
+                break;
+
+            float unused;
+            float newHeight = sampleHeight(heights, x, z, unused, unused);
+            float deltaHeight = newHeight - height;
+
+            float capacity = std::max(-deltaHeight * speed * water * s.sedimentCapacityFactor,
+                s.minSedimentCapacity);
+
+            int node = nodeI * n + nodeJ;
+            if (sediment > capacity || deltaHeight > 0.0f) {
+                // Going uphill fills the pit behind the droplet, otherwise drop the excess
+                float amount = deltaHeight > 0.0f
+                    ? std::min(deltaHeight, sediment)
+                    : (sediment - capacity) * s.depositSpeed;
+                sediment -= amount;
+
+                delta[node] += amount * (1.0f - u) * (1.0f - v);
+                delta[node + n] += amount * u * (1.0f - v);
+                delta[node + 1] += amount * (1.0f - u) * v;
+                delta[node + n + 1] += amount * u * v;
+            }
+            else {
+                float amount = std::min((capacity - sediment) * s.erodeSpeed, -deltaHeight);
+
+                for (size_t b = 0; b < brushWeights.size(); ++b) {
+                    int bi = nodeI + brushOffsetI[b];
+                    int bj = nodeJ + brushOffsetJ[b];
+                    if (bi < 0 || bj < 0 || bi >= m || bj >= n)
+                        continue;
+                    int idx = bi * n + bj;
+                    float eroded = amount * brushWeights[b];
+                    delta[idx] -= eroded;
+                    sediment += eroded;
+                }
+            }
+
+            speed = std::sqrt(std::max(speed * speed - deltaHeight * s.gravity, 0.0f));
+            water *= 1.0f - s.evaporateSpeed;
+        }
+    }
+}
+
+DropletErosion::Stats DropletErosion::erode(std::vector<float>& heights)
+{
+    Stats stats;
+    stats.droplets = 0;
+    stats.batches = 0;
+    stats.threads = settings.resolvedThreads();
+
+    if (m < 4 || n < 4 || (int)heights.size() != m * n) {
+        stats.seconds = 0.0;
+        stats.dropletsPerSecond = 0.0;
+        return stats;
+    }
+
+    JobSystem& jobs = JobSystem::instance();
+    const int threads = stats.threads;
+    const int batchSize = std::max(settings.batchSize, threads);
+    std::vector<std::vector<float>> accum(threads, std::vector<float>(heights.size(), 0.0f));
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int first = 0; first < settings.numDroplets; first += batchSize) {
+        int batch = std::min(batchSize, settings.numDroplets - first);
+        int perThread = (batch + threads - 1) / threads;
+        int used = std::min(threads, (batch + perThread - 1) / perThread);
+
+        // One job per accumulation buffer; the split only depends on
+        // numThreads, not on how many workers the job system has
+        jobs.parallelFor(0, used, 1, [&](int t0, int t1) {
+            for (int t = t0; t < t1; ++t) {
+                int begin = first + t * perThread;
+                int count = std::min(perThread, first + batch - begin);
+                simulateDroplets(heights, accum[t], begin, count);
+            }
+        });
+
+        // Merge the per-thread buffers, splitting the grid into row ranges
+        jobs.parallelFor(0, m, 32, [&](int i0, int i1) {
+            size_t begin = (size_t)i0 * n, end = (size_t)i1 * n;
+            for (int a = 0; a < used; ++a) {
+                std::vector<float>& buffer = accum[a];
+                for (size_t k = begin; k < end; ++k) {
+                    heights[k] += buffer[k];
+                    buffer[k] = 0.0f;
+                }
+            }
+        });
+
+        stats.droplets += batch;
+        stats.batches++;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    stats.seconds = std::chrono::duration<double>(end - start).count();
+    stats.dropletsPerSecond = stats.seconds > 0.0 ? stats.droplets / stats.seconds : 0.0;
+    return stats;
+}
@@ -0,0 +1,203 @@
+#include <FFT.hpp>
+#include <JobSystem.hpp>
+#include <SimdLanes.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Columns per job; a multiple of the SSE width
+static const int COLUMN_GRAIN = 32;
+
+// One row of the grid
+struct Row {
+    float* re;
+    float* im;
+};
+
+// b *= w, a, b = a + b, a - b on columns [x, x1); returns where it stopped,
+// short of x1 when fewer than WIDTH columns are left
+template <typename L>
+static int radix2(Row a, Row b, float wRe, float wIm, int x, int x1)
+{
+    typedef typename L::V V;
+    const V wr = L::set(wRe), wi = L::set(wIm);
+    for (; x + L::WIDTH <= x1; x += L::WIDTH) {
+        V ar = L::load(a.re + x), ai = L::load(a.im + x);
+        V br = L::load(b.re + x), bi = L::load(b.im + x);
+        V tr = L::sub(L::mul(br, wr), L::mul(bi, wi));
+        V ti = L::add(L::mul(br, wi), L::mul(bi, wr));
+        L::store(a.re + x, L::add(ar, tr));
+        L::store(a.im + x, L::add(ai, ti));
+        L::store(b.re + x, L::sub(ar, tr));
+        L::store(b.im + x, L::sub(ai, ti));
+    }
+    return x;
+}
+
+// Two radix-2 stages in one pass over rows p0..p3 = j, j + h, j + 2h, j + 3h
+// of a block of 4h: the first with twiddle wA = W(2h)^j on (p0, p1) and
+// (p2, p3), the second with W(4h)^j on (p0, p2) and W(4h)^(j + h) on
+// (p1, p3). The last is W(4h)^j * i, so it costs a swap instead of a multiply.
+template <typename L>
+static int radix4(Row r0, Row r1, Row r2, Row r3, float aRe, float aIm, float bRe, float bIm, int x, int x1)
+{
+    typedef typename L::V V;
+    const V war = L::set(aRe), wai = L::set(aIm);
+    const V wbr = L::set(bRe), wbi = L::set(bIm);
+    for (; x + L::WIDTH <= x1; x += L::WIDTH) {
+        V x0r = L::load(r0.re + x), x0i = L::load(r0.im + x);
+        V x1r = L::load(r1.re + x), x1i = L::load(r1.im + x);
+        V x2r = L::load(r2.re + x), x2i = L::load(r2.im + x);
+        V x3r = L::load(r3.re + x), x3i = L::load(r3.im + x);
+
+        V t1r = L::sub(L::mul(x1r, war), L::mul(x1i, wai));
+        V t1i = L::add(L::mul(x1r, wai), L::mul(x1i, war));
+        V t3r = L::sub(L::mul(x3r, war), L::mul(x3i, wai));
+        V t3i = L::add(L::mul(x3r, wai), L::mul(x3i, war));
+        V b0r = L::add(x0r, t1r), b0i = L::add(x0i, t1i);
+        V b1r = L::sub(x0r, t1r), b1i = L::sub(x0i, t1i);
+        V b2r = L::add(x2r, t3r), b2i = L::add(x2i, t3i);
+        V b3r = L::sub(x2r, t3r), b3i = L::sub(x2i, t3i);
+
+        V u2r = L::sub(L::mul(b2r, wbr), L::mul(b2i, wbi));
+        V u2i = L::add(L::mul(b2r, wbi), L::mul(b2i, wbr));
+        V u3r = L::sub(L::mul(b3r, wbr), L::mul(b3i, wbi));
+        V u3i = L::add(L::mul(b3r, wbi), L::mul(b3i, wbr));
+
+        L::store(r0.re + x, L::add(b0r, u2r));
+        L::store(r0.im + x, L::add(b0i, u2i));
+        L::store(r2.re + x, L::sub(b0r, u2r));
+        L::store(r2.im + x, L::sub(b0i, u2i));
+        // b1 +- i * u3
+        L::store(r1.re + x, L::sub(b1r, u3i));
+        L::store(r1.im + x, L::add(b1i, u3r));
+        L::store(r3.re + x, L::add(b1r, u3i));
+        L::store(r3.im + x, L::sub(b1i, u3r));
+    }
+    return x;
+}
+
+// ------------------- FFT2D ---------------------
+FFT2D::FFT2D() : size(0), log2Size(0), simd(simdAvailable())
+{
+}
+
+bool FFT2D::simdAvailable()
+{
+#ifdef SIMD_SSE
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool FFT2D::init(int n)
+{
+    if (n < 2 || (n & (n - 1)) != 0) {
+        std::cout << "FFT2D: size " << n << " is not a power of two\n";
+        return false;
+    }
+    size = n;
+    log2Size = 0;
+    while ((1 << log2Size) < size)
+        ++log2Size;
+
+    twiddleRe.resize(size / 2);
+    twiddleIm.resize(size / 2);
+    const double pi = 3.14159265358979323846;
+    for (int k = 0; k < size / 2; ++k) {
+        double angle = 2.0 * pi * k / size;
+        twiddleRe[k] = (float)std::cos(angle);
+        twiddleIm[k] = (float)std::sin(angle);
+    }
+
+    bitReverse.resize(size);
+    for (int i = 0; i < size; ++i) {
+        int r = 0;
+        for (int bit = 0; bit < log2Size; ++bit)
+            r |= ((i >> bit) & 1) << (log2Size - 1 - bit);
+        bitReverse[i] = r;
+    }
+    return true;
+}
+
+void FFT2D::inverse(float* re, float* im) const
+{
+    JobSystem& jobs = JobSystem::instance();
+    auto columnPass = [&](int x0, int x1) { columns(re, im, x0, x1); };
+
+    jobs.parallelFor(0, size, COLUMN_GRAIN, columnPass);
+    transpose(re);
+    transpose(im);
+    jobs.parallelFor(0, size, COLUMN_GRAIN, columnPass);
+    transpose(re);
+    transpose(im);
+}
+
+// Decimation in time along y, for columns [x0, x1)
+void FFT2D::columns(float* re, float* im, int x0, int x1) const
+{
+    auto row = [&](int y) { Row r = { re + (size_t)y * size, im + (size_t)y * size }; return r; };
+
+    for (int y = 0; y < size; ++y) {
+        int r = bitReverse[y];
+        if (y < r) {
+            std::swap_ranges(re + (size_t)y * size + x0, re + (size_t)y * size + x1, re + (size_t)r * size + x0);
+            std::swap_ranges(im + (size_t)y * size + x0, im + (size_t)y * size + x1, im + (size_t)r * size + x0);
+        }
+    }
+
+    int half = 1;
+    if (log2Size & 1) {
+        // The twiddle of the first stage is 1
+        for (int s = 0; s < size; s += 2) {
+            int x = x0;
+#ifdef SIMD_SSE
+            if (simd)
+                x = radix2<SseLanes>(row(s), row(s + 1), 1.0f, 0.0f, x, x1);
+#endif
+            radix2<ScalarLanes>(row(s), row(s + 1), 1.0f, 0.0f, x, x1);
+        }
+        half = 2;
+    }
+
+    for (; half < size; half *= 4) {
+        // W(4h)^j is twiddle j * step, W(2h)^j twiddle 2 * j * step
+        int step = size / (4 * half);
+        for (int s = 0; s < size; s += 4 * half) {
+            for (int j = 0; j < half; ++j) {
+                int a = 2 * j * step, b = j * step;
+                int p = s + j;
+                int x = x0;
+#ifdef SIMD_SSE
+                if (simd)
+                    x = radix4<SseLanes>(row(p), row(p + half), row(p + 2 * half), row(p + 3 * half),
+                        twiddleRe[a], twiddleIm[a], twiddleRe[b], twiddleIm[b], x, x1);
+#endif
+                radix4<ScalarLanes>(row(p), row(p + half), row(p + 2 * half), row(p + 3 * half),
+                    twiddleRe[a], twiddleIm[a], twiddleRe[b], twiddleIm[b], x, x1);
+            }
+        }
+    }
+}
+
+// In place, in square blocks so both sides of a swap stay in cache; each
+// job owns one band of block rows and the blocks right of the diagonal
+void FFT2D::transpose(float* data) const
+{
+    const int BLOCK = 16;
+    int blocks = (size + BLOCK - 1) / BLOCK;
+    JobSystem::instance().parallelFor(0, blocks, 1, [&](int b0, int b1) {
+        for (int bi = b0; bi < b1; ++bi) {
+            int y0 = bi * BLOCK, y1 = std::min(size, y0 + BLOCK);
+            for (int bj = bi; bj < blocks; ++bj) {
+                int xs = bj * BLOCK, xe = std::min(size, xs + BLOCK);
+                for (int y = y0; y < y1; ++y) {
+                    for (int x = std::max(xs, y + 1); x < xe; ++x)
+                        std::swap(data[(size_t)y * size + x], data[(size_t)x * size + y]);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,149 @@
+#include <FrameCapture.hpp>
+
+#include <cstring>
+#include <iostream>
+
+// How long destroy() waits for a readback still in flight
+static const GLuint64 FINISH_TIMEOUT_NS = 1000000000;
+
+FrameCapture::FrameCapture()
+    : active(false), readBuffer(GL_BACK), writeSlot(0), nextRead(0), frameIndex(0), captured(0), ringDrops(0)
+{
+    for (int i = 0; i < READBACK_SLOTS; ++i) {
+        pbo[i] = 0;
+        fences[i] = 0;
+        sizes[i] = 0;
+        widths[i] = heights[i] = 0;
+        indices[i] = 0;
+    }
+}
+
+bool FrameCapture::init(const CaptureSettings& captureSettings, int width, int height)
+{
+    settings = captureSettings;
+    if (!encoder.open(settings, width, height))
+        return false;
+
+    GLboolean doubleBuffered = GL_TRUE;
+    glGetBooleanv(GL_DOUBLEBUFFER, &doubleBuffered);
+    readBuffer = doubleBuffered ? GL_BACK : GL_FRONT;
+
+    glGenBuffers(READBACK_SLOTS, pbo);
+    writeSlot = nextRead = 0;
+    frameIndex = captured = ringDrops = 0;
+    active = true;
+
+    std::cout << "Capturing " << width << "x" << height << " " << captureFormatName(settings.format) << " frames to "
+        << settings.directory;
+    if (settings.frames > 0)
+        std::cout << ", " << settings.frames << " frames";
+    std::cout << "\n";
+    return true;
+}
+
+void FrameCapture::destroy()
+{
+    if (!active)
+        return;
+
+    // The last frames are still in flight; these may wait
+    while (fences[nextRead]) {
+        glClientWaitSync(fences[nextRead], GL_SYNC_FLUSH_COMMANDS_BIT, FINISH_TIMEOUT_NS);
+        readSlot(nextRead);
+    }
+    encoder.close();
+    glDeleteBuffers(READBACK_SLOTS, pbo);
+    for (int i = 0; i < READBACK_SLOTS; ++i) {
+        pbo[i] = 0;
+        sizes[i] = 0;
+    }
+    active = false;
+
+    const Stats s = getStats();
+    const FrameEncoder::Stats& e = s.encoder;
+    std::cout << "Capture: " << frameIndex << " frames, " << e.written << " written to " << settings.directory
+        << " (" << e.bytes / (1024.0 * 1024.0) << " MB), " << s.ringDrops + e.dropped << " dropped ("
+        << s.ringDrops << " readback, " << e.dropped << " encoder), " << e.repeated << " repeated in their place, "
+        << e.failed << " failed; encoding "
+        << (e.written + e.failed > 0 ? e.encodeMs / (e.written + e.failed) : 0.0) << " ms/frame mean, "
+        << e.maxEncodeMs << " ms max\n";
+}
+
+void FrameCapture::capture(int width, int height)
+{
+    if (!active || done())
+        return;
+    const long long index = frameIndex++;
+    // Three frames behind: the GPU has not caught up, so this one is lost
+    if (fences[writeSlot]) {
+        ringDrops++;
+        return;
+    }
+
+    const size_t bytes = (size_t)width * height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[writeSlot]);
+    if (sizes[writeSlot] != bytes) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        sizes[writeSlot] = bytes;
+    }
+    GLint previousFBO = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousFBO);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glReadBuffer(readBuffer);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previousFBO);
+
+    fences[writeSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    widths[writeSlot] = width;
+    heights[writeSlot] = height;
+    indices[writeSlot] = index;
+    writeSlot = (writeSlot + 1) % READBACK_SLOTS;
+}
+
+void FrameCapture::collect()
+{
+    if (!active)
+        return;
+    // In the order they were queued, so the encoder sees frames in sequence
+    while (fences[nextRead]) {
+        GLenum status = glClientWaitSync(fences[nextRead], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        readSlot(nextRead);
+    }
+}
+
+void FrameCapture::readSlot(int slot)
+{
+    glDeleteSync(fences[slot]);
+    fences[slot] = 0;
+    nextRead = (slot + 1) % READBACK_SLOTS;
+
+    const size_t bytes = (size_t)widths[slot] * heights[slot] * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[slot]);
+    const unsigned char* data = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (data) {
+        // The encoder hands back an earlier frame's buffer to fill
+        pixels.resize(bytes);
+        std::memcpy(&pixels[0], data, bytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        captured++;
+        encoder.submit(pixels, widths[slot], heights[slot], indices[slot]);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+bool FrameCapture::done() const
+{
+    return settings.frames > 0 && frameIndex >= settings.frames;
+}
+
+FrameCapture::Stats FrameCapture::getStats() const
+{
+    Stats s;
+    s.captured = captured;
+    s.ringDrops = ringDrops;
+    s.encoder = encoder.getStats();
+    return s;
+}
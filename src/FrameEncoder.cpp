@@ -0,0 +1,287 @@
+#include <FrameEncoder.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Deflate effort: the default 8 takes several times longer for files only
+// a little smaller, and a slow encoder means dropped frames
+static const int PNG_COMPRESSION = 2;
+
+const char* captureFormatName(CaptureFormat format)
+{
+    switch (format) {
+    case CAPTURE_PNG: return "png";
+    case CAPTURE_Y4M: return "y4m";
+    case CAPTURE_FORMAT_COUNT: break;
+    }
+    return "?";
+}
+
+bool parseCaptureFormat(const std::string& name, CaptureFormat& format)
+{
+    for (int i = 0; i < CAPTURE_FORMAT_COUNT; ++i) {
+        if (name == captureFormatName((CaptureFormat)i)) {
+            format = (CaptureFormat)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool makeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    return CreateDirectoryA(path.c_str(), NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// ------------------- CONVERSION ---------------------
+void FrameEncoder::rgbaToYuv420(const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out)
+{
+    const int chromaWidth = (width + 1) / 2, chromaHeight = (height + 1) / 2;
+    const size_t lumaSize = (size_t)width * height, chromaSize = (size_t)chromaWidth * chromaHeight;
+    out.resize(lumaSize + 2 * chromaSize);
+    unsigned char* yPlane = &out[0];
+    unsigned char* uPlane = yPlane + lumaSize;
+    unsigned char* vPlane = uPlane + chromaSize;
+
+    // 16.16 fixed point, the JFIF matrix; 0.5 rounds, and centring the
+    // chroma on 128 keeps every sum positive before it is shifted
+    const int ROUND = 1 << 15, CENTER = 128 << 16;
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* src = rgba + (size_t)(height - 1 - y) * width * 4;
+        unsigned char* dst = yPlane + (size_t)y * width;
+        for (int x = 0; x < width; ++x) {
+            int r = src[4 * x], g = src[4 * x + 1], b = src[4 * x + 2];
+            dst[x] = (unsigned char)((19595 * r + 38470 * g + 7471 * b + ROUND) >> 16);
+        }
+    }
+    for (int cy = 0; cy < chromaHeight; ++cy) {
+        // Output rows 2 cy and 2 cy + 1, the last one repeated on odd heights
+        const int y0 = 2 * cy, y1 = std::min(2 * cy + 1, height - 1);
+        const unsigned char* row0 = rgba + (size_t)(height - 1 - y0) * width * 4;
+        const unsigned char* row1 = rgba + (size_t)(height - 1 - y1) * width * 4;
+        for (int cx = 0; cx < chromaWidth; ++cx) {
+            const int x0 = 2 * cx, x1 = std::min(2 * cx + 1, width - 1);
+            int r = row0[4 * x0] + row0[4 * x1] + row1[4 * x0] + row1[4 * x1];
+            int g = row0[4 * x0 + 1] + row0[4 * x1 + 1] + row1[4 * x0 + 1] + row1[4 * x1 + 1];
+            int b = row0[4 * x0 + 2] + row0[4 * x1 + 2] + row1[4 * x0 + 2] + row1[4 * x1 + 2];
+            // Sums of four; the mean's shift folds into the fixed point
+            int u = (-11059 * r - 21709 * g + 32768 * b + 4 * (CENTER + ROUND)) >> 18;
+            int v = (32768 * r - 27439 * g - 5329 * b + 4 * (CENTER + ROUND)) >> 18;
+            // Pure blue and red round up to 256
+            uPlane[(size_t)cy * chromaWidth + cx] = (unsigned char)std::min(u, 255);
+            vPlane[(size_t)cy * chromaWidth + cx] = (unsigned char)std::min(v, 255);
+        }
+    }
+}
+
+// ------------------- ENCODER ---------------------
+FrameEncoder::FrameEncoder() : width(0), height(0), stream(nullptr), running(false), stopping(false),
+    sizeWarned(false), nextIndex(0)
+{
+}
+
+FrameEncoder::~FrameEncoder()
+{
+    close();
+}
+
+bool FrameEncoder::open(const CaptureSettings& captureSettings, int frameWidth, int frameHeight)
+{
+    close();
+    settings = captureSettings;
+    settings.maxQueued = std::max(settings.maxQueued, 1);
+    settings.fps = std::max(settings.fps, 1);
+    width = frameWidth;
+    height = frameHeight;
+    stats = Stats();
+
+    if (settings.directory.empty() || !makeDirectory(settings.directory)) {
+        std::cout << "Cannot create capture directory '" << settings.directory << "'\n";
+        return false;
+    }
+    if (settings.format == CAPTURE_Y4M) {
+        std::string path = settings.directory + "/capture.y4m";
+        stream = std::fopen(path.c_str(), "wb");
+        if (!stream) {
+            std::cout << "Cannot create " << path << "\n";
+            return false;
+        }
+        // Square pixels, progressive, full-range 4:2:0 with JPEG chroma siting
+        char header[128];
+        int length = std::snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n",
+            width, height, settings.fps);
+        std::fwrite(header, 1, length, stream);
+        stats.bytes += length;
+    }
+    stbi_write_png_compression_level = PNG_COMPRESSION;
+
+    stopping = false;
+    sizeWarned = false;
+    nextIndex = 0;
+    running = true;
+    thread = std::thread(&FrameEncoder::run, this);
+    return true;
+}
+
+void FrameEncoder::close()
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+    running = false;
+    if (stream) {
+        if (std::fclose(stream) != 0)
+            stats.failed++;
+        stream = nullptr;
+    }
+}
+
+bool FrameEncoder::submit(std::vector<unsigned char>& rgba, int frameWidth, int frameHeight, long long index)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.submitted++;
+    if (!running || (int)queue.size() >= settings.maxQueued) {
+        stats.dropped++;
+        return false;
+    }
+    queue.push_back(Frame());
+    Frame& frame = queue.back();
+    frame.rgba.swap(rgba);
+    frame.width = frameWidth;
+    frame.height = frameHeight;
+    frame.index = index;
+    if (!spares.empty()) {
+        rgba.swap(spares.back());
+        spares.pop_back();
+    }
+    wake.notify_one();
+    return true;
+}
+
+FrameEncoder::Stats FrameEncoder::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FrameEncoder::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        wake.wait(lock, [this]() { return stopping || !queue.empty(); });
+        if (queue.empty())
+            break;
+        Frame frame = std::move(queue.front());
+        queue.pop_front();
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        long long bytes = 0, repeated = 0;
+        bool ok = writeFrame(frame, bytes, repeated);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        if (ok) {
+            stats.written++;
+            stats.repeated += repeated;
+        }
+        else if (bytes < 0)
+            stats.dropped++;
+        else
+            stats.failed++;
+        stats.bytes += std::max(bytes, 0LL);
+        stats.encodeMs += ms;
+        stats.maxEncodeMs = std::max(stats.maxEncodeMs, ms);
+        // One spare per queue slot keeps submit() from allocating
+        if ((int)spares.size() < settings.maxQueued)
+            spares.push_back(std::move(frame.rgba));
+    }
+}
+
+struct PngOutput {
+    std::FILE* file;
+    long long bytes;
+    bool ok;
+};
+
+static void writePngChunk(void* context, void* data, int size)
+{
+    PngOutput* output = (PngOutput*)context;
+    if (output->ok && std::fwrite(data, 1, size, output->file) == (size_t)size)
+        output->bytes += size;
+    else
+        output->ok = false;
+}
+
+// False on failure; bytes comes back -1 for a frame skipped rather than failed
+bool FrameEncoder::writeFrame(const Frame& frame, long long& bytes, long long& repeated)
+{
+    if (settings.format == CAPTURE_Y4M) {
+        // The header fixed the size; a resized window's frames cannot go in
+        if (frame.width != width || frame.height != height) {
+            if (!sizeWarned)
+                std::cout << "Capture: frames are now " << frame.width << "x" << frame.height << ", the Y4M stream is "
+                    << width << "x" << height << "; dropping them\n";
+            sizeWarned = true;
+            bytes = -1;
+            return false;
+        }
+        rgbaToYuv420(&frame.rgba[0], width, height, scratch);
+        static const char FRAME_HEADER[] = "FRAME\n";
+        const size_t headerSize = sizeof(FRAME_HEADER) - 1;
+        // Once for itself and once for every frame dropped since the last
+        repeated = std::max(frame.index - nextIndex, 0LL);
+        nextIndex = frame.index + 1;
+        for (long long copy = 0; copy <= repeated; ++copy) {
+            if (std::fwrite(FRAME_HEADER, 1, headerSize, stream) != headerSize
+                || std::fwrite(&scratch[0], 1, scratch.size(), stream) != scratch.size())
+                return false;
+            bytes += (long long)(headerSize + scratch.size());
+        }
+        return true;
+    }
+
+    // RGB, top row first
+    const size_t rowSize = (size_t)frame.width * 3;
+    scratch.resize(rowSize * frame.height);
+    for (int y = 0; y < frame.height; ++y) {
+        const unsigned char* src = &frame.rgba[(size_t)(frame.height - 1 - y) * frame.width * 4];
+        unsigned char* dst = &scratch[rowSize * y];
+        for (int x = 0; x < frame.width; ++x) {
+            dst[3 * x] = src[4 * x];
+            dst[3 * x + 1] = src[4 * x + 1];
+            dst[3 * x + 2] = src[4 * x + 2];
+        }
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame_%06lld.png", frame.index);
+    std::string path = settings.directory + name;
+    PngOutput output = { std::fopen(path.c_str(), "wb"), 0, true };
+    if (!output.file)
+        return false;
+    bool ok = stbi_write_png_to_func(writePngChunk, &output, frame.width, frame.height, 3, &scratch[0], (int)rowSize) != 0;
+    ok = std::fclose(output.file) == 0 && ok && output.ok;
+    bytes = output.bytes;
+    return ok;
+}
@@ -0,0 +1,106 @@
+#include <GLRenderTargets.hpp>
+
+#include <iostream>
+
+struct TargetFormat {
+    unsigned int internalFormat;
+    size_t bytes;
+    // Transfer format and type glTexImage2D wants alongside, no data is passed
+    unsigned int format, type;
+};
+
+static const TargetFormat FORMATS[] = {
+    { GL_RGBA16F, 8, GL_RGBA, GL_FLOAT },
+    { GL_RGBA32F, 16, GL_RGBA, GL_FLOAT },
+    { GL_RGBA8, 4, GL_RGBA, GL_UNSIGNED_BYTE },
+    { GL_R11F_G11F_B10F, 4, GL_RGB, GL_FLOAT },
+    { GL_RG16F, 4, GL_RG, GL_FLOAT },
+    { GL_R16F, 2, GL_RED, GL_FLOAT },
+    { GL_R32F, 4, GL_RED, GL_FLOAT },
+    { GL_DEPTH_COMPONENT16, 2, GL_DEPTH_COMPONENT, GL_FLOAT },
+    { GL_DEPTH_COMPONENT24, 4, GL_DEPTH_COMPONENT, GL_FLOAT },
+    { GL_DEPTH_COMPONENT32F, 4, GL_DEPTH_COMPONENT, GL_FLOAT },
+    { GL_DEPTH24_STENCIL8, 4, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8 },
+};
+
+static const TargetFormat* findFormat(unsigned int internalFormat)
+{
+    for (const TargetFormat& f : FORMATS) {
+        if (f.internalFormat == internalFormat)
+            return &f;
+    }
+    return nullptr;
+}
+
+size_t GLRenderTargetBackend::formatBytes(unsigned int format)
+{
+    const TargetFormat* f = findFormat(format);
+    return f ? f->bytes : 4;
+}
+
+unsigned int GLRenderTargetBackend::createTexture(const RenderTargetDesc& desc, int width, int height)
+{
+    const TargetFormat* format = findFormat(desc.format);
+    if (!format) {
+        std::cout << "GLRenderTargetBackend: unknown format 0x" << std::hex << desc.format << std::dec
+            << ", using GL_RGBA16F\n";
+        format = findFormat(GL_RGBA16F);
+    }
+
+    unsigned int texture;
+    glGenTextures(1, &texture);
+    if (desc.samples > 1) {
+        // Resolved with a blit, never sampled, so no filtering to set
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+        glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, desc.samples, format->internalFormat, width, height, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        return texture;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, format->internalFormat, width, height, 0, format->format, format->type, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, desc.filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, desc.filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, desc.wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, desc.wrap);
+    if (desc.wrap == GL_CLAMP_TO_BORDER) {
+        // Outside a shadow map nothing is in shadow
+        float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    }
+    if (desc.compare) {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, desc.compare);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return texture;
+}
+
+void GLRenderTargetBackend::destroyTexture(unsigned int texture)
+{
+    glDeleteTextures(1, &texture);
+}
+
+unsigned int GLRenderTargetBackend::createFramebuffer(unsigned int colorTexture, unsigned int depthTexture)
+{
+    unsigned int framebuffer;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    if (colorTexture)
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorTexture, 0);
+    if (depthTexture)
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+    if (!colorTexture) {
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+    }
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "GLRenderTargetBackend: framebuffer " << framebuffer << " not complete\n";
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return framebuffer;
+}
+
+void GLRenderTargetBackend::destroyFramebuffer(unsigned int framebuffer)
+{
+    glDeleteFramebuffers(1, &framebuffer);
+}
@@ -0,0 +1,178 @@
+#include <GLStateCache.hpp>
+
+#include <iostream>
+
+GLStateCache::GLStateCache()
+    : framebuffer(0), width(0), height(0), program(0), vao(0), activeUnit(0),
+    flags(0), depthFunc(0), blendSrc(0), blendDst(0)
+{
+    invalidate();
+}
+
+void GLStateCache::invalidate()
+{
+    known = 0;
+    knownFlags = 0;
+    for (int i = 0; i < MAX_TEXTURE_UNITS; ++i)
+        unitKnown[i] = false;
+}
+
+// Counts the call one way or the other, true if it has to be issued
+bool GLStateCache::changed(bool isKnown, bool differs)
+{
+    if (isKnown && !differs) {
+        stats.elided++;
+        return false;
+    }
+    stats.issued++;
+    return true;
+}
+
+void GLStateCache::bindFramebuffer(unsigned int fbo)
+{
+    if (changed((known & KNOWN_FRAMEBUFFER) != 0, fbo != framebuffer))
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    framebuffer = fbo;
+    known |= KNOWN_FRAMEBUFFER;
+}
+
+void GLStateCache::viewport(int w, int h)
+{
+    if (changed((known & KNOWN_VIEWPORT) != 0, w != width || h != height))
+        glViewport(0, 0, w, h);
+    width = w;
+    height = h;
+    known |= KNOWN_VIEWPORT;
+}
+
+void GLStateCache::useProgram(unsigned int id)
+{
+    if (changed((known & KNOWN_PROGRAM) != 0, id != program))
+        glUseProgram(id);
+    program = id;
+    known |= KNOWN_PROGRAM;
+}
+
+void GLStateCache::bindVertexArray(unsigned int id)
+{
+    if (changed((known & KNOWN_VAO) != 0, id != vao))
+        glBindVertexArray(id);
+    vao = id;
+    known |= KNOWN_VAO;
+}
+
+void GLStateCache::bindTexture(unsigned int unit, unsigned int target, unsigned int texture)
+{
+    if (unit >= MAX_TEXTURE_UNITS) {
+        std::cout << "GLStateCache: texture unit " << unit << " out of range\n";
+        return;
+    }
+    Unit& bound = units[unit];
+    if (!changed(unitKnown[unit], bound.target != target || bound.texture != texture))
+        return;
+
+    if (changed((known & KNOWN_ACTIVE_UNIT) != 0, unit != activeUnit))
+        glActiveTexture(GL_TEXTURE0 + unit);
+    activeUnit = unit;
+    known |= KNOWN_ACTIVE_UNIT;
+
+    // A unit holds one texture per target; the one being replaced is unbound
+    // so the shadow copy can stay a single binding per unit
+    if (unitKnown[unit] && bound.target != target && bound.texture != 0)
+        glBindTexture(bound.target, 0);
+    glBindTexture(target, texture);
+
+    bound.target = target;
+    bound.texture = texture;
+    unitKnown[unit] = true;
+}
+
+void GLStateCache::setFlag(unsigned int flag, bool enable)
+{
+    if (changed((knownFlags & flag) != 0, enable != ((flags & flag) != 0))) {
+        GLenum cap = flag == RenderState::DEPTH_TEST ? GL_DEPTH_TEST
+            : flag == RenderState::CULL_FACE ? GL_CULL_FACE : GL_BLEND;
+        // Depth writes are a mask rather than a capability
+        if (flag == RenderState::DEPTH_WRITE)
+            glDepthMask(enable ? GL_TRUE : GL_FALSE);
+        else if (enable)
+            glEnable(cap);
+        else
+            glDisable(cap);
+    }
+    flags = enable ? flags | flag : flags & ~flag;
+    knownFlags |= flag;
+}
+
+void GLStateCache::apply(const RenderState& state)
+{
+    const unsigned int all[] = { RenderState::DEPTH_TEST, RenderState::DEPTH_WRITE,
+        RenderState::CULL_FACE, RenderState::BLEND };
+    for (unsigned int flag : all)
+        setFlag(flag, (state.flags & flag) != 0);
+
+    unsigned int func = state.depthFunc ? state.depthFunc : GL_LESS;
+    if (changed((known & KNOWN_DEPTH_FUNC) != 0, func != depthFunc))
+        glDepthFunc(func);
+    depthFunc = func;
+    known |= KNOWN_DEPTH_FUNC;
+
+    // The blend function only matters while blending
+    if (state.flags & RenderState::BLEND) {
+        unsigned int src = state.blendSrc ? state.blendSrc : GL_SRC_ALPHA;
+        unsigned int dst = state.blendDst ? state.blendDst : GL_ONE_MINUS_SRC_ALPHA;
+        if (changed((known & KNOWN_BLEND_FUNC) != 0, src != blendSrc || dst != blendDst))
+            glBlendFunc(src, dst);
+        blendSrc = src;
+        blendDst = dst;
+        known |= KNOWN_BLEND_FUNC;
+    }
+}
+
+void GLStateCache::submit(const CommandBuffer& buffer, GpuPassTimer* passTimer)
+{
+    const std::vector<CommandBuffer::Pass>& passes = buffer.getPasses();
+    const std::vector<RenderCommand>& commands = buffer.getCommands();
+    size_t next = 0;
+
+    for (unsigned int pass = 0; pass < passes.size(); ++pass) {
+        const CommandBuffer::Pass& p = passes[pass];
+        if (passTimer)
+            passTimer->mark(p.name);
+        if (p.bindTarget) {
+            bindFramebuffer(p.framebuffer);
+            viewport(p.width, p.height);
+            if (p.clearMask) {
+                // Depth clears honour the depth mask
+                if (p.clearMask & GL_DEPTH_BUFFER_BIT)
+                    setFlag(RenderState::DEPTH_WRITE, true);
+                if (p.clearMask & GL_COLOR_BUFFER_BIT)
+                    glClearColor(p.clearColor[0], p.clearColor[1], p.clearColor[2], p.clearColor[3]);
+                glClear(p.clearMask);
+            }
+        }
+
+        for (; next < commands.size() && commands[next].pass == pass; ++next) {
+            const RenderCommand& command = commands[next];
+            stats.draws++;
+            if (command.external) {
+                if (command.draw)
+                    command.draw();
+                invalidate();
+                continue;
+            }
+
+            useProgram(command.program);
+            if (command.uniforms)
+                command.uniforms();
+            bindVertexArray(command.vao);
+            for (int i = 0; i < command.textureCount; ++i) {
+                const TextureBinding& t = command.textures[i];
+                bindTexture(t.unit, t.target, t.texture);
+            }
+            apply(command.state);
+            if (command.draw)
+                command.draw();
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#include <GpuTimer.hpp>
+
+GpuTimer::GpuTimer() : writeSlot(0)
+{
+    for (int i = 0; i < SLOTS; ++i) {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+}
+
+void GpuTimer::init()
+{
+    glGenQueries(SLOTS, queries);
+}
+
+void GpuTimer::destroy()
+{
+    glDeleteQueries(SLOTS, queries);
+    for (int i = 0; i < SLOTS; ++i)
+        pending[i] = false;
+}
+
+void GpuTimer::begin()
+{
+    // With every slot still waiting on the GPU the oldest is given up
+    // rather than waited for
+    glBeginQuery(GL_TIME_ELAPSED, queries[writeSlot]);
+}
+
+void GpuTimer::end()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[writeSlot] = true;
+    writeSlot = (writeSlot + 1) % SLOTS;
+}
+
+bool GpuTimer::fetch(double& ms)
+{
+    // Oldest slot first; keep the newest that has finished
+    bool found = false;
+    for (int i = 0; i < SLOTS; ++i) {
+        int slot = (writeSlot + i) % SLOTS;
+        if (!pending[slot])
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 ns = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+        pending[slot] = false;
+        ms = ns / 1.0e6;
+        found = true;
+    }
+    return found;
+}
+
+GpuPassTimer::GpuPassTimer() : writeSlot(0)
+{
+    for (int i = 0; i < SLOTS; ++i) {
+        frames[i].marks = 0;
+        frames[i].pending = false;
+    }
+}
+
+void GpuPassTimer::init()
+{
+    for (int i = 0; i < SLOTS; ++i)
+        glGenQueries(MAX_PASSES + 1, frames[i].queries);
+}
+
+void GpuPassTimer::destroy()
+{
+    for (int i = 0; i < SLOTS; ++i) {
+        glDeleteQueries(MAX_PASSES + 1, frames[i].queries);
+        frames[i].pending = false;
+    }
+}
+
+void GpuPassTimer::beginFrame()
+{
+    // As with GpuTimer, a slot the GPU has not finished is given up
+    frames[writeSlot].marks = 0;
+    frames[writeSlot].pending = false;
+}
+
+void GpuPassTimer::mark(const char* pass)
+{
+    Frame& frame = frames[writeSlot];
+    if (frame.marks == MAX_PASSES)
+        return;
+    glQueryCounter(frame.queries[frame.marks], GL_TIMESTAMP);
+    frame.names[frame.marks++] = pass;
+}
+
+void GpuPassTimer::endFrame()
+{
+    Frame& frame = frames[writeSlot];
+    if (frame.marks == 0)
+        return;
+    glQueryCounter(frame.queries[frame.marks], GL_TIMESTAMP);
+    frame.pending = true;
+    writeSlot = (writeSlot + 1) % SLOTS;
+}
+
+bool GpuPassTimer::fetch(std::vector<PassTime>& passes)
+{
+    // Oldest slot first; keep the newest that has finished. The last
+    // timestamp of a frame is written last, so it being there means the
+    // rest are too.
+    int ready = -1;
+    for (int i = 0; i < SLOTS; ++i) {
+        int slot = (writeSlot + i) % SLOTS;
+        if (!frames[slot].pending)
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv(frames[slot].queries[frames[slot].marks], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        frames[slot].pending = false;
+        ready = slot;
+    }
+    if (ready < 0)
+        return false;
+
+    const Frame& frame = frames[ready];
+    GLuint64 start = 0;
+    glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &start);
+    passes.clear();
+    for (int i = 0; i < frame.marks; ++i) {
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(frame.queries[i + 1], GL_QUERY_RESULT, &end);
+        PassTime pass = { frame.names[i], (end - start) / 1.0e6 };
+        passes.push_back(pass);
+        start = end;
+    }
+    return true;
+}
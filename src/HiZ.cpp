@@ -0,0 +1,176 @@
+#include <HiZ.hpp>
+#include <Shader.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+HiZBuffer::HiZBuffer()
+    : program(nullptr), texture(0), fbo(0), vao(0), width(0), height(0), levels(0),
+      readbackLevel(0), readbackWidth(0), readbackHeight(0), writeSlot(0)
+{
+    for (int i = 0; i < READBACK_SLOTS; ++i) {
+        pbo[i] = 0;
+        fences[i] = 0;
+        viewProjections[i] = glm::mat4(1.0f);
+    }
+}
+
+void HiZBuffer::init(const ProgramVariant* program, unsigned int depthWidth, unsigned int depthHeight, unsigned int maxReadbackWidth)
+{
+    this->program = program;
+    width = std::max(depthWidth / 2, 1u);
+    height = std::max(depthHeight / 2, 1u);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    levels = 0;
+    readbackLevel = -1;
+    unsigned int w = width, h = height;
+    while (true) {
+        glTexImage2D(GL_TEXTURE_2D, levels, GL_RG32F, w, h, 0, GL_RG, GL_FLOAT, NULL);
+        if (readbackLevel < 0 && w <= maxReadbackWidth) {
+            readbackLevel = levels;
+            readbackWidth = w;
+            readbackHeight = h;
+        }
+        ++levels;
+        if (w == 1 && h == 1)
+            break;
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    glGenFramebuffers(1, &fbo);
+    glGenVertexArrays(1, &vao);
+
+    glGenBuffers(READBACK_SLOTS, pbo);
+    for (int i = 0; i < READBACK_SLOTS; ++i) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, readbackWidth * readbackHeight * sizeof(float), NULL, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    std::cout << "Hi-Z pyramid: " << width << "x" << height << ", " << levels << " levels, reading back "
+        << readbackWidth << "x" << readbackHeight << "\n";
+}
+
+void HiZBuffer::destroy()
+{
+    for (int i = 0; i < READBACK_SLOTS; ++i) {
+        if (fences[i])
+            glDeleteSync(fences[i]);
+        fences[i] = 0;
+    }
+    glDeleteBuffers(READBACK_SLOTS, pbo);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteTextures(1, &texture);
+}
+
+void HiZBuffer::build(unsigned int depthTexture, unsigned int renderWidth, unsigned int renderHeight,
+    const glm::mat4& viewProjection)
+{
+    GLint viewport[4], previousFBO;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFBO);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+
+    glDisable(GL_DEPTH_TEST);
+    program->shader->use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glBindVertexArray(vao);
+
+    unsigned int sourceWidth = renderWidth, sourceHeight = renderHeight;
+    unsigned int w = width, h = height;
+    for (int level = 0; level < levels; ++level) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+        if (level == 0) {
+            glBindTexture(GL_TEXTURE_2D, depthTexture);
+        }
+        else {
+            // Only the previous level is visible to the shader, so reading
+            // and writing the same texture never overlaps
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        }
+        HiZParams params;
+        params.firstLevel = level == 0;
+        params.sourceSize = glm::vec2((float)sourceWidth, (float)sourceHeight);
+        params.targetSize = glm::vec2((float)w, (float)h);
+        program->apply(params);
+        glViewport(0, 0, w, h);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        sourceWidth = w;
+        sourceHeight = h;
+        w = std::max(w / 2, 1u);
+        h = std::max(h / 2, 1u);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    // Queue the asynchronous readback of the small level; red is the farthest depth
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, readbackLevel);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[writeSlot]);
+    glReadPixels(0, 0, readbackWidth, readbackHeight, GL_RED, GL_FLOAT, 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    if (fences[writeSlot])
+        glDeleteSync(fences[writeSlot]);
+    fences[writeSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    viewProjections[writeSlot] = viewProjection;
+    writeSlot = (writeSlot + 1) % READBACK_SLOTS;
+
+    glBindVertexArray(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFBO);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    if (depthTest)
+        glEnable(GL_DEPTH_TEST);
+}
+
+bool HiZBuffer::fetch(OcclusionCuller& culler)
+{
+    // Walk from the oldest slot to the newest and keep the newest finished one
+    int ready = -1;
+    for (int i = 0; i < READBACK_SLOTS; ++i) {
+        int slot = (writeSlot + i) % READBACK_SLOTS;
+        if (!fences[slot])
+            continue;
+        GLenum status = glClientWaitSync(fences[slot], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        if (ready >= 0) {
+            glDeleteSync(fences[ready]);
+            fences[ready] = 0;
+        }
+        ready = slot;
+    }
+    if (ready < 0)
+        return false;
+
+    glDeleteSync(fences[ready]);
+    fences[ready] = 0;
+
+    size_t bytes = readbackWidth * readbackHeight * sizeof(float);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[ready]);
+    const float* data = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (data) {
+        culler.setDepth(data, readbackWidth, readbackHeight, viewProjections[ready]);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return data != nullptr;
+}
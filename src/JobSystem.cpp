@@ -0,0 +1,223 @@
+#include <JobSystem.hpp>
+
+#include <algorithm>
+
+// Which deque the current thread pushes to and pops from; threads outside
+// the pool use the shared one
+static thread_local const JobSystem* currentSystem = nullptr;
+static thread_local int currentQueue = -1;
+
+JobSystem& JobSystem::instance()
+{
+    static JobSystem system;
+    return system;
+}
+
+JobSystem::JobSystem() : queued(0), stopping(false), jobCount(0), stealCount(0), sleepCount(0)
+{
+    init();
+}
+
+JobSystem::~JobSystem()
+{
+    shutdown();
+}
+
+void JobSystem::init(int numWorkers)
+{
+    shutdown();
+    if (numWorkers < 0)
+        numWorkers = std::max(1, (int)std::thread::hardware_concurrency()) - 1;
+
+    stopping = false;
+    queues.clear();
+    for (int i = 0; i <= numWorkers; ++i)
+        queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+    for (int i = 0; i < numWorkers; ++i)
+        workers.emplace_back(&JobSystem::workerMain, this, i);
+}
+
+void JobSystem::shutdown()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+JobSystem::Stats JobSystem::getStats() const
+{
+    Stats stats;
+    stats.jobs = jobCount.load();
+    stats.steals = stealCount.load();
+    stats.sleeps = sleepCount.load();
+    return stats;
+}
+
+void JobSystem::resetStats()
+{
+    jobCount = 0;
+    stealCount = 0;
+    sleepCount = 0;
+}
+
+void JobSystem::run(Job job, const CounterPtr& counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    Task task;
+    task.job = std::move(job);
+    task.counter = counter;
+    submit(std::move(task));
+}
+
+void JobSystem::then(const CounterPtr& dependency, Job job, const CounterPtr& counter)
+{
+    if (counter)
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    if (dependency) {
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        // complete() decrements before it takes the lock, so a zero here means
+        // the continuations have already been collected
+        if (!dependency->done()) {
+            dependency->continuations.emplace_back(std::move(job), counter);
+            return;
+        }
+    }
+    Task task;
+    task.job = std::move(job);
+    task.counter = counter;
+    submit(std::move(task));
+}
+
+void JobSystem::wait(const CounterPtr& counter)
+{
+    while (counter && !counter->done()) {
+        Task task;
+        if (popTask(task))
+            execute(task);
+        else
+            std::this_thread::yield();
+    }
+}
+
+void JobSystem::parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& body)
+{
+    if (end <= begin)
+        return;
+    grain = std::max(grain, 1);
+    if (workers.empty() || end - begin <= grain) {
+        for (int first = begin; first < end; first += grain)
+            body(first, std::min(first + grain, end));
+        return;
+    }
+
+    CounterPtr counter = makeCounter();
+    for (int first = begin; first < end; first += grain) {
+        int last = std::min(first + grain, end);
+        run([&body, first, last]() { body(first, last); }, counter);
+    }
+    wait(counter);
+}
+
+void JobSystem::submit(Task task)
+{
+    int q = currentSystem == this ? currentQueue : (int)queues.size() - 1;
+    {
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        queues[q]->tasks.push_back(std::move(task));
+    }
+    queued.fetch_add(1, std::memory_order_release);
+
+    // Taking the lock orders this against a worker deciding to sleep
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    wake.notify_one();
+}
+
+bool JobSystem::popTask(Task& task)
+{
+    if (queued.load(std::memory_order_acquire) == 0)
+        return false;
+
+    const int count = (int)queues.size();
+    int own = currentSystem == this ? currentQueue : count - 1;
+    {
+        WorkQueue& queue = *queues[own];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    for (int i = 1; i < count; ++i) {
+        WorkQueue& queue = *queues[(own + i) % count];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            stealCount.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::execute(Task& task)
+{
+    task.job();
+    jobCount.fetch_add(1, std::memory_order_relaxed);
+    if (task.counter)
+        complete(task.counter);
+}
+
+void JobSystem::complete(const CounterPtr& counter)
+{
+    if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    std::vector<std::pair<Job, CounterPtr>> ready;
+    {
+        std::lock_guard<std::mutex> lock(counter->mutex);
+        ready.swap(counter->continuations);
+    }
+    for (auto& continuation : ready) {
+        Task task;
+        task.job = std::move(continuation.first);
+        task.counter = continuation.second;
+        submit(std::move(task));
+    }
+}
+
+void JobSystem::workerMain(int index)
+{
+    currentSystem = this;
+    currentQueue = index;
+
+    for (;;) {
+        Task task;
+        if (popTask(task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        if (stopping)
+            break;
+        if (queued.load(std::memory_order_acquire) > 0)
+            continue;
+        sleepCount.fetch_add(1, std::memory_order_relaxed);
+        wake.wait(lock, [this]() { return stopping || queued.load(std::memory_order_acquire) > 0; });
+        if (stopping)
+            break;
+    }
+
+    currentSystem = nullptr;
+    currentQueue = -1;
+}
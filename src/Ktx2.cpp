@@ -0,0 +1,221 @@
+#include <Ktx2.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// Fields are little-endian on disk, as on every platform this builds for
+
+static const unsigned char KTX2_IDENTIFIER[12] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+const size_t KTX2_HEADER_SIZE = 80;
+const size_t KTX2_LEVEL_ENTRY_SIZE = 24;
+
+const char* ktx2FormatName(unsigned int format)
+{
+    switch (format) {
+    case KTX2_FORMAT_RGBA8: return "RGBA8";
+    case KTX2_FORMAT_BC5: return "BC5";
+    case KTX2_FORMAT_BC7: return "BC7";
+    }
+    return "unknown";
+}
+
+bool ktx2IsBlockCompressed(unsigned int format)
+{
+    return format == KTX2_FORMAT_BC5 || format == KTX2_FORMAT_BC7;
+}
+
+size_t ktx2ImageSize(unsigned int format, int width, int height)
+{
+    if (ktx2IsBlockCompressed(format))
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 16;
+    return (size_t)width * height * 4;
+}
+
+static uint32_t read32(const unsigned char* p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t read64(const unsigned char* p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static void put32(std::vector<unsigned char>& out, size_t at, uint32_t v)
+{
+    memcpy(&out[at], &v, 4);
+}
+
+static void put64(std::vector<unsigned char>& out, size_t at, uint64_t v)
+{
+    memcpy(&out[at], &v, 8);
+}
+
+bool readKtx2(const unsigned char* data, size_t size, Ktx2Texture& texture)
+{
+    if (size < KTX2_HEADER_SIZE || memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        std::cout << "KTX2: not a KTX 2.0 file\n";
+        return false;
+    }
+
+    texture.format = read32(data + 12);
+    texture.width = (int)read32(data + 20);
+    texture.height = (int)read32(data + 24);
+    uint32_t depth = read32(data + 28);
+    uint32_t layers = read32(data + 32);
+    texture.faces = (int)read32(data + 36);
+    uint32_t levelCount = read32(data + 40);
+    uint32_t supercompression = read32(data + 44);
+
+    if (texture.format != KTX2_FORMAT_RGBA8 && !ktx2IsBlockCompressed(texture.format)) {
+        std::cout << "KTX2: unsupported vkFormat " << texture.format << "\n";
+        return false;
+    }
+    if (depth != 0 || layers > 1 || (texture.faces != 1 && texture.faces != 6) || texture.width <= 0
+        || texture.height <= 0 || supercompression != 0 || levelCount == 0) {
+        std::cout << "KTX2: only plain 2D textures and cubemaps with stored mips are supported\n";
+        return false;
+    }
+    if (size < KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_ENTRY_SIZE) {
+        std::cout << "KTX2: truncated level index\n";
+        return false;
+    }
+
+    texture.levels.resize(levelCount);
+    for (uint32_t i = 0; i < levelCount; ++i) {
+        const unsigned char* entry = data + KTX2_HEADER_SIZE + i * KTX2_LEVEL_ENTRY_SIZE;
+        uint64_t offset = read64(entry);
+        uint64_t length = read64(entry + 8);
+        size_t expected = ktx2ImageSize(texture.format, texture.levelWidth(i), texture.levelHeight(i)) * texture.faces;
+        if (offset + length > size || length != expected) {
+            std::cout << "KTX2: level " << i << " is out of bounds or has the wrong size\n";
+            return false;
+        }
+        texture.levels[i].offset = (size_t)offset;
+        texture.levels[i].size = (size_t)length;
+    }
+    return true;
+}
+
+// Basic data format descriptor for the three formats we write
+static std::vector<unsigned char> buildDfd(unsigned int format)
+{
+    struct Sample { uint32_t bitOffset, bitLength, channel, lower, upper; };
+    std::vector<Sample> samples;
+    uint32_t colorModel, blockDim, bytesPlane0;
+
+    if (format == KTX2_FORMAT_BC7) {
+        colorModel = 134;                       // KHR_DF_MODEL_BC7
+        blockDim = 3 | (3 << 8);
+        bytesPlane0 = 16;
+        samples.push_back({ 0, 127, 0, 0, 0xFFFFFFFFu });
+    }
+    else if (format == KTX2_FORMAT_BC5) {
+        colorModel = 132;                       // KHR_DF_MODEL_BC5
+        blockDim = 3 | (3 << 8);
+        bytesPlane0 = 16;
+        samples.push_back({ 0, 63, 0, 0, 0xFFFFFFFFu });
+        samples.push_back({ 64, 63, 1, 0, 0xFFFFFFFFu });
+    }
+    else {
+        colorModel = 1;                         // KHR_DF_MODEL_RGBSDA
+        blockDim = 0;
+        bytesPlane0 = 4;
+        samples.push_back({ 0, 7, 0, 0, 255 });
+        samples.push_back({ 8, 7, 1, 0, 255 });
+        samples.push_back({ 16, 7, 2, 0, 255 });
+        samples.push_back({ 24, 7, 15, 0, 255 });
+    }
+
+    uint32_t blockSize = 24 + 16 * (uint32_t)samples.size();
+    std::vector<unsigned char> dfd(4 + blockSize, 0);
+    put32(dfd, 0, (uint32_t)dfd.size());
+    put32(dfd, 4, 0);                                  // Khronos vendor, basic descriptor
+    put32(dfd, 8, 2 | (blockSize << 16));              // version 1.3
+    put32(dfd, 12, colorModel | (1u << 8) | (1u << 16));  // BT.709 primaries, linear transfer
+    put32(dfd, 16, blockDim);
+    put32(dfd, 20, bytesPlane0);
+    for (size_t i = 0; i < samples.size(); ++i) {
+        size_t at = 28 + 16 * i;
+        put32(dfd, at, samples[i].bitOffset | (samples[i].bitLength << 16) | (samples[i].channel << 24));
+        put32(dfd, at + 8, samples[i].lower);
+        put32(dfd, at + 12, samples[i].upper);
+    }
+    return dfd;
+}
+
+bool writeKtx2(const std::string& path, unsigned int format, int width, int height, int faces,
+    const std::vector<std::vector<unsigned char>>& levels)
+{
+    const size_t levelCount = levels.size();
+    const size_t alignment = ktx2IsBlockCompressed(format) ? 16 : 4;
+
+    std::vector<unsigned char> dfd = buildDfd(format);
+
+    const char writerKey[] = "KTXwriter";
+    const char writerValue[] = "OpenGLPrj TextureBaker";
+    std::vector<unsigned char> kvd(4);
+    put32(kvd, 0, (uint32_t)(sizeof(writerKey) + sizeof(writerValue)));
+    kvd.insert(kvd.end(), writerKey, writerKey + sizeof(writerKey));
+    kvd.insert(kvd.end(), writerValue, writerValue + sizeof(writerValue));
+    while (kvd.size() % 4)
+        kvd.push_back(0);
+
+    size_t dfdOffset = KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_ENTRY_SIZE;
+    size_t kvdOffset = dfdOffset + dfd.size();
+    size_t dataOffset = kvdOffset + kvd.size();
+
+    // Mip data is stored smallest level first
+    std::vector<size_t> levelOffsets(levelCount);
+    size_t end = dataOffset;
+    for (size_t i = levelCount; i-- > 0;) {
+        end = (end + alignment - 1) / alignment * alignment;
+        levelOffsets[i] = end;
+        end += levels[i].size();
+    }
+
+    std::vector<unsigned char> file(end, 0);
+    memcpy(&file[0], KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    put32(file, 12, format);
+    put32(file, 16, 1);                       // typeSize
+    put32(file, 20, (uint32_t)width);
+    put32(file, 24, (uint32_t)height);
+    put32(file, 28, 0);                       // pixelDepth
+    put32(file, 32, 0);                       // layerCount
+    put32(file, 36, (uint32_t)faces);
+    put32(file, 40, (uint32_t)levelCount);
+    put32(file, 44, 0);                       // no supercompression
+    put32(file, 48, (uint32_t)dfdOffset);
+    put32(file, 52, (uint32_t)dfd.size());
+    put32(file, 56, (uint32_t)kvdOffset);
+    put32(file, 60, (uint32_t)kvd.size());
+    put64(file, 64, 0);
+    put64(file, 72, 0);
+
+    for (size_t i = 0; i < levelCount; ++i) {
+        size_t entry = KTX2_HEADER_SIZE + i * KTX2_LEVEL_ENTRY_SIZE;
+        put64(file, entry, levelOffsets[i]);
+        put64(file, entry + 8, levels[i].size());
+        put64(file, entry + 16, levels[i].size());
+        memcpy(&file[levelOffsets[i]], levels[i].data(), levels[i].size());
+    }
+    memcpy(&file[dfdOffset], dfd.data(), dfd.size());
+    memcpy(&file[kvdOffset], kvd.data(), kvd.size());
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        std::cout << "KTX2: cannot write " << path << "\n";
+        return false;
+    }
+    out.write((const char*)file.data(), file.size());
+    return (bool)out;
+}
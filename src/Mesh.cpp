@@ -1,29 +1,134 @@
 #include <Mesh.hpp>
 #define STB_PERLIN_IMPLEMENTATION
 #include <stb_perlin.h>
+#include <AssetPack.hpp>
+#include <JobSystem.hpp>
 #include <random>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
 
 static const float SEA_LEVEL = 0.0f;
 static const float SHORE_WIDTH = 0.0f;
+static const int CHUNK_QUADS = 64; // terrain chunk size in grid quads per side
+static const int OCCLUDER_STRIDE = 16; // grid quads per occluder quad
 
 Mesh Mesh::generateGrid(float width, float depth, int m, int n,
     int erosionIterations = 20, float hydraulicFactor = 0.5f,
     float talusAngle = 0.2f)
 {
-    Mesh mesh;
-    mesh.vertices.reserve(m * n * 8);
-    mesh.indices.reserve((m - 1) * (n - 1) * 6);
+    std::vector<float> heights = generateHeightfield(width, depth, m, n);
+    applyDiffusionErosion(heights, m, n, erosionIterations, hydraulicFactor);
+    applyThermalErosion(heights, m, n, talusAngle);
+    return buildGrid(heights.data(), width, depth, m, n);
+}
 
+Mesh Mesh::generateGrid(float width, float depth, int m, int n,
+    const DropletErosion::Settings& erosion, float talusAngle)
+{
+    std::vector<float> heights = generateErodedHeightfield(width, depth, m, n, erosion, talusAngle, 0);
+    return buildGrid(heights.data(), width, depth, m, n);
+}
+
+std::vector<float> Mesh::generateErodedHeightfield(float width, float depth, int m, int n,
+    const DropletErosion::Settings& erosion, float talusAngle, unsigned int seed)
+{
+    std::vector<float> heights = generateHeightfield(width, depth, m, n, seed);
+
+    DropletErosion droplets(m, n, erosion);
+    DropletErosion::Stats stats = droplets.erode(heights);
+    std::cout << "Droplet erosion: " << stats.droplets << " droplets in "
+        << stats.batches << " batches on " << stats.threads << " threads, "
+        << stats.seconds * 1000.0 << " ms (" << (long long)stats.dropletsPerSecond
+        << " droplets/s)" << std::endl;
+
+    applyThermalErosion(heights, m, n, talusAngle);
+    return heights;
+}
+
+// ------------------- HEIGHTFIELD CACHE ---------------------
+// Cached heightfields live under res/heightfields as
+//   "HFLD", u32 m, u32 n, u64 key, then m * n floats
+// where key hashes every input of generateErodedHeightfield, so changing a
+// setting simply misses the cache. That includes the erosion thread count as
+// resolved on this machine: with numThreads = 0 it follows the JobSystem, and
+// a different split of the droplets gives different heights. Only seeded
+// terrain is cached.
+static const char HFIELD_MAGIC[4] = { 'H', 'F', 'L', 'D' };
+static const size_t HFIELD_HEADER_SIZE = 24;
+
+static unsigned long long heightfieldKey(float width, float depth, int m, int n,
+    const DropletErosion::Settings& e, float talusAngle, unsigned int seed)
+{
+    std::ostringstream key;
+    key << "v2 " << width << ' ' << depth << ' ' << m << ' ' << n << ' ' << talusAngle << ' ' << seed << ' '
+        << e.numDroplets << ' ' << e.batchSize << ' ' << e.maxLifetime << ' ' << e.brushRadius << ' '
+        << e.inertia << ' ' << e.sedimentCapacityFactor << ' ' << e.minSedimentCapacity << ' '
+        << e.erodeSpeed << ' ' << e.depositSpeed << ' ' << e.evaporateSpeed << ' ' << e.gravity << ' '
+        << e.initialWater << ' ' << e.initialSpeed << ' ' << e.seed << ' ' << e.resolvedThreads();
+    return AssetPack::hashName(key.str());
+}
+
+Mesh Mesh::loadGrid(float width, float depth, int m, int n,
+    const DropletErosion::Settings& erosion, float talusAngle, unsigned int seed)
+{
+    if (seed == 0)
+        return generateGrid(width, depth, m, n, erosion, talusAngle);
+
+    unsigned long long key = heightfieldKey(width, depth, m, n, erosion, talusAngle, seed);
+    std::ostringstream name;
+    name << "heightfields/terrain_" << std::hex << key << ".hfield";
+
+    AssetPack::Blob cached = AssetPack::instance().find(name.str());
+    if (cached.size == HFIELD_HEADER_SIZE + (size_t)m * n * sizeof(float)
+        && memcmp(cached.data, HFIELD_MAGIC, sizeof(HFIELD_MAGIC)) == 0) {
+        uint32_t cm, cn;
+        unsigned long long ckey;
+        memcpy(&cm, cached.data + 4, 4);
+        memcpy(&cn, cached.data + 8, 4);
+        memcpy(&ckey, cached.data + 16, 8);
+        if ((int)cm == m && (int)cn == n && ckey == key) {
+            std::cout << "Terrain: cached heightfield " << name.str() << "\n";
+            // Pack entries are 16-byte aligned, so the floats can be read in place
+            return buildGrid((const float*)(cached.data + HFIELD_HEADER_SIZE), width, depth, m, n);
+        }
+    }
+
+    std::vector<float> heights = generateErodedHeightfield(width, depth, m, n, erosion, talusAngle, seed);
+
+    std::string path = AssetPack::instance().getLooseRoot() + name.str();
+    std::ofstream out(path, std::ios::binary);
+    if (out) {
+        char header[HFIELD_HEADER_SIZE] = {};
+        uint32_t um = (uint32_t)m, un = (uint32_t)n;
+        memcpy(header, HFIELD_MAGIC, sizeof(HFIELD_MAGIC));
+        memcpy(header + 4, &um, 4);
+        memcpy(header + 8, &un, 4);
+        memcpy(header + 16, &key, 8);
+        out.write(header, sizeof(header));
+        out.write((const char*)heights.data(), heights.size() * sizeof(float));
+        std::cout << "Terrain: wrote heightfield cache " << path << "\n";
+    }
+    else {
+        std::cout << "Terrain: cannot write heightfield cache " << path << "\n";
+    }
+    return buildGrid(heights.data(), width, depth, m, n);
+}
+
+std::vector<float> Mesh::generateHeightfield(float width, float depth, int m, int n, unsigned int seed)
+{
     float dx = width / (m - 1);
     float dz = depth / (n - 1);
     float startX = -width * 0.5f;
     float startZ = -depth * 0.5f;
 
-    std::vector<glm::vec3> positions(m * n);
-    std::vector<glm::vec2> uvs(m * n);
+    std::vector<float> heights(m * n);
 
     std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937 gen(seed != 0 ? seed : rd());
     std::uniform_real_distribution<float> dis(0.0f, 1000.0f);
     float offsetX = dis(gen);
     float offsetZ = dis(gen);
@@ -31,194 +136,310 @@ Mesh Mesh::generateGrid(float width, float depth, int m, int n,
     float islandRadius = 0.4f * std::max(width, depth);
 
     // --- Generate initial heightmap ---
-    for (int i = 0; i < m; ++i) {
-        for (int j = 0; j < n; ++j) {
-            float x = startX + i * dx;
-            float z = startZ + j * dz;
-
-            float scale = 0.5f;
-            float amplitude = 3.0f;
-            float dist = glm::length(glm::vec2(x, z));
-            float falloff = glm::clamp(1.0f - (dist / islandRadius) * (dist / islandRadius), 0.0f, 1.0f);
-
-            float noise = 0.0f;
-            float freq = 1.0f;
-            float amp = 1.0f;
-            for (int o = 0; o < 3; ++o) {
-                noise += stb_perlin_noise3(
-                    (x + offsetX) * scale * freq,
-                    0.0f,
-                    (z + offsetZ) * scale * freq,
-                    0, 0, 0
-                ) * amp;
-                freq *= 2.0f;
-                amp *= 0.5f;
-            }
-            noise = glm::clamp(noise, -1.0f, 1.0f);
-            float rawHeight = noise * amplitude * falloff;
-
-            float t = glm::smoothstep(
-                SEA_LEVEL - SHORE_WIDTH,
-                SEA_LEVEL + SHORE_WIDTH,
-                rawHeight
-            );
+    JobSystem::instance().parallelFor(0, m, 16, [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            for (int j = 0; j < n; ++j) {
+                float x = startX + i * dx;
+                float z = startZ + j * dz;
+
+                float scale = 0.5f;
+                float amplitude = 3.0f;
+                float dist = glm::length(glm::vec2(x, z));
+                float falloff = glm::clamp(1.0f - (dist / islandRadius) * (dist / islandRadius), 0.0f, 1.0f);
+
+                float noise = 0.0f;
+                float freq = 1.0f;
+                float amp = 1.0f;
+                for (int o = 0; o < 3; ++o) {
+                    noise += stb_perlin_noise3(
+                        (x + offsetX) * scale * freq,
+                        0.0f,
+                        (z + offsetZ) * scale * freq,
+                        0, 0, 0
+                    ) * amp;
+                    freq *= 2.0f;
+                    amp *= 0.5f;
+                }
+                noise = glm::clamp(noise, -1.0f, 1.0f);
+                float rawHeight = noise * amplitude * falloff;
 
-            float y = glm::mix(SEA_LEVEL, rawHeight, t);
+                float t = glm::smoothstep(
+                    SEA_LEVEL - SHORE_WIDTH,
+                    SEA_LEVEL + SHORE_WIDTH,
+                    rawHeight
+                );
 
-            int idx = i * n + j;
-            positions[idx] = glm::vec3(x, y, z);
-            uvs[idx] = glm::vec2((float)i / (m - 1), (float)j / (n - 1));
+                heights[i * n + j] = glm::mix(SEA_LEVEL, rawHeight, t);
+            }
         }
-    }
+    });
 
-    std::vector<float> newHeights(m * n);
+    return heights;
+}
 
-    for (int iter = 0; iter < erosionIterations; ++iter) {
-        // Copy current heights
-        for (int k = 0; k < m * n; ++k)
-            newHeights[k] = positions[k].y;
+// Both erosion passes are written as gathers: every cell adds up what it
+// loses to and receives from its 8 neighbours, reading only the previous
+// iteration, so rows can be processed in parallel. Only interior cells give
+// material away, as before.
+static bool isInterior(int i, int j, int m, int n)
+{
+    return i > 0 && i < m - 1 && j > 0 && j < n - 1;
+}
 
-        for (int i = 1; i < m - 1; ++i) {
-            for (int j = 1; j < n - 1; ++j) {
-                int idx = i * n + j;
-                float centerY = positions[idx].y;
-
-                float totalDelta = 0.0f;
-                std::vector<float> deltas(8, 0.0f);
-
-                // Check 8 neighbors
-                int nIdx = 0;
-                for (int ni = -1; ni <= 1; ++ni) {
-                    for (int nj = -1; nj <= 1; ++nj) {
-                        if (ni == 0 && nj == 0) continue;
-                        int neighborIdx = (i + ni) * n + (j + nj);
-                        float neighborY = positions[neighborIdx].y;
-                        float delta = centerY - neighborY;
-                        if (delta > 0.01f) {
-                            delta *= hydraulicFactor * 0.5f;
-                            delta = glm::min(delta, 0.05f); // max move
-                            deltas[nIdx++] = delta;
-                            totalDelta += delta;
-                        }
-                        else {
-                            deltas[nIdx++] = 0.0f;
-                        }
+void Mesh::applyDiffusionErosion(std::vector<float>& heights, int m, int n, int iterations, float hydraulicFactor)
+{
+    std::vector<float> newHeights(m * n);
+    std::vector<float> outflow(m * n);
+    JobSystem& jobs = JobSystem::instance();
+
+    // Material moved from a cell of height from to a neighbour of height to
+    auto moved = [hydraulicFactor](float from, float to) {
+        float delta = from - to;
+        return delta > 0.01f ? glm::min(delta * hydraulicFactor * 0.5f, 0.05f) : 0.0f; // max move
+    };
+
+    for (int iter = 0; iter < iterations; ++iter) {
+        // Total each interior cell gives away
+        jobs.parallelFor(0, m, 16, [&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                for (int j = 0; j < n; ++j) {
+                    int idx = i * n + j;
+                    float total = 0.0f;
+                    if (isInterior(i, j, m, n)) {
+                        for (int ni = -1; ni <= 1; ++ni)
+                            for (int nj = -1; nj <= 1; ++nj)
+                                if (ni != 0 || nj != 0)
+                                    total += moved(heights[idx], heights[(i + ni) * n + (j + nj)]);
                     }
+                    outflow[idx] = total;
                 }
-
-                // Subtract total from center
-                newHeights[idx] -= totalDelta;
-
-                // Distribute to neighbors proportionally
-                nIdx = 0;
-                for (int ni = -1; ni <= 1; ++ni) {
-                    for (int nj = -1; nj <= 1; ++nj) {
-                        if (ni == 0 && nj == 0) continue;
-                        int neighborIdx = (i + ni) * n + (j + nj);
-                        if (totalDelta > 0.0f)
-                            newHeights[neighborIdx] += deltas[nIdx++] * (deltas[nIdx - 1] / totalDelta);
+            }
+        });
+
+        // Subtract the outflow, and take a share of every neighbour's
+        // outflow proportional to what it sends this way
+        jobs.parallelFor(0, m, 16, [&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                for (int j = 0; j < n; ++j) {
+                    int idx = i * n + j;
+                    float h = heights[idx] - outflow[idx];
+                    for (int ni = -1; ni <= 1; ++ni) {
+                        for (int nj = -1; nj <= 1; ++nj) {
+                            if (ni == 0 && nj == 0) continue;
+                            if (!isInterior(i + ni, j + nj, m, n)) continue;
+                            int source = (i + ni) * n + (j + nj);
+                            if (outflow[source] > 0.0f) {
+                                float delta = moved(heights[source], heights[idx]);
+                                h += delta * (delta / outflow[source]);
+                            }
+                        }
                     }
+                    newHeights[idx] = h;
                 }
             }
-        }
+        });
 
-        // Copy new heights back
-        for (int k = 0; k < m * n; ++k)
-            positions[k].y = newHeights[k];
+        heights.swap(newHeights);
     }
+}
 
+void Mesh::applyThermalErosion(std::vector<float>& heights, int m, int n, float talusAngle)
+{
     // --- Thermal erosion (slope-based smoothing) ---
+    std::vector<float> newHeights(m * n);
     for (int iter = 0; iter < 3; ++iter) {
-        std::vector<glm::vec3> newPositions = positions;
-        for (int i = 1; i < m - 1; ++i) {
-            for (int j = 1; j < n - 1; ++j) {
-                int idx = i * n + j;
-                float centerY = positions[idx].y;
-
-                for (int ni = -1; ni <= 1; ++ni) {
-                    for (int nj = -1; nj <= 1; ++nj) {
-                        if (ni == 0 && nj == 0) continue;
-                        int nIdx = (i + ni) * n + (j + nj);
-                        float neighborY = positions[nIdx].y;
-                        float slope = centerY - neighborY;
-
-                        if (slope > talusAngle) {
-                            float move = (slope - talusAngle) * 0.5f;
-                            newPositions[idx].y -= move;
-                            newPositions[nIdx].y += move;
+        JobSystem::instance().parallelFor(0, m, 16, [&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                for (int j = 0; j < n; ++j) {
+                    int idx = i * n + j;
+                    float centerY = heights[idx];
+                    float h = centerY;
+                    bool interior = isInterior(i, j, m, n);
+
+                    for (int ni = -1; ni <= 1; ++ni) {
+                        for (int nj = -1; nj <= 1; ++nj) {
+                            if (ni == 0 && nj == 0) continue;
+                            if (i + ni < 0 || i + ni >= m || j + nj < 0 || j + nj >= n) continue;
+                            float neighbourY = heights[(i + ni) * n + (j + nj)];
+
+                            // Slides down to the neighbour, or in from it
+                            if (interior && centerY - neighbourY > talusAngle)
+                                h -= (centerY - neighbourY - talusAngle) * 0.5f;
+                            if (isInterior(i + ni, j + nj, m, n) && neighbourY - centerY > talusAngle)
+                                h += (neighbourY - centerY - talusAngle) * 0.5f;
                         }
                     }
+                    newHeights[idx] = h;
                 }
             }
-        }
-        positions = newPositions;
+        });
+        heights.swap(newHeights);
     }
+}
 
-    // --- Generate indices and normals (same as before) ---
-    for (int i = 0; i < m - 1; ++i) {
-        for (int j = 0; j < n - 1; ++j) {
-            unsigned int a = i * n + j;
-            unsigned int b = (i + 1) * n + j;
-            unsigned int c = (i + 1) * n + (j + 1);
-            unsigned int d = i * n + (j + 1);
-
-            auto inside = [&](unsigned int idx) {
-                glm::vec2 posXZ(positions[idx].x, positions[idx].z);
-                return glm::length(posXZ) <= islandRadius;
-                };
+Mesh Mesh::buildGrid(const float* heights, float width, float depth, int m, int n)
+{
+    Mesh mesh;
+    mesh.indices.reserve((m - 1) * (n - 1) * 6);
+
+    float dx = width / (m - 1);
+    float dz = depth / (n - 1);
+    float startX = -width * 0.5f;
+    float startZ = -depth * 0.5f;
+
+    float islandRadius = 0.4f * std::max(width, depth);
 
-            if (inside(a) || inside(b) || inside(c)) {
-                mesh.indices.push_back(a);
-                mesh.indices.push_back(d);
-                mesh.indices.push_back(b);
+    JobSystem& jobs = JobSystem::instance();
+
+    std::vector<glm::vec3> positions(m * n);
+    std::vector<glm::vec2> uvs(m * n);
+    jobs.parallelFor(0, m, 16, [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            for (int j = 0; j < n; ++j) {
+                int idx = i * n + j;
+                positions[idx] = glm::vec3(startX + i * dx, heights[idx], startZ + j * dz);
+                uvs[idx] = glm::vec2((float)i / (m - 1), (float)j / (n - 1));
             }
+        }
+    });
+
+    auto inside = [&](unsigned int idx) {
+        glm::vec2 posXZ(positions[idx].x, positions[idx].z);
+        return glm::length(posXZ) <= islandRadius;
+        };
+
+    // --- Generate indices chunk by chunk so every chunk is a contiguous index range ---
+    // Chunks are built in parallel and then appended in order
+    std::vector<std::pair<int, int>> chunkOrigins;
+    for (int ci = 0; ci < m - 1; ci += CHUNK_QUADS)
+        for (int cj = 0; cj < n - 1; cj += CHUNK_QUADS)
+            chunkOrigins.push_back(std::make_pair(ci, cj));
+
+    std::vector<Chunk> chunks(chunkOrigins.size());
+    std::vector<std::vector<unsigned int>> chunkIndices(chunkOrigins.size());
+    jobs.parallelFor(0, (int)chunkOrigins.size(), 1, [&](int c0, int c1) {
+        for (int k = c0; k < c1; ++k) {
+            int ci = chunkOrigins[k].first, cj = chunkOrigins[k].second;
+            std::vector<unsigned int>& indices = chunkIndices[k];
+
+            for (int i = ci; i < std::min(ci + CHUNK_QUADS, m - 1); ++i) {
+                for (int j = cj; j < std::min(cj + CHUNK_QUADS, n - 1); ++j) {
+                    unsigned int a = i * n + j;
+                    unsigned int b = (i + 1) * n + j;
+                    unsigned int c = (i + 1) * n + (j + 1);
+                    unsigned int d = i * n + (j + 1);
+
+                    if (inside(a) || inside(b) || inside(c)) {
+                        indices.push_back(a);
+                        indices.push_back(d);
+                        indices.push_back(b);
+                    }
 
-            if (inside(b) || inside(c) || inside(d)) {
-                mesh.indices.push_back(d);
-                mesh.indices.push_back(c);
-                mesh.indices.push_back(b);
+                    if (inside(b) || inside(c) || inside(d)) {
+                        indices.push_back(d);
+                        indices.push_back(c);
+                        indices.push_back(b);
+                    }
+                }
             }
+
+            for (unsigned int index : indices)
+                chunks[k].bounds.expand(positions[index]);
         }
+    });
+
+    for (size_t k = 0; k < chunks.size(); ++k) {
+        Chunk chunk = chunks[k];
+        chunk.firstIndex = (unsigned int)mesh.indices.size();
+        chunk.indexCount = (unsigned int)chunkIndices[k].size();
+        if (chunk.indexCount == 0)
+            continue;
+
+        mesh.indices.insert(mesh.indices.end(), chunkIndices[k].begin(), chunkIndices[k].end());
+        mesh.bounds.expand(chunk.bounds);
+        mesh.chunks.push_back(chunk);
     }
 
-    std::vector<glm::vec3> normals(m * n, glm::vec3(0.0f));
-    for (size_t k = 0; k < mesh.indices.size(); k += 3) {
-        unsigned int ia = mesh.indices[k + 0];
-        unsigned int ib = mesh.indices[k + 1];
-        unsigned int ic = mesh.indices[k + 2];
-
-        glm::vec3 A = positions[ia];
-        glm::vec3 B = positions[ib];
-        glm::vec3 C = positions[ic];
+    // --- Coarse occluder: decimated grid kept below the real surface ---
+    // Every coarse vertex takes the lowest height around it, so the coarse
+    // triangles never poke out of the terrain they stand in for.
+    int om = (m - 2) / OCCLUDER_STRIDE + 2;
+    int on = (n - 2) / OCCLUDER_STRIDE + 2;
+    for (int ci = 0; ci < om; ++ci) {
+        for (int cj = 0; cj < on; ++cj) {
+            int gi = std::min(ci * OCCLUDER_STRIDE, m - 1);
+            int gj = std::min(cj * OCCLUDER_STRIDE, n - 1);
+            float lowest = heights[gi * n + gj];
+            for (int i = std::max(gi - OCCLUDER_STRIDE, 0); i <= std::min(gi + OCCLUDER_STRIDE, m - 1); ++i)
+                for (int j = std::max(gj - OCCLUDER_STRIDE, 0); j <= std::min(gj + OCCLUDER_STRIDE, n - 1); ++j)
+                    lowest = std::min(lowest, heights[i * n + j]);
+            mesh.occluderVertices.push_back(glm::vec3(positions[gi * n + gj].x, lowest, positions[gi * n + gj].z));
+        }
+    }
+    for (int ci = 0; ci < om - 1; ++ci) {
+        for (int cj = 0; cj < on - 1; ++cj) {
+            unsigned int a = ci * on + cj;
+            unsigned int b = (ci + 1) * on + cj;
+            unsigned int c = (ci + 1) * on + (cj + 1);
+            unsigned int d = ci * on + (cj + 1);
+
+            // Only cells fully covered by drawn terrain may occlude
+            auto gridIndex = [&](unsigned int o) {
+                return std::min((int)(o / on) * OCCLUDER_STRIDE, m - 1) * n + std::min((int)(o % on) * OCCLUDER_STRIDE, n - 1);
+                };
+            if (!inside(gridIndex(a)) || !inside(gridIndex(b)) || !inside(gridIndex(c)) || !inside(gridIndex(d)))
+                continue;
 
-        glm::vec3 faceN = glm::normalize(glm::cross(B - A, C - A));
-        normals[ia] += faceN;
-        normals[ib] += faceN;
-        normals[ic] += faceN;
+            unsigned int quad[6] = { a, d, b, d, c, b };
+            mesh.occluderIndices.insert(mesh.occluderIndices.end(), quad, quad + 6);
+        }
     }
 
-    for (size_t i = 0; i < normals.size(); ++i)
-        normals[i] = glm::normalize(normals[i]);
+    // Every vertex sums the normals of the drawn triangles around it: the
+    // two triangles of each of the up to four quads touching it, under the
+    // same inside() tests as the index pass
+    auto faceNormal = [&](unsigned int ia, unsigned int ib, unsigned int ic) {
+        return glm::normalize(glm::cross(positions[ib] - positions[ia], positions[ic] - positions[ia]));
+        };
+
+    mesh.vertices.resize((size_t)m * n * 8);
+    jobs.parallelFor(0, m, 16, [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            for (int j = 0; j < n; ++j) {
+                unsigned int idx = i * n + j;
+                glm::vec3 no(0.0f);
+                for (int qi = std::max(i - 1, 0); qi <= std::min(i, m - 2); ++qi) {
+                    for (int qj = std::max(j - 1, 0); qj <= std::min(j, n - 2); ++qj) {
+                        unsigned int a = qi * n + qj;
+                        unsigned int b = (qi + 1) * n + qj;
+                        unsigned int c = (qi + 1) * n + (qj + 1);
+                        unsigned int d = qi * n + (qj + 1);
+
+                        if (idx != c && (inside(a) || inside(b) || inside(c)))
+                            no += faceNormal(a, d, b);
+                        if (idx != a && (inside(b) || inside(c) || inside(d)))
+                            no += faceNormal(d, c, b);
+                    }
+                }
+                no = glm::normalize(no);
 
-    for (int i = 0; i < m; ++i) {
-        for (int j = 0; j < n; ++j) {
-            int idx = i * n + j;
-            glm::vec3 p = positions[idx];
-            glm::vec3 no = normals[idx];
-            glm::vec2 uv = uvs[idx];
+                glm::vec3 p = positions[idx];
+                glm::vec2 uv = uvs[idx];
+                float* v = &mesh.vertices[(size_t)idx * 8];
 
-            mesh.vertices.push_back(p.x);
-            mesh.vertices.push_back(p.y);
-            mesh.vertices.push_back(p.z);
+                v[0] = p.x;
+                v[1] = p.y;
+                v[2] = p.z;
 
-            mesh.vertices.push_back(no.x);
-            mesh.vertices.push_back(no.y);
-            mesh.vertices.push_back(no.z);
+                v[3] = no.x;
+                v[4] = no.y;
+                v[5] = no.z;
 
-            mesh.vertices.push_back(uv.x);
-            mesh.vertices.push_back(uv.y);
+                v[6] = uv.x;
+                v[7] = uv.y;
+            }
         }
-    }
+    });
 
     mesh.vertexCount = m * n;
     return mesh;
@@ -295,6 +516,7 @@ Mesh Mesh::generateWaterPlane(float width, float depth, unsigned int divisions =
     }
 
     mesh.vertexCount = (divisions + 1) * (divisions + 1);
+    mesh.bounds = AABB(glm::vec3(-halfW, y, -halfD), glm::vec3(halfW, y, halfD));
 
     return mesh;
 }
@@ -0,0 +1,209 @@
+#include <Occlusion.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+const char* occlusionModeName(OcclusionMode mode)
+{
+    switch (mode) {
+    case OCCLUSION_OFF: return "off";
+    case OCCLUSION_SOFTWARE: return "software";
+    case OCCLUSION_HIZ: return "hi-z";
+    }
+    return "?";
+}
+
+// ------------------- DEPTH PYRAMID ---------------------
+void DepthPyramid::build(const float* depth, int width, int height)
+{
+    levels.clear();
+    if (width <= 0 || height <= 0)
+        return;
+
+    Level base;
+    base.width = width;
+    base.height = height;
+    base.depth.assign(depth, depth + width * height);
+    levels.push_back(base);
+
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const Level& src = levels.back();
+        Level dst;
+        dst.width = (src.width + 1) / 2;
+        dst.height = (src.height + 1) / 2;
+        dst.depth.resize(dst.width * dst.height);
+
+        for (int y = 0; y < dst.height; ++y) {
+            int y0 = y * 2;
+            int y1 = std::min(y0 + 1, src.height - 1);
+            for (int x = 0; x < dst.width; ++x) {
+                int x0 = x * 2;
+                int x1 = std::min(x0 + 1, src.width - 1);
+                float d = std::max(
+                    std::max(src.depth[y0 * src.width + x0], src.depth[y0 * src.width + x1]),
+                    std::max(src.depth[y1 * src.width + x0], src.depth[y1 * src.width + x1]));
+                dst.depth[y * dst.width + x] = d;
+            }
+        }
+        levels.push_back(dst);
+    }
+}
+
+bool DepthPyramid::isOccluded(const AABB& box, const glm::mat4& viewProjection) const
+{
+    if (levels.empty())
+        return false;
+
+    float minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+    float nearest = 1.0f;
+    for (int c = 0; c < 8; ++c) {
+        glm::vec4 corner((c & 1) ? box.max.x : box.min.x,
+                         (c & 2) ? box.max.y : box.min.y,
+                         (c & 4) ? box.max.z : box.min.z, 1.0f);
+        glm::vec4 p = viewProjection * corner;
+        if (p.w <= 1e-5f)
+            return false;
+
+        float x = p.x / p.w, y = p.y / p.w, z = p.z / p.w;
+        minX = std::min(minX, x); maxX = std::max(maxX, x);
+        minY = std::min(minY, y); maxY = std::max(maxY, y);
+        nearest = std::min(nearest, z * 0.5f + 0.5f);
+    }
+
+    if (maxX < -1.0f || minX > 1.0f || maxY < -1.0f || minY > 1.0f)
+        return false;
+
+    // Screen rectangle in base-level texels, grown by one texel so rounding
+    // and pixel-centre rules can only make the test more conservative
+    const Level& base = levels[0];
+    int x0 = std::max((int)std::floor((minX * 0.5f + 0.5f) * base.width) - 1, 0);
+    int x1 = std::min((int)std::floor((maxX * 0.5f + 0.5f) * base.width) + 1, base.width - 1);
+    int y0 = std::max((int)std::floor((minY * 0.5f + 0.5f) * base.height) - 1, 0);
+    int y1 = std::min((int)std::floor((maxY * 0.5f + 0.5f) * base.height) + 1, base.height - 1);
+
+    // Coarsest level where the rectangle covers at most 2x2 texels
+    int level = 0;
+    while (level + 1 < (int)levels.size() && ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1))
+        ++level;
+
+    const Level& l = levels[level];
+    float farthest = 0.0f;
+    for (int y = y0 >> level; y <= std::min(y1 >> level, l.height - 1); ++y)
+        for (int x = x0 >> level; x <= std::min(x1 >> level, l.width - 1); ++x)
+            farthest = std::max(farthest, l.depth[y * l.width + x]);
+
+    return nearest > farthest;
+}
+
+// ------------------- SOFTWARE RASTERIZER ---------------------
+SoftwareRasterizer::SoftwareRasterizer(int width, int height)
+    : width(width), height(height), depth(width * height, 1.0f)
+{
+}
+
+void SoftwareRasterizer::clear()
+{
+    std::fill(depth.begin(), depth.end(), 1.0f);
+}
+
+void SoftwareRasterizer::drawTriangles(const std::vector<glm::vec3>& vertices,
+    const std::vector<unsigned int>& indices, const glm::mat4& viewProjection)
+{
+    clip.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i)
+        clip[i] = viewProjection * glm::vec4(vertices[i], 1.0f);
+
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const glm::vec4& c0 = clip[indices[t]];
+        const glm::vec4& c1 = clip[indices[t + 1]];
+        const glm::vec4& c2 = clip[indices[t + 2]];
+        if (c0.w <= 1e-5f || c1.w <= 1e-5f || c2.w <= 1e-5f)
+            continue;
+
+        // Window coordinates
+        float x0 = (c0.x / c0.w * 0.5f + 0.5f) * width, y0 = (c0.y / c0.w * 0.5f + 0.5f) * height;
+        float x1 = (c1.x / c1.w * 0.5f + 0.5f) * width, y1 = (c1.y / c1.w * 0.5f + 0.5f) * height;
+        float x2 = (c2.x / c2.w * 0.5f + 0.5f) * width, y2 = (c2.y / c2.w * 0.5f + 0.5f) * height;
+        float z0 = c0.z / c0.w * 0.5f + 0.5f;
+        float z1 = c1.z / c1.w * 0.5f + 0.5f;
+        float z2 = c2.z / c2.w * 0.5f + 0.5f;
+
+        float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+        if (std::fabs(area) < 1e-8f)
+            continue;
+        float invArea = 1.0f / area;
+
+        int minPx = std::max((int)std::floor(std::min(x0, std::min(x1, x2))), 0);
+        int maxPx = std::min((int)std::ceil(std::max(x0, std::max(x1, x2))), width - 1);
+        int minPy = std::max((int)std::floor(std::min(y0, std::min(y1, y2))), 0);
+        int maxPy = std::min((int)std::ceil(std::max(y0, std::max(y1, y2))), height - 1);
+
+        for (int py = minPy; py <= maxPy; ++py) {
+            float sy = py + 0.5f;
+            for (int px = minPx; px <= maxPx; ++px) {
+                float sx = px + 0.5f;
+                // Barycentrics from edge functions; both windings are occluders
+                float w0 = ((x2 - x1) * (sy - y1) - (y2 - y1) * (sx - x1)) * invArea;
+                float w1 = ((x0 - x2) * (sy - y2) - (y0 - y2) * (sx - x2)) * invArea;
+                float w2 = 1.0f - w0 - w1;
+                if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+                    continue;
+
+                float z = w0 * z0 + w1 * z1 + w2 * z2;
+                if (z < 0.0f)
+                    continue;
+                float& d = depth[py * width + px];
+                if (z < d)
+                    d = z;
+            }
+        }
+    }
+}
+
+// ------------------- OCCLUSION CULLER ---------------------
+OcclusionCuller::OcclusionCuller(int width, int height)
+    : rasterizer(width, height), pyramidViewProjection(1.0f)
+{
+}
+
+void OcclusionCuller::setOccluders(const std::vector<glm::vec3>& vertices, const std::vector<unsigned int>& indices)
+{
+    occluderVertices = vertices;
+    occluderIndices = indices;
+}
+
+void OcclusionCuller::renderOccluders(const glm::mat4& viewProjection)
+{
+    rasterizer.clear();
+    rasterizer.drawTriangles(occluderVertices, occluderIndices, viewProjection);
+    pyramid.build(rasterizer.getDepth().data(), rasterizer.getWidth(), rasterizer.getHeight());
+    pyramidViewProjection = viewProjection;
+}
+
+void OcclusionCuller::setDepth(const float* depth, int width, int height, const glm::mat4& viewProjection)
+{
+    pyramid.build(depth, width, height);
+    pyramidViewProjection = viewProjection;
+}
+
+bool OcclusionCuller::isOccluded(const AABB& box) const
+{
+    return pyramid.isOccluded(box, pyramidViewProjection);
+}
+
+void OcclusionCuller::cull(const std::vector<AABB>& boxes, std::vector<unsigned int>& visible,
+    OcclusionStats& stats) const
+{
+    stats.tested += (int)visible.size();
+    if (pyramid.empty())
+        return;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < visible.size(); ++i) {
+        if (isOccluded(boxes[visible[i]]))
+            stats.occluded++;
+        else
+            visible[kept++] = visible[i];
+    }
+    visible.resize(kept);
+}
@@ -0,0 +1,196 @@
+#include <OceanFFT.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+static const float GRAVITY = 9.81f;
+static const float PI = 3.14159265358979323846f;
+
+OceanFFT::OceanFFT() : front(0), ready(false)
+{
+}
+
+OceanFFT::~OceanFFT()
+{
+    finish();
+}
+
+bool OceanFFT::init(const Settings& s)
+{
+    finish();
+    pending.reset();
+    int n = s.size;
+    if (n < MIN_SIZE || n > MAX_SIZE || (n & (n - 1)) != 0) {
+        std::cout << "OceanFFT: size " << n << " must be a power of two from " << MIN_SIZE
+            << " to " << MAX_SIZE << "\n";
+        return false;
+    }
+    settings = s;
+    fft.init(n);
+
+    size_t count = (size_t)n * n;
+    h0.assign(count, std::complex<float>(0.0f, 0.0f));
+    h0MirrorConj.resize(count);
+    omega.resize(count);
+    for (int i = 0; i < 3; ++i) {
+        gridRe[i].resize(count);
+        gridIm[i].resize(count);
+    }
+    for (Maps& m : maps) {
+        m.displacement.assign(count, glm::vec4(0.0f));
+        m.normals.assign(count, glm::vec4(0.0f, 1.0f, 0.0f, 0.0f));
+        m.ms = 0.0;
+    }
+    front = 0;
+    ready = false;
+
+    // Phillips spectrum, with waves much shorter than the largest ones
+    // damped away
+    glm::vec2 wind = glm::normalize(settings.windDirection);
+    float largest = settings.windSpeed * settings.windSpeed / GRAVITY;
+    float smallest = largest * 0.001f;
+    std::mt19937 rng(settings.seed);
+    std::normal_distribution<float> gaussian(0.0f, 1.0f);
+    for (int v = 0; v < n; ++v) {
+        for (int u = 0; u < n; ++u) {
+            float xi = gaussian(rng), eta = gaussian(rng);
+            // The Nyquist row and column have no negative partner, which
+            // would leave the slopes complex; they are dropped
+            if (u == n / 2 || v == n / 2)
+                continue;
+            glm::vec2 k = waveVector(u, v);
+            float k2 = glm::dot(k, k);
+            if (k2 < 1e-12f)
+                continue;
+            float kw = glm::dot(k, wind);
+            float phillips = settings.amplitude * std::exp(-1.0f / (k2 * largest * largest)) / (k2 * k2)
+                * (kw * kw / k2) * std::exp(-k2 * smallest * smallest);
+            h0[(size_t)v * n + u] = std::complex<float>(xi, eta) * std::sqrt(phillips * 0.5f);
+        }
+    }
+
+    // Frequencies are rounded to multiples of 2 pi / period, so every wave
+    // is back where it started after one period
+    float base = 2.0f * PI / settings.period;
+    for (int v = 0; v < n; ++v) {
+        for (int u = 0; u < n; ++u) {
+            size_t i = (size_t)v * n + u;
+            h0MirrorConj[i] = std::conj(h0[(size_t)((n - v) % n) * n + (n - u) % n]);
+            float w = std::sqrt(GRAVITY * glm::length(waveVector(u, v)));
+            omega[i] = std::floor(w / base) * base;
+        }
+    }
+    return true;
+}
+
+glm::vec2 OceanFFT::waveVector(int u, int v) const
+{
+    int n = settings.size;
+    int kx = u < n / 2 ? u : u - n;
+    int kz = v < n / 2 ? v : v - n;
+    return glm::vec2((float)kx, (float)kz) * (2.0f * PI / settings.patchSize);
+}
+
+std::complex<float> OceanFFT::heightSpectrum(int u, int v, float time) const
+{
+    size_t i = (size_t)v * settings.size + u;
+    float phase = omega[i] * std::fmod(time, settings.period);
+    std::complex<float> rotation(std::cos(phase), std::sin(phase));
+    return h0[i] * rotation + h0MirrorConj[i] * std::conj(rotation);
+}
+
+void OceanFFT::compute(float time, Maps& out)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    const int n = settings.size;
+    const std::complex<float> I(0.0f, 1.0f);
+    JobSystem& jobs = JobSystem::instance();
+
+    jobs.parallelFor(0, n, 16, [&](int v0, int v1) {
+        for (int v = v0; v < v1; ++v) {
+            for (int u = 0; u < n; ++u) {
+                size_t i = (size_t)v * n + u;
+                std::complex<float> h = heightSpectrum(u, v, time);
+                glm::vec2 k = waveVector(u, v);
+                float length = glm::length(k);
+
+                // Displacement -i k / |k| h, slope i k h
+                std::complex<float> dx(0.0f), dz(0.0f);
+                if (length > 0.0f) {
+                    dx = -I * (settings.choppiness * k.x / length) * h;
+                    dz = -I * (settings.choppiness * k.y / length) * h;
+                }
+                std::complex<float> a = h + I * dx;
+                std::complex<float> b = dz + I * (I * k.x * h);
+                std::complex<float> c = I * k.y * h;
+
+                gridRe[0][i] = a.real(); gridIm[0][i] = a.imag();
+                gridRe[1][i] = b.real(); gridIm[1][i] = b.imag();
+                gridRe[2][i] = c.real(); gridIm[2][i] = c.imag();
+            }
+        }
+    });
+
+    for (int g = 0; g < 3; ++g)
+        fft.inverse(gridRe[g].data(), gridIm[g].data());
+
+    jobs.parallelFor(0, n, 16, [&](int v0, int v1) {
+        for (size_t i = (size_t)v0 * n; i < (size_t)v1 * n; ++i) {
+            out.displacement[i] = glm::vec4(gridIm[0][i], gridRe[0][i], gridRe[1][i], 0.0f);
+            glm::vec3 normal = glm::normalize(glm::vec3(-gridIm[1][i], 1.0f, -gridRe[2][i]));
+            out.normals[i] = glm::vec4(normal, 0.0f);
+        }
+    });
+
+    out.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void OceanFFT::publish()
+{
+    front = 1 - front;
+    stats.updates++;
+    stats.totalMs += maps[front].ms;
+    if (maps[front].ms > stats.maxMs)
+        stats.maxMs = maps[front].ms;
+}
+
+void OceanFFT::update(float time)
+{
+    compute(time, maps[1 - front]);
+    publish();
+}
+
+void OceanFFT::start(float time)
+{
+    if (pending || ready)
+        return;
+    JobSystem& jobs = JobSystem::instance();
+    Maps& back = maps[1 - front];
+    if (jobs.getWorkerCount() == 0) {
+        // Nobody would pick the job up until something waits
+        compute(time, back);
+        ready = true;
+        return;
+    }
+    pending = jobs.makeCounter();
+    jobs.run([this, time, &back]() { compute(time, back); }, pending);
+}
+
+bool OceanFFT::poll()
+{
+    if (pending && pending->done())
+        pending.reset();
+    else if (!ready)
+        return false;
+    ready = false;
+    publish();
+    return true;
+}
+
+void OceanFFT::finish()
+{
+    if (pending)
+        JobSystem::instance().wait(pending);
+}
@@ -0,0 +1,106 @@
+#include <ProgramKey.hpp>
+
+#include <algorithm>
+
+const char* qualityPresetName(QualityPreset preset)
+{
+    switch (preset) {
+    case QUALITY_LOW: return "low";
+    case QUALITY_MEDIUM: return "medium";
+    case QUALITY_HIGH: return "high";
+    case QUALITY_COUNT: break;
+    }
+    return "?";
+}
+
+bool parseQualityPreset(const std::string& name, QualityPreset& preset)
+{
+    for (int i = 0; i < QUALITY_COUNT; ++i) {
+        if (name == qualityPresetName((QualityPreset)i)) {
+            preset = (QualityPreset)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+QualitySettings QualitySettings::preset(QualityPreset preset)
+{
+    QualitySettings q;
+    switch (preset) {
+    case QUALITY_LOW: q.shadowKernel = 0; q.blurTaps = 3; break;
+    case QUALITY_HIGH: q.shadowKernel = 2; q.blurTaps = 7; break;
+    default: q.shadowKernel = 1; q.blurTaps = 5; break;
+    }
+    return q;
+}
+
+ProgramKey ProgramKey::masked(unsigned int features) const
+{
+    ProgramKey defaults, k = *this;
+    if (!(features & FEATURE_CLIP))
+        k.clip = defaults.clip;
+    if (!(features & FEATURE_SHADOW_FILTER))
+        k.shadowFilter = defaults.shadowFilter;
+    if (!(features & FEATURE_SHADOW_KERNEL))
+        k.shadowKernel = defaults.shadowKernel;
+    if (!(features & FEATURE_BLUR_TAPS))
+        k.blurTaps = defaults.blurTaps;
+    if (!(features & FEATURE_REFLECTIONS))
+        k.reflections = defaults.reflections;
+    return k;
+}
+
+unsigned int ProgramKey::bits() const
+{
+    return (clip ? 1u : 0u) | (unsigned int)shadowFilter << 1 | (unsigned int)shadowKernel << 4
+        | (unsigned int)blurTaps << 8 | (unsigned int)reflections << 12;
+}
+
+std::string ProgramKey::defines(unsigned int features) const
+{
+    std::string out;
+    if ((features & FEATURE_CLIP) && clip)
+        out += "#define CLIP_PLANE\n";
+    if (features & FEATURE_SHADOW_FILTER)
+        out += "#define SHADOW_FILTER " + std::to_string((int)shadowFilter) + "\n";
+    if (features & FEATURE_SHADOW_KERNEL)
+        out += "#define SHADOW_KERNEL " + std::to_string(shadowKernel) + "\n";
+    if (features & FEATURE_BLUR_TAPS)
+        out += "#define BLUR_TAPS " + std::to_string(blurTaps) + "\n";
+    if ((features & FEATURE_REFLECTIONS) && reflections == REFLECTION_SSR)
+        out += "#define SCREEN_SPACE_REFLECTIONS\n";
+    return out;
+}
+
+std::string ProgramKey::describe(unsigned int features) const
+{
+    std::string out;
+    if ((features & FEATURE_CLIP) && clip)
+        out += " CLIP_PLANE";
+    if (features & FEATURE_SHADOW_FILTER)
+        out += std::string(" SHADOW_FILTER=") + shadowFilterName(shadowFilter);
+    if (features & FEATURE_SHADOW_KERNEL)
+        out += " SHADOW_KERNEL=" + std::to_string(shadowKernel);
+    if (features & FEATURE_BLUR_TAPS)
+        out += " BLUR_TAPS=" + std::to_string(blurTaps);
+    if ((features & FEATURE_REFLECTIONS) && reflections == REFLECTION_SSR)
+        out += " SCREEN_SPACE_REFLECTIONS";
+    return out.empty() ? "default" : out.substr(1);
+}
+
+std::string insertDefines(const std::string& source, const std::string& defines)
+{
+    if (defines.empty())
+        return source;
+    size_t version = source.find("#version");
+    if (version == std::string::npos)
+        return defines + "#line 1\n" + source;
+
+    size_t end = source.find('\n', version);
+    if (end == std::string::npos)
+        return source + "\n" + defines;
+    int versionLine = 1 + (int)std::count(source.begin(), source.begin() + end, '\n');
+    return source.substr(0, end + 1) + defines + "#line " + std::to_string(versionLine + 1) + "\n"
+        + source.substr(end + 1);
+}
@@ -0,0 +1,211 @@
+#include <Programs.hpp>
+#include <Shader.hpp>
+
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+ProgramRegistry::ProgramRegistry()
+{
+    std::fill(loaded, loaded + PROGRAM_COUNT, nullptr);
+}
+
+ProgramRegistry::~ProgramRegistry()
+{
+}
+
+void ProgramRegistry::load(const std::string& path, const ProgramKey& key)
+{
+    shaderPath = path;
+    for (int i = 0; i < PROGRAM_COUNT; ++i)
+        loaded[i] = compile((ProgramId)i, key);
+    std::cout << "Compiled " << stats.variants << " programs in " << stats.compileMs << " ms ("
+        << stats.maxCompileMs << " ms longest)\n";
+}
+
+void ProgramRegistry::setConstants(const ConstantSetter& setter)
+{
+    constants = setter;
+    for (int i = 0; i < PROGRAM_COUNT; ++i) {
+        for (const std::unique_ptr<ProgramVariant>& v : variants[i]) {
+            v->shader->use();
+            constants((ProgramId)i, *v->shader);
+        }
+    }
+}
+
+const ProgramVariant& ProgramRegistry::variant(ProgramId id, const ProgramKey& key)
+{
+    // A handful per program at most, so a linear search
+    unsigned int bits = key.masked(programSource(id).features).bits();
+    for (const std::unique_ptr<ProgramVariant>& v : variants[id]) {
+        if (v->key.bits() == bits)
+            return *v;
+    }
+    ProgramVariant* v = compile(id, key);
+    std::cout << "Compiled " << programSource(id).name << " variant "
+        << v->key.describe(programSource(id).features) << " in " << v->compileMs << " ms\n";
+    return *v;
+}
+
+ProgramVariant* ProgramRegistry::compile(ProgramId id, const ProgramKey& key)
+{
+    const ProgramSource& source = programSource(id);
+    std::unique_ptr<ProgramVariant> v(new ProgramVariant());
+    v->program = id;
+    v->key = key.masked(source.features);
+
+    // Reading the link status waits for the driver, so this is the whole compile
+    auto start = std::chrono::steady_clock::now();
+    v->shader.reset(new Shader(shaderPath + source.vertex, shaderPath + source.fragment,
+        v->key.defines(source.features)));
+    v->ID = v->shader->ID;
+    v->locate();
+    v->compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    if (constants) {
+        v->shader->use();
+        constants(id, *v->shader);
+    }
+    stats.variants++;
+    stats.compileMs += v->compileMs;
+    stats.maxCompileMs = std::max(stats.maxCompileMs, v->compileMs);
+    variants[id].push_back(std::move(v));
+    return variants[id].back().get();
+}
+
+void ProgramVariant::locate()
+{
+    // Missing uniforms come back as -1, which glUniform* ignores; only this
+    // program's are looked up
+    auto location = [this](const char* name) {
+        return glGetUniformLocation(ID, name);
+    };
+    switch (program) {
+    case PROGRAM_TERRAIN:
+        terrain.viewProjection = location("viewProjection");
+        terrain.model = location("model");
+        terrain.viewPos = location("viewPos");
+        terrain.lightDir = location("lightDir");
+        terrain.lightSpaceMatrix = location("lightSpaceMatrix");
+        terrain.clipHeight = location("clipHeight");
+        terrain.clipAbove = location("clipAbove");
+        terrain.shIrradiance = location("shIrradiance");
+        break;
+    case PROGRAM_DEPTH:
+        depth.lightSpaceMatrix = location("lightSpaceMatrix");
+        depth.model = location("model");
+        depth.minHeight = location("minHeight");
+        break;
+    case PROGRAM_SHADOW_MOMENTS:
+        moments.lightSpaceMatrix = location("lightSpaceMatrix");
+        moments.model = location("model");
+        break;
+    case PROGRAM_SKYBOX:
+        skybox.inverseViewProjection = location("inverseViewProjection");
+        skybox.sunDirection = location("sunDirection");
+        skybox.sunColor = location("sunColor");
+        break;
+    case PROGRAM_WATER:
+        water.projection = location("projection");
+        water.view = location("view");
+        water.reflectionVP = location("reflectionVP");
+        water.lightSpaceMatrix = location("lightSpaceMatrix");
+        water.viewPos = location("viewPos");
+        water.time = location("time");
+        water.normalStrength = location("normalStrength");
+        water.renderScale = location("renderScale");
+        water.hizLevels = location("hizLevels");
+        break;
+    case PROGRAM_BRIGHTPASS:
+        brightThreshold = location("threshold");
+        brightRenderScale = location("renderScale");
+        break;
+    case PROGRAM_BLUR:
+        blurHorizontal = location("horizontal");
+        blurRenderScale = location("renderScale");
+        break;
+    case PROGRAM_FINAL:
+        finalExposure = location("exposure");
+        finalRenderScale = location("renderScale");
+        break;
+    case PROGRAM_HIZ:
+        hiz.firstLevel = location("firstLevel");
+        hiz.sourceSize = location("sourceSize");
+        hiz.targetSize = location("targetSize");
+        break;
+    default:
+        break;
+    }
+}
+
+void ProgramVariant::apply(const TerrainParams& p) const
+{
+    glUniformMatrix4fv(terrain.viewProjection, 1, GL_FALSE, glm::value_ptr(p.viewProjection));
+    glUniformMatrix4fv(terrain.model, 1, GL_FALSE, glm::value_ptr(p.model));
+    glUniform3fv(terrain.viewPos, 1, glm::value_ptr(p.viewPos));
+    glUniform3fv(terrain.lightDir, 1, glm::value_ptr(p.lightDir));
+    glUniformMatrix4fv(terrain.lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(p.lightSpaceMatrix));
+    glUniform1f(terrain.clipHeight, p.clipHeight);
+    glUniform1i(terrain.clipAbove, p.clipAbove);
+    glUniform3fv(terrain.shIrradiance, 9, glm::value_ptr(p.shIrradiance[0]));
+}
+
+void ProgramVariant::apply(const DepthParams& p) const
+{
+    glUniformMatrix4fv(depth.lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(p.lightSpaceMatrix));
+    glUniformMatrix4fv(depth.model, 1, GL_FALSE, glm::value_ptr(p.model));
+    glUniform1f(depth.minHeight, p.minHeight);
+}
+
+void ProgramVariant::apply(const ShadowMomentsParams& p) const
+{
+    glUniformMatrix4fv(moments.lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(p.lightSpaceMatrix));
+    glUniformMatrix4fv(moments.model, 1, GL_FALSE, glm::value_ptr(p.model));
+}
+
+void ProgramVariant::apply(const SkyboxParams& p) const
+{
+    glUniformMatrix4fv(skybox.inverseViewProjection, 1, GL_FALSE, glm::value_ptr(p.inverseViewProjection));
+    glUniform3fv(skybox.sunDirection, 1, glm::value_ptr(p.sunDirection));
+    glUniform3fv(skybox.sunColor, 1, glm::value_ptr(p.sunColor));
+}
+
+void ProgramVariant::apply(const WaterParams& p) const
+{
+    glUniformMatrix4fv(water.projection, 1, GL_FALSE, glm::value_ptr(p.projection));
+    glUniformMatrix4fv(water.view, 1, GL_FALSE, glm::value_ptr(p.view));
+    glUniformMatrix4fv(water.reflectionVP, 1, GL_FALSE, glm::value_ptr(p.reflectionVP));
+    glUniformMatrix4fv(water.lightSpaceMatrix, 1, GL_FALSE, glm::value_ptr(p.lightSpaceMatrix));
+    glUniform3fv(water.viewPos, 1, glm::value_ptr(p.viewPos));
+    glUniform1f(water.time, p.time);
+    glUniform1f(water.normalStrength, p.normalStrength);
+    glUniform2fv(water.renderScale, 1, glm::value_ptr(p.renderScale));
+    glUniform1i(water.hizLevels, p.hizLevels);
+}
+
+void ProgramVariant::apply(const BrightPassParams& p) const
+{
+    glUniform1f(brightThreshold, p.threshold);
+    glUniform2fv(brightRenderScale, 1, glm::value_ptr(p.renderScale));
+}
+
+void ProgramVariant::apply(const BlurParams& p) const
+{
+    glUniform1i(blurHorizontal, p.horizontal ? 1 : 0);
+    glUniform2fv(blurRenderScale, 1, glm::value_ptr(p.renderScale));
+}
+
+void ProgramVariant::apply(const FinalParams& p) const
+{
+    glUniform1f(finalExposure, p.exposure);
+    glUniform2fv(finalRenderScale, 1, glm::value_ptr(p.renderScale));
+}
+
+void ProgramVariant::apply(const HiZParams& p) const
+{
+    glUniform1i(hiz.firstLevel, p.firstLevel ? 1 : 0);
+    glUniform2fv(hiz.sourceSize, 1, glm::value_ptr(p.sourceSize));
+    glUniform2fv(hiz.targetSize, 1, glm::value_ptr(p.targetSize));
+}
@@ -0,0 +1,22 @@
+#include <Reflections.hpp>
+
+const char* reflectionModeName(ReflectionMode mode)
+{
+    switch (mode) {
+    case REFLECTION_PLANAR: return "planar";
+    case REFLECTION_SSR: return "ssr";
+    case REFLECTION_MODE_COUNT: break;
+    }
+    return "?";
+}
+
+bool parseReflectionMode(const std::string& name, ReflectionMode& mode)
+{
+    for (int i = 0; i < REFLECTION_MODE_COUNT; ++i) {
+        if (name == reflectionModeName((ReflectionMode)i)) {
+            mode = (ReflectionMode)i;
+            return true;
+        }
+    }
+    return false;
+}
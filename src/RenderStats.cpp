@@ -0,0 +1,203 @@
+#include <RenderStats.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+void PassTimeStats::add(const std::vector<GpuPassTimer::PassTime>& frame)
+{
+    frames++;
+    for (const GpuPassTimer::PassTime& time : frame) {
+        size_t i = 0;
+        while (i < passes.size() && std::strcmp(passes[i].name, time.name) != 0)
+            ++i;
+        if (i == passes.size()) {
+            Pass pass = { time.name, 0.0 };
+            passes.push_back(pass);
+        }
+        passes[i].totalMs += time.ms;
+    }
+}
+
+void RenderStats::reset()
+{
+    frames = 0;
+    shadowCull = CullStats();
+    reflectionCull = CullStats();
+    sceneCull = CullStats();
+    shadowDraw = DrawStats();
+    reflectionDraw = DrawStats();
+    sceneDraw = DrawStats();
+    prepassDraw = DrawStats();
+    depthPrepass = false;
+    terrainShading = ShadingStats();
+    occlusionMode = OCCLUSION_OFF;
+    sceneOcclusion = OcclusionStats();
+    water = WaterClipmap::Stats();
+    ocean = OceanFFT::Stats();
+    atmosphere = Atmosphere::Stats();
+    sunElevation = 0.0f;
+    indirectRing = RingBuffer::Stats();
+    frameTime = FrameTimeStats();
+    simulation = Simulation::Stats();
+    stateCache = GLStateCache::Stats();
+    gpuTime = FrameTimeStats();
+    passTimes = PassTimeStats();
+    resolutionStats = ResolutionController::Stats();
+    renderTargets = RenderTargetPool::Stats();
+    quality = QUALITY_MEDIUM;
+    reflections = REFLECTION_PLANAR;
+    capturing = false;
+}
+
+void RenderStats::addPassTimes(const std::vector<GpuPassTimer::PassTime>& frame)
+{
+    passTimes.add(frame);
+
+    // Which mode the frame was rendered in shows in its passes
+    bool planar = false, ssr = false;
+    double planarMs = 0.0, ssrMs = 0.0;
+    for (const GpuPassTimer::PassTime& time : frame) {
+        if (std::strcmp(time.name, "reflection") == 0) {
+            planar = true;
+            planarMs += time.ms;
+        }
+        else if (std::strcmp(time.name, "scenecopy") == 0 || std::strcmp(time.name, "hiz") == 0) {
+            ssr = ssr || std::strcmp(time.name, "scenecopy") == 0;
+            ssrMs += time.ms;
+        }
+        else if (std::strcmp(time.name, "water") == 0) {
+            planarMs += time.ms;
+            ssrMs += time.ms;
+        }
+    }
+    if (planar)
+        reflectionCost[REFLECTION_PLANAR].add(planarMs);
+    else if (ssr)
+        reflectionCost[REFLECTION_SSR].add(ssrMs);
+}
+
+static void printPass(std::ostream& out, const char* pass, const CullStats& cull,
+    const DrawStats& draw, int frames)
+{
+    out << "  " << pass << ": " << cull.visible / frames << "/" << cull.total / frames
+        << " chunks visible, " << cull.nodesTested / frames << " volumes tested, draw calls "
+        << draw.chunks / frames << " -> " << draw.drawCalls / frames
+        << " (" << draw.ranges / frames << " ranges)\n";
+}
+
+void RenderStats::print(std::ostream& out) const
+{
+    if (frames == 0)
+        return;
+
+    out << "---- " << frames << " frames ----\n";
+    printPass(out, "shadow    ", shadowCull, shadowDraw, frames);
+    int shadowSize = shadows.prefiltered() ? shadows.momentMapSize : shadows.mapSize;
+    out << "  shadow filter: " << shadowFilterName(shadows.filter) << ", " << shadowSize << "x" << shadowSize
+        << (shadows.prefiltered() ? " moment map, blurred\n" : " depth map\n");
+    printPass(out, "reflection", reflectionCull, reflectionDraw, frames);
+    printPass(out, "scene     ", sceneCull, sceneDraw, frames);
+    if (terrainShading.frames > 0) {
+        out << "  terrain shading: " << terrainShading.samples / terrainShading.frames << " samples/frame, "
+            << (double)terrainShading.samples / std::max(terrainShading.pixels, 1LL) << " per pixel; depth pre-pass "
+            << (depthPrepass ? "on" : "off");
+        if (prepassDraw.drawCalls > 0)
+            out << " (" << prepassDraw.ranges / frames << " ranges front to back)";
+        out << "\n";
+    }
+
+    if (occlusionMode != OCCLUSION_OFF && sceneCull.total > 0) {
+        const OcclusionStats& occ = sceneOcclusion;
+        out << "  occlusion (" << occlusionModeName(occlusionMode) << "): "
+            << occ.occluded / frames << "/" << occ.tested / frames << " frustum-visible chunks rejected ("
+            << (occ.tested ? 100.0 * occ.occluded / occ.tested : 0.0) << "%), frustum alone rejects "
+            << 100.0 * (sceneCull.total - sceneCull.visible) / sceneCull.total << "%, water tiles occluded "
+            << water.occluded / frames << "/" << (water.tiles + water.occluded) / frames << "\n";
+    }
+    out << "  water: " << water.tiles / frames << " tiles, " << water.vertices / frames
+        << " vertices, " << water.nodesTested / frames << " quadtree nodes tested\n";
+    if (ocean.updates > 0) {
+        out << "  ocean: " << ocean.updates << " FFT updates, " << ocean.totalMs / ocean.updates
+            << " ms mean, " << ocean.maxMs << " ms max on the job system\n";
+    }
+    out << "  sky: sun " << sunElevation << " degrees up; " << atmosphere.skyViewUpdates << " sky view marches, "
+        << atmosphere.faceUpdates << " cube faces";
+    if (atmosphere.skyViewUpdates + atmosphere.faceUpdates > 0)
+        out << ", " << atmosphere.totalMs / frames << " ms/frame mean, " << atmosphere.maxMs << " ms max on the job system";
+    out << " (LUTs precomputed in " << atmosphere.precomputeMs << " ms)\n";
+    if (indirectRing.frames > 0) {
+        out << "  indirect ring: " << indirectRing.bytes / indirectRing.frames << " bytes/frame, "
+            << indirectRing.stalls << " stalls (" << indirectRing.stallMs << " ms waiting), "
+            << indirectRing.overflows << " overflows\n";
+    }
+    if (frameTime.frames > 0) {
+        out << "  frame time: " << frameTime.meanMs() << " ms mean, " << frameTime.stddevMs()
+            << " ms stddev, " << frameTime.maxMs << " ms max; simulation "
+            << (simulationSettings.frameStep > 0.0 ? "per frame" : simulationSettings.threaded ? "threaded" : "inline")
+            << " at " << simulationSettings.tickRate
+            << " Hz, load " << simulationSettings.loadMs << " ms: " << simulation.ticks << " ticks, "
+            << simulation.lateTicks << " late, " << simulation.droppedTicks << " dropped, "
+            << simulation.maxTickMs << " ms longest\n";
+    }
+    if (gpuTime.frames > 0) {
+        out << "  GPU time: " << gpuTime.meanMs() << " ms mean, " << gpuTime.stddevMs() << " ms stddev, "
+            << gpuTime.maxMs << " ms max\n";
+    }
+    if (passTimes.frames > 0) {
+        out << "  GPU passes:";
+        for (size_t i = 0; i < passTimes.passes.size(); ++i) {
+            out << (i ? ", " : " ") << passTimes.passes[i].name << " "
+                << passTimes.passes[i].totalMs / passTimes.frames;
+        }
+        out << " ms\n";
+    }
+    out << "  reflections: " << reflectionModeName(reflections) << "; GPU cost";
+    for (int mode = 0; mode < REFLECTION_MODE_COUNT; ++mode) {
+        const FrameTimeStats& cost = reflectionCost[mode];
+        out << (mode ? ", " : " ") << reflectionModeName((ReflectionMode)mode) << " ";
+        if (cost.frames > 0)
+            out << cost.meanMs() << " ms mean over " << cost.frames << " frames";
+        else
+            out << "not measured yet";
+    }
+    out << "\n";
+    if (resolutionStats.frames > 0) {
+        const ResolutionController::Settings& s = resolutionSettings;
+        out << "  resolution: scale " << resolutionStats.scaleSum / resolutionStats.frames << " mean ("
+            << resolutionStats.minScale << ".." << resolutionStats.maxScale << ", " << resolutionStats.changes
+            << " changes), limits " << s.minScale << ".." << s.maxScale;
+        if (s.targetMs > 0.0) {
+            out << ", target " << s.targetMs << " ms; controller at " << resolution.filteredMs
+                << " ms, error " << resolution.error << ", integral " << resolution.integral
+                << ", derivative " << resolution.derivative << ", requested " << resolution.requested << "\n";
+        }
+        else {
+            out << ", controller off\n";
+        }
+    }
+    if (renderTargets.targets > 0) {
+        const double MB = 1024.0 * 1024.0;
+        out << "  render targets: " << renderTargets.targets << " (" << renderTargets.bytes / MB << " MB, peak "
+            << renderTargets.peakBytes / MB << " MB), " << renderTargets.framebuffers << " framebuffers; "
+            << renderTargets.allocations << " allocated, " << renderTargets.reuses / frames << " reused per frame, "
+            << renderTargets.frees << " freed\n";
+    }
+    if (programs.variants > 0) {
+        out << "  programs: " << qualityPresetName(quality) << " quality, " << programs.variants
+            << " variants compiled in " << programs.compileMs << " ms (" << programs.maxCompileMs << " ms longest)\n";
+    }
+    if (capturing) {
+        const FrameEncoder::Stats& encoder = capture.encoder;
+        out << "  capture: " << capture.captured << " frames read back, " << encoder.written << " written ("
+            << encoder.bytes / (1024.0 * 1024.0) << " MB), " << encoder.submitted - encoder.written - encoder.dropped
+            - encoder.failed << " queued; dropped " << capture.ringDrops << " waiting on readback, " << encoder.dropped
+            << " by the encoder; " << encoder.failed << " failed, "
+            << (encoder.written + encoder.failed > 0 ? encoder.encodeMs / (encoder.written + encoder.failed) : 0.0) << " ms/frame encoding\n";
+    }
+    if (stateCache.draws > 0) {
+        out << "  state: " << stateCache.issued / frames << " GL state calls issued, "
+            << stateCache.elided / frames << " elided as redundant, " << stateCache.draws / frames
+            << " commands per frame\n";
+    }
+    out.flush();
+}
@@ -0,0 +1,168 @@
+#include <RenderTargetPool.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+RenderTargetDesc RenderTargetDesc::fixed(int width, int height, unsigned int format, unsigned int filter, unsigned int wrap)
+{
+    RenderTargetDesc desc = { std::max(width, 1), std::max(height, 1), 1.0f, format, 1, filter, wrap, 0 };
+    return desc;
+}
+
+RenderTargetDesc RenderTargetDesc::relative(float scale, unsigned int format, unsigned int filter, unsigned int wrap)
+{
+    RenderTargetDesc desc = { 0, 0, scale, format, 1, filter, wrap, 0 };
+    return desc;
+}
+
+RenderTargetPool::RenderTargetPool() : backend(nullptr), referenceWidth(1), referenceHeight(1), frame(0)
+{
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+    if (!entries.empty())
+        std::cout << "RenderTargetPool: " << entries.size() << " targets not destroyed\n";
+}
+
+void RenderTargetPool::init(Backend* b, const Settings& s)
+{
+    destroy();
+    backend = b;
+    settings = s;
+    frame = 0;
+    stats = Stats();
+}
+
+void RenderTargetPool::destroy()
+{
+    while (!entries.empty())
+        free(entries.size() - 1);
+}
+
+void RenderTargetPool::resolveSize(const RenderTargetDesc& desc, int& width, int& height) const
+{
+    if (!desc.isRelative()) {
+        width = desc.width;
+        height = desc.height;
+        return;
+    }
+    width = std::max(1, (int)(referenceWidth * desc.scale + 0.5f));
+    height = std::max(1, (int)(referenceHeight * desc.scale + 0.5f));
+}
+
+size_t RenderTargetPool::targetBytes(const RenderTargetDesc& desc, int width, int height) const
+{
+    return (size_t)width * height * std::max(desc.samples, 1) * backend->bytesPerTexel(desc.format);
+}
+
+void RenderTargetPool::beginFrame(int width, int height)
+{
+    ++frame;
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    if (width == referenceWidth && height == referenceHeight)
+        return;
+    referenceWidth = width;
+    referenceHeight = height;
+
+    // Resized: nothing will ask for the old sizes again
+    for (size_t i = entries.size(); i-- > 0;) {
+        const Entry& entry = entries[i];
+        int w, h;
+        resolveSize(entry.desc, w, h);
+        if (entry.desc.isRelative() && !entry.inUse && (w != entry.target.width || h != entry.target.height))
+            free(i);
+    }
+}
+
+void RenderTargetPool::endFrame()
+{
+    for (size_t i = entries.size(); i-- > 0;) {
+        entries[i].inUse = false;
+        if (frame - entries[i].lastUsedFrame > settings.maxIdleFrames)
+            free(i);
+    }
+}
+
+RenderTarget RenderTargetPool::acquire(const RenderTargetDesc& desc)
+{
+    int width, height;
+    resolveSize(desc, width, height);
+    for (Entry& entry : entries) {
+        if (!entry.inUse && entry.desc.compatible(desc)
+            && entry.target.width == width && entry.target.height == height) {
+            entry.inUse = true;
+            entry.lastUsedFrame = frame;
+            stats.reuses++;
+            return entry.target;
+        }
+    }
+
+    Entry entry;
+    entry.desc = desc;
+    entry.target.texture = backend->createTexture(desc, width, height);
+    entry.target.width = width;
+    entry.target.height = height;
+    entry.bytes = targetBytes(desc, width, height);
+    entry.inUse = true;
+    entry.lastUsedFrame = frame;
+    entries.push_back(entry);
+
+    stats.targets++;
+    stats.bytes += entry.bytes;
+    stats.peakBytes = std::max(stats.peakBytes, stats.bytes);
+    stats.allocations++;
+    return entry.target;
+}
+
+void RenderTargetPool::release(const RenderTarget& target)
+{
+    for (Entry& entry : entries) {
+        if (entry.target.texture == target.texture) {
+            entry.inUse = false;
+            return;
+        }
+    }
+    std::cout << "RenderTargetPool: releasing texture " << target.texture << ", which is not a pooled target\n";
+}
+
+unsigned int RenderTargetPool::framebuffer(unsigned int color, unsigned int depth)
+{
+    for (const CachedFramebuffer& cached : framebuffers) {
+        if (cached.color == color && cached.depth == depth)
+            return cached.framebuffer;
+    }
+    CachedFramebuffer cached = { backend->createFramebuffer(color, depth), color, depth };
+    framebuffers.push_back(cached);
+    stats.framebuffers++;
+    return cached.framebuffer;
+}
+
+void RenderTargetPool::free(size_t index)
+{
+    unsigned int texture = entries[index].target.texture;
+    for (size_t i = framebuffers.size(); i-- > 0;) {
+        if (framebuffers[i].color == texture || framebuffers[i].depth == texture) {
+            backend->destroyFramebuffer(framebuffers[i].framebuffer);
+            framebuffers.erase(framebuffers.begin() + i);
+            stats.framebuffers--;
+        }
+    }
+    backend->destroyTexture(texture);
+
+    stats.targets--;
+    stats.bytes -= entries[index].bytes;
+    stats.frees++;
+    entries.erase(entries.begin() + index);
+}
+
+void RenderTargetPool::resetStats()
+{
+    Stats kept;
+    kept.targets = stats.targets;
+    kept.framebuffers = stats.framebuffers;
+    kept.bytes = stats.bytes;
+    kept.peakBytes = stats.peakBytes;
+    stats = kept;
+}
@@ -0,0 +1,60 @@
+#include <ResolutionController.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+ResolutionController::ResolutionController() : measured(false)
+{
+    init(Settings());
+}
+
+void ResolutionController::init(const Settings& s)
+{
+    settings = s;
+    settings.maxScale = std::max(settings.maxScale, settings.minScale);
+    state.scale = settings.maxScale;
+    state.requested = settings.maxScale;
+    state.filteredMs = 0.0;
+    state.error = state.integral = state.derivative = 0.0;
+    measured = false;
+    stats = Stats();
+}
+
+float ResolutionController::update(double gpuMs)
+{
+    if (!isEnabled())
+        return state.scale;
+
+    state.filteredMs = measured ? state.filteredMs + settings.smoothing * (gpuMs - state.filteredMs) : gpuMs;
+    double error = (settings.targetMs - state.filteredMs) / settings.targetMs;
+    state.derivative = measured ? error - state.error : 0.0;
+    state.error = error;
+    measured = true;
+
+    // Pinned at a limit and pushed further into it: leave the integral be
+    bool pinnedHigh = state.requested >= settings.maxScale && error > 0.0;
+    bool pinnedLow = state.requested <= settings.minScale && error < 0.0;
+    if (!pinnedHigh && !pinnedLow)
+        state.integral += error;
+
+    // The integral holds the offset from full scale the load needs
+    state.requested = settings.maxScale + (float)(settings.kp * error + settings.ki * state.integral
+        + settings.kd * state.derivative);
+
+    float wanted = std::min(std::max(state.requested, settings.minScale), settings.maxScale);
+    bool atLimit = wanted == settings.minScale || wanted == settings.maxScale;
+    if (std::abs(wanted - state.scale) >= settings.step || (atLimit && wanted != state.scale)) {
+        float stepped = atLimit ? wanted : std::floor(wanted / settings.step + 0.5f) * settings.step;
+        state.scale = std::min(std::max(stepped, settings.minScale), settings.maxScale);
+        stats.changes++;
+    }
+    return state.scale;
+}
+
+void ResolutionController::countFrame()
+{
+    stats.frames++;
+    stats.scaleSum += state.scale;
+    stats.minScale = std::min(stats.minScale, state.scale);
+    stats.maxScale = std::max(stats.maxScale, state.scale);
+}
@@ -0,0 +1,128 @@
+#include <RingBuffer.hpp>
+
+#include <chrono>
+#include <iostream>
+
+RingBuffer::RingBuffer()
+    : target(GL_ARRAY_BUFFER), buffer(0), persistent(false), mapped(nullptr),
+      segmentSize(0), framesInFlight(0), segment(0), head(0)
+{
+}
+
+void RingBuffer::init(GLenum target, GLsizeiptr segmentSize, int framesInFlight)
+{
+    this->target = target;
+    this->segmentSize = segmentSize;
+    this->framesInFlight = framesInFlight;
+    segment = framesInFlight - 1;
+    head = 0;
+    fences.assign(framesInFlight, (GLsync)0);
+
+    GLsizeiptr total = segmentSize * framesInFlight;
+    persistent = GLAD_GL_VERSION_4_4 || GLAD_GL_ARB_buffer_storage;
+
+    glGenBuffers(1, &buffer);
+    glBindBuffer(target, buffer);
+    if (persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(target, total, nullptr, flags);
+        mapped = (unsigned char*)glMapBufferRange(target, 0, total, flags);
+        if (!mapped) {
+            std::cout << "RingBuffer: persistent mapping failed, using glBufferSubData\n";
+            glDeleteBuffers(1, &buffer);
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+            persistent = false;
+        }
+    }
+    if (!persistent) {
+        glBufferData(target, total, nullptr, GL_STREAM_DRAW);
+        staging.resize(total);
+    }
+    glBindBuffer(target, 0);
+}
+
+void RingBuffer::destroy()
+{
+    for (GLsync& fence : fences) {
+        if (fence)
+            glDeleteSync(fence);
+        fence = 0;
+    }
+    if (buffer) {
+        if (mapped) {
+            glBindBuffer(target, buffer);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+    buffer = 0;
+    mapped = nullptr;
+}
+
+void RingBuffer::beginFrame()
+{
+    segment = (segment + 1) % framesInFlight;
+    head = 0;
+    stats.frames++;
+
+    if (persistent) {
+        GLsync& fence = fences[segment];
+        if (fence) {
+            GLenum status = glClientWaitSync(fence, 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                // The GPU is still reading this segment: this is the stall we want to see
+                auto start = std::chrono::high_resolution_clock::now();
+                do {
+                    status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                } while (status == GL_TIMEOUT_EXPIRED);
+                auto end = std::chrono::high_resolution_clock::now();
+                stats.stalls++;
+                stats.stallMs += std::chrono::duration<double, std::milli>(end - start).count();
+            }
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+    else if (segment == 0) {
+        // Orphan: the driver hands out fresh storage instead of synchronizing
+        glBindBuffer(target, buffer);
+        glBufferData(target, segmentSize * framesInFlight, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(target, 0);
+    }
+}
+
+void RingBuffer::endFrame()
+{
+    if (persistent) {
+        if (fences[segment])
+            glDeleteSync(fences[segment]);
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
+
+RingBuffer::Allocation RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+    Allocation allocation = { nullptr, 0, size };
+
+    GLsizeiptr aligned = (head + alignment - 1) / alignment * alignment;
+    if (aligned + size > segmentSize) {
+        stats.overflows++;
+        return allocation;
+    }
+    head = aligned + size;
+    stats.bytes += size;
+
+    allocation.offset = segment * segmentSize + aligned;
+    allocation.data = persistent ? mapped + allocation.offset : staging.data() + allocation.offset;
+    return allocation;
+}
+
+void RingBuffer::flush(const Allocation& allocation)
+{
+    if (persistent || !allocation.data)
+        return;
+    glBindBuffer(target, buffer);
+    glBufferSubData(target, allocation.offset, allocation.size, allocation.data);
+}
@@ -0,0 +1,53 @@
+#include <SampleCounter.hpp>
+
+SampleCounter::SampleCounter() : writeSlot(0)
+{
+    for (int i = 0; i < SLOTS; ++i) {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+}
+
+void SampleCounter::init()
+{
+    glGenQueries(SLOTS, queries);
+}
+
+void SampleCounter::destroy()
+{
+    glDeleteQueries(SLOTS, queries);
+    for (int i = 0; i < SLOTS; ++i)
+        pending[i] = false;
+}
+
+void SampleCounter::begin()
+{
+    glBeginQuery(GL_SAMPLES_PASSED, queries[writeSlot]);
+}
+
+void SampleCounter::end()
+{
+    glEndQuery(GL_SAMPLES_PASSED);
+    pending[writeSlot] = true;
+    writeSlot = (writeSlot + 1) % SLOTS;
+}
+
+bool SampleCounter::fetch(long long& samples)
+{
+    bool found = false;
+    for (int i = 0; i < SLOTS; ++i) {
+        int slot = (writeSlot + i) % SLOTS;
+        if (!pending[slot])
+            continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            break;
+        GLuint64 count = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &count);
+        pending[slot] = false;
+        samples = (long long)count;
+        found = true;
+    }
+    return found;
+}
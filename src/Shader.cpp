@@ -1,4 +1,6 @@
 #include <Shader.hpp>
+#include <AssetPack.hpp>
+#include <ProgramKey.hpp>
 
 Shader::Shader(const char *vertexPath, const char *fragmentPath) {
 
@@ -18,13 +20,24 @@ Shader::Shader(const std::string vertexPath, const std::string fragmentPath) {
   compileShader();
 }
 
+// a permutation of the same sources
+// ------------------------------------------------------------------------
+Shader::Shader(const std::string vertexPath, const std::string fragmentPath,
+               const std::string &defines) {
+
+  readShader(vertexPath.c_str(), SHADER_TYPE::VERTEX);
+  readShader(fragmentPath.c_str(), SHADER_TYPE::FRAGMENT);
+  vertexShader = insertDefines(vertexShader, defines);
+  fragmentShader = insertDefines(fragmentShader, defines);
+
+  compileShader();
+}
+
 void Shader::readShader(char const *const shaderPath,
                         Shader::SHADER_TYPE type) {
 
-  // 1. retrieve the shader source code from shaderPath
-  std::string shaderCode;
-  std::ifstream shaderFile;
-
+  // 1. retrieve the shader source code from the asset pack (or the loose
+  // file when it is not packed)
   std::string *shaderCodePtr = nullptr;
 
   std::string shdrTypename;
@@ -43,25 +56,14 @@ void Shader::readShader(char const *const shaderPath,
     break;
   }
 
-  // ensure ifstream objects can throw exceptions:
-  shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-  try {
-    // open files
-    shaderFile.open(shaderPath);
-    std::stringstream shaderStream;
-    // read file's buffer contents into streams
-    shaderStream << shaderFile.rdbuf();
-    // close file handlers
-    shaderFile.close();
-    // convert stream into string
-    shaderCode = shaderStream.str();
-  } catch (std::ifstream::failure e) {
+  AssetPack::Blob source = AssetPack::instance().find(shaderPath);
+  if (source.empty()) {
     std::cout << "ERROR::" << shdrTypename << "::FILE_NOT_SUCCESFULLY_READ"
               << std::endl;
+  } else if (shaderCodePtr) {
+    shaderCodePtr->assign((const char *)source.data, source.size);
   }
 
-  *shaderCodePtr = shaderCode;
-
   return;
 }
 
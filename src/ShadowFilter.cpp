@@ -0,0 +1,24 @@
+#include <ShadowFilter.hpp>
+
+const char* shadowFilterName(ShadowFilter filter)
+{
+    switch (filter) {
+    case SHADOW_PCF: return "pcf";
+    case SHADOW_HARDWARE_PCF: return "hardware";
+    case SHADOW_VSM: return "vsm";
+    case SHADOW_ESM: return "esm";
+    case SHADOW_FILTER_COUNT: break;
+    }
+    return "?";
+}
+
+bool parseShadowFilter(const std::string& name, ShadowFilter& filter)
+{
+    for (int i = 0; i < SHADOW_FILTER_COUNT; ++i) {
+        if (name == shadowFilterName((ShadowFilter)i)) {
+            filter = (ShadowFilter)i;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,239 @@
+#include <Simulation.hpp>
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cmath>
+
+// Ticks run back to back when the simulation is behind, up to this many;
+// beyond that it skips ahead instead of falling further behind
+static const int MAX_CATCH_UP = 5;
+
+// The sun goes once round the sky a day, 60 degrees up at its highest and
+// 3 at its lowest, so the day cycle runs through low, red light without a
+// night the lighting has no answer for. It starts halfway up, towards +z.
+static const float SUN_LOWEST = glm::radians(3.0f);
+static const float SUN_HIGHEST = glm::radians(60.0f);
+
+static glm::vec3 lightDirection(float time, float dayLength)
+{
+    float phase = 2.0f * glm::pi<float>() * time / dayLength;
+    float elevation = 0.5f * (SUN_HIGHEST + SUN_LOWEST) + 0.5f * (SUN_HIGHEST - SUN_LOWEST) * sin(phase);
+    float azimuth = 0.5f * glm::pi<float>() + phase;
+    glm::vec3 sunDir(cos(elevation) * cos(azimuth), sin(elevation), cos(elevation) * sin(azimuth));
+    return -sunDir;
+}
+
+void FrameTimeStats::add(double ms)
+{
+    frames++;
+    sumMs += ms;
+    sumSqMs += ms * ms;
+    maxMs = std::max(maxMs, ms);
+}
+
+double FrameTimeStats::meanMs() const
+{
+    return frames ? sumMs / frames : 0.0;
+}
+
+double FrameTimeStats::stddevMs() const
+{
+    if (frames < 2)
+        return 0.0;
+    double mean = meanMs();
+    return std::sqrt(std::max(sumSqMs / frames - mean * mean, 0.0));
+}
+
+Camera RenderPacket::makeCamera() const
+{
+    Camera camera(cameraPosition, glm::vec3(0.0f, 1.0f, 0.0f), cameraYaw, cameraPitch);
+    camera.Zoom = cameraZoom;
+    return camera;
+}
+
+Simulation::Simulation() : packets(0), nextDue(0.0), running(false)
+{
+}
+
+Simulation::~Simulation()
+{
+    stop();
+}
+
+void Simulation::start(const Camera& camera, const Settings& settings)
+{
+    stop();
+    this->settings = settings;
+    this->camera = camera;
+    startTime = std::chrono::steady_clock::now();
+    packets = 0;
+
+    current.position = camera.Position;
+    current.yaw = camera.Yaw;
+    current.pitch = camera.Pitch;
+    current.zoom = camera.Zoom;
+    current.time = 0.0f;
+    current.lightDir = lightDirection(0.0f, settings.dayLength);
+    current.tick = 0;
+    current.stamp = 0.0;
+    nextDue = 1.0 / settings.tickRate;
+
+    previous = latest = current;
+    input = InputState();
+    stats = Stats();
+
+    if (!ticksOnRenderThread()) {
+        running = true;
+        thread = std::thread(&Simulation::threadMain, this);
+    }
+}
+
+void Simulation::stop()
+{
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+double Simulation::now() const
+{
+    if (settings.frameStep > 0.0)
+        return packets * settings.frameStep;
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+Simulation::Stats Simulation::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void Simulation::resetStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stats = Stats();
+}
+
+// ------------------- MAIN THREAD ---------------------
+void Simulation::submitInput(const InputState& frame)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    input.forward = frame.forward;
+    input.backward = frame.backward;
+    input.left = frame.left;
+    input.right = frame.right;
+    input.mouseX += frame.mouseX;
+    input.mouseY += frame.mouseY;
+    input.scroll += frame.scroll;
+}
+
+RenderPacket Simulation::packet()
+{
+    if (settings.frameStep > 0.0)
+        packets++;
+    if (ticksOnRenderThread())
+        runDueTicks(now());
+
+    State a, b;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        a = previous;
+        b = latest;
+    }
+
+    // One tick behind real time, so there is always a newer tick to blend to
+    double renderTime = now() - 1.0 / settings.tickRate;
+    double span = b.stamp - a.stamp;
+    float alpha = span > 0.0 ? (float)std::min(std::max((renderTime - a.stamp) / span, 0.0), 1.0) : 1.0f;
+
+    RenderPacket packet;
+    packet.cameraPosition = glm::mix(a.position, b.position, alpha);
+    packet.cameraYaw = glm::mix(a.yaw, b.yaw, alpha);
+    packet.cameraPitch = glm::mix(a.pitch, b.pitch, alpha);
+    packet.cameraZoom = glm::mix(a.zoom, b.zoom, alpha);
+    packet.time = glm::mix(a.time, b.time, alpha);
+    packet.lightDir = glm::normalize(glm::mix(a.lightDir, b.lightDir, alpha));
+    packet.tick = b.tick;
+    packet.alpha = alpha;
+    return packet;
+}
+
+// ------------------- TICKS ---------------------
+void Simulation::threadMain()
+{
+    while (running) {
+        double t = now();
+        if (t < nextDue)
+            std::this_thread::sleep_for(std::chrono::duration<double>(nextDue - t));
+        else
+            runDueTicks(t);
+    }
+}
+
+void Simulation::runDueTicks(double t)
+{
+    const double dt = 1.0 / settings.tickRate;
+    // nextDue is a running sum of dt; without the slack its rounding could
+    // leave a tick due exactly at t, as a frame step often makes one, for later
+    t += dt * 1e-6;
+    for (int ran = 0; nextDue <= t; ++ran) {
+        if (ran == MAX_CATCH_UP && settings.frameStep <= 0.0) {
+            long long skipped = (long long)((t - nextDue) / dt) + 1;
+            nextDue += skipped * dt;
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.droppedTicks += skipped;
+            break;
+        }
+        if (settings.frameStep <= 0.0 && now() - nextDue > dt) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.lateTicks++;
+        }
+        step(dt, nextDue);
+        nextDue += dt;
+    }
+}
+
+void Simulation::step(double dt, double stamp)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    InputState in;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        in = input;
+        input.mouseX = input.mouseY = input.scroll = 0.0f;
+    }
+
+    if (in.forward) camera.ProcessKeyboard(FORWARD, (float)dt);
+    if (in.backward) camera.ProcessKeyboard(BACKWARD, (float)dt);
+    if (in.left) camera.ProcessKeyboard(LEFT, (float)dt);
+    if (in.right) camera.ProcessKeyboard(RIGHT, (float)dt);
+    if (in.mouseX != 0.0f || in.mouseY != 0.0f)
+        camera.ProcessMouseMovement(in.mouseX, in.mouseY);
+    if (in.scroll != 0.0f)
+        camera.ProcessMouseScroll(in.scroll);
+
+    current.tick++;
+    current.stamp = stamp;
+    current.time = (float)(current.tick * dt);
+    current.lightDir = lightDirection(current.time, settings.dayLength);
+    current.position = camera.Position;
+    current.yaw = camera.Yaw;
+    current.pitch = camera.Pitch;
+    current.zoom = camera.Zoom;
+
+    // Synthetic simulation cost
+    if (settings.loadMs > 0.0) {
+        double ms = current.tick % 16 == 0 ? settings.loadMs * 4.0 : settings.loadMs;
+        auto until = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double, std::milli>(ms));
+        while (std::chrono::steady_clock::now() < until) {}
+    }
+
+    double tickMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::lock_guard<std::mutex> lock(mutex);
+    previous = latest;
+    latest = current;
+    stats.ticks++;
+    stats.maxTickMs = std::max(stats.maxTickMs, tickMs);
+}
@@ -0,0 +1,122 @@
+#include <WaterClipmap.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+WaterClipmap::WaterClipmap() : levels(0)
+{
+}
+
+void WaterClipmap::init(const Settings& s)
+{
+    settings = s;
+
+    // Enough levels that one root tile covers the whole square
+    levels = 1;
+    while (getTileSize(levels - 1) < settings.size && levels < MAX_LEVELS)
+        ++levels;
+    if (getTileSize(levels - 1) < settings.size)
+        std::cout << "WaterClipmap: " << MAX_LEVELS << " levels cover only "
+            << getTileSize(levels - 1) << " of " << settings.size << " units\n";
+
+    if (settings.rangeFactor * (2.0f * settings.morphStart - 1.0f) < 2.0f * std::sqrt(2.0f))
+        std::cout << "WaterClipmap: range factor " << settings.rangeFactor << " is too small for morph start "
+            << settings.morphStart << ", seams will open between levels\n";
+
+    for (int level = 0; level < levels; ++level)
+        ranges[level] = settings.rangeFactor * getTileSize(level);
+}
+
+float WaterClipmap::getTileSize(int level) const
+{
+    return settings.leafSize * (float)(1 << level);
+}
+
+void WaterClipmap::buildTileMesh(std::vector<float>& vertices, std::vector<unsigned int>& indices) const
+{
+    const int n = settings.gridResolution;
+    vertices.clear();
+    indices.clear();
+    for (int z = 0; z <= n; ++z) {
+        for (int x = 0; x <= n; ++x) {
+            vertices.push_back((float)x / n);
+            vertices.push_back((float)z / n);
+        }
+    }
+    for (int z = 0; z < n; ++z) {
+        for (int x = 0; x < n; ++x) {
+            unsigned int topLeft = z * (n + 1) + x;
+            unsigned int bottomLeft = (z + 1) * (n + 1) + x;
+            indices.push_back(topLeft);
+            indices.push_back(bottomLeft);
+            indices.push_back(topLeft + 1);
+            indices.push_back(topLeft + 1);
+            indices.push_back(bottomLeft);
+            indices.push_back(bottomLeft + 1);
+        }
+    }
+}
+
+AABB WaterClipmap::tileBounds(const WaterTile& tile) const
+{
+    return AABB(glm::vec3(tile.x, settings.height - settings.waveAmplitude, tile.z),
+        glm::vec3(tile.x + tile.size, settings.height + settings.waveAmplitude, tile.z + tile.size));
+}
+
+// Closest point of the box to p, for the sphere test
+static float distanceToBox(const glm::vec3& p, const AABB& box)
+{
+    glm::vec3 closest = glm::clamp(p, box.min, box.max);
+    return glm::length(p - closest);
+}
+
+void WaterClipmap::select(const glm::vec3& camera, const Frustum& frustum, std::vector<WaterTile>& tiles, Stats& stats) const
+{
+    tiles.clear();
+    if (levels == 0)
+        return;
+    float half = getTileSize(levels - 1) * 0.5f;
+    selectNode(-half, -half, levels - 1, camera, frustum, tiles, stats);
+    stats.tiles += (int)tiles.size();
+}
+
+void WaterClipmap::selectNode(float x, float z, int level, const glm::vec3& camera, const Frustum& frustum,
+    std::vector<WaterTile>& tiles, Stats& stats) const
+{
+    float size = getTileSize(level);
+    WaterTile tile = { x, z, size, (float)level };
+    AABB box = tileBounds(tile);
+    stats.nodesTested++;
+    if (!frustum.intersects(box))
+        return;
+
+    // Refine while the next finer level's range reaches into the tile
+    if (level == 0 || distanceToBox(camera, box) > ranges[level - 1]) {
+        tiles.push_back(tile);
+        return;
+    }
+    float half = size * 0.5f;
+    selectNode(x, z, level - 1, camera, frustum, tiles, stats);
+    selectNode(x + half, z, level - 1, camera, frustum, tiles, stats);
+    selectNode(x, z + half, level - 1, camera, frustum, tiles, stats);
+    selectNode(x + half, z + half, level - 1, camera, frustum, tiles, stats);
+}
+
+float WaterClipmap::morphFactor(const WaterTile& tile, const glm::vec2& grid, const glm::vec3& camera) const
+{
+    int level = (int)tile.level;
+    glm::vec3 p(tile.x + grid.x * tile.size, settings.height, tile.z + grid.y * tile.size);
+    float start = getMorphStartDistance(level);
+    float end = ranges[level];
+    float t = (glm::length(camera - p) - start) / (end - start);
+    return std::min(std::max(t, 0.0f), 1.0f);
+}
+
+glm::vec2 WaterClipmap::morphGrid(const glm::vec2& grid, float morph) const
+{
+    float n = (float)settings.gridResolution;
+    // 1 for odd grid indices, 0 for even ones
+    glm::vec2 odd(glm::fract(grid.x * n * 0.5f) * 2.0f, glm::fract(grid.y * n * 0.5f) * 2.0f);
+    return grid - odd / n * morph;
+}
@@ -2,151 +2,364 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 #include <stb.h>
-#include "Skybox.hpp"
+#include <Bench.hpp>
 
 
 // World dimensions
 const float worldWidth = 20000.0f;
 const float worldDepth = 20000.0f;
+// The sky's irradiance is in its HDR units, against a terrain sun of 1;
+// this keeps the noon ambient near the flat 0.1 it replaced
+const float ambientScale = 0.4f;
 
-int main() {
-    GLFWwindow* window = initGLFW();
+// The whole of text as a number, without the exceptions of std::stoi and co.
+static bool parseNumber(const char* text, long long& value)
+{
+    char* end;
+    errno = 0;
+    value = std::strtoll(text, &end, 10);
+    return end != text && *end == '\0' && errno == 0;
+}
 
-    std::string shaderPath = "../res/shaders/";
+static bool parseNumber(const char* text, double& value)
+{
+    char* end;
+    errno = 0;
+    value = std::strtod(text, &end);
+    return end != text && *end == '\0' && errno == 0;
+}
 
-    std::unordered_map<std::string, std::unique_ptr<Shader>> shaders;
-    shaders["terrain"] = std::make_unique<Shader>(shaderPath + "shader.vert", shaderPath + "shader.frag");
-    shaders["depth"] = std::make_unique<Shader>(shaderPath + "depth_shader.vert", shaderPath + "depth_shader.frag");
-    shaders["sun"] = std::make_unique<Shader>(shaderPath + "sun_shader.vert", shaderPath + "sun_shader.frag");
-    shaders["blur"] = std::make_unique<Shader>(shaderPath + "blur.vert", shaderPath + "blur.frag");
-    shaders["final"] = std::make_unique<Shader>(shaderPath + "final.vert", shaderPath + "final.frag");
-    shaders["brightpass"] = std::make_unique<Shader>(shaderPath + "bright_pass.vert", shaderPath + "bright_pass.frag");
-    shaders["skybox"] = std::make_unique<Shader>(shaderPath + "skybox.vert", shaderPath + "skybox.frag");
-    shaders["water"] = std::make_unique<Shader>(shaderPath + "water.vert",shaderPath + "water.frag");
+// Sets value from a numeric option, raised to minimum; anything that is not
+// a number in range for T leaves it as it was
+template <typename T>
+static void parseOption(const std::string& flag, const char* text, T& value,
+    T minimum = std::numeric_limits<T>::lowest())
+{
+    typedef typename std::conditional<std::is_integral<T>::value, long long, double>::type Parsed;
+    Parsed parsed;
+    if (parseNumber(text, parsed) && parsed >= (Parsed)std::numeric_limits<T>::lowest()
+        && parsed <= (Parsed)std::numeric_limits<T>::max())
+        value = std::max((T)parsed, minimum);
+    else
+        std::cout << "Unknown " << flag << " value " << text << ", using " << value << "\n";
+}
 
-    
-    Mesh terrain = Mesh::generateGrid(10.0f, 10.0f, 1000, 1000, 20, 0.25f, 0.1f);
-    Mesh waterMesh = Mesh::generateWaterPlane(10000, 10000, worldWidth/10);
-    
-    glm::vec3 minPos(FLT_MAX, FLT_MAX, FLT_MAX);
-    glm::vec3 maxPos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+int main(int argc, char** argv) {
+    startupTime = std::chrono::steady_clock::now();
 
-    // Ensure terrain.vertices.size() is a multiple of 3
-    size_t vertexCount = terrain.vertices.size() / 3;
+    if (argc > 2 && std::string(argv[1]) == "--bench") {
+        int result = runBenchmark(argv[2]);
+        if (result < 0)
+            printBenchmarks();
+        return result < 0 ? 1 : result;
+    }
+    simulationSettings.dayLength = DAY_LENGTH;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sync-assets")
+            asyncAssets = false;
+        else if (arg == "--loose-assets")
+            looseAssets = true;
+        else if (arg == "--seed" && i + 1 < argc)
+            parseOption(arg, argv[++i], terrainSeed);
+        else if (arg == "--sim-inline")
+            simulationSettings.threaded = false;
+        else if (arg == "--sim-load" && i + 1 < argc)
+            parseOption(arg, argv[++i], simulationSettings.loadMs);
+        else if (arg == "--day-length" && i + 1 < argc)
+            parseOption(arg, argv[++i], simulationSettings.dayLength, 1.0f);
+        else if (arg == "--ocean-size" && i + 1 < argc)
+            parseOption(arg, argv[++i], oceanSettings.size);
+        else if (arg == "--res-target" && i + 1 < argc)
+            parseOption(arg, argv[++i], resolutionSettings.targetMs);
+        else if (arg == "--res-min" && i + 1 < argc)
+            parseOption(arg, argv[++i], resolutionSettings.minScale);
+        else if (arg == "--res-max" && i + 1 < argc)
+            parseOption(arg, argv[++i], resolutionSettings.maxScale);
+        else if (arg == "--no-prepass")
+            depthPrepass = false;
+        else if (arg == "--shadow-filter" && i + 1 < argc) {
+            if (!parseShadowFilter(argv[++i], shadowSettings.filter))
+                std::cout << "Unknown shadow filter " << argv[i] << ", using "
+                    << shadowFilterName(shadowSettings.filter) << "\n";
+        }
+        else if (arg == "--reflections" && i + 1 < argc) {
+            if (!parseReflectionMode(argv[++i], reflectionSettings.mode))
+                std::cout << "Unknown reflection mode " << argv[i] << ", using "
+                    << reflectionModeName(reflectionSettings.mode) << "\n";
+        }
+        else if (arg == "--quality" && i + 1 < argc) {
+            if (!parseQualityPreset(argv[++i], qualityPreset))
+                std::cout << "Unknown quality preset " << argv[i] << ", using " << qualityPresetName(qualityPreset) << "\n";
+        }
+        else if (arg == "--capture" && i + 1 < argc)
+            captureSettings.directory = argv[++i];
+        else if (arg == "--capture-format" && i + 1 < argc) {
+            if (!parseCaptureFormat(argv[++i], captureSettings.format))
+                std::cout << "Unknown capture format " << argv[i] << ", using "
+                    << captureFormatName(captureSettings.format) << "\n";
+        }
+        else if (arg == "--capture-frames" && i + 1 < argc)
+            parseOption(arg, argv[++i], captureSettings.frames, 0);
+        else if (arg == "--capture-fps" && i + 1 < argc)
+            parseOption(arg, argv[++i], captureSettings.fps, 1);
+        else if (arg == "--capture-queue" && i + 1 < argc)
+            parseOption(arg, argv[++i], captureSettings.maxQueued, 1);
+        else if (arg == "--headless")
+            headless = true;
+    }
+    // Captured frames are 1 / fps of simulation apart, so the video plays
+    // at the speed the scene ran, however long each frame took to render
+    if (!captureSettings.directory.empty())
+        simulationSettings.frameStep = 1.0 / captureSettings.fps;
 
-    for (size_t i = 0; i < vertexCount; ++i) {
-        float x = terrain.vertices[i * 3 + 0];
-        float y = terrain.vertices[i * 3 + 1];
-        float z = terrain.vertices[i * 3 + 2];
+    // Everything under res/ comes from the packed archive when it exists
+    AssetPack::instance().open(looseAssets ? "" : "../assets.pack", "../res/");
 
-        if (x < minPos.x) minPos.x = x;
-        if (y < minPos.y) minPos.y = y;
-        if (z < minPos.z) minPos.z = z;
+    GLFWwindow* window = initGLFW();
 
-        if (x > maxPos.x) maxPos.x = x;
-        if (y > maxPos.y) maxPos.y = y;
-        if (z > maxPos.z) maxPos.z = z;
-    }
+    std::string shaderPath = "../res/shaders/";
+
+    ProgramRegistry programs;
+    programs.load(shaderPath, ProgramKey(shadowSettings.filter, QualitySettings::preset(qualityPreset),
+        reflectionSettings.mode));
+
+    // Textures decode on loader threads while the terrain is generated
+    AssetLoader::Settings assetSettings;
+    assetSettings.async = asyncAssets;
+    AssetLoader assets;
+    assets.init(assetSettings);
 
-    glm::vec3 islandCenter = (minPos + maxPos) * 0.5f;
+    SceneTextures textures;
+    textures.waterNormals = assets.requestTexture2D("../res/textures/WaterNormalMap.jpg", true,
+        glm::vec4(0.5f, 0.5f, 1.0f, 1.0f));
+
+    DropletErosion::Settings erosion;
+    erosion.numDroplets = 300000;
+    Mesh terrain = Mesh::loadGrid(10.0f, 10.0f, 1000, 1000, erosion, 0.1f, terrainSeed);
+
+    // Bounds are gathered per chunk during generation (vertices are 8 floats wide)
+    glm::vec3 islandCenter = terrain.bounds.center();
 
     unsigned int terrainVAO, terrainVBO, terrainEBO;
-    unsigned int waterVBO, waterEBO, waterVAO;
 
-    createWaterPlaneVAO(waterMesh.vertices, waterMesh.indices, waterVAO, waterVBO, waterEBO);
+    // Water tiles in rings around the camera over the whole world
+    WaterClipmap::Settings waterSettings;
+    waterSettings.size = worldWidth;
+    waterSettings.height = WATER_LEVEL;
+    WaterClipmap waterLod;
+    waterLod.init(waterSettings);
+    WaterGeometry water;
+    createWaterTilesVAO(waterLod, water);
 
     setupMesh(terrain, terrainVAO, terrainVBO, terrainEBO);
 
-    const unsigned int SHADOW_WIDTH = 4096, SHADOW_HEIGHT = 4096;
-    unsigned int depthMapFBO, depthMap;
-    setupShadowMap(depthMapFBO, depthMap, SHADOW_WIDTH, SHADOW_HEIGHT);
+    renderLoop(window, programs, terrain, terrainVAO,
+        waterLod, water, islandCenter,
+        assets, textures);
 
-    renderLoop(window, shaders, terrain, terrainVAO,
-        waterMesh, waterVAO,
-        depthMapFBO, depthMap);
+    assets.shutdown();
 
     glDeleteVertexArrays(1, &terrainVAO);
     glDeleteBuffers(1, &terrainVBO);
     glDeleteBuffers(1, &terrainEBO);
 
-    glDeleteVertexArrays(1, &waterVAO);
-    glDeleteBuffers(1, &waterVBO);
-    glDeleteBuffers(1, &waterEBO);
+    glDeleteVertexArrays(1, &water.VAO);
+    glDeleteBuffers(1, &water.VBO);
+    glDeleteBuffers(1, &water.EBO);
+    glDeleteBuffers(1, &water.instanceVBO);
     
     glfwTerminate();
     return 0;
 }
 
 
-unsigned int createWaterPlaneVAO(std::vector<float>& outVertices, std::vector<unsigned int>& outIndices,
-    unsigned int& VAO, unsigned int& VBO, unsigned int& EBO)
+void createWaterTilesVAO(const WaterClipmap& lod, WaterGeometry& water)
 {
-    if (outVertices.empty() || outIndices.empty()) {
-        std::cerr << "Error: Empty vertex or index buffer!" << std::endl;
-        return 0;
-    }
-
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
+    std::vector<float> vertices;
+    std::vector<unsigned int> indices;
+    lod.buildTileMesh(vertices, indices);
+    water.indexCount = (GLsizei)indices.size();
 
-    // Vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, outVertices.size() * sizeof(float), outVertices.data(), GL_STATIC_DRAW);
+    glGenVertexArrays(1, &water.VAO);
+    glGenBuffers(1, &water.VBO);
+    glGenBuffers(1, &water.EBO);
+    glGenBuffers(1, &water.instanceVBO);
 
-    // Index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, outIndices.size() * sizeof(unsigned int), outIndices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(water.VAO);
 
-    // Stride: 3+3+2+3+3 = 14 floats
-    GLsizei stride = 14 * sizeof(float);
+    // One tile: grid positions in [0, 1]
+    glBindBuffer(GL_ARRAY_BUFFER, water.VBO);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
 
-    glEnableVertexAttribArray(0); // Position
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, water.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
-    glEnableVertexAttribArray(1); // Normal
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+    // Per tile: corner, size and level, refilled every frame
+    glBindBuffer(GL_ARRAY_BUFFER, water.instanceVBO);
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(WaterTile), (void*)0);
+    glVertexAttribDivisor(5, 1);
 
-    glEnableVertexAttribArray(2); // TexCoords
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+    glBindVertexArray(0);
+}
 
-    glEnableVertexAttribArray(3); // Tangent
-    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, stride, (void*)(8 * sizeof(float)));
+void createOceanTextures(int size, OceanTextures& textures)
+{
+    unsigned int* maps[] = { &textures.displacement, &textures.normals };
+    for (unsigned int* texture : maps) {
+        glGenTextures(1, texture);
+        glBindTexture(GL_TEXTURE_2D, *texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-    glEnableVertexAttribArray(4); // Bitangent
-    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, stride, (void*)(11 * sizeof(float)));
+// Mipmaps too: far tiles sample the averaged waves instead of aliasing
+void uploadOceanMaps(const OceanFFT& ocean, const OceanTextures& textures)
+{
+    int size = ocean.getSettings().size;
+    glBindTexture(GL_TEXTURE_2D, textures.displacement);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_FLOAT, ocean.getDisplacement().data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, textures.normals);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGBA, GL_FLOAT, ocean.getNormals().data());
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
-    glBindVertexArray(0);
+void createSkyTextures(const Atmosphere& atmosphere, SkyTextures& textures)
+{
+    const Atmosphere::Settings& settings = atmosphere.getSettings();
+    glGenTextures(1, &textures.skyView);
+    glBindTexture(GL_TEXTURE_2D, textures.skyView);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, settings.skyViewWidth, settings.skyViewHeight, 0, GL_RGB, GL_FLOAT, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The mips are the prefiltered levels, not a box-filtered chain
+    const int levels = atmosphere.getCubeLevels();
+    glGenTextures(1, &textures.environment);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textures.environment);
+    for (int face = 0; face < Atmosphere::CUBE_FACES; ++face) {
+        for (int level = 0; level < levels; ++level) {
+            int size = std::max(settings.cubeSize >> level, 1);
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, GL_RGB16F, size, size, 0, GL_RGB, GL_FLOAT,
+                nullptr);
+        }
+        textures.faceVersions[face] = -1;
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    textures.skyViewVersion = -1;
+}
 
-    return VAO;
+// Only what changed since the last upload: most frames one face, with its
+// mips, at most
+void uploadSky(const Atmosphere& atmosphere, SkyTextures& textures)
+{
+    const Atmosphere::Settings& settings = atmosphere.getSettings();
+    if (atmosphere.getSkyViewVersion() != textures.skyViewVersion) {
+        glBindTexture(GL_TEXTURE_2D, textures.skyView);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, settings.skyViewWidth, settings.skyViewHeight, GL_RGB, GL_FLOAT,
+            atmosphere.getSkyView().data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        textures.skyViewVersion = atmosphere.getSkyViewVersion();
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, textures.environment);
+    for (int face = 0; face < Atmosphere::CUBE_FACES; ++face) {
+        if (atmosphere.getFaceVersion(face) == textures.faceVersions[face])
+            continue;
+        for (int level = 0; level < atmosphere.getCubeLevels(); ++level) {
+            int size = std::max(settings.cubeSize >> level, 1);
+            glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, level, 0, 0, size, size, GL_RGB, GL_FLOAT,
+                atmosphere.getFace(face, level).data());
+        }
+        textures.faceVersions[face] = atmosphere.getFaceVersion(face);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 }
 
 
 // ------------------- INIT ---------------------
 GLFWwindow* initGLFW() {
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    // Headless, GLFW's null platform (3.4 and later) needs no display
+    // server; its windows only carry a context, from OSMesa or from EGL
+    // without a surface. Older GLFW makes an invisible window on the
+    // display, so it needs one (or Xvfb).
+#ifdef GLFW_PLATFORM_NULL
+    if (headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+    if (!glfwInit()) {
+        std::cout << (headless ? "Failed to initialize GLFW's null platform for --headless\n"
+                               : "Failed to initialize GLFW\n");
+        exit(-1);
+    }
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Procedural Terrain with HDR Sun", nullptr, nullptr);
+    if (headless)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    std::vector<int> contextApis;
+#ifdef GLFW_PLATFORM_NULL
+    if (headless) {
+        contextApis.push_back(GLFW_OSMESA_CONTEXT_API);
+        contextApis.push_back(GLFW_EGL_CONTEXT_API);
+    }
+#endif
+    if (contextApis.empty())
+        contextApis.push_back(GLFW_NATIVE_CONTEXT_API);
+
+    // Prefer 4.5 (persistent buffers) or 4.3 (multi-draw indirect),
+    // everything still runs on 3.3
+    GLFWwindow* window = nullptr;
+    const int versions[][2] = { { 4, 5 }, { 4, 3 }, { 3, 3 } };
+    for (int api : contextApis) {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, api);
+        for (const auto& version : versions) {
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version[0]);
+            glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version[1]);
+            window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Procedural Terrain with HDR Sun", nullptr, nullptr);
+            if (window) break;
+        }
+        if (window) break;
+    }
     if (!window) { std::cout << "Failed to create window\n"; glfwTerminate(); exit(-1); }
+    // May differ from the requested size (high-DPI screens, off-screen contexts)
+    glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
 
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    glfwSetKeyCallback(window, key_callback);
+    if (!headless)
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD\n";
         exit(-1);
     }
+    std::cout << "OpenGL " << glGetString(GL_VERSION) << "\n";
 
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
+    // Filter across the environment cubemap's face edges
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
     glCullFace(GL_BACK);
     return window;
 }
@@ -171,270 +384,230 @@ void setupMesh(const Mesh& terrain, unsigned int& VAO, unsigned int& VBO, unsign
     glEnableVertexAttribArray(2);
 }
 
-// ------------------- SHADOW MAP ---------------------
-void setupShadowMap(unsigned int& depthMapFBO, unsigned int& depthMap, unsigned int width, unsigned int height) {
-    glGenFramebuffers(1, &depthMapFBO);
-    glGenTextures(1, &depthMap);
-    glBindTexture(GL_TEXTURE_2D, depthMap);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMap, 0);
-    glDrawBuffer(GL_NONE);
-    glReadBuffer(GL_NONE);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
-// ------------------- BLOOM BUFFERS ---------------------
-void setupBloomBuffers(BloomBuffers& bloom, unsigned int width, unsigned int height) {
-    glGenFramebuffers(1, &bloom.hdrFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, bloom.hdrFBO);
-
-    glGenTextures(2, bloom.colorBuffers);
-    for (unsigned int i = 0; i < 2; i++) {
-        glBindTexture(GL_TEXTURE_2D, bloom.colorBuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, bloom.colorBuffers[i], 0);
-    }
-
-    unsigned int rboDepth;
-    glGenRenderbuffers(1, &rboDepth);
-    glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-
-    unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-    glDrawBuffers(2, attachments);
-
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "HDR Framebuffer not complete!\n";
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-    glGenFramebuffers(2, bloom.pingpongFBO);
-    glGenTextures(2, bloom.pingpongColorbuffers);
-    for (unsigned int i = 0; i < 2; i++) {
-        glBindFramebuffer(GL_FRAMEBUFFER, bloom.pingpongFBO[i]);
-        glBindTexture(GL_TEXTURE_2D, bloom.pingpongColorbuffers[i]);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, bloom.pingpongColorbuffers[i], 0);
-    }
-}
-
-// ------------------- SUN SETUP ---------------------
-unsigned int setupSun() {
-    unsigned int VAO, VBO, EBO;
-    std::vector<float> vertices;
-    std::vector<unsigned int> indices;
-    const unsigned int X_SEGMENTS = 32;
-    const unsigned int Y_SEGMENTS = 32;
-
-    for (unsigned int y = 0; y <= Y_SEGMENTS; ++y) {
-        for (unsigned int x = 0; x <= X_SEGMENTS; ++x) {
-            float xSegment = (float)x / X_SEGMENTS;
-            float ySegment = (float)y / Y_SEGMENTS;
-            float xPos = cos(xSegment * 2.0f * M_PI) * sin(ySegment * M_PI);
-            float yPos = cos(ySegment * M_PI);
-            float zPos = sin(xSegment * 2.0f * M_PI) * sin(ySegment * M_PI);
-            vertices.push_back(xPos);
-            vertices.push_back(yPos);
-            vertices.push_back(zPos);
-        }
-    }
-    for (unsigned int y = 0; y < Y_SEGMENTS; ++y) {
-        for (unsigned int x = 0; x < X_SEGMENTS; ++x) {
-            indices.push_back(y * (X_SEGMENTS + 1) + x);
-            indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-            indices.push_back((y + 1) * (X_SEGMENTS + 1) + x + 1);
-            indices.push_back(y * (X_SEGMENTS + 1) + x);
-            indices.push_back((y + 1) * (X_SEGMENTS + 1) + x + 1);
-            indices.push_back(y * (X_SEGMENTS + 1) + x + 1);
-        }
-    }
-
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
-
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    return VAO;
-}
-
-// ------------------- SKYBOX SETUP ---------------------
-unsigned int createSkyboxVAO()
+// ------------------- SKY SETUP ---------------------
+// The sky's fullscreen triangle makes its corners from gl_VertexID, but the
+// core profile still wants a vertex array bound to draw
+unsigned int createSkyVAO()
 {
-    float skyboxVertices[] = {
-        -1.0f,  1.0f, -1.0f,
-        -1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f, -1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-
-        -1.0f, -1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f,
-        -1.0f, -1.0f,  1.0f,
-
-        -1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f, -1.0f,
-         1.0f,  1.0f,  1.0f,
-         1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f,  1.0f,
-        -1.0f,  1.0f, -1.0f,
-
-        -1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f, -1.0f,
-         1.0f, -1.0f, -1.0f,
-        -1.0f, -1.0f,  1.0f,
-         1.0f, -1.0f,  1.0f
-    };
-
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), skyboxVertices, GL_STATIC_DRAW);
-
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-
-    glBindVertexArray(0);
-
-    return skyboxVAO;
+    unsigned int skyVAO;
+    glGenVertexArrays(1, &skyVAO);
+    return skyVAO;
 }
 
-
-void renderSkyBox(Shader *shader, unsigned int skyboxVAO, unsigned int cubemapTexture) {
-    glDepthFunc(GL_LEQUAL);
-    shader->use();
-
-   glm::mat4 view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-   glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom),
-       (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 5000.0f);
-
-   shader->setMat4("view", view);
-   shader->setMat4("projection", projection);
-
-   glBindVertexArray(skyboxVAO);
-   glActiveTexture(GL_TEXTURE0);
-   glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-   glDrawArrays(GL_TRIANGLES, 0, 36);
-   glBindVertexArray(0);
-   glDepthFunc(GL_LESS);
+void setIrradiance(TerrainParams& params, const SH9& irradiance) {
+    for (int i = 0; i < 9; ++i)
+        params.shIrradiance[i] = ambientScale * irradiance.coefficients[i];
 }
 
-void renderReflectiveWater(Shader* shader, unsigned int waterVAO, glm::mat4 model, glm::mat4 projection, glm::mat4 view, glm::vec3 pos) {
-	shader->use();
-	shader->setMat4("projection", projection);
-	shader->setMat4("view", view);
-	shader->setMat4("model", model);
-	shader->setVec3("cameraPos", pos);
-	glBindVertexArray(waterVAO);
-	glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+// The typed parameters are applied when the command replays
+template <class Params>
+void setUniforms(RenderCommand& command, const ProgramVariant& program, const Params& params) {
+    command.uniforms = [&program, params]() { program.apply(params); };
 }
 
-
-// ------------------- SUN RENDER ---------------------
-void renderSun(Shader* shader, unsigned int sunVAO, glm::vec3 lightDir, glm::mat4 projection, glm::mat4 view) {
-    glm::vec3 sunPos = -100.0f * lightDir;
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), sunPos);
-    model = glm::scale(model, glm::vec3(5.0f));
-    shader->use();
-    shader->setMat4("projection", projection);
-    shader->setMat4("view", view);
-    shader->setMat4("model", model);
-    shader->setVec3("color", glm::vec3(10.0f, 8.0f, 6.0f));
-    glBindVertexArray(sunVAO);
-    glDrawElements(GL_TRIANGLE_STRIP, 32 * 32 * 6, GL_UNSIGNED_INT, 0);
+void recordSky(CommandBuffer& commands, const ProgramRegistry& programs, unsigned int skyVAO,
+    unsigned int skyViewTexture, glm::vec3 sunDir, glm::vec3 sunColor, const glm::mat4& view,
+    const glm::mat4& projection, const RenderState& state) {
+    // At the far plane and after the opaque layer: only what nothing
+    // covered is shaded
+    const ProgramVariant& program = programs.get(PROGRAM_SKYBOX);
+    RenderCommand& sky = commands.add(LAYER_SKY, program.ID, skyVAO, state);
+    sky.addTexture(0, GL_TEXTURE_2D, skyViewTexture);
+
+    SkyboxParams params;
+    params.inverseViewProjection = glm::inverse(projection * glm::mat4(glm::mat3(view)));
+    params.sunDirection = sunDir;
+    params.sunColor = sunColor;
+    setUniforms(sky, program, params);
+    sky.draw = []() { glDrawArrays(GL_TRIANGLES, 0, 3); };
 }
+
 void renderLoop(
     GLFWwindow* window,
-    std::unordered_map<std::string, std::unique_ptr<Shader>>& shaders,
+    ProgramRegistry& programs,
     const Mesh& terrain, unsigned int terrainVAO,
-    const Mesh& waterMesh, unsigned int waterVAO,
-    unsigned int depthMapFBO, unsigned int depthMap)
+    const WaterClipmap& waterLod, const WaterGeometry& water,
+    glm::vec3 islandCenter,
+    AssetLoader& assets, const SceneTextures& textures)
 {
     // ---------------- INITIAL SETUP ----------------
-    BloomBuffers bloom;
-    setupBloomBuffers(bloom, SCR_WIDTH, SCR_HEIGHT);
-
-    unsigned int sunVAO = setupSun();
-    unsigned int skyboxVAO = createSkyboxVAO();
-
-    SkyBox skybox("../res/textures/Daylight Box UV.png");
-    unsigned int cubemapTexture = skybox.getTextureID();
-
-    shaders["skybox"]->use();
-    shaders["skybox"]->setInt("skybox", 0);
-
-    unsigned int waterNormalMap = loadWaterNormalMap("../res/textures/WaterNormalMap.jpg");
-
-    shaders["water"]->use();
-    shaders["water"]->setInt("reflectionTex", 0);
-    shaders["water"]->setInt("shadowMap", 1);
-    shaders["water"]->setFloat("minHeight", 0.005f);
-    shaders["water"]->setFloat("maxHeight", 0.05f);
-
-    // ---------------- REFLECTION FBO ----------------
-    unsigned int reflectionFBO, reflectionTex, reflectionRBO;
-    glGenFramebuffers(1, &reflectionFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, reflectionFBO);
-
-    glGenTextures(1, &reflectionTex);
-    glBindTexture(GL_TEXTURE_2D, reflectionTex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_FLOAT, nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reflectionTex, 0);
-
-    glGenRenderbuffers(1, &reflectionRBO);
-    glBindRenderbuffer(GL_RENDERBUFFER, reflectionRBO);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SCR_WIDTH, SCR_HEIGHT);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, reflectionRBO);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
+    unsigned int skyVAO = createSkyVAO();
+
+    // ---------------- OCEAN ----------------
+    // Each frame uploads the waves finished on the job system and starts on
+    // the next ones, so they are a frame behind
+    OceanFFT ocean;
+    if (!ocean.init(oceanSettings))
+        ocean.init(OceanFFT::Settings());
+    ocean.update(0.0f);
+    OceanTextures oceanTextures;
+    createOceanTextures(ocean.getSettings().size, oceanTextures);
+    uploadOceanMaps(ocean, oceanTextures);
+
+    // ---------------- SKY ----------------
+    // Transmittance and multiple scattering are built here, on the job
+    // system; the sky view and the cubemap follow the sun in the loop
+    Atmosphere atmosphere;
+    atmosphere.init(Atmosphere::Settings());
+    SkyTextures skyTextures;
+    createSkyTextures(atmosphere, skyTextures);
+    float horizonZenith = atmosphere.getHorizonZenith();
+    float skyMaxLod = (float)(atmosphere.getCubeLevels() - 1);
+
+    // Samplers and constants, set by name on each variant as it is compiled
+    glm::vec2 morphRanges[WaterClipmap::MAX_LEVELS];
+    for (int level = 0; level < waterLod.getLevels(); ++level)
+        morphRanges[level] = glm::vec2(waterLod.getMorphStartDistance(level), waterLod.getRange(level));
+    int waterLevels = waterLod.getLevels();
+    float gridResolution = (float)waterLod.getSettings().gridResolution;
+    float patchSize = ocean.getSettings().patchSize;
+    // By value: the registry outlives this function
+    programs.setConstants([=](ProgramId id, Shader& shader) {
+        switch (id) {
+        case PROGRAM_SKYBOX:
+            shader.setInt("skyView", 0);
+            shader.setFloat("horizonZenith", horizonZenith);
+            // As wide as the old sun sphere: radius 5 at 100
+            shader.setFloat("sunAngularRadius", std::asin(0.05f));
+            break;
+        case PROGRAM_WATER:
+            shader.setInt("reflectionTex", 0);
+            shader.setInt("shadowMap", 1);
+            shader.setInt("shadowCompareMap", 2);
+            shader.setFloat("vsmBleedReduction", shadowSettings.vsmBleedReduction);
+            shader.setFloat("esmExponent", shadowSettings.esmExponent);
+            shader.setFloat("minHeight", 0.005f);
+            shader.setFloat("maxHeight", 0.05f);
+            shader.setVec3("islandPos", islandCenter);
+            shader.setInt("skyCubemap", 3);
+            shader.setFloat("skyMaxLod", skyMaxLod);
+            shader.setFloat("waterRoughness", 0.15f);
+            shader.setInt("normalMap", 4);
+            shader.setInt("displacementMap", 5);
+            shader.setInt("oceanNormalMap", 6);
+            shader.setInt("sceneColorTex", 0);
+            shader.setInt("hizTex", 7);
+            shader.setFloat("nearPlane", NEAR_PLANE);
+            shader.setFloat("farPlane", FAR_PLANE);
+            shader.setInt("ssrMaxSteps", reflectionSettings.maxSteps);
+            shader.setFloat("ssrMaxDistance", reflectionSettings.maxDistance);
+            shader.setFloat("ssrThickness", reflectionSettings.thickness);
+            shader.setFloat("patchSize", patchSize);
+            shader.setFloat("waterLevel", WATER_LEVEL);
+            shader.setFloat("gridResolution", gridResolution);
+            glUniform2fv(glGetUniformLocation(shader.ID, "morphRanges"), waterLevels, &morphRanges[0].x);
+            break;
+        case PROGRAM_TERRAIN:
+            shader.setInt("shadowMap", 1);
+            shader.setInt("shadowCompareMap", 2);
+            shader.setFloat("vsmBleedReduction", shadowSettings.vsmBleedReduction);
+            shader.setFloat("esmExponent", shadowSettings.esmExponent);
+            break;
+        case PROGRAM_SHADOW_MOMENTS:
+            shader.setFloat("esmExponent", shadowSettings.esmExponent);
+            break;
+        case PROGRAM_BRIGHTPASS:
+            shader.setInt("scene", 0);
+            break;
+        case PROGRAM_BLUR:
+            shader.setInt("image", 0);
+            break;
+        case PROGRAM_FINAL:
+            shader.setInt("scene", 0);
+            shader.setInt("bloomBlur", 1);
+            break;
+        case PROGRAM_HIZ:
+            shader.setInt("source", 0);
+            break;
+        default:
+            break;
+        }
+    });
+
+    // ---------------- TERRAIN CULLING ----------------
+    std::vector<AABB> chunkBounds;
+    for (const Mesh::Chunk& chunk : terrain.chunks)
+        chunkBounds.push_back(chunk.bounds);
+    BVH terrainBVH;
+    terrainBVH.build(chunkBounds);
+    // One list per pass: the batches are built when the commands replay
+    std::vector<unsigned int> shadowChunks, reflectionChunks, sceneChunks;
+
+    // shadow, reflection, depth pre-pass and scene pass each get their own
+    // command slot
+    DrawBatch terrainBatch;
+    terrainBatch.init((unsigned int)terrain.chunks.size(), 4);
+
+    // ---------------- OCCLUSION CULLING ----------------
+    OcclusionCuller occlusion;
+    occlusion.setOccluders(terrain.occluderVertices, terrain.occluderIndices);
+    // Sized to the depth target, rebuilt when that changes with the window
+    HiZBuffer hiz;
+    int hizWidth = 0, hizHeight = 0;
+    OcclusionMode activeOcclusionMode = occlusionMode;
+
+    RenderStats stats;
+    float lastStatsTime = (float)glfwGetTime();
+    bool firstFrame = true;
 
     glm::mat4 terrainModel = glm::mat4(1.0f);
     float waterHeight = 0.01f;
-    float tileSize = 10.0f;
+    std::vector<WaterTile> waterTiles;
+
+    // The frame is recorded into commands, sorted, then replayed through the
+    // state cache
+    CommandBuffer frameCommands;
+    GLStateCache stateCache;
+    unsigned int quad = getQuadVAO();
+
+    // Internal resolution, from GPU time measured over the submitted frame
+    ResolutionController resolution;
+    resolution.init(resolutionSettings);
+    GpuTimer gpuTimer;
+    gpuTimer.init();
+    // The same split by pass, for the render stats
+    GpuPassTimer passTimer;
+    passTimer.init();
+    std::vector<GpuPassTimer::PassTime> passTimes;
+    // Terrain fragments the scene pass shades, with or without the pre-pass
+    SampleCounter shadedSamples;
+    shadedSamples.init();
+    // The finished frames, read back a few frames late and written on the
+    // encoder's thread
+    FrameCapture capture;
+    if (!captureSettings.directory.empty())
+        capture.init(captureSettings, windowWidth, windowHeight);
+
+    // ---------------- RENDER TARGETS ----------------
+    // Asked for pass by pass and handed back once the last pass reading
+    // them is recorded, so later passes reuse them. The window-sized ones
+    // cover the largest resolution scale; a frame renders into part of them.
+    GLRenderTargetBackend targetBackend;
+    RenderTargetPool targets;
+    targets.init(&targetBackend);
+    const float targetScale = resolution.getSettings().maxScale;
+    // One shadow map per filter (see ShadowFilter.hpp); switching leaves
+    // the other modes' maps idle until the pool frees them
+    RenderTargetDesc shadowDescs[SHADOW_FILTER_COUNT];
+    shadowDescs[SHADOW_PCF] = RenderTargetDesc::fixed(shadowSettings.mapSize, shadowSettings.mapSize,
+        GL_DEPTH_COMPONENT24, GL_NEAREST, GL_CLAMP_TO_BORDER);
+    shadowDescs[SHADOW_HARDWARE_PCF] = RenderTargetDesc::fixed(shadowSettings.mapSize, shadowSettings.mapSize,
+        GL_DEPTH_COMPONENT24, GL_LINEAR, GL_CLAMP_TO_BORDER);
+    shadowDescs[SHADOW_HARDWARE_PCF].compare = GL_LEQUAL;
+    shadowDescs[SHADOW_VSM] = RenderTargetDesc::fixed(shadowSettings.momentMapSize, shadowSettings.momentMapSize,
+        GL_RG32F, GL_LINEAR, GL_CLAMP_TO_BORDER);
+    shadowDescs[SHADOW_ESM] = RenderTargetDesc::fixed(shadowSettings.momentMapSize, shadowSettings.momentMapSize,
+        GL_R32F, GL_LINEAR, GL_CLAMP_TO_BORDER);
+    const RenderTargetDesc momentsDepthDesc = RenderTargetDesc::fixed(shadowSettings.momentMapSize,
+        shadowSettings.momentMapSize, GL_DEPTH_COMPONENT24, GL_NEAREST, GL_CLAMP_TO_EDGE);
+    const RenderTargetDesc colorDesc = RenderTargetDesc::relative(targetScale, GL_RGBA16F, GL_LINEAR, GL_CLAMP_TO_EDGE);
+    // A texture rather than a renderbuffer, so Hi-Z can read it
+    const RenderTargetDesc depthDesc = RenderTargetDesc::relative(targetScale, GL_DEPTH_COMPONENT24, GL_NEAREST,
+        GL_CLAMP_TO_EDGE);
+
+    // Camera, light and water time advance on the update thread
+    Simulation simulation;
+    simulation.start(camera, simulationSettings);
 
     // ==================== MAIN LOOP ====================
     while (!glfwWindowShouldClose(window))
@@ -442,33 +615,152 @@ void renderLoop(
         float time = (float)glfwGetTime();
         deltaTime = time - lastFrame;
         lastFrame = time;
+        if (!firstFrame)
+            stats.frameTime.add(deltaTime * 1000.0);
+
         processInput(window);
+        simulation.submitInput(frameInput);
+        frameInput.mouseX = frameInput.mouseY = frameInput.scroll = 0.0f;
+
+        // Everything below reads the simulation through this frame's packet
+        RenderPacket frame = simulation.packet();
+        camera = frame.makeCamera();
+        terrainBatch.beginFrame();
+
+        // Placeholders are swapped for the real textures once they are uploaded
+        assets.update();
+        unsigned int waterNormalMap = assets.getTexture(textures.waterNormals);
+
+        if (ocean.poll())
+            uploadOceanMaps(ocean, oceanTextures);
+        ocean.start(frame.time);
+
+        // ---------------- RESOLUTION ----------------
+        double gpuMs;
+        if (gpuTimer.fetch(gpuMs)) {
+            stats.gpuTime.add(gpuMs);
+            resolution.update(gpuMs);
+        }
+        if (passTimer.fetch(passTimes))
+            stats.addPassTimes(passTimes);
+        capture.collect();
+        resolution.countFrame();
+
+        // Resizing frees the old window-sized targets; the passes below
+        // allocate the new ones
+        targets.beginFrame(windowWidth, windowHeight);
+        int targetWidth, targetHeight;
+        targets.resolveSize(colorDesc, targetWidth, targetHeight);
+        int renderWidth = std::min(targetWidth, std::max(1, (int)(windowWidth * resolution.getScale() + 0.5f)));
+        int renderHeight = std::min(targetHeight, std::max(1, (int)(windowHeight * resolution.getScale() + 0.5f)));
+        glm::vec2 renderScale((float)renderWidth / targetWidth, (float)renderHeight / targetHeight);
+        float aspect = (float)targetWidth / targetHeight;
+
+        // A few frames old, so not necessarily at this frame's resolution
+        long long samples;
+        if (shadedSamples.fetch(samples))
+            stats.terrainShading.add(samples, (long long)renderWidth * renderHeight);
+
+        if (targetWidth != hizWidth || targetHeight != hizHeight) {
+            if (hizWidth > 0)
+                hiz.destroy();
+            hiz.init(&programs.get(PROGRAM_HIZ), targetWidth, targetHeight);
+            hizWidth = targetWidth;
+            hizHeight = targetHeight;
+            occlusion.invalidate();
+        }
 
         // ---------------- LIGHT SETUP ----------------
-        glm::vec3 lightDir = glm::normalize(glm::vec3(
-            sin(time * 0.1f),
-            -1.0f,
-            -1.0f
-        ));
+        glm::vec3 lightDir = frame.lightDir;
         glm::vec3 lightPos = -10.0f * lightDir;
 
+        // ---------------- SKY ----------------
+        // The first frame waits for the whole sky; after that the sky view
+        // follows the sun a step behind and the cubemap a face a step
+        glm::vec3 sunDir = -lightDir;
+        if (firstFrame)
+            atmosphere.update(sunDir);
+        else
+            atmosphere.poll();
+        uploadSky(atmosphere, skyTextures);
+        atmosphere.start(sunDir);
+        // What the air leaves of the sun, as bright as the sun used to be
+        // at midday
+        glm::vec3 sunColor = 10.0f * atmosphere.sunTransmittance(sunDir);
+
         glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 1.0f, 30.0f);
         glm::mat4 lightView = glm::lookAt(lightPos, glm::vec3(0.0f), glm::vec3(0, 1, 0));
         glm::mat4 lightSpaceMatrix = lightProjection * lightView;
 
-        // ================= SHADOW PASS =================
-        glViewport(0, 0, 4096, 4096);
-        glBindFramebuffer(GL_FRAMEBUFFER, depthMapFBO);
-        glClear(GL_DEPTH_BUFFER_BIT);
-
-        shaders["depth"]->use();
-        shaders["depth"]->setMat4("lightSpaceMatrix", lightSpaceMatrix);
+        frameCommands.clear();
+        const RenderState opaque;
+        const RenderState twoSided(RenderState::DEPTH_TEST | RenderState::DEPTH_WRITE);
+        const RenderState postProcess(0);
+        // Tested against the far plane the sky is drawn at, never written
+        const RenderState skyState(RenderState::DEPTH_TEST, GL_LEQUAL);
+
+        // ---------------- PROGRAMS ----------------
+        // Variants for this frame's shadow filter, quality preset and
+        // reflection mode, compiled the first time a pass asks for them
+        ShadowFilter shadowFilter = shadowSettings.filter;
+        bool ssr = reflectionSettings.mode == REFLECTION_SSR;
+        ProgramKey frameKey(shadowFilter, QualitySettings::preset(qualityPreset), reflectionSettings.mode);
+        const ProgramVariant& depthProgram = programs.get(PROGRAM_DEPTH);
+        const ProgramVariant& blurProgram = programs.variant(PROGRAM_BLUR, frameKey);
+        const ProgramVariant& terrainProgram = programs.variant(PROGRAM_TERRAIN, frameKey);
+        const ProgramVariant& waterProgram = programs.variant(PROGRAM_WATER, frameKey);
 
-        shaders["depth"]->setMat4("model", terrainModel);
-        glBindVertexArray(terrainVAO);
-        glDrawElements(GL_TRIANGLES, terrain.indices.size(), GL_UNSIGNED_INT, 0);
+        // ================= SHADOW PASS =================
+        RenderTarget shadowMap = targets.acquire(shadowDescs[shadowFilter]);
+        cullTerrain(terrainBVH, lightSpaceMatrix, shadowChunks, stats.shadowCull);
+        RenderCommand* shadowTerrain;
+        if (shadowSettings.prefiltered()) {
+            // Moments into a colour target, cleared to the far plane
+            RenderTarget momentsDepth = targets.acquire(momentsDepthDesc);
+            frameCommands.beginPass(CommandBuffer::Pass("shadow", targets.framebuffer(shadowMap.texture,
+                momentsDepth.texture), shadowMap.width, shadowMap.height, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT)
+                .setClearColor(1.0f, 1.0f, 1.0f, 1.0f));
+            ShadowMomentsParams momentsParams;
+            momentsParams.lightSpaceMatrix = lightSpaceMatrix;
+            momentsParams.model = terrainModel;
+            const ProgramVariant& momentsProgram = programs.variant(PROGRAM_SHADOW_MOMENTS, frameKey);
+            shadowTerrain = &frameCommands.add(LAYER_OPAQUE, momentsProgram.ID, terrainVAO, opaque);
+            setUniforms(*shadowTerrain, momentsProgram, momentsParams);
+            targets.release(momentsDepth);
+        }
+        else {
+            frameCommands.beginPass(CommandBuffer::Pass("shadow", targets.framebuffer(0, shadowMap.texture),
+                shadowMap.width, shadowMap.height, GL_DEPTH_BUFFER_BIT));
+            DepthParams shadowParams;
+            shadowParams.lightSpaceMatrix = lightSpaceMatrix;
+            shadowParams.model = terrainModel;
+            shadowParams.minHeight = -std::numeric_limits<float>::max();
+            shadowTerrain = &frameCommands.add(LAYER_OPAQUE, depthProgram.ID, terrainVAO, opaque);
+            setUniforms(*shadowTerrain, depthProgram, shadowParams);
+        }
+        shadowTerrain->draw = [&]() {
+            terrainBatch.build(terrain, shadowChunks);
+            terrainBatch.draw(stats.shadowDraw);
+        };
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // VSM and ESM filter before the lookup: the bloom blur, across and
+        // then down through a second map, so a lookup is one fetch
+        if (shadowSettings.prefiltered()) {
+            RenderTarget blurred = targets.acquire(shadowDescs[shadowFilter]);
+            RenderTarget source[2] = { shadowMap, blurred };
+            for (int i = 0; i < 2; ++i) {
+                frameCommands.beginPass(CommandBuffer::Pass("shadowblur", targets.framebuffer(source[1 - i].texture, 0),
+                    shadowMap.width, shadowMap.height, 0));
+                RenderCommand& blur = frameCommands.add(LAYER_OPAQUE, blurProgram.ID, quad, postProcess);
+                blur.addTexture(0, GL_TEXTURE_2D, source[i].texture);
+                BlurParams blurParams = { i == 0, glm::vec2(1.0f) };
+                setUniforms(blur, blurProgram, blurParams);
+                blur.draw = []() { glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); };
+            }
+            targets.release(blurred);
+        }
+        // The hardware comparison needs a sampler2DShadow, on its own unit
+        int shadowUnit = shadowFilter == SHADOW_HARDWARE_PCF ? 2 : 1;
 
         // ================= REFLECTION CAMERA =================
         glm::vec3 reflCamPos = camera.Position;
@@ -491,174 +783,340 @@ void renderLoop(
 
         glm::mat4 reflProjection = glm::perspective(
             glm::radians(camera.Zoom),
-            (float)SCR_WIDTH / (float)SCR_HEIGHT,
-            0.1f,
-            5000.0f
+            aspect,
+            NEAR_PLANE,
+            FAR_PLANE
         );
+        glm::mat4 reflectionVP = reflProjection * reflView;
 
         // ================= REFLECTION PASS =================
-        glBindFramebuffer(GL_FRAMEBUFFER, reflectionFBO);
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glDisable(GL_CULL_FACE);
-        glEnable(GL_DEPTH_TEST);
-
-        glm::mat4 reflectionVP = reflProjection * reflView;
-		shaders["water"]->use();
-        shaders["water"]->setMat4("reflectionVP", reflectionVP);
-        
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        shaders["water"]->setInt("skyCubemap", 3);
-        shaders["water"]->setFloat("normalStrength", 0.2f);
-
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_2D, waterNormalMap);
-        shaders["water"]->setInt("normalMap", 4);
-        shaders["water"]->setFloat("normalStrength", 0.1f);
-		shaders["water"]->setFloat("time", time);
-		shaders["water"]->setVec3("viewPos", camera.Position);   
-
-        // Terrain
-        shaders["terrain"]->use();
-        shaders["terrain"]->setMat4("projection", reflProjection);
-        shaders["terrain"]->setMat4("view", reflView);
-        shaders["terrain"]->setMat4("model", terrainModel);
-        shaders["terrain"]->setVec3("viewPos", reflCamPos);
-        shaders["terrain"]->setVec3("lightDir", lightDir);
-        shaders["terrain"]->setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        shaders["terrain"]->setFloat("clipHeight", waterHeight);
-        shaders["terrain"]->setInt("clipAbove", -1);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        shaders["terrain"]->setInt("shadowMap", 1);
-
-        glBindVertexArray(terrainVAO);
-        glDrawElements(GL_TRIANGLES, terrain.indices.size(), GL_UNSIGNED_INT, 0);
-
-        // Sun (important!)
-        renderSun(shaders["sun"].get(), sunVAO, lightDir, reflProjection, reflView);
-
-        glEnable(GL_CULL_FACE);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        // Planar only: SSR reads the scene pass instead
+        RenderTarget reflectionColor = {};
+        if (!ssr) {
+            // The reflection clips at the water; the scene has no clipping code
+            const ProgramVariant& reflectionProgram = programs.variant(PROGRAM_TERRAIN, frameKey.withClip(true));
+            reflectionColor = targets.acquire(colorDesc);
+            RenderTarget reflectionDepth = targets.acquire(depthDesc);
+            frameCommands.beginPass(CommandBuffer::Pass("reflection",
+                targets.framebuffer(reflectionColor.texture, reflectionDepth.texture), renderWidth, renderHeight,
+                GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+
+            cullTerrain(terrainBVH, reflectionVP, reflectionChunks, stats.reflectionCull);
+
+            // Terrain
+            TerrainParams reflectionParams;
+            reflectionParams.viewProjection = reflectionVP;
+            reflectionParams.model = terrainModel;
+            reflectionParams.viewPos = reflCamPos;
+            reflectionParams.lightDir = lightDir;
+            reflectionParams.lightSpaceMatrix = lightSpaceMatrix;
+            reflectionParams.clipHeight = waterHeight;
+            reflectionParams.clipAbove = 1;
+            setIrradiance(reflectionParams, atmosphere.getIrradiance());
+            RenderCommand& reflectionTerrain = frameCommands.add(LAYER_OPAQUE, reflectionProgram.ID, terrainVAO,
+                twoSided);
+            reflectionTerrain.addTexture(shadowUnit, GL_TEXTURE_2D, shadowMap.texture);
+            setUniforms(reflectionTerrain, reflectionProgram, reflectionParams);
+            reflectionTerrain.draw = [&]() {
+                terrainBatch.build(terrain, reflectionChunks);
+                terrainBatch.draw(stats.reflectionDraw);
+            };
+
+            // Sky and sun, mirrored
+            recordSky(frameCommands, programs, skyVAO, skyTextures.skyView, sunDir, sunColor, reflView, reflProjection,
+                skyState);
+            // The scene pass gets it as its depth buffer
+            targets.release(reflectionDepth);
+        }
 
         // ================= SCENE PASS =================
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glBindFramebuffer(GL_FRAMEBUFFER, bloom.hdrFBO);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_DEPTH_TEST);
-
         glm::mat4 view = camera.GetViewMatrix();
         glm::mat4 projection = glm::perspective(
             glm::radians(camera.Zoom),
-            (float)SCR_WIDTH / (float)SCR_HEIGHT,
-            0.1f,
-            5000.0f
+            aspect,
+            NEAR_PLANE,
+            FAR_PLANE
         );
 
-        renderSkyBox(shaders["skybox"].get(), skyboxVAO, cubemapTexture);
+        glm::mat4 viewProjection = projection * view;
+        cullTerrain(terrainBVH, viewProjection, sceneChunks, stats.sceneCull);
 
-        shaders["terrain"]->use();
-        shaders["terrain"]->setMat4("projection", projection);
-        shaders["terrain"]->setMat4("view", view);
-        shaders["terrain"]->setMat4("model", terrainModel);
-        shaders["terrain"]->setVec3("viewPos", camera.Position);
-        shaders["terrain"]->setVec3("lightDir", lightDir);
-        shaders["terrain"]->setMat4("lightSpaceMatrix", lightSpaceMatrix);
-        shaders["terrain"]->setFloat("clipHeight", waterHeight);
-        shaders["terrain"]->setInt("clipAbove", -1); // disable clipping
+        if (occlusionMode != activeOcclusionMode) {
+            occlusion.invalidate();
+            activeOcclusionMode = occlusionMode;
+        }
+        if (occlusionMode == OCCLUSION_HIZ)
+            hiz.fetch(occlusion);
+        else if (occlusionMode == OCCLUSION_SOFTWARE)
+            occlusion.renderOccluders(viewProjection);
+        if (occlusionMode != OCCLUSION_OFF)
+            occlusion.cull(chunkBounds, sceneChunks, stats.sceneOcclusion);
+
+        RenderTarget sceneColor = targets.acquire(colorDesc);
+        RenderTarget sceneDepth = targets.acquire(depthDesc);
+        unsigned int sceneFBO = targets.framebuffer(sceneColor.texture, sceneDepth.texture);
+        glm::vec3 eye = camera.Position;
+
+        // Terrain depth first, nearest chunks first, with the depth
+        // program; the shading below then runs once per visible pixel and
+        // the sky only where no terrain is
+        bool prepass = depthPrepass;
+        if (prepass) {
+            frameCommands.beginPass(CommandBuffer::Pass("prepass", sceneFBO, renderWidth, renderHeight,
+                GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+            DepthParams prepassParams;
+            prepassParams.lightSpaceMatrix = viewProjection;
+            prepassParams.model = terrainModel;
+            prepassParams.minHeight = TERRAIN_MIN_HEIGHT;
+            RenderCommand& prepassTerrain = frameCommands.add(LAYER_OPAQUE, depthProgram.ID, terrainVAO, opaque);
+            setUniforms(prepassTerrain, depthProgram, prepassParams);
+            prepassTerrain.draw = [&, eye]() {
+                terrainBatch.buildFrontToBack(terrain, sceneChunks, eye);
+                terrainBatch.draw(stats.prepassDraw);
+            };
+        }
+        frameCommands.beginPass(CommandBuffer::Pass("scene", sceneFBO, renderWidth, renderHeight,
+            prepass ? 0 : GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+
+        TerrainParams sceneParams;
+        sceneParams.viewProjection = viewProjection;
+        sceneParams.model = terrainModel;
+        sceneParams.viewPos = camera.Position;
+        sceneParams.lightDir = lightDir;
+        sceneParams.lightSpaceMatrix = lightSpaceMatrix;
+        sceneParams.clipHeight = waterHeight;
+        sceneParams.clipAbove = 1;
+        setIrradiance(sceneParams, atmosphere.getIrradiance());
+        // After a pre-pass only the nearest surface is left to pass, in any
+        // order, so the ranges merge as far as they can
+        RenderState sceneTerrainState = prepass ? RenderState(RenderState::DEPTH_TEST | RenderState::CULL_FACE, GL_EQUAL)
+            : opaque;
+        RenderCommand& sceneTerrain = frameCommands.add(LAYER_OPAQUE, terrainProgram.ID, terrainVAO,
+            sceneTerrainState);
+        sceneTerrain.addTexture(shadowUnit, GL_TEXTURE_2D, shadowMap.texture);
+        setUniforms(sceneTerrain, terrainProgram, sceneParams);
+        sceneTerrain.draw = [&, eye, prepass]() {
+            if (prepass)
+                terrainBatch.build(terrain, sceneChunks);
+            else
+                terrainBatch.buildFrontToBack(terrain, sceneChunks, eye);
+            shadedSamples.begin();
+            terrainBatch.draw(stats.sceneDraw);
+            shadedSamples.end();
+        };
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-        shaders["terrain"]->setInt("shadowMap", 1);
+        // ================= SKY =================
+        // The sun is a disc in the sky shader. Before the water, so
+        // screen-space reflections see it.
+        recordSky(frameCommands, programs, skyVAO, skyTextures.skyView, sunDir, sunColor, view, projection, skyState);
+
+        // ================= HI-Z =================
+        // Next frame's occlusion tests and this frame's screen-space
+        // reflections read the opaque scene's depth
+        if (occlusionMode == OCCLUSION_HIZ || ssr) {
+            frameCommands.beginPass(CommandBuffer::Pass("hiz"));
+            unsigned int depthTexture = sceneDepth.texture;
+            frameCommands.addExternal([&hiz, depthTexture, renderWidth, renderHeight, viewProjection]() {
+                hiz.build(depthTexture, renderWidth, renderHeight, viewProjection);
+            });
+        }
 
-        glBindVertexArray(terrainVAO);
-        glDrawElements(GL_TRIANGLES, terrain.indices.size(), GL_UNSIGNED_INT, 0);
+        // The water cannot read the target it draws into, so SSR reads a copy
+        RenderTarget sceneCopy = {};
+        if (ssr) {
+            sceneCopy = targets.acquire(colorDesc);
+            frameCommands.beginPass(CommandBuffer::Pass("scenecopy"));
+            unsigned int copyFBO = targets.framebuffer(sceneCopy.texture, 0);
+            frameCommands.addExternal([sceneFBO, copyFBO, renderWidth, renderHeight]() {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFBO);
+                glBindFramebuffer(GL_DRAW_FRAMEBUFFER, copyFBO);
+                glBlitFramebuffer(0, 0, renderWidth, renderHeight, 0, 0, renderWidth, renderHeight,
+                    GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            });
+        }
 
         // ================= WATER PASS =================
-        glDepthMask(GL_FALSE);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-        glDisable(GL_CULL_FACE);
-
-        shaders["water"]->use();
-        shaders["water"]->setMat4("projection", projection);
-        shaders["water"]->setMat4("view", view);
-
-        glm::vec3 waterPos = camera.Position;
-        waterPos.y = waterHeight;
-
-        // snap to avoid swimming artifacts
-        waterPos.x = floor(waterPos.x / tileSize) * tileSize;
-        waterPos.z = floor(waterPos.z / tileSize) * tileSize;
-
-        glm::mat4 waterModel = glm::translate(glm::mat4(1.0f), waterPos);
-
-        shaders["water"]->setMat4("model", waterModel);
-        shaders["water"]->setVec3("viewPos", camera.Position);
-        shaders["water"]->setVec3("lightDir", lightDir);
-        shaders["water"]->setFloat("time", time);
-		shaders["water"]->setMat4("lightSpaceMatrix", lightSpaceMatrix);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, reflectionTex);
-
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, depthMap);
-
-        glBindVertexArray(waterVAO);
-        glDrawElements(GL_TRIANGLES, waterMesh.indices.size(), GL_UNSIGNED_INT, 0);
-
-        glDepthMask(GL_TRUE);
-        glDisable(GL_BLEND);
-        glEnable(GL_CULL_FACE);
-
-        // ================= SUN =================
-        renderSun(shaders["sun"].get(), sunVAO, lightDir, projection, view);
+        WaterClipmap::Stats waterStats;
+        waterLod.select(camera.Position, Frustum::fromMatrix(viewProjection), waterTiles, waterStats);
+        if (occlusionMode != OCCLUSION_OFF) {
+            size_t kept = 0;
+            for (const WaterTile& tile : waterTiles) {
+                if (!occlusion.isOccluded(waterLod.tileBounds(tile)))
+                    waterTiles[kept++] = tile;
+            }
+            waterStats.occluded = (int)(waterTiles.size() - kept);
+            waterStats.tiles -= waterStats.occluded;
+            waterTiles.resize(kept);
+        }
+        waterStats.vertices = (long long)waterTiles.size() * waterLod.getTileVertexCount();
+        stats.water.nodesTested += waterStats.nodesTested;
+        stats.water.tiles += waterStats.tiles;
+        stats.water.occluded += waterStats.occluded;
+        stats.water.vertices += waterStats.vertices;
+
+        frameCommands.beginPass(CommandBuffer::Pass("water", sceneFBO, renderWidth, renderHeight, 0));
+        if (!waterTiles.empty()) {
+            RenderCommand& waterDraw = frameCommands.add(LAYER_TRANSPARENT, waterProgram.ID, water.VAO,
+                RenderState(RenderState::DEPTH_TEST | RenderState::BLEND));
+            waterDraw.addTexture(0, GL_TEXTURE_2D, ssr ? sceneCopy.texture : reflectionColor.texture);
+            waterDraw.addTexture(shadowUnit, GL_TEXTURE_2D, shadowMap.texture);
+            waterDraw.addTexture(3, GL_TEXTURE_CUBE_MAP, skyTextures.environment);
+            waterDraw.addTexture(4, GL_TEXTURE_2D, waterNormalMap);
+            waterDraw.addTexture(5, GL_TEXTURE_2D, oceanTextures.displacement);
+            waterDraw.addTexture(6, GL_TEXTURE_2D, oceanTextures.normals);
+            if (ssr)
+                waterDraw.addTexture(7, GL_TEXTURE_2D, hiz.getTexture());
+            WaterParams waterParams;
+            waterParams.projection = projection;
+            waterParams.view = view;
+            waterParams.reflectionVP = reflectionVP;
+            waterParams.lightSpaceMatrix = lightSpaceMatrix;
+            waterParams.viewPos = camera.Position;
+            waterParams.time = frame.time;
+            waterParams.normalStrength = 0.1f;
+            waterParams.renderScale = renderScale;
+            waterParams.hizLevels = hiz.getLevels();
+            setUniforms(waterDraw, waterProgram, waterParams);
+            waterDraw.draw = [&water, &waterTiles]() {
+                // Respecified (and so orphaned) every frame; a few hundred tiles at most
+                glBindBuffer(GL_ARRAY_BUFFER, water.instanceVBO);
+                glBufferData(GL_ARRAY_BUFFER, waterTiles.size() * sizeof(WaterTile), waterTiles.data(), GL_STREAM_DRAW);
+                glDrawElementsInstanced(GL_TRIANGLES, water.indexCount, GL_UNSIGNED_INT, 0, (GLsizei)waterTiles.size());
+            };
+        }
+        targets.release(ssr ? sceneCopy : reflectionColor);
+        targets.release(shadowMap);
+        targets.release(sceneDepth);
 
         // ================= BLOOM =================
-        glBindFramebuffer(GL_FRAMEBUFFER, bloom.pingpongFBO[0]);
-        shaders["brightpass"]->use();
-        shaders["brightpass"]->setFloat("threshold", 0.6f);
-        glBindTexture(GL_TEXTURE_2D, bloom.colorBuffers[0]);
-        renderQuad();
+        // The first of these takes over the reflection's colour target, or
+        // the scene copy
+        RenderTarget pingpong[2] = { targets.acquire(colorDesc), targets.acquire(colorDesc) };
+        unsigned int pingpongFBO[2] = { targets.framebuffer(pingpong[0].texture, 0),
+            targets.framebuffer(pingpong[1].texture, 0) };
+
+        frameCommands.beginPass(CommandBuffer::Pass("bright", pingpongFBO[0], renderWidth, renderHeight, 0));
+        const ProgramVariant& brightProgram = programs.get(PROGRAM_BRIGHTPASS);
+        RenderCommand& bright = frameCommands.add(LAYER_OPAQUE, brightProgram.ID, quad, postProcess);
+        bright.addTexture(0, GL_TEXTURE_2D, sceneColor.texture);
+        BrightPassParams brightParams = { 0.6f, renderScale };
+        setUniforms(bright, brightProgram, brightParams);
+        bright.draw = []() { glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); };
 
         bool horizontal = true, first = true;
-        shaders["blur"]->use();
         for (int i = 0; i < 5; i++) {
-            glBindFramebuffer(GL_FRAMEBUFFER, bloom.pingpongFBO[horizontal]);
-            shaders["blur"]->setInt("horizontal", horizontal);
-            glBindTexture(GL_TEXTURE_2D,
-                first ? bloom.pingpongColorbuffers[0]
-                : bloom.pingpongColorbuffers[!horizontal]);
-            renderQuad();
+            frameCommands.beginPass(CommandBuffer::Pass("blur", pingpongFBO[horizontal], renderWidth, renderHeight, 0));
+            RenderCommand& blur = frameCommands.add(LAYER_OPAQUE, blurProgram.ID, quad, postProcess);
+            blur.addTexture(0, GL_TEXTURE_2D,
+                first ? pingpong[0].texture
+                : pingpong[!horizontal].texture);
+            BlurParams blurParams = { horizontal, renderScale };
+            setUniforms(blur, blurProgram, blurParams);
+            blur.draw = []() { glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); };
             horizontal = !horizontal;
             if (first) first = false;
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        shaders["final"]->use();
-        shaders["final"]->setBool("bloom", true);
-        shaders["final"]->setFloat("exposure", 1.3f);
-
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, bloom.colorBuffers[0]);
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, bloom.pingpongColorbuffers[!horizontal]);
-
-        renderQuad();
+        // Upscales to the window
+        frameCommands.beginPass(CommandBuffer::Pass("final", 0, windowWidth, windowHeight,
+            GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+        const ProgramVariant& finalProgram = programs.get(PROGRAM_FINAL);
+        RenderCommand& composite = frameCommands.add(LAYER_OPAQUE, finalProgram.ID, quad, postProcess);
+        composite.addTexture(0, GL_TEXTURE_2D, sceneColor.texture);
+        composite.addTexture(1, GL_TEXTURE_2D, pingpong[!horizontal].texture);
+        FinalParams finalParams = { 1.3f, renderScale };
+        setUniforms(composite, finalProgram, finalParams);
+        composite.draw = []() { glDrawArrays(GL_TRIANGLE_STRIP, 0, 4); };
+
+        // ================= SUBMIT =================
+        frameCommands.sort();
+        // Anything outside the cache may have touched state since last frame
+        stateCache.invalidate();
+        gpuTimer.begin();
+        passTimer.beginFrame();
+        stateCache.submit(frameCommands, &passTimer);
+        passTimer.endFrame();
+        gpuTimer.end();
+        terrainBatch.endFrame();
+        targets.endFrame();
+
+        // The composite is in the back buffer until the swap
+        capture.capture(windowWidth, windowHeight);
+        if (capture.done())
+            glfwSetWindowShouldClose(window, true);
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        if (firstFrame) {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupTime).count();
+            std::cout << "Time to first frame: " << ms << " ms ("
+                << (asyncAssets ? "async" : "synchronous") << " texture loading)\n";
+            firstFrame = false;
+        }
+
+        stats.frames++;
+        stats.occlusionMode = occlusionMode;
+        stats.depthPrepass = depthPrepass;
+        stats.shadows = shadowSettings;
+        stats.quality = qualityPreset;
+        stats.reflections = reflectionSettings.mode;
+        stats.programs = programs.getStats();
+        stats.indirectRing = terrainBatch.getCommandBuffer().getStats();
+        stats.simulationSettings = simulation.getSettings();
+        stats.simulation = simulation.getStats();
+        stats.stateCache = stateCache.getStats();
+        stats.ocean = ocean.getStats();
+        stats.atmosphere = atmosphere.getStats();
+        stats.sunElevation = glm::degrees(std::asin(glm::clamp(sunDir.y, -1.0f, 1.0f)));
+        stats.resolutionSettings = resolution.getSettings();
+        stats.resolution = resolution.getState();
+        stats.resolutionStats = resolution.getStats();
+        stats.renderTargets = targets.getStats();
+        stats.capturing = capture.isActive();
+        stats.capture = capture.getStats();
+        if (time - lastStatsTime >= STATS_INTERVAL) {
+            stats.print(std::cout);
+            stats.reset();
+            terrainBatch.getCommandBuffer().resetStats();
+            simulation.resetStats();
+            stateCache.resetStats();
+            ocean.resetStats();
+            atmosphere.resetStats();
+            resolution.resetStats();
+            targets.resetStats();
+            lastStatsTime = time;
+        }
     }
+
+    simulation.stop();
+    ocean.finish();
+    atmosphere.finish();
+    gpuTimer.destroy();
+    passTimer.destroy();
+    shadedSamples.destroy();
+    capture.destroy();
+    glDeleteTextures(1, &oceanTextures.displacement);
+    glDeleteTextures(1, &oceanTextures.normals);
+    glDeleteTextures(1, &skyTextures.skyView);
+    glDeleteTextures(1, &skyTextures.environment);
+    glDeleteVertexArrays(1, &skyVAO);
+    terrainBatch.destroy();
+    hiz.destroy();
+    targets.destroy();
+}
+
+// ------------------- TERRAIN CHUNKS ---------------------
+void cullTerrain(const BVH& bvh, const glm::mat4& viewProjection,
+    std::vector<unsigned int>& visible, CullStats& stats)
+{
+    visible.clear();
+    bvh.cull(Frustum::fromMatrix(viewProjection), visible, stats);
 }
 
 
 
-void renderQuad() {
+unsigned int getQuadVAO() {
     if (quadVAO == 0)
     {
         float quadVertices[] = {
@@ -679,55 +1137,26 @@ void renderQuad() {
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
+    return quadVAO;
+}
 
-    glBindVertexArray(quadVAO);
+void renderQuad() {
+    glBindVertexArray(getQuadVAO());
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
     glBindVertexArray(0);
 }
 
-unsigned int loadWaterNormalMap(const char* path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-
-    if (data)
-    {
-        GLenum format = (nrChannels == 3) ? GL_RGB : GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cerr << "Failed to load normal map: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
-
-
 void processInput(GLFWwindow* window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) glfwSetWindowShouldClose(window, true);
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS) camera.ProcessKeyboard(FORWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS) camera.ProcessKeyboard(BACKWARD, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS) camera.ProcessKeyboard(LEFT, deltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS) camera.ProcessKeyboard(RIGHT, deltaTime);
+    frameInput.forward = glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS;
+    frameInput.backward = glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS;
+    frameInput.left = glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS;
+    frameInput.right = glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS;
 }
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
+    windowWidth = width;
+    windowHeight = height;
 }
 void mouse_callback(GLFWwindow* window, double xposd, double yposd) {
     float xpos = static_cast<float>(xposd);
@@ -737,8 +1166,32 @@ void mouse_callback(GLFWwindow* window, double xposd, double yposd) {
     float yoffset = lastY - ypos;
     lastX = xpos;
     lastY = ypos;
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    frameInput.mouseX += xoffset;
+    frameInput.mouseY += yoffset;
+}
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    if (action != GLFW_PRESS) return;
+    if (key == GLFW_KEY_O) {
+        occlusionMode = (OcclusionMode)((occlusionMode + 1) % 3);
+        std::cout << "Occlusion culling: " << occlusionModeName(occlusionMode) << "\n";
+    }
+    if (key == GLFW_KEY_P) {
+        depthPrepass = !depthPrepass;
+        std::cout << "Terrain depth pre-pass: " << (depthPrepass ? "on" : "off") << "\n";
+    }
+    if (key == GLFW_KEY_F) {
+        shadowSettings.filter = (ShadowFilter)((shadowSettings.filter + 1) % SHADOW_FILTER_COUNT);
+        std::cout << "Shadow filter: " << shadowFilterName(shadowSettings.filter) << "\n";
+    }
+    if (key == GLFW_KEY_R) {
+        reflectionSettings.mode = (ReflectionMode)((reflectionSettings.mode + 1) % REFLECTION_MODE_COUNT);
+        std::cout << "Reflections: " << reflectionModeName(reflectionSettings.mode) << "\n";
+    }
+    if (key == GLFW_KEY_Q) {
+        qualityPreset = (QualityPreset)((qualityPreset + 1) % QUALITY_COUNT);
+        std::cout << "Quality: " << qualityPresetName(qualityPreset) << "\n";
+    }
 }
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    frameInput.scroll += static_cast<float>(yoffset);
 }
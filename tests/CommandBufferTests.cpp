@@ -0,0 +1,97 @@
+#include "Tests.hpp"
+
+#include <CommandBuffer.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// What the backend relies on from a sorted frame
+struct SortedOrder {
+    bool passesAndLayers;          // passes in order, layers in order within a pass
+    bool transparent;              // transparent commands in recording order
+    bool programRuns;              // no program interleaving within an opaque layer
+    bool unique;                   // no command duplicated, so with the count kept none lost
+};
+
+static SortedOrder sortedOrder(const CommandBuffer& commands)
+{
+    const std::vector<RenderCommand>& sorted = commands.getCommands();
+    SortedOrder order = { true, true, true, true };
+    std::vector<bool> seen(commands.getPasses().size() * CommandBuffer::MAX_COMMANDS_PER_PASS, false);
+    std::vector<unsigned int> finishedPrograms;
+
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        const RenderCommand& c = sorted[i];
+        size_t id = c.pass * CommandBuffer::MAX_COMMANDS_PER_PASS + c.sequence;
+        if (seen[id])
+            order.unique = false;
+        seen[id] = true;
+        if (i == 0)
+            continue;
+
+        const RenderCommand& prev = sorted[i - 1];
+        bool samePass = prev.pass == c.pass;
+        bool sameLayer = samePass && prev.layer == c.layer;
+        if (prev.pass > c.pass || (samePass && prev.layer > c.layer))
+            order.passesAndLayers = false;
+        if (sameLayer && c.layer == LAYER_TRANSPARENT && prev.sequence > c.sequence)
+            order.transparent = false;
+        if (!sameLayer)
+            finishedPrograms.clear();
+        else if (c.layer != LAYER_TRANSPARENT && prev.program != c.program) {
+            if (std::find(finishedPrograms.begin(), finishedPrograms.end(), c.program) != finishedPrograms.end())
+                order.programRuns = false;
+            finishedPrograms.push_back(prev.program);
+        }
+    }
+    return order;
+}
+
+// Recording and sorting synthetic frames without a GL context: the order
+// the backend relies on, and fewer state changes than the recorded order
+void testCommands()
+{
+    const int FRAMES = 50;
+    CommandBuffer commands;
+    SortedOrder all = { true, true, true, true };
+    bool kept = true, fewer = true;
+    CommandBuffer::StateChanges before, after;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        recordSyntheticFrame(commands, 1234u + frame);
+        size_t recorded = commands.getCommands().size();
+        CommandBuffer::StateChanges unsorted = commands.countStateChanges();
+        commands.sort();
+        CommandBuffer::StateChanges changes = commands.countStateChanges();
+        if (frame == 0) {
+            before = unsorted;
+            after = changes;
+        }
+
+        SortedOrder order = sortedOrder(commands);
+        all.passesAndLayers = all.passesAndLayers && order.passesAndLayers;
+        all.transparent = all.transparent && order.transparent;
+        all.programRuns = all.programRuns && order.programRuns;
+        all.unique = all.unique && order.unique;
+        kept = kept && commands.getCommands().size() == recorded;
+        fewer = fewer && changes.total() < unsorted.total();
+    }
+    std::cout << "state changes " << before.total() << " recorded, " << after.total() << " sorted\n";
+    check(all.passesAndLayers, "passes, and layers within a pass, come out in order");
+    check(all.transparent, "transparent commands keep their recording order");
+    check(all.programRuns, "each program's opaque commands are contiguous");
+    check(all.unique && kept, "every command comes out exactly once");
+    check(fewer, "sorting saves state changes");
+
+    // A sky recorded first draws after the opaque layer of its pass
+    {
+        CommandBuffer frame;
+        frame.beginPass(CommandBuffer::Pass("pass", 1, 64, 64, 0));
+        frame.add(LAYER_SKY, 2, 1, RenderState(RenderState::DEPTH_TEST));
+        frame.add(LAYER_OPAQUE, 1, 1, RenderState(RenderState::DEPTH_TEST | RenderState::DEPTH_WRITE));
+        frame.sort();
+        const std::vector<RenderCommand>& sorted = frame.getCommands();
+        check(sorted.size() == 2 && sorted[0].layer == LAYER_OPAQUE && sorted[1].layer == LAYER_SKY,
+            "the sky sorts after the opaque draws");
+    }
+}
@@ -0,0 +1,158 @@
+#include "Tests.hpp"
+
+#include <Culling.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// The matrices the renderer culls with, looking over boxes scattered
+// around the origin
+struct CullingView {
+    const char* name;
+    glm::mat4 viewProjection;
+};
+
+static std::vector<CullingView> cullingViews()
+{
+    std::vector<CullingView> views;
+    const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+
+    glm::vec3 eye(-40.0f, 12.0f, -60.0f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(10.0f, 0.0f, 20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    views.push_back({ "camera", projection * view });
+
+    // As renderLoop builds it: the camera mirrored below the water,
+    // pitched the other way
+    const float water = 0.01f;
+    glm::vec3 front = glm::normalize(glm::vec3(10.0f, 0.0f, 20.0f) - eye);
+    glm::vec3 reflEye(eye.x, 2.0f * water - eye.y, eye.z);
+    glm::vec3 reflFront(front.x, -front.y, front.z);
+    glm::mat4 reflView = glm::lookAt(reflEye, reflEye + reflFront, glm::vec3(0.0f, 1.0f, 0.0f));
+    views.push_back({ "reflection", projection * reflView });
+
+    // And as a true mirror through the water plane, which flips the
+    // handedness of the matrix the planes are taken from
+    glm::mat4 mirror(1.0f);
+    mirror[1][1] = -1.0f;
+    mirror[3][1] = 2.0f * water;
+    views.push_back({ "mirrored", projection * view * mirror });
+
+    glm::mat4 lightProjection = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 1.0f, 30.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(-10.0f, 12.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    views.push_back({ "light", lightProjection * lightView });
+    return views;
+}
+
+// Some point of the box strictly inside the clip volume: the frustum test
+// may keep boxes that are not visible, never drop one that is
+static bool boxVisible(const AABB& box, const glm::mat4& viewProjection)
+{
+    const int STEPS = 4;
+    for (int i = 0; i <= STEPS; ++i) {
+        for (int j = 0; j <= STEPS; ++j) {
+            for (int k = 0; k <= STEPS; ++k) {
+                glm::vec3 t(i / (float)STEPS, j / (float)STEPS, k / (float)STEPS);
+                glm::vec4 p = viewProjection * glm::vec4(box.min + t * box.extent(), 1.0f);
+                if (p.w > 0.0f && std::abs(p.x) < p.w && std::abs(p.y) < p.w && std::abs(p.z) < p.w)
+                    return true;
+            }
+        }
+    }
+    return false;
+}
+
+// BVH::cull against classifying every box on its own, for the camera, both
+// reflections and the light; the fully-inside fast path; and an empty tree
+void testCulling()
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f), height(-5.0f, 15.0f), size(0.5f, 8.0f);
+    const int BOXES = 3000;
+    std::vector<AABB> boxes;
+    for (int i = 0; i < BOXES; ++i) {
+        glm::vec3 min(position(rng), height(rng), position(rng));
+        boxes.push_back(AABB(min, min + glm::vec3(size(rng), size(rng), size(rng))));
+    }
+
+    for (int leafSize : { 1, 4, 16 }) {
+        BVH bvh;
+        bvh.build(boxes, leafSize);
+        for (const CullingView& view : cullingViews()) {
+            Frustum frustum = Frustum::fromMatrix(view.viewProjection);
+            std::vector<unsigned int> expected;
+            bool conservative = true;
+            for (int i = 0; i < BOXES; ++i) {
+                if (frustum.intersects(boxes[i]))
+                    expected.push_back(i);
+                else
+                    conservative = conservative && !boxVisible(boxes[i], view.viewProjection);
+            }
+
+            std::vector<unsigned int> visible;
+            CullStats stats;
+            bvh.cull(frustum, visible, stats);
+            std::sort(visible.begin(), visible.end());
+            if (leafSize == 4) {
+                std::cout << view.name << ": " << visible.size() << "/" << BOXES << " visible, "
+                    << stats.nodesTested << " volumes tested\n";
+            }
+            check(conservative, "no box with a point inside the clip volume is classified outside");
+            check(visible == expected, "BVH culling keeps exactly the boxes classified one by one");
+            check(stats.total == BOXES && stats.visible == (int)expected.size(), "cull stats count the boxes");
+            check(!expected.empty() && (int)expected.size() < BOXES, "the view keeps some boxes and drops others");
+        }
+    }
+
+    // Everything in view: the root is inside, and nothing below it is tested
+    {
+        BVH bvh;
+        bvh.build(boxes);
+        glm::mat4 all = glm::ortho(-200.0f, 200.0f, -200.0f, 200.0f, -200.0f, 200.0f);
+        Frustum frustum = Frustum::fromMatrix(all);
+        check(frustum.classify(bvh.bounds()) == Frustum::INSIDE, "the bounds of all boxes are inside a view around them");
+        std::vector<unsigned int> visible;
+        CullStats stats;
+        bvh.cull(frustum, visible, stats);
+        std::sort(visible.begin(), visible.end());
+        bool allBoxes = (int)visible.size() == BOXES;
+        for (int i = 0; allBoxes && i < BOXES; ++i)
+            allBoxes = visible[i] == (unsigned int)i;
+        check(allBoxes && stats.nodesTested == 1, "a subtree inside the frustum is taken whole after one test");
+    }
+
+    // Part of the boxes clustered well inside the camera's view: they come
+    // back through inside subtrees, with fewer tests than boxes
+    {
+        std::vector<AABB> clustered = boxes;
+        std::uniform_real_distribution<float> near(-2.0f, 2.0f);
+        for (int i = 0; i < BOXES / 2; ++i) {
+            glm::vec3 min(near(rng), near(rng), near(rng) + 10.0f);
+            clustered[i] = AABB(min, min + glm::vec3(0.5f));
+        }
+        BVH bvh;
+        bvh.build(clustered);
+        Frustum frustum = Frustum::fromMatrix(cullingViews()[0].viewProjection);
+        std::vector<unsigned int> expected, visible;
+        for (int i = 0; i < BOXES; ++i) {
+            if (frustum.intersects(clustered[i]))
+                expected.push_back(i);
+        }
+        CullStats stats;
+        bvh.cull(frustum, visible, stats);
+        std::sort(visible.begin(), visible.end());
+        check(visible == expected, "clustered boxes cull the same through inside subtrees");
+        check(stats.nodesTested < (int)expected.size(), "inside subtrees save testing their boxes");
+    }
+
+    {
+        BVH bvh;
+        bvh.build(std::vector<AABB>());
+        std::vector<unsigned int> visible;
+        CullStats stats;
+        bvh.cull(Frustum::fromMatrix(cullingViews()[0].viewProjection), visible, stats);
+        check(bvh.empty() && visible.empty() && stats.total == 0 && stats.nodesTested == 0, "an empty BVH culls nothing");
+    }
+}
@@ -0,0 +1,195 @@
+#include "Tests.hpp"
+
+#include <Atmosphere.hpp>
+#include <EnvironmentLighting.hpp>
+#include <JobSystem.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// What a white Lambertian surface facing n reflects, summed over every texel
+static glm::vec3 bruteIrradiance(const std::vector<glm::vec3>* const faces[6], int size, glm::vec3 n)
+{
+    double sum[3] = {};
+    for (int face = 0; face < 6; ++face) {
+        for (int y = 0; y < size; ++y) {
+            for (int x = 0; x < size; ++x) {
+                glm::vec3 dir = cubeFaceDirection(face, 2.0f * (x + 0.5f) / size - 1.0f, 2.0f * (y + 0.5f) / size - 1.0f);
+                float len = glm::length(dir);
+                float cosine = glm::dot(n, dir / len);
+                if (cosine <= 0.0f)
+                    continue;
+                double weight = cosine * (2.0f / size) * (2.0f / size) / (len * len * len);
+                const glm::vec3& c = (*faces[face])[(size_t)y * size + x];
+                for (int i = 0; i < 3; ++i)
+                    sum[i] += c[i] * weight;
+            }
+        }
+    }
+    const double PI = 3.14159265358979;
+    return glm::vec3((float)(sum[0] / PI), (float)(sum[1] / PI), (float)(sum[2] / PI));
+}
+
+static double shDifference(const SH9& a, const SH9& b)
+{
+    double d = 0.0;
+    for (int i = 0; i < 9; ++i)
+        d = std::max(d, (double)glm::length(a.coefficients[i] - b.coefficients[i]) / std::max(glm::length(b.coefficients[0]), 1e-6f));
+    return d;
+}
+
+// SH9 projection and irradiance, the prefiltered levels, and the
+// atmosphere's environment cube built from them
+void testIrradiance()
+{
+    std::mt19937 rng(23);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto randomDirection = [&]() {
+        return sunDirection(glm::degrees(std::asin(2.0f * unit(rng) - 1.0f)), 360.0f * unit(rng));
+    };
+    SHProjector projector;
+
+    // Radiance that is itself band-limited comes back as it went in
+    {
+        SH9 source;
+        for (glm::vec3& c : source.coefficients)
+            c = glm::vec3(unit(rng), unit(rng), unit(rng)) - 0.5f;
+        source.coefficients[0] += glm::vec3(2.0f);
+        const int SIZE = 64;
+        std::vector<glm::vec3> faces[6];
+        fillCube(faces, SIZE, [&](glm::vec3 d) { return source.evaluate(d); });
+        const std::vector<glm::vec3>* ptrs[6] = { &faces[0], &faces[1], &faces[2], &faces[3], &faces[4], &faces[5] };
+        SH9 projected = projector.project(ptrs, SIZE);
+        double error = 0.0;
+        for (int i = 0; i < 9; ++i) {
+            glm::vec3 d = projected.coefficients[i] - source.coefficients[i];
+            error = std::max(error, (double)std::max(std::abs(d.x), std::max(std::abs(d.y), std::abs(d.z))));
+        }
+        std::cout << "band-limited radiance on a " << SIZE << "^2 cube recovered within " << error << "\n";
+        check(error < 2e-3, "band-limited radiance projects back onto its coefficients");
+    }
+
+    // The sky: SH ambient against brute force, as the terrain sees it.
+    // Errors are relative to the brightest normal: facing the dark ground
+    // there is next to nothing to get right.
+    Atmosphere::Settings settings;
+    Atmosphere atmosphere;
+    atmosphere.init(settings);
+    for (float elevation : { 60.0f, 20.0f, 3.0f }) {
+        atmosphere.update(sunDirection(elevation, 40.0f));
+        const std::vector<glm::vec3>* ptrs[6];
+        for (int face = 0; face < 6; ++face)
+            ptrs[face] = &atmosphere.getFace(face);
+        SH9 irradiance = projector.project(ptrs, settings.cubeSize).irradiance();
+
+        const int NORMALS = 200;
+        std::vector<glm::vec3> normals;
+        std::vector<float> reference;
+        for (int i = 0; i < NORMALS; ++i) {
+            normals.push_back(randomDirection());
+            reference.push_back(luminance(bruteIrradiance(ptrs, settings.cubeSize, normals.back())));
+        }
+        float brightest = *std::max_element(reference.begin(), reference.end());
+        double mean = 0.0, worst = 0.0;
+        for (int i = 0; i < NORMALS; ++i) {
+            // Clamped as shader.frag does
+            float sh = std::max(luminance(irradiance.evaluate(normals[i])), 0.0f);
+            double error = std::abs(sh - reference[i]) / std::max(brightest, 1e-6f);
+            mean += error / NORMALS;
+            worst = std::max(worst, error);
+        }
+        std::cout << "sun at " << elevation << " degrees: SH irradiance within " << 100.0 * mean << "% mean, "
+            << 100.0 * worst << "% max of integrating the cube\n";
+        check(mean < 0.03 && worst < 0.1, "SH9 irradiance matches integrating the sky");
+        glm::vec3 up = irradiance.evaluate(glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::vec3 stored = atmosphere.getIrradiance().evaluate(glm::vec3(0.0f, 1.0f, 0.0f));
+        check(glm::length(stored - up) < 1e-5f * glm::length(up), "the atmosphere keeps the cube's irradiance");
+    }
+
+    // The sums are in a fixed order, so every thread count agrees exactly,
+    // and the SSE lanes only reorder the additions a little
+    {
+        const int SIZE = 64;
+        std::vector<glm::vec3> faces[6];
+        glm::vec3 sun = sunDirection(20.0f, 40.0f);
+        fillCube(faces, SIZE, [&](glm::vec3 d) {
+            return glm::vec3(0.2f, 0.4f, 0.9f) * (0.5f + 0.5f * d.y) + glm::vec3(3.0f) * std::pow(std::max(glm::dot(d, sun), 0.0f), 8.0f);
+        });
+        const std::vector<glm::vec3>* ptrs[6] = { &faces[0], &faces[1], &faces[2], &faces[3], &faces[4], &faces[5] };
+        SH9 scalarBase, simdBase;
+        bool deterministic = true;
+        double simdDifference = 0.0;
+        for (int threads : { 1, 2, 4 }) {
+            JobSystem::instance().init(threads - 1);
+            projector.setSimd(false);
+            SH9 scalar = projector.project(ptrs, SIZE);
+            projector.setSimd(true);
+            SH9 simd = projector.project(ptrs, SIZE);
+            if (threads == 1) {
+                scalarBase = scalar;
+                simdBase = simd;
+            }
+            deterministic = deterministic && shDifference(scalar, scalarBase) == 0.0 && shDifference(simd, simdBase) == 0.0;
+            simdDifference = std::max(simdDifference, shDifference(simd, scalar));
+        }
+        JobSystem::instance().init(0);
+        check(deterministic, "the projection does not depend on the thread count");
+        check(simdDifference < 1e-4, "the SSE projection matches the scalar one");
+    }
+
+    // Prefiltered levels: a constant cube stays constant, and the sky's
+    // levels keep its brightness and match prefiltering the full-size cube,
+    // which the atmosphere skips by reading box-filtered ones
+    {
+        const int SIZE = 16;
+        std::vector<glm::vec3> faces[6];
+        fillCube(faces, SIZE, [](glm::vec3) { return glm::vec3(0.25f, 0.5f, 1.0f); });
+        const std::vector<glm::vec3>* ptrs[6] = { &faces[0], &faces[1], &faces[2], &faces[3], &faces[4], &faces[5] };
+        double constantError = 0.0;
+        for (int face = 0; face < 6; ++face) {
+            std::vector<glm::vec3> out;
+            prefilterFace(ptrs, SIZE, face, 4, 0.6f, out);
+            for (const glm::vec3& c : out)
+                constantError = std::max(constantError, (double)glm::length(c - glm::vec3(0.25f, 0.5f, 1.0f)));
+        }
+        check(constantError < 1e-5, "prefiltering keeps a constant cube constant");
+
+        atmosphere.update(sunDirection(10.0f, 40.0f));
+        const int levels = atmosphere.getCubeLevels();
+        const std::vector<glm::vec3>* full[6];
+        for (int face = 0; face < 6; ++face)
+            full[face] = &atmosphere.getFace(face);
+        double baseMean = 0.0;
+        bool meanKept = true, matches = true;
+        for (int level = 0; level < levels; ++level) {
+            int size = std::max(settings.cubeSize >> level, 1);
+            float roughness = cubeLevelRoughness(level, levels);
+            double mean = 0.0, meanError = 0.0, maxError = 0.0;
+            for (int face = 0; face < 6; ++face) {
+                const std::vector<glm::vec3>& texels = atmosphere.getFace(face, level);
+                std::vector<glm::vec3> reference;
+                if (level > 0)
+                    prefilterFace(full, settings.cubeSize, face, size, roughness, reference);
+                else
+                    reference = texels;
+                for (size_t i = 0; i < texels.size(); ++i) {
+                    mean += luminance(texels[i]) / (6.0 * size * size);
+                    double error = std::abs(luminance(texels[i]) - luminance(reference[i]));
+                    meanError += error / (6.0 * size * size);
+                    maxError = std::max(maxError, error);
+                }
+            }
+            if (level == 0)
+                baseMean = mean;
+            // Texel means weigh the corners less than the solid angle does,
+            // so allow a little drift
+            meanKept = meanKept && std::abs(mean - baseMean) < 0.1 * baseMean;
+            matches = matches && meanError < 0.03 * baseMean && maxError < 0.1 * baseMean;
+        }
+        check(meanKept, "prefiltered levels keep the sky's brightness");
+        check(matches, "prefiltering box-filtered faces matches prefiltering the full cube");
+    }
+}
@@ -0,0 +1,215 @@
+#include "Tests.hpp"
+
+#include <FrameEncoder.hpp>
+#include <Simulation.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Written under the working directory (ctest's is the build directory)
+// and deleted again
+static const std::string DIRECTORY = "test_capture";
+
+static long long fileSize(const std::string& path)
+{
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return -1;
+    std::fseek(file, 0, SEEK_END);
+    long long size = std::ftell(file);
+    std::fclose(file);
+    return size;
+}
+
+// The YUV conversion, the Y4M and PNG output, the drop accounting, and the
+// simulation stepped a frame at a time as it is while capturing
+void testCapture()
+{
+    // BT.601 full range, the bottom row of the input first in the output
+    {
+        const unsigned char colours[][3] = { { 255, 255, 255 }, { 0, 0, 0 }, { 255, 0, 0 }, { 0, 0, 255 } };
+        const int expected[][3] = { { 255, 128, 128 }, { 0, 128, 128 }, { 76, 85, 255 }, { 29, 255, 107 } };
+        bool exact = true;
+        for (int c = 0; c < 4; ++c) {
+            std::vector<unsigned char> rgba(2 * 2 * 4, 255), yuv;
+            for (int i = 0; i < 4; ++i)
+                std::memcpy(&rgba[4 * i], colours[c], 3);
+            FrameEncoder::rgbaToYuv420(&rgba[0], 2, 2, yuv);
+            for (int i = 0; i < 4; ++i)
+                exact = exact && std::abs(yuv[i] - expected[c][0]) <= 1;
+            exact = exact && std::abs(yuv[4] - expected[c][1]) <= 1 && std::abs(yuv[5] - expected[c][2]) <= 1;
+        }
+        check(exact, "white, black, red and blue convert to their BT.601 full-range values");
+
+        // 3 x 3, black with a white top row: luma flipped, chroma averaged
+        // over 2 x 2 blocks with the edge repeated
+        std::vector<unsigned char> rgba(3 * 3 * 4, 0), yuv;
+        for (int x = 0; x < 3; ++x)
+            std::memset(&rgba[(2 * 3 + x) * 4], 255, 4);
+        FrameEncoder::rgbaToYuv420(&rgba[0], 3, 3, yuv);
+        check(yuv.size() == 9 + 2 * 4, "odd sizes round the chroma planes up");
+        check(yuv[0] == 255 && yuv[3] == 0 && yuv[8] == 0, "rows come out top first");
+        check(yuv[9] == 128 && yuv[13] == 128, "grey keeps the chroma centred");
+    }
+
+    // Y4M: a header, then every frame as FRAME and its planes
+    {
+        const int W = 64, H = 36, FRAMES = 10;
+        CaptureSettings settings;
+        settings.directory = DIRECTORY;
+        settings.format = CAPTURE_Y4M;
+        settings.fps = 30;
+        settings.maxQueued = FRAMES + 1;
+        FrameEncoder encoder;
+        check(encoder.open(settings, W, H), "the Y4M stream opens");
+        std::vector<unsigned char> rgba;
+        for (int i = 0; i < FRAMES; ++i) {
+            makeFrame(rgba, W, H, i);
+            encoder.submit(rgba, W, H, i);
+        }
+        makeFrame(rgba, W / 2, H / 2, FRAMES);
+        encoder.submit(rgba, W / 2, H / 2, FRAMES);
+        encoder.close();
+        FrameEncoder::Stats stats = encoder.getStats();
+
+        const std::string path = DIRECTORY + "/capture.y4m";
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        char header[128] = {};
+        if (file) {
+            if (!std::fgets(header, sizeof(header), file))
+                header[0] = 0;
+            std::fclose(file);
+        }
+        const long long frameBytes = 6 + W * H + 2 * (W / 2) * (H / 2);
+        const long long size = fileSize(path);
+        check(std::strncmp(header, "YUV4MPEG2 W64 H36 F30:1 Ip A1:1 C420jpeg", 40) == 0, "the Y4M header describes the stream");
+        check(stats.written == FRAMES && size == (long long)std::strlen(header) + FRAMES * frameBytes,
+            "every frame is in the stream at its size");
+        check(stats.dropped == 1 && stats.bytes == size, "a frame of another size is dropped, not written");
+        std::remove(path.c_str());
+    }
+
+    // Y4M frames missing from the indices: the next one written fills in for
+    // them, so the stream still has a frame per index
+    {
+        const int W = 16, H = 8;
+        const long long indices[] = { 0, 1, 3, 4, 7 };
+        CaptureSettings settings;
+        settings.directory = DIRECTORY;
+        settings.format = CAPTURE_Y4M;
+        FrameEncoder encoder;
+        encoder.open(settings, W, H);
+        std::vector<unsigned char> rgba;
+        for (long long index : indices) {
+            makeFrame(rgba, W, H, (int)index);
+            encoder.submit(rgba, W, H, index);
+        }
+        encoder.close();
+        FrameEncoder::Stats stats = encoder.getStats();
+
+        const std::string path = DIRECTORY + "/capture.y4m";
+        std::vector<unsigned char> stream((size_t)std::max(fileSize(path), 0LL));
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        if (file) {
+            if (std::fread(stream.data(), 1, stream.size(), file) != stream.size())
+                stream.clear();
+            std::fclose(file);
+        }
+        const size_t frameBytes = 6 + W * H + 2 * (W / 2) * (H / 2);
+        const size_t headerSize = std::find(stream.begin(), stream.end(), '\n') - stream.begin() + 1;
+        check(stats.written == 5 && stats.repeated == 3 && stream.size() == headerSize + 8 * frameBytes,
+            "every missing index gets a repeated frame");
+        // Index 2 is a copy of index 3, index 5 and 6 of index 7
+        auto frameAt = [&](int i) { return stream.begin() + headerSize + i * frameBytes; };
+        bool copies = stream.size() == headerSize + 8 * frameBytes
+            && std::equal(frameAt(2), frameAt(3), frameAt(3)) && std::equal(frameAt(5), frameAt(6), frameAt(7))
+            && std::equal(frameAt(6), frameAt(7), frameAt(7)) && !std::equal(frameAt(1), frameAt(2), frameAt(2));
+        check(copies, "the frame after a gap is the one repeated");
+        std::remove(path.c_str());
+    }
+
+    // PNG: one file per frame, numbered by the index it was submitted with
+    {
+        const int W = 48, H = 32, FRAMES = 5;
+        CaptureSettings settings;
+        settings.directory = DIRECTORY;
+        settings.format = CAPTURE_PNG;
+        settings.maxQueued = FRAMES;
+        FrameEncoder encoder;
+        check(encoder.open(settings, W, H), "the PNG directory opens");
+        std::vector<unsigned char> rgba;
+        for (int i = 0; i < FRAMES; ++i) {
+            makeFrame(rgba, W, H, i);
+            encoder.submit(rgba, W, H, 2 * i);
+        }
+        encoder.close();
+        bool files = encoder.getStats().written == FRAMES;
+        for (int i = 0; i < 2 * FRAMES; ++i) {
+            const std::string path = framePath(DIRECTORY, i);
+            std::FILE* file = std::fopen(path.c_str(), "rb");
+            unsigned char signature[8] = {};
+            if (file) {
+                files = files && std::fread(signature, 1, 8, file) == 8;
+                std::fclose(file);
+            }
+            static const unsigned char PNG_SIGNATURE[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+            files = files && (i % 2 == 0) == (std::memcmp(signature, PNG_SIGNATURE, 8) == 0);
+            std::remove(path.c_str());
+        }
+        check(files, "PNG frames are written under their indices, gaps and all");
+    }
+
+    // Frames submitted faster than they are written: with a short queue
+    // some are dropped, and every one is accounted for either way
+    for (int maxQueued : { 2, 64 }) {
+        const int W = 640, H = 360, FRAMES = 24;
+        CaptureSettings settings;
+        settings.directory = DIRECTORY;
+        settings.format = CAPTURE_PNG;
+        settings.maxQueued = maxQueued;
+        FrameEncoder encoder;
+        encoder.open(settings, W, H);
+        std::vector<unsigned char> rgba;
+        for (int i = 0; i < FRAMES; ++i) {
+            makeFrame(rgba, W, H, i);
+            encoder.submit(rgba, W, H, i);
+        }
+        encoder.close();
+        FrameEncoder::Stats stats = encoder.getStats();
+        std::cout << "queue of " << maxQueued << ": " << stats.written << " written, " << stats.dropped << " dropped\n";
+        check(stats.submitted == FRAMES && stats.written + stats.dropped == FRAMES && stats.failed == 0,
+            "every submitted frame is either written or counted as dropped");
+        if (maxQueued >= FRAMES)
+            check(stats.dropped == 0, "nothing is dropped while the queue has room");
+        for (int i = 0; i < FRAMES; ++i)
+            std::remove(framePath(DIRECTORY, i).c_str());
+    }
+
+    // Capturing, the simulation advances 1 / fps per frame whatever the
+    // clock says, and runs every tick that makes due, even many at once
+    for (int fps : { 30, 2 }) {
+        Simulation::Settings settings;
+        settings.tickRate = 60.0;
+        settings.frameStep = 1.0 / fps;
+        Simulation simulation;
+        simulation.start(Camera(), settings);
+        const int FRAMES = 20;
+        RenderPacket packet;
+        for (int i = 0; i < FRAMES; ++i)
+            packet = simulation.packet();
+        Simulation::Stats stats = simulation.getStats();
+        simulation.stop();
+        const long long ticks = (long long)(FRAMES * settings.tickRate / fps + 0.5);
+        // Rendered a tick behind the newest
+        const float expected = (float)(FRAMES * settings.frameStep - 1.0 / settings.tickRate);
+        std::cout << fps << " fps: " << stats.ticks << " ticks, simulation at " << packet.time << " s after "
+            << FRAMES << " frames\n";
+        check(stats.ticks == ticks && stats.droppedTicks == 0, "frame steps run every tick they make due");
+        check(std::abs(packet.time - expected) < 1e-4f, "each frame moves the simulation on by 1 / fps");
+    }
+}
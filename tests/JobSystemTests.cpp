@@ -0,0 +1,140 @@
+#include "Tests.hpp"
+
+#include <Erosion.hpp>
+#include <JobSystem.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+// Hammers the scheduler with tiny jobs from several directions at once and
+// verifies each one ran exactly once and in dependency order
+static void checkContention()
+{
+    JobSystem& jobs = JobSystem::instance();
+
+    // Several outside threads submitting to the shared deque at once
+    {
+        const int producers = 4, perProducer = 20000;
+        std::vector<std::atomic<int>> hits(producers * perProducer);
+        for (std::atomic<int>& hit : hits)
+            hit = 0;
+        JobSystem::CounterPtr counter = jobs.makeCounter();
+        std::vector<std::thread> threadsOut;
+        for (int p = 0; p < producers; ++p) {
+            threadsOut.emplace_back([&, p]() {
+                for (int i = 0; i < perProducer; ++i) {
+                    int index = p * perProducer + i;
+                    jobs.run([&hits, index]() { hits[index]++; }, counter);
+                }
+            });
+        }
+        for (std::thread& t : threadsOut)
+            t.join();
+        jobs.wait(counter);
+        bool once = true;
+        for (std::atomic<int>& hit : hits)
+            once = once && hit == 1;
+        check(once, "jobs from outside threads ran exactly once");
+    }
+
+    // parallelFor covers the range once, in chunks no larger than the grain
+    for (int grain : { 1, 7, 64, 1000, 1 << 20 }) {
+        const int count = 100003;
+        std::vector<std::atomic<int>> hits(count);
+        for (std::atomic<int>& hit : hits)
+            hit = 0;
+        std::atomic<bool> oversized(false);
+        jobs.parallelFor(0, count, grain, [&](int first, int last) {
+            if (last - first > grain || last <= first)
+                oversized = true;
+            for (int i = first; i < last; ++i)
+                hits[i]++;
+        });
+        bool once = true;
+        for (std::atomic<int>& hit : hits)
+            once = once && hit == 1;
+        check(once && !oversized, "parallelFor covers the range once within the grain");
+    }
+
+    // Nested parallelFor from inside jobs, waited on by workers
+    {
+        std::atomic<long long> sum(0);
+        jobs.parallelFor(0, 64, 1, [&](int first, int last) {
+            for (int outer = first; outer < last; ++outer) {
+                jobs.parallelFor(0, 1000, 10, [&](int a, int b) {
+                    long long local = 0;
+                    for (int i = a; i < b; ++i)
+                        local += i;
+                    sum += local;
+                });
+            }
+        });
+        check(sum == 64LL * 999 * 1000 / 2, "nested parallelFor sums every index once");
+    }
+
+    // Continuations: a chain of fan-out stages, each started by then() and
+    // checking that the whole previous stage has finished
+    {
+        const int stages = 50, width = 200;
+        std::vector<std::atomic<int>> done(stages);
+        for (std::atomic<int>& d : done)
+            d = 0;
+        std::atomic<bool> early(false);
+
+        JobSystem::CounterPtr previous = jobs.makeCounter();
+        for (int i = 0; i < width; ++i)
+            jobs.run([&done]() { done[0]++; }, previous);
+        for (int stage = 1; stage < stages; ++stage) {
+            JobSystem::CounterPtr next = jobs.makeCounter();
+            jobs.then(previous, [&, stage, next]() {
+                if (done[stage - 1] != width)
+                    early = true;
+                for (int i = 0; i < width; ++i)
+                    jobs.run([&done, stage]() { done[stage]++; }, next);
+            }, next);
+            previous = next;
+        }
+        jobs.wait(previous);
+        check(!early && done[stages - 1] == width, "continuations run after their dependency");
+
+        // then() on a counter that has already reached zero runs right away
+        std::atomic<int> late(0);
+        JobSystem::CounterPtr after = jobs.makeCounter();
+        jobs.then(previous, [&late]() { late++; }, after);
+        jobs.wait(after);
+        check(late == 1, "a continuation on a finished counter runs");
+    }
+}
+
+// The scheduler under contention for every pool size, and droplet erosion,
+// which splits its work by numThreads, giving the same heights on all of them
+void testJobs()
+{
+    const int M = 128, N = 128;
+    std::vector<float> source(M * N);
+    for (int i = 0; i < M; ++i)
+        for (int j = 0; j < N; ++j)
+            source[i * N + j] = 0.3f * std::sin(i * 0.11f) * std::cos(j * 0.07f) + 0.002f * ((i * 31 + j * 17) % 13);
+    DropletErosion::Settings erosion;
+    erosion.numDroplets = 20000;
+    erosion.batchSize = 4096;
+    erosion.numThreads = 8;
+
+    std::vector<float> reference;
+    bool sameTerrain = true;
+    for (int threads : { 1, 2, 4, 8 }) {
+        JobSystem::instance().init(threads - 1);
+        checkContention();
+
+        std::vector<float> heights = source;
+        DropletErosion(M, N, erosion).erode(heights);
+        if (reference.empty())
+            reference = heights;
+        sameTerrain = sameTerrain && heights == reference;
+    }
+    JobSystem::instance().init(0);
+    check(reference != source, "erosion changes the heights");
+    check(sameTerrain, "eroded heights do not depend on the pool size");
+}
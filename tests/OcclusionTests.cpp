@@ -0,0 +1,191 @@
+#include "Tests.hpp"
+
+#include <Occlusion.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// True if every sampled point of the box is behind the rasterized depth at
+// its pixel: what the culler may claim, checked against the full-resolution
+// buffer instead of the pyramid
+static bool hiddenInDepth(const AABB& box, const glm::mat4& viewProjection, const std::vector<float>& depth,
+    int width, int height)
+{
+    const int STEPS = 8;
+    for (int i = 0; i <= STEPS; ++i) {
+        for (int j = 0; j <= STEPS; ++j) {
+            for (int k = 0; k <= STEPS; ++k) {
+                glm::vec3 t(i / (float)STEPS, j / (float)STEPS, k / (float)STEPS);
+                glm::vec4 p = viewProjection * glm::vec4(box.min + t * box.extent(), 1.0f);
+                if (p.w <= 0.0f)
+                    return false;
+                glm::vec3 ndc = glm::vec3(p) / p.w;
+                if (std::abs(ndc.x) > 1.0f || std::abs(ndc.y) > 1.0f)
+                    continue;
+                int x = std::min((int)((ndc.x * 0.5f + 0.5f) * width), width - 1);
+                int y = std::min((int)((ndc.y * 0.5f + 0.5f) * height), height - 1);
+                if (ndc.z * 0.5f + 0.5f <= depth[y * width + x])
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+// A wall rasterized in software, boxes behind, in front of, around and
+// through the near plane of it, and the depth pyramid on sizes that are
+// not powers of two
+void testOcclusion()
+{
+    // The camera at the origin looking down -z at a 20 x 20 wall 20 away
+    const int WIDTH = 256, HEIGHT = 144;
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(60.0f), (float)WIDTH / HEIGHT, 0.5f, 500.0f)
+        * glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    const float WALL = 20.0f, HALF = 10.0f;
+    std::vector<glm::vec3> wall = { glm::vec3(-HALF, -HALF, -WALL), glm::vec3(HALF, -HALF, -WALL),
+        glm::vec3(HALF, HALF, -WALL), glm::vec3(-HALF, HALF, -WALL) };
+    std::vector<unsigned int> indices = { 0, 1, 2, 0, 2, 3 };
+
+    OcclusionCuller culler(WIDTH, HEIGHT);
+    culler.setOccluders(wall, indices);
+    check(!culler.ready(), "nothing is occluded before the occluders are drawn");
+    culler.renderOccluders(viewProjection);
+    check(culler.ready(), "drawing the occluders builds the pyramid");
+
+    // The rasterized wall sits at its depth and only covers its own pixels
+    SoftwareRasterizer rasterizer(WIDTH, HEIGHT);
+    rasterizer.drawTriangles(wall, indices, viewProjection);
+    const std::vector<float>& depth = rasterizer.getDepth();
+    glm::vec4 centre = viewProjection * glm::vec4(0.0f, 0.0f, -WALL, 1.0f);
+    float wallDepth = centre.z / centre.w * 0.5f + 0.5f;
+    check(std::abs(depth[(HEIGHT / 2) * WIDTH + WIDTH / 2] - wallDepth) < 1e-4f, "the wall is drawn at its depth");
+    check(depth[0] == 1.0f && depth[WIDTH - 1] == 1.0f, "the corners past the wall stay clear");
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    auto box = [&](float x0, float x1, float y0, float y1, float z0, float z1) {
+        glm::vec3 a(x0 + (x1 - x0) * unit(rng), y0 + (y1 - y0) * unit(rng), z0 + (z1 - z0) * unit(rng));
+        glm::vec3 b(x0 + (x1 - x0) * unit(rng), y0 + (y1 - y0) * unit(rng), z0 + (z1 - z0) * unit(rng));
+        return AABB(glm::min(a, b), glm::max(a, b));
+    };
+
+    const int BOXES = 500;
+    int behind = 0, hiddenBehind = 0;
+    bool front = true, edges = true, nearPlane = true, conservative = true;
+    for (int i = 0; i < BOXES; ++i) {
+        // Well inside the wall's shadow, at twice its distance and more, and
+        // small enough that the pyramid level read for it stays on the wall
+        glm::vec3 corner(-8.0f + 13.0f * unit(rng), -8.0f + 13.0f * unit(rng), -60.0f + 17.0f * unit(rng));
+        AABB back(corner, corner + glm::vec3(3.0f * unit(rng), 3.0f * unit(rng), 3.0f * unit(rng)));
+        hiddenBehind += hiddenInDepth(back, viewProjection, depth, WIDTH, HEIGHT);
+        behind += culler.isOccluded(back);
+
+        front = front && !culler.isOccluded(box(-HALF, HALF, -HALF, HALF, -WALL + 0.5f, -1.0f));
+        // Behind the wall but reaching past its right or top edge, which at
+        // 40 away is 20 out
+        AABB right = box(0.0f, 15.0f, -8.0f, 8.0f, -45.0f, -40.0f), top = box(-8.0f, 8.0f, 0.0f, 15.0f, -45.0f, -40.0f);
+        right.max.x = std::max(right.max.x, 25.0f);
+        top.max.y = std::max(top.max.y, 25.0f);
+        edges = edges && !culler.isOccluded(right) && !culler.isOccluded(top);
+        // From behind the camera to behind the wall
+        AABB through = box(-2.0f, 2.0f, -2.0f, 2.0f, -60.0f, 5.0f);
+        through.max.z = std::max(through.max.z, 1.0f);
+        through.min.z = std::min(through.min.z, -30.0f);
+        nearPlane = nearPlane && !culler.isOccluded(through);
+
+        AABB any = box(-40.0f, 40.0f, -30.0f, 30.0f, -80.0f, 2.0f);
+        if (culler.isOccluded(any))
+            conservative = conservative && hiddenInDepth(any, viewProjection, depth, WIDTH, HEIGHT);
+    }
+    std::cout << "wall: " << behind << "/" << BOXES << " boxes behind it rejected (" << hiddenBehind
+        << " hidden in the full-resolution depth)\n";
+    check(behind == BOXES, "boxes fully behind the wall are rejected");
+    check(front, "boxes in front of the wall are never rejected");
+    check(edges, "boxes reaching past the wall's edge are never rejected");
+    check(nearPlane, "boxes crossing the near plane are never rejected");
+    check(conservative, "every rejected box is hidden in the full-resolution depth");
+
+    // OcclusionCuller::cull keeps the order of what it does not reject
+    {
+        std::vector<AABB> boxes = { AABB(glm::vec3(-2.0f, -2.0f, -50.0f), glm::vec3(2.0f, 2.0f, -45.0f)),
+            AABB(glm::vec3(-2.0f, -2.0f, -15.0f), glm::vec3(2.0f, 2.0f, -10.0f)),
+            AABB(glm::vec3(3.0f, -4.0f, -42.0f), glm::vec3(5.0f, -1.0f, -40.0f)),
+            AABB(glm::vec3(25.0f, -2.0f, -45.0f), glm::vec3(28.0f, 2.0f, -40.0f)) };
+        std::vector<unsigned int> visible = { 0, 1, 2, 3 };
+        OcclusionStats stats;
+        culler.cull(boxes, visible, stats);
+        check(visible == std::vector<unsigned int>({ 1, 3 }) && stats.tested == 4 && stats.occluded == 2,
+            "cull removes the occluded boxes and counts them");
+    }
+
+    // Pyramid on 37 x 23 random depths: each level holds the farthest depth
+    // of the texels it covers, and a box is only occluded if it is behind
+    // all of the base texels under it, whatever level the test picks
+    {
+        const int W = 37, H = 23;
+        std::vector<float> base(W * H);
+        for (float& d : base)
+            d = unit(rng);
+        DepthPyramid pyramid;
+        pyramid.build(base.data(), W, H);
+
+        bool sizes = pyramid.levelCount() == 7 && pyramid.width(1) == 19 && pyramid.height(1) == 12
+            && pyramid.width(6) == 1 && pyramid.height(6) == 1;
+        check(sizes, "levels round odd sizes up down to 1 x 1");
+        bool farthest = true;
+        for (int level = 1; level < pyramid.levelCount(); ++level) {
+            for (int y = 0; y < pyramid.height(level); ++y) {
+                for (int x = 0; x < pyramid.width(level); ++x) {
+                    float expected = 0.0f;
+                    for (int by = y << level; by < std::min((y + 1) << level, H); ++by)
+                        for (int bx = x << level; bx < std::min((x + 1) << level, W); ++bx)
+                            expected = std::max(expected, base[by * W + bx]);
+                    farthest = farthest && pyramid.at(level, x, y) == expected;
+                }
+            }
+        }
+        check(farthest, "every pyramid texel is the farthest base depth it covers");
+
+        // One far texel in a near field: a test reading a level that misses
+        // part of the rectangle can miss the spike under it. With the
+        // identity matrix, NDC is the box itself.
+        const glm::mat4 identity(1.0f);
+        bool levelsCover = true;
+        int occluded = 0;
+        const int RECTS = 2000;
+        std::vector<float> spiked(W * H);
+        for (int i = 0; i < RECTS; ++i) {
+            std::fill(spiked.begin(), spiked.end(), 0.2f);
+            spiked[(int)(unit(rng) * H) * W + (int)(unit(rng) * W)] = 0.9f;
+            pyramid.build(spiked.data(), W, H);
+            int x0 = (int)(unit(rng) * W), y0 = (int)(unit(rng) * H);
+            int x1 = std::min(x0 + (int)(unit(rng) * 13), W - 1), y1 = std::min(y0 + (int)(unit(rng) * 9), H - 1);
+            float nearest = 0.5f + 0.3f * unit(rng);
+            AABB rect(glm::vec3((x0 + 0.25f) / W * 2.0f - 1.0f, (y0 + 0.25f) / H * 2.0f - 1.0f, nearest * 2.0f - 1.0f),
+                glm::vec3((x1 + 0.75f) / W * 2.0f - 1.0f, (y1 + 0.75f) / H * 2.0f - 1.0f, 1.0f));
+            float under = 0.0f;
+            for (int y = y0; y <= y1; ++y)
+                for (int x = x0; x <= x1; ++x)
+                    under = std::max(under, spiked[y * W + x]);
+            if (pyramid.isOccluded(rect, identity)) {
+                occluded++;
+                levelsCover = levelsCover && nearest > under;
+            }
+        }
+        check(levelsCover, "the level a test reads covers the whole rectangle");
+
+        // A flat pyramid decides by depth alone
+        std::vector<float> flat(W * H, 0.5f);
+        DepthPyramid plane;
+        plane.build(flat.data(), W, H);
+        AABB rect(glm::vec3(-0.3f, -0.2f, 0.4f), glm::vec3(0.5f, 0.1f, 0.6f));
+        AABB closer(glm::vec3(-0.3f, -0.2f, -0.4f), glm::vec3(0.5f, 0.1f, 0.6f));
+        check(plane.isOccluded(rect, identity) && !plane.isOccluded(closer, identity),
+            "boxes are occluded by depth, however large their rectangle");
+        std::cout << "pyramid: " << occluded << "/" << RECTS << " rectangles occluded beside a far texel\n";
+        check(occluded > RECTS / 4, "rectangles clear of the far texel are occluded");
+    }
+}
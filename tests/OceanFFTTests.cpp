@@ -0,0 +1,124 @@
+#include "Tests.hpp"
+
+#include <FFT.hpp>
+#include <OceanFFT.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// Largest difference between FFT2D and a direct double precision sum over
+// random input, relative to the largest output
+static double fftError(int n, bool simd)
+{
+    std::mt19937 rng(n);
+    std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+    std::vector<float> re((size_t)n * n), im((size_t)n * n);
+    for (size_t i = 0; i < re.size(); ++i) {
+        re[i] = value(rng);
+        im[i] = value(rng);
+    }
+    std::vector<std::complex<double>> input(re.size());
+    for (size_t i = 0; i < re.size(); ++i)
+        input[i] = std::complex<double>(re[i], im[i]);
+
+    FFT2D fft;
+    fft.init(n);
+    fft.setSimd(simd);
+    fft.inverse(re.data(), im.data());
+
+    const double pi = 3.14159265358979323846;
+    double maxError = 0.0, maxValue = 0.0;
+    for (int y = 0; y < n; ++y) {
+        for (int x = 0; x < n; ++x) {
+            std::complex<double> sum(0.0, 0.0);
+            for (int v = 0; v < n; ++v)
+                for (int u = 0; u < n; ++u)
+                    sum += input[(size_t)v * n + u] * std::polar(1.0, 2.0 * pi * (double)((u * x + v * y) % n) / n);
+            size_t i = (size_t)y * n + x;
+            maxError = std::max(maxError, std::abs(sum - std::complex<double>(re[i], im[i])));
+            maxValue = std::max(maxValue, std::abs(sum));
+        }
+    }
+    return maxError / maxValue;
+}
+
+// The maps of a whole update against the five fields summed directly from
+// the spectrum at a few grid points, relative to the largest height, and
+// the largest difference in the normals; this also catches packing two
+// real fields into one transform going wrong
+static void oceanMapErrors(const OceanFFT& ocean, float time, double& heightError, double& normalError)
+{
+    const int n = ocean.getSettings().size;
+    const float choppiness = ocean.getSettings().choppiness;
+    const std::complex<double> I(0.0, 1.0);
+    const double pi = 3.14159265358979323846;
+    std::mt19937 rng(7);
+    double maxError = 0.0, maxHeight = 1e-12, maxNormalError = 0.0;
+    for (int sample = 0; sample < 16; ++sample) {
+        int x = (int)(rng() % n), y = (int)(rng() % n);
+        std::complex<double> h(0.0), dx(0.0), dz(0.0), sx(0.0), sz(0.0);
+        for (int v = 0; v < n; ++v) {
+            for (int u = 0; u < n; ++u) {
+                std::complex<double> a = std::complex<double>(ocean.heightSpectrum(u, v, time))
+                    * std::polar(1.0, 2.0 * pi * (double)((u * x + v * y) % n) / n);
+                glm::vec2 k = ocean.waveVector(u, v);
+                double length = std::sqrt((double)k.x * k.x + (double)k.y * k.y);
+                h += a;
+                if (length > 0.0) {
+                    dx += -I * (choppiness * k.x / length) * a;
+                    dz += -I * (choppiness * k.y / length) * a;
+                }
+                sx += I * (double)k.x * a;
+                sz += I * (double)k.y * a;
+            }
+        }
+        // Every field is real
+        maxError = std::max(maxError, std::abs(h.imag()) + std::abs(dx.imag()) + std::abs(sx.imag()));
+
+        size_t i = (size_t)y * n + x;
+        glm::vec4 d = ocean.getDisplacement()[i];
+        maxError = std::max(maxError, std::abs(d.x - dx.real()));
+        maxError = std::max(maxError, std::abs(d.y - h.real()));
+        maxError = std::max(maxError, std::abs(d.z - dz.real()));
+        maxHeight = std::max(maxHeight, std::abs(h.real()));
+
+        glm::vec4 m = ocean.getNormals()[i];
+        glm::vec3 normal = glm::normalize(glm::vec3((float)-sx.real(), 1.0f, (float)-sz.real()));
+        maxNormalError = std::max(maxNormalError,
+            (double)std::abs(m.x - normal.x) + std::abs(m.y - normal.y) + std::abs(m.z - normal.z));
+    }
+    heightError = maxError / maxHeight;
+    normalError = maxNormalError;
+}
+
+// FFT2D, SSE and scalar, against a direct sum, and whole ocean updates
+// against the spectrum they come from
+void testOcean()
+{
+    double fftWorst = 0.0;
+    for (int n : { 2, 4, 8, 16, 32 })
+        fftWorst = std::max(fftWorst, std::max(fftError(n, true), fftError(n, false)));
+    std::cout << "FFT2D within " << fftWorst << " of a direct sum" << (FFT2D::simdAvailable() ? ", SSE and scalar" : "") << "\n";
+    check(fftWorst < 1e-5, "FFT2D matches a double precision DFT");
+
+    // The direct sums cost n^2 per point, so only the smaller grids
+    for (int n = OceanFFT::MIN_SIZE; n <= 128; n *= 2) {
+        OceanFFT::Settings settings;
+        settings.size = n;
+        OceanFFT ocean;
+        ocean.init(settings);
+        const float time = 10.0f;
+        ocean.update(time);
+
+        double heightError, normalError;
+        oceanMapErrors(ocean, time, heightError, normalError);
+        std::cout << n << "x" << n << ": maps within " << heightError << " of the summed spectrum, normals within "
+            << normalError << "\n";
+        check(heightError <= 1e-3, "displacements match the spectrum summed directly");
+        check(normalError <= 1e-3, "normals match the slopes summed directly");
+    }
+}
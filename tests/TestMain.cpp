@@ -0,0 +1,54 @@
+#include "Tests.hpp"
+
+#include <iostream>
+#include <string>
+
+static int failures = 0;
+
+bool check(bool pass, const char* what)
+{
+    if (!pass) {
+        std::cout << "CHECK FAILED: " << what << "\n";
+        failures++;
+    }
+    return pass;
+}
+
+struct Suite {
+    const char* name;
+    void (*run)();
+};
+
+static const Suite SUITES[] = {
+    { "irradiance", testIrradiance },
+    { "capture", testCapture },
+    { "commands", testCommands },
+    { "culling", testCulling },
+    { "jobs", testJobs },
+    { "ocean", testOcean },
+    { "occlusion", testOcclusion },
+    { "water", testWater },
+};
+
+// OpenGLPrjTests [suite]: runs one suite, or all of them
+int main(int argc, char** argv)
+{
+    std::string name = argc > 1 ? argv[1] : "all";
+    bool found = false;
+    for (const Suite& suite : SUITES) {
+        if (name == suite.name || name == "all") {
+            std::cout << "---- " << suite.name << " ----\n";
+            suite.run();
+            found = true;
+        }
+    }
+    if (!found) {
+        std::cout << "Unknown suite " << name << "; available:";
+        for (const Suite& suite : SUITES)
+            std::cout << " " << suite.name;
+        std::cout << "\n";
+        return 1;
+    }
+    std::cout << (failures ? "CHECKS FAILED" : "all checks passed") << "\n";
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+#ifndef mTests
+#define mTests
+#pragma once
+
+#include <BenchFixtures.hpp>
+
+// Correctness checks of the parts that run without a GL context, built as
+// OpenGLPrjTests and run by ctest, one suite per test. Timing lives in the
+// game's --bench modes; both take their synthetic inputs from BenchFixtures.
+
+// Prints what failed and marks the run as failed; returns pass
+bool check(bool pass, const char* what);
+
+// Suites, in TestMain.cpp's table
+void testIrradiance();
+void testCapture();
+void testCommands();
+void testCulling();
+void testJobs();
+void testOcean();
+void testOcclusion();
+void testWater();
+
+#endif
@@ -0,0 +1,84 @@
+#include "Tests.hpp"
+
+#include <WaterClipmap.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Tiles a and b touch along an edge of positive length
+static bool tilesAdjacent(const WaterTile& a, const WaterTile& b)
+{
+    float overlapX = std::min(a.x + a.size, b.x + b.size) - std::max(a.x, b.x);
+    float overlapZ = std::min(a.z + a.size, b.z + b.size) - std::max(a.z, b.z);
+    return (overlapX == 0.0f && overlapZ > 0.0f) || (overlapZ == 0.0f && overlapX > 0.0f);
+}
+
+// Every edge between levels is watertight once morphed: the finer side's
+// edge vertices land on the coarser grid, whose own edge vertices have not
+// moved. Neighbours are never more than one level apart.
+static bool seamsClosed(const WaterClipmap& clipmap, const std::vector<WaterTile>& tiles, const glm::vec3& camera)
+{
+    const int n = clipmap.getSettings().gridResolution;
+    for (const WaterTile& fine : tiles) {
+        for (const WaterTile& coarse : tiles) {
+            if (coarse.level <= fine.level || !tilesAdjacent(fine, coarse))
+                continue;
+            if (coarse.level - fine.level > 1.0f)
+                return false;
+
+            float coarseCell = coarse.size / n;
+            for (int i = 0; i <= n; ++i) {
+                for (int edge = 0; edge < 4; ++edge) {
+                    float u = (float)i / n;
+                    glm::vec2 grid = edge == 0 ? glm::vec2(u, 0.0f) : edge == 1 ? glm::vec2(u, 1.0f)
+                        : edge == 2 ? glm::vec2(0.0f, u) : glm::vec2(1.0f, u);
+                    // Fine vertex on the shared edge: must sit on the coarse lattice
+                    glm::vec2 p = clipmap.morphGrid(grid, clipmap.morphFactor(fine, grid, camera));
+                    float x = fine.x + p.x * fine.size, z = fine.z + p.y * fine.size;
+                    bool onEdge = x >= coarse.x && x <= coarse.x + coarse.size && z >= coarse.z && z <= coarse.z + coarse.size;
+                    if (onEdge) {
+                        float cx = (x - coarse.x) / coarseCell, cz = (z - coarse.z) / coarseCell;
+                        if (cx != std::floor(cx) || cz != std::floor(cz))
+                            return false;
+                    }
+                    // Coarse vertex on the shared edge: must not have moved
+                    float cxw = coarse.x + grid.x * coarse.size, czw = coarse.z + grid.y * coarse.size;
+                    bool shared = cxw >= fine.x && cxw <= fine.x + fine.size && czw >= fine.z && czw <= fine.z + fine.size;
+                    if (shared && clipmap.morphGrid(grid, clipmap.morphFactor(coarse, grid, camera)) != grid)
+                        return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// For each water size, with nothing culled and from a few heights and
+// positions, the tiles cover the water square exactly once without seams
+void testWater()
+{
+    Frustum everything = Frustum::fromMatrix(glm::ortho(-1e5f, 1e5f, -1e5f, 1e5f, -1e5f, 1e5f));
+    for (float size : { 2500.0f, 5000.0f, 10000.0f, 20000.0f, 40000.0f }) {
+        WaterClipmap::Settings settings;
+        settings.size = size;
+        WaterClipmap clipmap;
+        clipmap.init(settings);
+        double root = clipmap.getTileSize(clipmap.getLevels() - 1);
+
+        bool covered = true, closed = true;
+        std::vector<WaterTile> tiles;
+        for (const glm::vec3& eye : { glm::vec3(0.0f, 5.0f, 10.0f), glm::vec3(137.0f, 0.5f, -61.0f), glm::vec3(-900.0f, 80.0f, 400.0f) }) {
+            WaterClipmap::Stats stats;
+            clipmap.select(eye, everything, tiles, stats);
+            double area = 0.0;
+            for (const WaterTile& t : tiles)
+                area += (double)t.size * t.size;
+            covered = covered && area == root * root;
+            closed = closed && seamsClosed(clipmap, tiles, eye);
+        }
+        check(covered, "water tiles cover the square once");
+        check(closed, "water tiles meet without seams");
+    }
+}
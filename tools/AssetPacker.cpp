@@ -0,0 +1,45 @@
+// Packs every file under res/ into one archive the game memory-maps at
+// startup (see AssetPack.hpp). Run as a post-build step.
+//
+//   AssetPacker <output.pack> <res directory>
+#include <AssetPack.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        std::cout << "usage: AssetPacker <output.pack> <res directory>\n";
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> names = AssetPack::listFiles(argv[2]);
+    if (names.empty()) {
+        std::cout << "AssetPacker: no files under " << argv[2] << "\n";
+        return 1;
+    }
+    if (!AssetPack::write(argv[1], argv[2], names))
+        return 1;
+
+    // Read it back through the same lookup the game uses
+    AssetPack& pack = AssetPack::instance();
+    if (!pack.open(argv[1], "") || pack.entryCount() != names.size()) {
+        std::cout << "AssetPacker: " << argv[1] << " did not read back\n";
+        return 1;
+    }
+    for (const std::string& name : names) {
+        if (pack.find(name).empty()) {
+            std::cout << "AssetPacker: " << name << " missing from " << argv[1] << "\n";
+            return 1;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << argv[1] << ": " << names.size() << " files, " << seconds << " s\n";
+    return 0;
+}
@@ -0,0 +1,199 @@
+// Offline texture baker: converts a PNG/JPEG into a KTX2 file with a full
+// mip chain in a block-compressed format, so the game can map it and hand
+// it to glCompressedTexImage2D without decoding anything.
+//
+//   TextureBaker [--cubemap-cross] [--normal-map] [--flip-y] [--uncompressed] <input> <output.ktx2>
+//
+// Colour textures become BC7, normal maps BC5 (x and y only); --uncompressed
+// writes RGBA8 for drivers without BPTC/RGTC.
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <BlockCompression.hpp>
+#include <Ktx2.hpp>
+#include <Skybox.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+struct Image {
+    int width, height;
+    std::vector<unsigned char> rgba;
+};
+
+// 2x2 box filter; normal maps are averaged as vectors and renormalized
+static Image downsample(const Image& src, bool normalMap)
+{
+    Image dst;
+    dst.width = std::max(src.width / 2, 1);
+    dst.height = std::max(src.height / 2, 1);
+    dst.rgba.resize((size_t)dst.width * dst.height * 4);
+
+    for (int y = 0; y < dst.height; ++y) {
+        int y0 = std::min(y * 2, src.height - 1), y1 = std::min(y * 2 + 1, src.height - 1);
+        for (int x = 0; x < dst.width; ++x) {
+            int x0 = std::min(x * 2, src.width - 1), x1 = std::min(x * 2 + 1, src.width - 1);
+            const unsigned char* texels[4] = {
+                &src.rgba[((size_t)y0 * src.width + x0) * 4], &src.rgba[((size_t)y0 * src.width + x1) * 4],
+                &src.rgba[((size_t)y1 * src.width + x0) * 4], &src.rgba[((size_t)y1 * src.width + x1) * 4]
+            };
+            float sum[4] = { 0, 0, 0, 0 };
+            for (int t = 0; t < 4; ++t)
+                for (int c = 0; c < 4; ++c)
+                    sum[c] += normalMap && c < 3 ? texels[t][c] / 127.5f - 1.0f : texels[t][c] / 4.0f;
+
+            unsigned char* out = &dst.rgba[((size_t)y * dst.width + x) * 4];
+            if (normalMap) {
+                float len = std::sqrt(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+                if (len < 1e-6f) {
+                    sum[0] = sum[1] = 0.0f;
+                    sum[2] = len = 1.0f;
+                }
+                for (int c = 0; c < 3; ++c)
+                    out[c] = (unsigned char)std::lround((sum[c] / len * 0.5f + 0.5f) * 255.0f);
+                out[3] = (unsigned char)std::lround(sum[3]);
+            }
+            else {
+                for (int c = 0; c < 4; ++c)
+                    out[c] = (unsigned char)std::lround(sum[c]);
+            }
+        }
+    }
+    return dst;
+}
+
+static std::vector<unsigned char> encode(const Image& image, unsigned int format)
+{
+    std::vector<unsigned char> out(ktx2ImageSize(format, image.width, image.height));
+    if (format == KTX2_FORMAT_BC7)
+        compressBC7(image.rgba.data(), image.width, image.height, out.data());
+    else if (format == KTX2_FORMAT_BC5)
+        compressBC5(image.rgba.data(), image.width, image.height, out.data());
+    else
+        memcpy(out.data(), image.rgba.data(), out.size());
+    return out;
+}
+
+// PSNR over the channels the format keeps
+static double psnr(const Image& image, const std::vector<unsigned char>& encoded, unsigned int format)
+{
+    if (format == KTX2_FORMAT_RGBA8)
+        return INFINITY;
+
+    std::vector<unsigned char> decoded(image.rgba.size());
+    if (format == KTX2_FORMAT_BC7)
+        decompressBC7Mode6(encoded.data(), image.width, image.height, decoded.data());
+    else
+        decompressBC5(encoded.data(), image.width, image.height, decoded.data());
+
+    int channels = format == KTX2_FORMAT_BC5 ? 2 : 4;
+    double error = 0.0;
+    for (size_t i = 0; i < image.rgba.size(); i += 4) {
+        for (int c = 0; c < channels; ++c) {
+            double d = (double)image.rgba[i + c] - decoded[i + c];
+            error += d * d;
+        }
+    }
+    error /= (double)(image.rgba.size() / 4 * channels);
+    return error > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / error) : INFINITY;
+}
+
+int main(int argc, char** argv)
+{
+    bool cubemap = false, normalMap = false, flip = false, uncompressed = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--cubemap-cross") cubemap = true;
+        else if (arg == "--normal-map") normalMap = true;
+        else if (arg == "--flip-y") flip = true;
+        else if (arg == "--uncompressed") uncompressed = true;
+        else paths.push_back(arg);
+    }
+    if (paths.size() != 2) {
+        std::cout << "usage: TextureBaker [--cubemap-cross] [--normal-map] [--flip-y] [--uncompressed] <input> <output.ktx2>\n";
+        return 1;
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int w, h, c;
+    unsigned char* data = stbi_load(paths[0].c_str(), &w, &h, &c, 4);
+    if (!data) {
+        std::cout << "Failed to load " << paths[0] << "\n";
+        return 1;
+    }
+
+    // Top-level faces, one for a plain 2D texture
+    std::vector<Image> faces;
+    if (cubemap) {
+        int faceSize = h / 3;
+        if (faceSize <= 0 || w < faceSize * 4) {
+            std::cout << paths[0] << " is not a 4x3 cross\n";
+            stbi_image_free(data);
+            return 1;
+        }
+        for (int i = 0; i < 6; ++i) {
+            Image face;
+            face.width = face.height = faceSize;
+            face.rgba.resize((size_t)faceSize * faceSize * 4);
+            int x, y;
+            SkyBox::faceOrigin(i, faceSize, x, y);
+            SkyBox::extractFace(data, faceSize, x, y, w, 4, face.rgba.data());
+            faces.push_back(face);
+        }
+    }
+    else {
+        Image image;
+        image.width = w;
+        image.height = h;
+        image.rgba.resize((size_t)w * h * 4);
+        size_t rowBytes = (size_t)w * 4;
+        for (int y = 0; y < h; ++y)
+            memcpy(&image.rgba[y * rowBytes], data + (size_t)(flip ? h - 1 - y : y) * rowBytes, rowBytes);
+        faces.push_back(image);
+    }
+    stbi_image_free(data);
+
+    unsigned int format = uncompressed ? KTX2_FORMAT_RGBA8 : normalMap ? KTX2_FORMAT_BC5 : KTX2_FORMAT_BC7;
+    int width = faces[0].width, height = faces[0].height;
+    int levelCount = 1;
+    while ((width >> levelCount) > 0 || (height >> levelCount) > 0)
+        ++levelCount;
+
+    std::vector<std::vector<unsigned char>> levels(levelCount);
+    size_t rawBytes = 0;
+    double levelZeroPsnr = INFINITY;
+    for (Image& face : faces) {
+        Image mip = face;
+        for (int level = 0; level < levelCount; ++level) {
+            std::vector<unsigned char> encoded = encode(mip, format);
+            if (level == 0)
+                levelZeroPsnr = std::min(levelZeroPsnr, psnr(mip, encoded, format));
+            levels[level].insert(levels[level].end(), encoded.begin(), encoded.end());
+            rawBytes += mip.rgba.size();
+            if (level + 1 < levelCount)
+                mip = downsample(mip, normalMap);
+        }
+    }
+
+    if (!writeKtx2(paths[1], format, width, height, (int)faces.size(), levels))
+        return 1;
+
+    size_t bakedBytes = 0;
+    for (const std::vector<unsigned char>& level : levels)
+        bakedBytes += level.size();
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    std::cout << paths[1] << ": " << width << "x" << height << (cubemap ? " cubemap, " : ", ")
+        << levelCount << " levels, " << ktx2FormatName(format) << ", "
+        << bakedBytes / 1024 << " KB (RGBA8 with mips: " << rawBytes / 1024 << " KB, "
+        << (double)rawBytes / bakedBytes << "x), PSNR " << levelZeroPsnr << " dB, "
+        << seconds << " s\n";
+    return 0;
+}